@@ -0,0 +1,480 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "catalog.h"
+#include "walker.h"
+#include "hash.h"
+
+// Banc d'essai de bout en bout : sauvegarde initiale, sauvegarde incrémentale, restauration et liste
+// sur un jeu de données synthétique déterministe (usage : bench_backup BINAIRE [RÉPERTOIRE] [ÉCHELLE]).
+// Le jeu contient de nombreux petits fichiers, quelques très gros, des fichiers modifiés par insertion
+// entre les deux sauvegardes et une arborescence de copies. Chaque scénario exécute le programme
+// dans un processus fils ; une ligne JSON par scénario est écrite sur la sortie standard. Le programme
+// sort avec 0 même en cas d'erreur : "ok" vient du résultat vérifié (nouvelle sauvegarde au catalogue,
+// restauration identique à la source, sauvegardes listées), pas seulement du code de sortie.
+
+#define SMALL_FILES 2000            // Petits fichiers (1 à 32 Kio) à l'échelle 1
+#define LARGE_FILES 2               // Très gros fichiers (64 Mio) à l'échelle 1
+#define LARGE_SIZE (64u << 20)
+#define MUTATED_FILES 20            // Fichiers de 1 Mio modifiés par insertion avant la sauvegarde incrémentale
+#define MUTATED_SIZE (1u << 20)
+#define DUP_COPIES 8                // Copies d'un même sous-arbre de 50 fichiers
+#define DUP_FILES 50
+#define DUP_SIZE (80u << 10)
+
+// Mesures d'un processus fils
+typedef struct {
+    double seconds;
+    int status;
+    long peak_rss_kb;
+    long voluntary_cs;
+    long involuntary_cs;
+    long minor_faults;
+    unsigned long long syscr;       // Appels de la famille read (syscr de /proc/PID/io), pas tous les appels système
+    unsigned long long syscw;       // Appels de la famille write (syscw)
+    unsigned long long rchar;       // Octets lus par ces appels
+    unsigned long long wchar;       // Octets écrits
+} run_stats;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Générateur pseudo-aléatoire (xorshift64), identique d'une exécution à l'autre
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Remplissage d'un tampon : données aléatoires ou texte (compressible) selon la graine
+static void fill(unsigned char *data, size_t size, uint64_t seed, int text) {
+    static const char *words[] = {"sauvegarde", "chunk", "dépôt", "fichier", "index", "arbre",
+                                  "manifeste", "réseau", "serveur", "données", "\n", "  "};
+    uint64_t state = seed * 0x9e3779b97f4a7c15ull + 1;
+    size_t done = 0;
+    while (done < size) {
+        uint64_t value = next_random(&state);
+        if (text) {
+            const char *word = words[value % (sizeof(words) / sizeof(words[0]))];
+            for (const char *c = word; *c && done < size; c++) {
+                data[done++] = (unsigned char)*c;
+            }
+            if (done < size) {
+                data[done++] = ' ';
+            }
+        } else {
+            size_t n = size - done < sizeof(value) ? size - done : sizeof(value);
+            memcpy(data + done, &value, n);
+            done += n;
+        }
+    }
+}
+
+// Écriture d'un fichier de données déterministes
+static int make_file(const char *path, size_t size, uint64_t seed, int text) {
+    unsigned char *data = malloc(size ? size : 1);
+    if (!data) {
+        perror("Erreur d'allocation d'un fichier de test");
+        return -1;
+    }
+    fill(data, size, seed, text);
+    FILE *file = fopen(path, "wb");
+    int status = file && fwrite(data, 1, size, file) == size ? 0 : -1;
+    if (file && fclose(file) != 0) {
+        status = -1;
+    }
+    if (status != 0) {
+        perror("Erreur d'écriture d'un fichier de test");
+    }
+    free(data);
+    return status;
+}
+
+// Insertion de quelques octets au milieu d'un fichier : le découpage par contenu doit réutiliser le reste
+static int insert_bytes(const char *path, size_t offset, size_t count, uint64_t seed) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror("Erreur d'ouverture d'un fichier de test");
+        return -1;
+    }
+    struct stat st;
+    fstat(fileno(file), &st);
+    size_t size = (size_t)st.st_size;
+    unsigned char *data = malloc(size + count);
+    int status = data && fread(data, 1, size, file) == size ? 0 : -1;
+    fclose(file);
+    if (status == 0) {
+        offset = offset < size ? offset : size;
+        memmove(data + offset + count, data + offset, size - offset);
+        fill(data + offset, count, seed, 0);
+        file = fopen(path, "wb");
+        status = file && fwrite(data, 1, size + count, file) == size + count ? 0 : -1;
+        if (file && fclose(file) != 0) {
+            status = -1;
+        }
+    }
+    if (status != 0) {
+        perror("Erreur de modification d'un fichier de test");
+    }
+    free(data);
+    return status;
+}
+
+// Création du jeu de données initial
+static int make_dataset(const char *dir, int scale, uint64_t *bytes, uint64_t *files) {
+    char path[4096];
+    const char *subdirs[] = {"petits", "gros", "modifies", "copies"};
+    int status = mkdir(dir, 0755);
+    for (size_t i = 0; i < sizeof(subdirs) / sizeof(subdirs[0]) && status == 0; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, subdirs[i]);
+        status = mkdir(path, 0755);
+    }
+    *bytes = 0;
+    *files = 0;
+
+    // Petits fichiers répartis dans 20 répertoires, un sur trois sous forme de texte
+    uint64_t state = 42;
+    for (int i = 0; i < SMALL_FILES * scale && status == 0; i++) {
+        if (i % (SMALL_FILES / 20) == 0) {
+            snprintf(path, sizeof(path), "%s/petits/r%03d", dir, i / (SMALL_FILES / 20));
+            status = mkdir(path, 0755);
+        }
+        size_t size = 1024 + next_random(&state) % (31u << 10);
+        snprintf(path, sizeof(path), "%s/petits/r%03d/f%05d", dir, i / (SMALL_FILES / 20), i);
+        status = status == 0 ? make_file(path, size, (uint64_t)i + 1000, i % 3 == 0) : -1;
+        *bytes += size;
+        (*files)++;
+    }
+    for (int i = 0; i < LARGE_FILES * scale && status == 0; i++) {
+        snprintf(path, sizeof(path), "%s/gros/g%d", dir, i);
+        status = make_file(path, LARGE_SIZE, (uint64_t)i + 1, 0);
+        *bytes += LARGE_SIZE;
+        (*files)++;
+    }
+    for (int i = 0; i < MUTATED_FILES * scale && status == 0; i++) {
+        snprintf(path, sizeof(path), "%s/modifies/m%03d", dir, i);
+        status = make_file(path, MUTATED_SIZE, (uint64_t)i + 500, i % 2);
+        *bytes += MUTATED_SIZE;
+        (*files)++;
+    }
+    // Arborescence de copies : mêmes contenus sous des chemins différents
+    for (int c = 0; c < DUP_COPIES * scale && status == 0; c++) {
+        snprintf(path, sizeof(path), "%s/copies/c%02d", dir, c);
+        status = mkdir(path, 0755);
+        for (int i = 0; i < DUP_FILES && status == 0; i++) {
+            snprintf(path, sizeof(path), "%s/copies/c%02d/d%02d", dir, c, i);
+            status = make_file(path, DUP_SIZE, (uint64_t)i + 9000, i % 2);
+            *bytes += DUP_SIZE;
+            (*files)++;
+        }
+    }
+    return status;
+}
+
+// Modifications entre les deux sauvegardes : insertions, petits fichiers réécrits et ajoutés
+static int mutate_dataset(const char *dir, int scale) {
+    char path[4096];
+    int status = 0;
+    uint64_t state = 7;
+    for (int i = 0; i < MUTATED_FILES * scale && status == 0; i++) {
+        snprintf(path, sizeof(path), "%s/modifies/m%03d", dir, i);
+        status = insert_bytes(path, next_random(&state) % MUTATED_SIZE, 1 + next_random(&state) % 200, (uint64_t)i + 77);
+    }
+    for (int i = 0; i < LARGE_FILES * scale && status == 0; i++) {
+        snprintf(path, sizeof(path), "%s/gros/g%d", dir, i);
+        status = insert_bytes(path, LARGE_SIZE / 2, 4096, (uint64_t)i + 88);
+    }
+    for (int i = 0; i < SMALL_FILES * scale && status == 0; i += 20) {
+        snprintf(path, sizeof(path), "%s/petits/r%03d/f%05d", dir, i / (SMALL_FILES / 20), i);
+        status = make_file(path, 4096, (uint64_t)i + 5000, 1);
+    }
+    snprintf(path, sizeof(path), "%s/nouveaux", dir);
+    status = status == 0 ? mkdir(path, 0755) : -1;
+    for (int i = 0; i < 100 * scale && status == 0; i++) {
+        snprintf(path, sizeof(path), "%s/nouveaux/n%04d", dir, i);
+        status = make_file(path, 8192, (uint64_t)i + 7000, 0);
+    }
+    return status;
+}
+
+// Lecture des compteurs d'entrées-sorties d'un processus terminé mais pas encore attendu
+static void read_io(pid_t pid, run_stats *stats) {
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/%d/io", (int)pid);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        sscanf(line, "syscr: %llu", &stats->syscr);
+        sscanf(line, "syscw: %llu", &stats->syscw);
+        sscanf(line, "rchar: %llu", &stats->rchar);
+        sscanf(line, "wchar: %llu", &stats->wchar);
+    }
+    fclose(file);
+}
+
+// Exécution du programme avec ses arguments, sortie standard écrite dans output (ignorée si NULL)
+static int run(char *const argv[], const char *output, run_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Erreur lors de la création d'un processus");
+        return -1;
+    }
+    if (pid == 0) {
+        int null = output ? open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644) : open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+        }
+        execv(argv[0], argv);
+        perror("Erreur lors de l'exécution du programme");
+        _exit(127);
+    }
+    // Le processus reste visible dans /proc jusqu'à wait4 : ses compteurs sont lus avant
+    siginfo_t info;
+    while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) != 0 && errno == EINTR) {
+    }
+    stats->seconds = now() - start;
+    read_io(pid, stats);
+    struct rusage usage;
+    int status;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("Erreur lors de l'attente d'un processus");
+        return -1;
+    }
+    stats->status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    stats->peak_rss_kb = usage.ru_maxrss;
+    stats->voluntary_cs = usage.ru_nvcsw;
+    stats->involuntary_cs = usage.ru_nivcsw;
+    stats->minor_faults = usage.ru_minflt;
+    return stats->status == 0 ? 0 : -1;
+}
+
+// Digest SHA-256 du contenu d'un fichier
+static int hash_file(const char *path, unsigned char *digest) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    static unsigned char block[1 << 20];
+    hash_ctx ctx;
+    int status = hash_init(&ctx, HASH_SHA256);
+    size_t n;
+    while (status == 0 && (n = fread(block, 1, sizeof(block), file)) > 0) {
+        status = hash_update(&ctx, block, n);
+    }
+    if (status == 0 && !ferror(file)) {
+        status = hash_final(&ctx, digest);
+    } else {
+        hash_free(&ctx);
+        status = -1;
+    }
+    fclose(file);
+    return status;
+}
+
+// Comparaison d'une restauration avec la source (nftw n'a pas d'argument utilisateur)
+static struct {
+    size_t source_len;
+    const char *restored;
+    uint64_t files;         // Fichiers de la source comparés
+    uint64_t restored_files;
+    uint64_t mismatches;
+} verification;
+
+static int compare_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)ftw;
+    if (flag != FTW_F || !S_ISREG(st->st_mode)) {
+        return 0;
+    }
+    verification.files++;
+    char *restored = walk_join(verification.restored, path + verification.source_len + 1);
+    struct stat restored_st;
+    unsigned char expected[DIGEST_MAX_LENGTH], got[DIGEST_MAX_LENGTH];
+    const char *problem = NULL;
+    if (!restored || lstat(restored, &restored_st) != 0 || !S_ISREG(restored_st.st_mode)) {
+        problem = "absent";
+    } else if (restored_st.st_size != st->st_size) {
+        problem = "taille différente";
+    } else if (hash_file(path, expected) != 0 || hash_file(restored, got) != 0 ||
+               memcmp(expected, got, hash_digest_length(HASH_SHA256)) != 0) {
+        problem = "contenu différent";
+    }
+    if (problem) {
+        verification.mismatches++;
+        fprintf(stderr, "Restauration incorrecte de %s : %s.\n", path + verification.source_len + 1, problem);
+    }
+    free(restored);
+    return 0;
+}
+
+static int count_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)path;
+    (void)ftw;
+    if (flag == FTW_F && S_ISREG(st->st_mode)) {
+        verification.restored_files++;
+    }
+    return 0;
+}
+
+// Vérification de la restauration : chaque fichier de la source est présent avec la même taille et le
+// même digest, et la restauration ne contient pas d'autres fichiers
+static int verify_restore(const char *source, const char *restored, uint64_t *compared) {
+    memset(&verification, 0, sizeof(verification));
+    verification.source_len = strlen(source);
+    verification.restored = restored;
+    if (nftw(source, compare_entry, 64, FTW_PHYS) != 0 || nftw(restored, count_entry, 64, FTW_PHYS) != 0) {
+        perror("Erreur lors du parcours de la restauration");
+        return -1;
+    }
+    if (verification.restored_files != verification.files) {
+        fprintf(stderr, "Restauration incorrecte : %llu fichiers au lieu de %llu.\n",
+                (unsigned long long)verification.restored_files, (unsigned long long)verification.files);
+        verification.mismatches++;
+    }
+    *compared = verification.files;
+    return verification.mismatches == 0 ? 0 : -1;
+}
+
+// La liste des sauvegardes (sortie enregistrée dans path) mentionne-t-elle name ?
+static int listed(const char *path, const char *name) {
+    FILE *file = fopen(path, "r");
+    char line[4096];
+    int found = 0;
+    while (file && !found && fgets(line, sizeof(line), file)) {
+        found = strstr(line, name) != NULL;
+    }
+    if (file) {
+        fclose(file);
+    }
+    return found;
+}
+
+// Dernière sauvegarde enregistrée dans le catalogue de la destination
+static int last_record(const char *dest, catalog_record *record) {
+    char *store_path = walk_join(dest, ".store");
+    catalog_t catalog;
+    int status = store_path && catalog_load(&catalog, store_path) == 0 && catalog.count > 0 ? 0 : -1;
+    if (status == 0) {
+        *record = catalog.records[catalog.count - 1];
+        catalog_free(&catalog);
+    }
+    free(store_path);
+    return status;
+}
+
+// Ligne JSON d'un scénario ; ok est le résultat vérifié du scénario
+static void report(const char *scenario, int ok, const run_stats *stats, uint64_t bytes, uint64_t files,
+                   const catalog_record *record) {
+    printf("{\"scenario\":\"%s\",\"ok\":%s,\"exit_status\":%d,\"seconds\":%.6f,\"bytes\":%llu,\"files\":%llu,"
+           "\"mb_per_s\":%.2f,\"files_per_s\":%.1f,",
+           scenario, ok ? "true" : "false", stats->status, stats->seconds,
+           (unsigned long long)bytes, (unsigned long long)files,
+           stats->seconds > 0 ? bytes / stats->seconds / 1e6 : 0.0,
+           stats->seconds > 0 ? files / stats->seconds : 0.0);
+    if (record) {
+        printf("\"new_bytes\":%llu,\"stored_bytes\":%llu,\"dedup_ratio\":%.3f,",
+               (unsigned long long)record->new_bytes, (unsigned long long)record->stored_bytes,
+               catalog_dedup_ratio(record));
+    }
+    printf("\"peak_rss_kb\":%ld,\"read_calls\":%llu,\"write_calls\":%llu,\"read_bytes\":%llu,"
+           "\"write_bytes\":%llu,\"voluntary_cs\":%ld,\"involuntary_cs\":%ld,\"minor_faults\":%ld}\n",
+           stats->peak_rss_kb, stats->syscr, stats->syscw, stats->rchar, stats->wchar,
+           stats->voluntary_cs, stats->involuntary_cs, stats->minor_faults);
+    fflush(stdout);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage : %s BINAIRE [RÉPERTOIRE] [ÉCHELLE]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    char *binary = realpath(argv[1], NULL);
+    const char *base = argc > 2 ? argv[2] : ".";
+    int scale = argc > 3 ? atoi(argv[3]) : 1;
+    if (!binary || scale < 1) {
+        fprintf(stderr, "Binaire ou échelle invalide.\n");
+        free(binary);
+        return EXIT_FAILURE;
+    }
+
+    char work[1024], data[2048], dest[2048], out[2048];
+    snprintf(work, sizeof(work), "%s/bench_backup.%d", base, (int)getpid());
+    snprintf(data, sizeof(data), "%s/source", work);
+    snprintf(dest, sizeof(dest), "%s/destination", work);
+    snprintf(out, sizeof(out), "%s/restauration", work);
+    if (mkdir(work, 0755) != 0 || mkdir(dest, 0755) != 0) {
+        perror("Erreur de création du répertoire de test");
+        free(binary);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t bytes, files;
+    fprintf(stderr, "Création du jeu de données dans %s...\n", data);
+    int status = make_dataset(data, scale, &bytes, &files);
+
+    // Une sauvegarde réussie ajoute un enregistrement au catalogue : le code de sortie ne suffit pas
+    run_stats stats;
+    catalog_record record, first;
+    char *backup[] = {binary, "--backup", "--source", data, "--dest", dest, NULL};
+    if (status == 0) {
+        run(backup, NULL, &stats);
+        status = last_record(dest, &first);
+        report("backup_initial", status == 0, &stats, bytes, files, status == 0 ? &first : NULL);
+    }
+    if (status == 0 && (status = mutate_dataset(data, scale)) == 0) {
+        run(backup, NULL, &stats);
+        catalog_record *found = last_record(dest, &record) == 0 && strcmp(record.name, first.name) != 0 ? &record : NULL;
+        status = found ? 0 : -1;
+        report("backup_incremental", found != NULL, &stats, found ? found->logical_bytes : bytes,
+               found ? found->file_count : files, found);
+    }
+    if (status == 0) {
+        // La dernière sauvegarde est restaurée dans un répertoire neuf, puis comparée à la source
+        char *name = walk_join(dest, record.name);
+        char *restore[] = {binary, "--restore", "--source", name, "--dest", out, NULL};
+        uint64_t compared = 0;
+        status = name ? 0 : -1;
+        if (status == 0) {
+            run(restore, NULL, &stats);
+            status = verify_restore(data, out, &compared);
+        }
+        report("restore", status == 0, &stats, record.logical_bytes, compared, NULL);
+        free(name);
+    }
+    if (status == 0) {
+        char listing[2100];
+        snprintf(listing, sizeof(listing), "%s/liste", work);
+        char *list[] = {binary, "--list-backups", "--source", dest, NULL};
+        run(list, listing, &stats);
+        status = listed(listing, first.name) && listed(listing, record.name) ? 0 : -1;
+        report("list", status == 0, &stats, 0, 2, NULL);
+    }
+
+    nftw(work, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    free(binary);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "file_handler.h"
+
+// Banc d'essai de copy_file : débit de chaque méthode sur un gros fichier et sur de nombreux petits
+// (usage : bench_copy [RÉPERTOIRE] [TAILLE_GROS_Mo] [NOMBRE_PETITS] [TAILLE_PETITS_Ko])
+// Le répertoire détermine le système de fichiers testé (reflink sur btrfs/XFS uniquement).
+// Les sources sont dans le cache de pages : on mesure le coût de la copie, pas celui du disque.
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Création d'un fichier de données pseudo-aléatoires déterministes
+static int make_file(const char *path, size_t size, uint64_t seed) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror("Erreur de création d'un fichier de test");
+        return -1;
+    }
+    uint64_t block[8192];
+    uint64_t state = seed * 0x9e3779b97f4a7c15ull + 1;
+    for (size_t done = 0; done < size;) {
+        for (size_t i = 0; i < sizeof(block) / sizeof(block[0]); i++) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            block[i] = state;
+        }
+        size_t n = size - done < sizeof(block) ? size - done : sizeof(block);
+        if (fwrite(block, 1, n, file) != n) {
+            perror("Erreur d'écriture d'un fichier de test");
+            fclose(file);
+            return -1;
+        }
+        done += n;
+    }
+    return fclose(file);
+}
+
+// Copie de count fichiers avec une seule méthode, renvoie la durée ou -1 si la méthode n'est pas disponible
+static double run(const char *dir, const char *prefix, int count, copy_method method) {
+    char src[4096 + 32], dest[4096 + 32];
+    double start = now();
+    for (int i = 0; i < count; i++) {
+        snprintf(src, sizeof(src), "%s/%s-%d", dir, prefix, i);
+        snprintf(dest, sizeof(dest), "%s/%s-%d.copie", dir, prefix, i);
+        if (copy_file_methods(src, dest, COPY_MASK(method)) != method) {
+            unlink(dest);
+            return -1;
+        }
+    }
+    double elapsed = now() - start;
+    for (int i = 0; i < count; i++) {
+        snprintf(dest, sizeof(dest), "%s/%s-%d.copie", dir, prefix, i);
+        unlink(dest);
+    }
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    const char *base = argc > 1 ? argv[1] : ".";
+    size_t large_size = (argc > 2 ? strtoull(argv[2], NULL, 10) : 512) << 20;
+    int small_count = argc > 3 ? atoi(argv[3]) : 2000;
+    size_t small_size = (argc > 4 ? strtoull(argv[4], NULL, 10) : 16) << 10;
+    // Les noms des fichiers de test (« /petit- » et un entier) tiennent dans la marge de path
+    char dir[4096], path[sizeof(dir) + 32];
+
+    if (snprintf(dir, sizeof(dir), "%s/bench_copy.%d", base, (int)getpid()) >= (int)sizeof(dir)) {
+        fprintf(stderr, "Chemin du répertoire de test trop long : %s\n", base);
+        return EXIT_FAILURE;
+    }
+    if (mkdir(dir, 0755) != 0) {
+        perror("Erreur de création du répertoire de test");
+        return EXIT_FAILURE;
+    }
+
+    snprintf(path, sizeof(path), "%s/gros-0", dir);
+    int status = make_file(path, large_size, 1);
+    for (int i = 0; i < small_count && status == 0; i++) {
+        snprintf(path, sizeof(path), "%s/petit-%d", dir, i);
+        status = make_file(path, small_size, (uint64_t)i + 2);
+    }
+
+    if (status == 0) {
+        printf("%-16s %14s %14s %12s\n", "méthode", "gros (Go/s)", "petits (Go/s)", "fichiers/s");
+        for (int method = 0; method < COPY_METHOD_COUNT; method++) {
+            double large = run(dir, "gros", 1, method);
+            double small = large < 0 ? -1 : run(dir, "petit", small_count, method);
+            if (large < 0 || small < 0) {
+                printf("%-16s %14s %14s %12s\n", copy_method_name(method), "n/d", "n/d", "n/d");
+                continue;
+            }
+            printf("%-16s %14.2f %14.2f %12.0f\n", copy_method_name(method),
+                   large_size / large / 1e9,
+                   (double)small_size * small_count / small / 1e9,
+                   small_count / small);
+        }
+    }
+
+    // Nettoyage des fichiers de test
+    snprintf(path, sizeof(path), "%s/gros-0", dir);
+    unlink(path);
+    for (int i = 0; i < small_count; i++) {
+        snprintf(path, sizeof(path), "%s/petit-%d", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+    return status == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "chunk_index.h"
+
+// Banc d'essai de l'index des chunks : débit d'insertion et de recherche
+// à mesure que la table grandit (usage : bench_index [ENTRÉES_MAX] [TAILLE_DIGEST])
+
+#define LOOKUPS_PER_STEP 1000000u
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Digest synthétique déterministe de la i-ème entrée (les digests réels sont uniformes)
+static void make_key(uint64_t i, unsigned char *key, size_t key_len) {
+    uint64_t state = i * 0x9e3779b97f4a7c15ull + 0x632be59bd9b4e019ull;
+    for (size_t off = 0; off < key_len; off += sizeof(uint64_t)) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        size_t n = key_len - off < sizeof(z) ? key_len - off : sizeof(z);
+        memcpy(key + off, &z, n);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t max_entries = argc > 1 ? strtoull(argv[1], NULL, 10) : (1u << 24);
+    size_t key_len = argc > 2 ? strtoul(argv[2], NULL, 10) : 16;
+    unsigned char key[64];
+    chunk_index_t index;
+
+    if (key_len < 12 || key_len > sizeof(key)) {
+        fprintf(stderr, "Taille de digest invalide : %zu\n", key_len);
+        return EXIT_FAILURE;
+    }
+    // Départ volontairement petit : les agrandissements font partie de la mesure
+    if (chunk_index_init(&index, key_len, 0) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("%12s %14s %14s %14s %12s\n", "entrees", "insert Mops/s", "trouve Mops/s", "absent Mops/s", "octets/entree");
+    uint64_t inserted = 0;
+    for (uint64_t target = 1u << 16; target <= max_entries; target *= 2) {
+        chunk_location location = {0};
+        // Le premier palier insère 65536 entrées d'un coup, les suivants doublent la table
+        uint64_t step_start = inserted;
+        double start = now();
+        for (; inserted < target; inserted++) {
+            make_key(inserted, key, key_len);
+            location.offset = inserted;
+            if (chunk_index_insert(&index, key, &location) < 0) {
+                chunk_index_free(&index);
+                return EXIT_FAILURE;
+            }
+        }
+        double insert_rate = (inserted - step_start) / (now() - start) / 1e6;
+
+        // Recherches réussies sur des entrées tirées dans toute la table
+        uint64_t found = 0;
+        uint64_t pick = 1;
+        start = now();
+        for (unsigned i = 0; i < LOOKUPS_PER_STEP; i++) {
+            pick = pick * 6364136223846793005ull + 1442695040888963407ull;
+            make_key((pick >> 16) % inserted, key, key_len);
+            found += chunk_index_find(&index, key, &location);
+        }
+        double hit_rate = LOOKUPS_PER_STEP / (now() - start) / 1e6;
+
+        // Recherches de digests absents (cas d'un chunk nouveau)
+        start = now();
+        for (unsigned i = 0; i < LOOKUPS_PER_STEP; i++) {
+            make_key(max_entries + i, key, key_len);
+            found += chunk_index_find(&index, key, &location);
+        }
+        double miss_rate = LOOKUPS_PER_STEP / (now() - start) / 1e6;
+
+        if (found != LOOKUPS_PER_STEP) {
+            fprintf(stderr, "Résultat incohérent : %llu trouvés\n", (unsigned long long)found);
+            chunk_index_free(&index);
+            return EXIT_FAILURE;
+        }
+        printf("%12llu %14.2f %14.2f %14.2f %12.1f\n", (unsigned long long)inserted,
+               insert_rate, hit_rate, miss_rate, (double)chunk_index_memory(&index) / inserted);
+    }
+
+    chunk_index_free(&index);
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,13 @@
 #include "backup_manager.h"
 #include "deduplication.h"
 #include "file_handler.h"
+#include "walker.h"
+#include "snapshot_index.h"
+#include "files_cache.h"
+#include "network.h"
+#include "chunk_index.h"
+#include "catalog.h"
+#include "metrics.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,8 +18,10 @@
 #include <limits.h>
 #include <errno.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <pthread.h>
 
-#define MAX_PATH 1024  // Définir MAX_PATH comme 1024 caractère
 bool verbose;
 bool dry_run=true;
 
@@ -49,111 +58,25 @@ void get_timestamp(char *buffer, size_t size) {
              ts.tv_nsec / 1000000);
 }
 
-// Fonction récursive pour calculer la taille d'un dossier
-long long calculer_taille_dossier(const char *chemin) {
-    DIR *dossier = opendir(chemin);
-    if (!dossier) {
-        perror("Erreur d'ouverture du dossier");
-        return -1;
+// Visite du calcul de taille : seuls les fichiers réguliers comptent
+static int ajouter_taille(const walk_entry *entry, void *arg) {
+    if (entry->type == DT_REG) {
+        atomic_fetch_add((atomic_llong *)arg, (long long)entry->st->st_size);
     }
-
-    struct dirent *entree;
-    struct stat info;
-    long long taille_totale = 0;
-
-    while ((entree = readdir(dossier)) != NULL) {
-        // Ignorer les entrées spéciales "." et ".."
-        if (strcmp(entree->d_name, ".") == 0 || strcmp(entree->d_name, "..") == 0) {
-            continue;
-        }
-
-        // Construire le chemin complet de l'entrée
-        char chemin_complet[1024];
-        snprintf(chemin_complet, sizeof(chemin_complet), "%s/%s", chemin, entree->d_name);
-
-        // Obtenir les informations sur l'entrée
-        if (stat(chemin_complet, &info) == -1) {
-            perror("Erreur d'accès aux informations du fichier");
-            continue;
-        }
-
-        if (S_ISREG(info.st_mode)) {
-            // Si c'est un fichier, ajouter sa taille
-            taille_totale += info.st_size;
-        } else if (S_ISDIR(info.st_mode)) {
-            // Si c'est un dossier, appeler récursivement la fonction
-            long long taille_sous_dossier = calculer_taille_dossier(chemin_complet);
-            if (taille_sous_dossier != -1) {
-                taille_totale += taille_sous_dossier;
-            }
-        }
-    }
-
-    closedir(dossier);
-    return taille_totale;
+    return WALK_CONTINUE;
 }
 
-void appel_write(char *file_path, FILE *logfile) {
-    struct stat file_stat;
-    if (stat(file_path, &file_stat) == -1) {
-        perror("Erreur lors de la récupération des métadonnées36");
-        return;
-    }
-
-    log_element *new_log = malloc(sizeof(log_element));
-    if (!new_log) {
-        perror("Erreur d'allocation mémoire pour log_element");
-        return;
-    }
-
-    new_log->path = strdup(file_path);
-    new_log->date = malloc(32);
-    if (!new_log->path || !new_log->date) {
-        perror("Erreur d'allocation mémoire pour path ou date");
-        free(new_log->path);
-        free(new_log);
-        return;
-    }
-    get_timestamp(new_log->date, 32);
-
-    // Calcul du MD5
-    unsigned char file_data[4096];
-    FILE *file = fopen(file_path, "rb");
-    if (!file) {
-        perror("Erreur d'ouverture du fichier pour MD5");
-        free(new_log->path);
-        free(new_log->date);
-        free(new_log);
-        return;
-    }
-    size_t bytes_read = fread(file_data, 1, sizeof(file_data), file);
-    fclose(file);
-
-    compute_md5(file_data, bytes_read, new_log->md5);
-
-    // Vérifie si logfile est ouvert avant d'écrire
-    if (!logfile) {
-        fprintf(stderr, "Erreur : fichier de log non ouvert.\n");
-        free(new_log->path);
-        free(new_log->date);
-        free(new_log);
-        return;
-    }
-
-    write_log_element(new_log, logfile);
-
-    free(new_log->path);
-    free(new_log->date);
-    free(new_log);
-}
+// Fonction pour calculer la taille d'un dossier (parcours parallèle)
+long long calculer_taille_dossier(const char *chemin) {
+    atomic_llong taille_totale = 0;
+    walk_options options = {ajouter_taille, NULL, &taille_totale, backup_jobs, WALK_STAT_FILES};
 
-// Fonction pour convertir un MD5 en chaîne hexadécimale
-char* md5_to_string(unsigned char *md5) {
-    static char md5_str[MD5_DIGEST_LENGTH * 2 + 1];
-    for (int i = 0; i < MD5_DIGEST_LENGTH; i++) {
-        sprintf(&md5_str[i * 2], "%02x", md5[i]);
+    // Les entrées illisibles sont ignorées, comme les dossiers qui ne peuvent pas être ouverts
+    if (walk_tree(chemin, &options) == -1) {
+        perror("Erreur d'ouverture du dossier");
+        return -1;
     }
-    return md5_str;
+    return atomic_load(&taille_totale);
 }
 
 // Fonction qui vérifie l'éxistance du fichier
@@ -202,12 +125,37 @@ int check_directory(const char *path) {
     return 0; // Succès
 }
 
+// Visite de la suppression : les fichiers sont supprimés au fil du parcours
+static int supprimer_entree(const walk_entry *entry, void *arg) {
+    const char *chemin = arg;
+    if (entry->type == DT_DIR) {
+        return WALK_CONTINUE;
+    }
+    if (unlinkat(entry->dirfd, entry->name, 0) == -1) {
+        perror("Erreur lors de la suppression du fichier");
+        return WALK_ABORT;
+    }
+    printf("Fichier supprimé : %s/%s\n", chemin, entry->path);
+    return WALK_CONTINUE;
+}
+
+// Un répertoire est supprimé une fois tout son contenu traité
+static int supprimer_repertoire(const walk_entry *entry, void *arg) {
+    const char *chemin = arg;
+    if (unlinkat(entry->dirfd, entry->name, AT_REMOVEDIR) == -1) {
+        perror("Erreur lors de la suppression du répertoire.");
+        return WALK_ABORT;
+    }
+    printf("Répertoire supprimé : %s/%s.\n", chemin, entry->path);
+    return WALK_CONTINUE;
+}
+
 // Fonction pour supprimer un fichier ou un dossier récursivement
 int supprimer_recursivement(const char *chemin) {
     struct stat chemin_stat;
 
     // Vérifier si le chemin existe et obtenir ses informations
-    if (stat(chemin, &chemin_stat) != 0) {
+    if (lstat(chemin, &chemin_stat) != 0) {
         perror("Erreur lors de l'obtention des informations sur le chemin");
         return -1;
     }
@@ -223,33 +171,13 @@ int supprimer_recursivement(const char *chemin) {
         }
     }
 
-    // Si c'est un répertoire, on traite son contenu récursivement
+    // Si c'est un répertoire, son contenu est supprimé en parallèle, en profondeur d'abord
     if (S_ISDIR(chemin_stat.st_mode)) {
-        DIR *dir = opendir(chemin);
-        if (!dir) {
-            perror("Erreur lors de l'ouverture du répertoire");
+        walk_options options = {supprimer_entree, supprimer_repertoire, (void *)chemin, backup_jobs, 0};
+        if (walk_tree(chemin, &options) != 0) {
             return -1;
         }
 
-        struct dirent *entry;
-        char sous_chemin[1024];
-
-        // Parcourir les entrées du répertoire
-        while ((entry = readdir(dir)) != NULL) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue; // Ignorer les répertoires spéciaux
-            }
-
-            snprintf(sous_chemin, sizeof(sous_chemin), "%s/%s", chemin, entry->d_name);
-
-            // Suppression récursive du contenu
-            if (supprimer_recursivement(sous_chemin) != 0) {
-                closedir(dir);
-                return -1;
-            }
-        }
-        closedir(dir);
-
         // Supprimer le répertoire une fois vide
         if (rmdir(chemin) == 0) {
             printf("Répertoire supprimé : %s.\n", chemin);
@@ -270,6 +198,23 @@ char *find_last_backup(const char *dest_dir) {
     struct dirent *entry;
     char *last_backup = NULL;
 
+    // Le catalogue suffit si sa dernière sauvegarde existe encore ; sinon les noms sont parcourus
+    char *store_path = walk_join(dest_dir, STORE_DIR);
+    catalog_t catalog;
+    if (store_path && catalog_load(&catalog, store_path) == 0 && catalog.count > 0) {
+        const char *name = catalog.records[catalog.count - 1].name;
+        char *backup_path = walk_join(dest_dir, name);
+        if (backup_path && access(backup_path, F_OK) == 0) {
+            last_backup = strdup(name);
+        }
+        free(backup_path);
+        catalog_free(&catalog);
+    }
+    free(store_path);
+    if (last_backup) {
+        return last_backup;
+    }
+
     dir = opendir(dest_dir);
     if (!dir) {
         perror("Erreur lors de l'ouverture du répertoire destination.");
@@ -277,7 +222,8 @@ char *find_last_backup(const char *dest_dir) {
     }
 
     while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        // Ignorer les entrées cachées : ".", ".." et le dépôt de chunks
+        if (entry->d_name[0] == '.') {
             continue;
         }
 
@@ -291,155 +237,183 @@ char *find_last_backup(const char *dest_dir) {
     return last_backup;
 }
 
-void copie_backup(const char *backup_id, const char *restore_dir) {
-    DIR *src;
-    struct dirent *entry;
-    struct stat src_stat;
+// Lecture d'une horloge en nanosecondes
+static int64_t horloge_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
 
-    src = opendir(backup_id);
-    if (!src) {
-        perror("Erreur lors de l'ouverture du répertoire source.");
-        return;
+// Contexte de l'écrivain du pipeline
+typedef struct {
+    snapshot_index_writer *index; // Entrées de la nouvelle sauvegarde
+    files_cache_t *cache;         // Cache des fichiers du dépôt
+} enregistrement_writer;
+
+// Fonction appelée par l'écrivain du pipeline : enregistre l'entrée d'un fichier, dont la liste de chunks
+// est déjà rangée dans le dépôt
+static int enregistrer_fichier(const backup_job *job, const chunk_list_ref *list, void *arg) {
+    enregistrement_writer *writer = arg;
+    if (snapshot_writer_add_file(writer->index, job->path, &job->st, list) != 0) {
+        return -1;
     }
+    // Le fichier ne sera plus relu tant que sa taille, ses dates et son inode ne changent pas
+    if (writer->cache) {
+        files_cache_add(writer->cache, &job->st, list);
+    }
+    if (verbose) {
+        printf("Sauvegarde de '%s' terminée avec succès.\n", job->src_path);
+    }
+    return 0;
+}
 
+// Contexte du parcours de enregistrement()
+typedef struct {
+    const char *src_dir;
+    size_t src_len;
+    backup_pipeline *pipeline;
+    snapshot_index_writer *index;     // Entrées de la nouvelle sauvegarde
+    files_cache_t *cache;             // Cache des fichiers du dépôt
+    char *src_path;                   // Chemin source, réutilisé d'un fichier à l'autre
+    size_t src_capacity;
+} enregistrement_ctx;
+
+// Visite de la source : relevé des répertoires, reprise des fichiers inchangés et envoi des autres au pipeline
+static int verifier_source(const walk_entry *entry, void *arg) {
+    enregistrement_ctx *ctx = arg;
+    struct stat src_stat;
 
-    // Parcourir les fichiers et répertoires
-    while ((entry = readdir(src)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+    // Chaque répertoire a son entrée, pour que les répertoires vides soient conservés
+    if (entry->type == DT_DIR) {
+        if (snapshot_writer_add_dir(ctx->index, entry->path, entry->st) != 0) {
+            return WALK_ABORT;
         }
+        return WALK_CONTINUE;
+    }
 
-
-        char src_path[1024], dest_path[1024];
-        snprintf(src_path, sizeof(src_path), "%s/%s", backup_id, entry->d_name);
-        snprintf(dest_path, sizeof(dest_path), "%s/%s", restore_dir, entry->d_name);
-
-        // copier le fichier spécifique ".backup_log"
-        if (strcmp(entry->d_name, ".backup_log") == 0) {
-            if(dry_run){
-                printf("Copie du fichier %s vers %s.\n",src_path,dest_path);
-            }
-            else{
-                copy_file(src_path,dest_path);
-            }
-            continue;
+    // Un lien symbolique vers un fichier est sauvegardé comme le fichier lui-même
+    if (entry->type == DT_LNK) {
+        if (fstatat(entry->dirfd, entry->name, &src_stat, 0) == -1 || !S_ISREG(src_stat.st_mode)) {
+            return WALK_CONTINUE;
         }
+    } else if (entry->type == DT_REG) {
+        src_stat = *entry->st;
+    } else {
+        return WALK_CONTINUE;
+    }
 
-        if (stat(src_path, &src_stat) == -1) {
-            perror("Erreur lors de la récupération des informations sur le fichier source.");
-            continue;
+    // Fichier inchangé (même inode, taille et dates) : sa liste de chunks est reprise du cache,
+    // le fichier n'est pas ouvert. Le stat du parcours est le seul appel système pour ce fichier.
+    const files_cache_entry *cached = ctx->cache ? files_cache_lookup(ctx->cache, &src_stat) : NULL;
+    if (cached) {
+        chunk_list_ref list;
+        files_cache_list(ctx->cache, cached, &list);
+        if (snapshot_writer_add_file(ctx->index, entry->path, &src_stat, &list) == 0) {
+            return WALK_CONTINUE;
         }
+    }
 
-        if (S_ISDIR(src_stat.st_mode)) {
-            // Créer le sous-répertoire dans la destination
-            if(dry_run){
-                printf("Creation du repertoire %s;\n",dest_path);
-            }
-            else{
-                mkdir(dest_path,0755);
-            }
-            copie_backup(src_path, dest_path);
-        } else {
-            if(dry_run){
-                printf("Creation du lien dur de %s vers %s.\n",src_path,dest_path);
-            }
-            else {
-                // Créer un lien dur vers le fichier source
-                if (link(src_path, dest_path) == -1) {
-                    perror("Erreur lors de la création d'un lien dur.\n");
-                }
-            }
+    // Chemin source construit dans un tampon réutilisé, agrandi seulement pour un chemin plus long
+    size_t len = ctx->src_len + strlen(entry->path) + 2;
+    if (len > ctx->src_capacity) {
+        char *grown = realloc(ctx->src_path, len * 2);
+        if (!grown) {
+            perror("Erreur d'allocation mémoire pour un chemin");
+            return WALK_ABORT;
         }
+        ctx->src_path = grown;
+        ctx->src_capacity = len * 2;
     }
-    closedir(src);
+    snprintf(ctx->src_path, ctx->src_capacity, "%s/%s", ctx->src_dir, entry->path);
+    // Le fichier est lu, découpé et haché par les threads du pipeline ; les données vont dans le dépôt.
+    // La file du pipeline est bornée : le parcours attend quand les lecteurs ont trop de retard.
+    // Un fichier qui n'a pas pu être confié manquerait à l'arbre : la sauvegarde échoue
+    if (pipeline_submit(ctx->pipeline, ctx->src_path, entry->path, &src_stat) != 0) {
+        fprintf(stderr, "Erreur : '%s' n'a pas pu être ajouté à la sauvegarde.\n", ctx->src_path);
+        return WALK_ABORT;
+    }
+    return WALK_CONTINUE;
 }
 
-int enregistrement(const char *src_dir, const char *dest_dir,FILE *logfile) {
-    DIR *src = opendir(src_dir);
-    if (!src) {
-        perror("Erreur lors de l'ouverture du répertoire source.");
-        return -1;
-    }
+int enregistrement(const char *src_dir, backup_pipeline *pipeline, snapshot_index_writer *index, files_cache_t *cache) {
+    enregistrement_ctx ctx = {src_dir, strlen(src_dir), pipeline, index, cache, NULL, 0};
 
-    DIR *dest = opendir(dest_dir);
-    if (!dest) {
-        perror("Erreur lors de l'ouverture du répertoire destination.");
-        closedir(src);
+    // Les fichiers sont confiés au pipeline au fil du parcours, triés par nom dans chaque répertoire :
+    // l'ordre d'écriture dans le dépôt ne dépend ni du système de fichiers ni du nombre de threads.
+    // Le stat des répertoires donne leurs métadonnées dans l'arbre.
+    walk_options options = {verifier_source, NULL, &ctx, 1, WALK_STAT_FILES | WALK_STAT_DIRS | WALK_SORTED};
+    int status = walk_tree(src_dir, &options);
+    free(ctx.src_path);
+    return status;
+}
+
+// Sauvegarde de la source dans un dépôt ouvert (local ou distant) : fichiers, puis arbres et manifeste
+static int sauvegarder(const char *source_dir, chunk_store_t *store, files_cache_t *cache, snapshot_manifest *manifest) {
+    /* @param: cache est le cache des fichiers du dépôt, NULL pour relire tous les fichiers
+    *           manifest reçoit la racine et les totaux de la sauvegarde
+    *  @return: 0 si l'arborescence complète est dans le dépôt, 1 si la sauvegarde est complète
+    *           sauf des fichiers ou répertoires illisibles, -1 sinon (écriture dans le dépôt impossible...)
+    */
+    snapshot_index_writer index;
+    enregistrement_writer writer = {&index, cache};
+    // Les listes de chunks des fichiers lus sont rangées dans le dépôt au fil de la sauvegarde : l'index
+    // n'en garde que les racines
+    if (snapshot_writer_init(&index, store->hash, store->digest_len) != 0) {
         return -1;
     }
 
-    struct dirent *entry;
-    struct stat src_stat, dest_stat;
-
-    // Parcourir les fichiers dans le répertoire source
-    while ((entry = readdir(src)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
+    // Appel de la fonction enregistrement pour faire le backup incrémental :
+    // le parcours alimente le pipeline (lecture/découpage/hachage en parallèle, écriture ordonnée)
+    backup_pipeline pipeline;
+    int status = -1;
+    if (pipeline_start(&pipeline, store, backup_jobs, enregistrer_fichier, &writer) == 0) {
+        int walk_errors = enregistrement(source_dir, &pipeline, &index, cache);
+        uint64_t failures = pipeline_finish(&pipeline);
+        status = walk_errors < 0 || pipeline.store_failed ? -1 : 0;
+        if (walk_errors > 0) {
+            failures += (uint64_t)walk_errors;
         }
-
-        char src_path[1024], dest_path[1024];
-        snprintf(src_path, sizeof(src_path), "%s/%s", src_dir, entry->d_name);
-        snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_dir, entry->d_name);
-
-        if (stat(src_path, &src_stat) == -1) {
-            perror("Erreur lors de la récupération des informations source.");
-            continue;
+        // Les chunks encore en tampon d'écriture doivent être dans les packs avant que le cache,
+        // puis un arbre ou le manifeste, ne les référencent. Le cache d'une sauvegarde distante n'est
+        // enregistré qu'une fois la sauvegarde acceptée par le serveur (create_remote_backup).
+        if (store_flush(store) != 0) {
+            status = -1;
+        } else if (cache && !store->remote) {
+            files_cache_save(cache);
         }
 
-        if (S_ISDIR(src_stat.st_mode)) {
-            if (stat(dest_path, &dest_stat) == -1) {
-                if (mkdir(dest_path, 0755) == -1) {
-                    perror("Erreur lors de la création du dossier destination.");
-                    continue;
-                }
-            }
-            enregistrement(src_path, dest_path,logfile);  // Appel récursif
-        } else if (S_ISREG(src_stat.st_mode)) {
-            if (stat(dest_path, &dest_stat) == -1 || src_stat.st_mtime > dest_stat.st_mtime) {
-                copy_file(src_path, dest_path);
-                backup_file(dest_path);
-                appel_write(dest_path, logfile);
-            }
+        // Un arbre par répertoire dans le dépôt, puis le manifeste qui référence la racine
+        if (status == 0) {
+            status = snapshot_writer_store(&index, store, manifest);
         }
-    }
-
-    // Vérifier les fichiers dans le répertoire destination
-    while ((entry = readdir(dest)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, ".backup_log") == 0) {
-            continue;
+        if (status == 0 && store_flush(store) != 0) {
+            status = -1;
         }
-
-        char dest_path[1024], src_path[1024];
-        snprintf(dest_path, sizeof(dest_path), "%s/%s", dest_dir, entry->d_name);
-        snprintf(src_path, sizeof(src_path), "%s/%s", src_dir, entry->d_name);
-
-        if (stat(dest_path, &dest_stat) == -1) {
-            continue;
+        if (status == 0) {
+            printf("Sauvegarde terminée (%llu fichiers, %llu échecs).\n",
+                   (unsigned long long)manifest->file_count, (unsigned long long)failures);
         }
-
-        if (stat(src_path, &src_stat) == -1) {
-            supprimer_recursivement(dest_path);
+        if (status == 0 && failures > 0) {
+            status = 1;
         }
     }
-
-    // Fermeture des répertoires et du fichier de log
-    closedir(src);
-    closedir(dest);
-    printf("Sauvegarde terminée et fichier .backup_log mis à jour.\n");
-    return 0;
+    snapshot_writer_free(&index);
+    return status;
 }
 
 // Fonction pour créer une nouvelle sauvegarde complète puis incrémentale
-void create_backup(const char *source_dir, const char *backup_dir) {
-    FILE *log_file;
-    printf("create_backup");
+int create_backup(const char *source_dir, const char *backup_dir) {
+    /* @return: 0 si la sauvegarde est enregistrée en entier, -1 sinon (une sauvegarde dont des fichiers
+    *           n'ont pas pu être lus est enregistrée, mais le code de sortie signale l'échec)
+    */
+    chunk_store_t store;
     if (check_directory(source_dir) == -1) {
         printf("Erreur : vérifier le répertoire source (existence, permission).\n");
-        return;
+        return -1;
     }
     if (check_directory(backup_dir) == -1) {
         printf("Erreur : vérifier le répertoire backup (existence, permission).\n");
-        return;
+        return -1;
     }
 
     // Génération du timestamp pour le nom de la sauvegarde
@@ -447,236 +421,949 @@ void create_backup(const char *source_dir, const char *backup_dir) {
     get_timestamp(timestamp, sizeof(timestamp));
 
     // Création du chemin de sauvegarde
-    char backup_path[1024];
-    snprintf(backup_path, sizeof(backup_path), "%s/%s", backup_dir, timestamp);
+    char *backup_path = walk_join(backup_dir, timestamp);
+    if (!backup_path) {
+        return -1;
+    }
 
-    // Création du fichier .backup_log
-    char backup_log_path[1024];
-    snprintf(backup_log_path, sizeof(backup_log_path), "%s/.backup_log", backup_path);
+    // Une sauvegarde ne dépend pas de la précédente : les arbres inchangés sont déjà dans le dépôt
+    // et ne sont pas réécrits, la sauvegarde ne contient que son manifeste
     if (dry_run){
+        char *last_backup_name = find_last_backup(backup_dir);
         printf("Creation du repertoire %s dans le repertoire %s.\n",timestamp,backup_dir);
-        printf("Creation du fichier .backup_log dans le repertoire %s.\n",backup_path);
-    }else{
-        mkdir(backup_path, 0755);
-        log_file = fopen(backup_log_path, "w");
-        if (!log_file) {
-            perror("Erreur lors de la création du fichier .backup_log");
-            return;
-        }
-    }
-    char *last_backup_name = find_last_backup(backup_dir);
-    if(dry_run){
         if (last_backup_name) {
             printf("La derniere backup enregistre est %s.\n", last_backup_name);
         }
         else{
             printf("Il n'y a pas de derniere backup.\n");
         }
-    }
-    if (last_backup_name) {
-        // Sauvegarde incrémentale
-        char last_backup_path[1024];
-        snprintf(last_backup_path, sizeof(last_backup_path), "%s/%s", backup_dir, last_backup_name);
-
-        copie_backup(last_backup_path, backup_path);
         free(last_backup_name);
-    }
-    if(dry_run){
-        printf("Lecture du backup_log\n");
         printf("Appel de la fonction enregistrement qui copie les fichier du dossier source vers dest.\n");
-        printf("Appel de la fonction update_backup_log qui met a jour le fichier backup_log.\n");
-    }else {
-        // Lecture de l'ancien backup_log
-        log_t logs = read_backup_log(backup_log_path);
-
-        // Appel de la fonction enregistrement pour faire le backup incrémental
-        enregistrement(source_dir, backup_path, log_file);
-
-        fclose(log_file);
-
-        // Mettre à jour le fichier .backup_log
-        update_backup_log(backup_log_path, &logs);
+        printf("Ecriture des arbres dans le dépôt et du manifeste %s de la sauvegarde.\n", SNAPSHOT_MANIFEST_NAME);
+        free(backup_path);
+        return 0;
     }
-}
 
-// Fonction permettant d'enregistrer dans un fichier le tableau de chunks dédupliqué
-void write_backup_file(const char *output_filename, Chunk *chunks, int chunk_count) {
-    FILE *output_file = fopen(output_filename, "wb");  // Ouvrir le fichier de sortie en mode binaire
-    if (!output_file) {
-        perror("Erreur d'ouverture du fichier de sauvegarde");
-        return;
+    // Un seul dépôt de chunks par destination, partagé par toutes les sauvegardes
+    if (store_open(&store, backup_dir) != 0) {
+        free(backup_path);
+        return -1;
     }
 
-    // Parcourir tous les chunks et écrire leurs données dans le fichier
-    for (int i = 0; i < chunk_count; i++) {
-        size_t data_size = strlen((char *)chunks[i].data);  // Taille réelle des données dans ce chunk
-
-        // Écrire le MD5 suivi des données du chunk
-        if (fwrite(chunks[i].md5, 1, MD5_DIGEST_LENGTH, output_file) != MD5_DIGEST_LENGTH) {
-            perror("Erreur d'écriture du MD5 dans le fichier");
-            fclose(output_file);
-            return;
-        }
+    files_cache_t cache;
+    if (files_cache_open(&cache, store.path, store.hash, store.digest_len) != 0) {
+        store_close(&store);
+        free(backup_path);
+        return -1;
+    }
 
-        if (fwrite(chunks[i].data, 1, data_size, output_file) != data_size) {
-            perror("Erreur d'écriture dans le fichier");
-            fclose(output_file);
-            return;
+    // La sauvegarde n'existe qu'une fois son manifeste écrit ; des fichiers illisibles n'empêchent pas
+    // d'enregistrer les autres
+    catalog_record record = {.start_ns = horloge_ns(CLOCK_REALTIME)};
+    int64_t start = horloge_ns(CLOCK_MONOTONIC);
+    snapshot_manifest manifest;
+    char *manifest_path = NULL;
+    int saved = sauvegarder(source_dir, &store, &cache, &manifest);
+    int status = saved == 0 ? 0 : -1;
+    if (saved >= 0 &&
+        (manifest_path = walk_join(backup_path, SNAPSHOT_MANIFEST_NAME)) != NULL &&
+        mkdir(backup_path, 0755) == 0 && snapshot_manifest_write(manifest_path, &manifest) == 0) {
+        printf("Manifeste %s écrit.\n", manifest_path);
+        if (saved > 0) {
+            fprintf(stderr, "Attention : la sauvegarde %s est incomplète, des fichiers n'ont pas pu être lus.\n",
+                    backup_path);
         }
+        // Statistiques de la sauvegarde dans le catalogue, pour --list-backups
+        snprintf(record.name, sizeof(record.name), "%s", timestamp);
+        record.duration_ns = (uint64_t)(horloge_ns(CLOCK_MONOTONIC) - start);
+        record.file_count = manifest.file_count;
+        record.tree_count = manifest.tree_count;
+        record.logical_bytes = manifest.total_size;
+        record.new_bytes = store.new_raw_bytes;
+        record.stored_bytes = store.new_bytes;
+        record.new_chunks = store.new_chunks;
+        catalog_append(store.path, &record);
+    } else {
+        fprintf(stderr, "Erreur : la sauvegarde %s n'a pas pu être enregistrée.\n", backup_path);
+        rmdir(backup_path);
+        status = -1;
     }
-
-    fclose(output_file);  // Fermer le fichier après l'écriture
-    printf("Fichier de sauvegarde créé : %s\n", output_filename);
+    free(manifest_path);
+
+    if (verbose) {
+        printf("Cache des fichiers : %llu fichiers inchangés, %llu à lire.\n",
+               (unsigned long long)cache.hits, (unsigned long long)cache.misses);
+        printf("Dépôt : %llu objets, %llu nouveaux (%llu octets écrits pour %llu octets de données, compression %s).\n",
+               (unsigned long long)store.index.count,
+               (unsigned long long)store.new_chunks,
+               (unsigned long long)store.new_bytes,
+               (unsigned long long)store.new_raw_bytes,
+               codec_name(store.codec.algo));
+    }
+    files_cache_close(&cache);
+    store_close(&store);
+    free(backup_path);
+    return status;
 }
 
-// Fonction permettant de sauvegarder un fichier en appliquant la déduplication
-void backup_file(const char *filename) {
-
-    // Ouvrir le fichier à sauvegarder en mode binaire
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        perror("Erreur lors de l'ouverture du fichier");
-        return;
+// Fonction pour créer une sauvegarde sur un serveur distant (--d-server, --d-port)
+int create_remote_backup(const char *source_dir, const char *server, int port) {
+    /* @return: 0 si la sauvegarde est enregistrée en entier sur le serveur, -1 sinon
+    */
+    if (check_directory(source_dir) == -1) {
+        printf("Erreur : vérifier le répertoire source (existence, permission).\n");
+        return -1;
     }
-
-    // Initialiser la table de hachage pour les MD5 des chunks
-    Md5Entry hash_table[HASH_TABLE_SIZE] = {0};  // Table de hachage pour éviter les doublons
-
-    // Allouer un tableau dynamique pour les chunks (vérifier le nombre d'éléments)
-    Chunk *chunks = malloc(sizeof(Chunk) * CHUNK_SIZE);
-    if (chunks == NULL) {
-        perror("Erreur d'allocation mémoire pour les chunks");
-        fclose(file);
-        return;
+    char timestamp[32];
+    get_timestamp(timestamp, sizeof(timestamp));
+    if (dry_run) {
+        printf("Envoi de la sauvegarde %s au serveur %s:%d.\n", timestamp, server, port);
+        printf("Seuls les chunks absents du dépôt du serveur seraient transmis.\n");
+        return 0;
     }
 
-    int chunk_count = 0;
-
-    // Dédupliquer le fichier et le découper en chunks
-    deduplicate_file(file, chunks, &chunk_count);
-
-    // Si aucun chunk n'a été trouvé, afficher une erreur et arrêter la sauvegarde
-    if (chunk_count == 0) {
-        fprintf(stderr, "Aucun chunk à sauvegarder pour '%s'.\n", filename);
-        free(chunks);
-        fclose(file);
-        return;
+    // Le dépôt local ne fait que proposer les digests au serveur, qui demande ceux qui lui manquent.
+    chunk_store_t store;
+    remote_session session;
+    if (remote_open(&session, &store, server, port) != 0) {
+        fprintf(stderr, "Erreur : impossible d'ouvrir une session avec %s:%d.\n", server, port);
+        return -1;
     }
 
-    // Fermer le fichier après la lecture
-    fclose(file);
-
-    // Appeler la fonction pour écrire les chunks dans un fichier de sauvegarde
-    char backup_filename[MAX_PATH];
-    snprintf(backup_filename, sizeof(backup_filename), "backup/%s_backup.dat", filename);
-    write_backup_file(backup_filename, chunks, chunk_count);
-
-    // Libérer la mémoire des chunks
-    for (int i = 0; i < chunk_count; i++) {
-        free(chunks[i].data);  // Assurez-vous de libérer correctement la mémoire de chaque chunk
+    // Le client garde son propre cache des fichiers pour ce serveur : un fichier inchangé n'est ni relu
+    // ni proposé. Il n'est repris que pour la génération du dépôt du serveur qui l'a vu naître (un
+    // nettoyage la change), et n'est enregistré qu'une fois tous ses chunks reçus par le serveur.
+    files_cache_t cache;
+    bool cached = files_cache_open_remote(&cache, server, port, store.hash, store.digest_len, session.epoch) == 0;
+
+    snapshot_manifest manifest;
+    int saved = sauvegarder(source_dir, &store, cached ? &cache : NULL, &manifest);
+    int status = saved == 0 ? 0 : -1;
+    if (saved >= 0 && remote_commit(&session, timestamp, &manifest) == 0) {
+        printf("Sauvegarde %s enregistrée sur %s:%d.\n", timestamp, server, port);
+        if (cached) {
+            files_cache_save(&cache);
+        }
+        if (saved > 0) {
+            fprintf(stderr, "Attention : la sauvegarde %s est incomplète, des fichiers n'ont pas pu être lus.\n",
+                    timestamp);
+        }
+    } else {
+        fprintf(stderr, "Erreur : la sauvegarde %s n'a pas pu être enregistrée sur le serveur.\n", timestamp);
+        status = -1;
     }
-    free(chunks);
 
-    printf("Sauvegarde de '%s' terminée avec succès.\n", filename);
+    if (verbose && cached) {
+        printf("Cache des fichiers : %llu fichiers inchangés, %llu à lire.\n",
+               (unsigned long long)cache.hits, (unsigned long long)cache.misses);
+    }
+    if (verbose) {
+        printf("Réseau : %llu chunks proposés, %llu envoyés (%llu octets pour %llu octets de données), %llu octets émis.\n",
+               (unsigned long long)session.offered,
+               (unsigned long long)session.sent_chunks,
+               (unsigned long long)session.sent_bytes,
+               (unsigned long long)session.sent_raw_bytes,
+               (unsigned long long)session.wire_bytes);
+    }
+    if (cached) {
+        files_cache_close(&cache);
+    }
+    remote_close(&session);
+    store_close(&store);
+    return status;
 }
 
-// Fonction pour restaurer un fichier à partir des chunks dédupliqués
-int write_restored_files(const char *output_filename, Chunk *chunks, int chunk_count) {
-    // Ouvrir le fichier de sortie en mode binaire
-    FILE *output_file = fopen(output_filename, "wb");
-    if (!output_file) {
+// Fonction pour restaurer un fichier à partir de sa recette, sans la charger entièrement en mémoire
+int write_restored_files(const char *output_filename, chunk_source *source, chunk_store_t *store) {
+    /* @param: output_filename est le fichier restauré (créé ou tronqué ; avec --delta, un fichier
+    *           existant est mis à jour en place)
+    *           source est la liste de ses chunks, lus dans store
+    *  @return: 0 en cas de succès, -1 sinon (un fichier incomplet créé par la restauration est supprimé)
+    */
+    // Restauration différentielle : seuls les chunks qui diffèrent du fichier existant sont écrits
+    int fd = restore_delta ? open(output_filename, O_RDWR | O_CLOEXEC) : -1;
+    bool delta = fd >= 0;
+    if (!delta) {
+        fd = open(output_filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
         perror("Erreur lors de l'ouverture du fichier de sortie");
         return -1;
     }
 
-    Md5Entry hash_table[HASH_TABLE_SIZE] = {0};  // Table de hachage pour éviter les doublons
-
-    // Parcourir tous les chunks pour écrire le fichier restauré
-    for (int i = 0; i < chunk_count; i++) {
-        // Vérifier si le chunk est déjà présent dans la table de hachage
-        int index = find_md5(hash_table, chunks[i].md5);
+    // Les chunks sont écrits dans l'ordre du fichier, par grands blocs
+    uint64_t written = source->file_size;
+    int status = delta ? restore_recipe_delta(source, store, fd, &written) : restore_recipe(source, store, fd);
 
-        if (index == -1) {
-            // Si le chunk n'est pas trouvé, il est unique, on l'ajoute à la table de hachage
-            add_md5(hash_table, chunks[i].md5, i);
-
-            // Écrire les données du chunk dans le fichier de sortie
-            size_t bytes_written = fwrite(chunks[i].data, 1, CHUNK_SIZE, output_file);
+    // Fermer le fichier après avoir écrit tous les chunks
+    if (close(fd) != 0 && status == 0) {
+        perror("Erreur lors de la fermeture du fichier restauré");
+        status = -1;
+    }
+    if (status != 0) {
+        // Un fichier existant n'est jamais supprimé, même partiellement mis à jour
+        if (delta) {
+            fprintf(stderr, "'%s' n'a été que partiellement mis à jour.\n", output_filename);
         } else {
-            // Si le chunk est déjà dans la table, il a déjà été écrit
-            printf("Chunk %d déjà écrit (référence trouvée dans la table de hachage).\n", i);
+            unlink(output_filename);
         }
+        return -1;
+    }
+    if (verbose && delta) {
+        printf("Fichier '%s' mis à jour : %llu octets écrits sur %llu\n", output_filename,
+               (unsigned long long)written, (unsigned long long)source->file_size);
+    } else if (verbose) {
+        printf("Fichier restauré avec succès dans '%s'\n", output_filename);
     }
-
-    // Fermer le fichier après avoir écrit tous les chunks
-    fclose(output_file);
-    printf("Fichier restauré avec succès dans '%s'\n", output_filename);
     return 0;
 }
 
-void restore_backup(const char *backup_id, const char *restore_dir) {
+// Création des répertoires parents d'un fichier restauré, au-delà de la racine de restauration
+static void creer_parents(char *chemin, size_t racine_len) {
+    for (char *slash = strchr(chemin + racine_len + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(chemin, 0755) == -1 && errno != EEXIST) {
+            perror("Erreur lors de la création du répertoire");
+        }
+        *slash = '/';
+    }
+}
+
+// Restauration d'une sauvegarde antérieure à l'index binaire, à partir de son .backup_log
+static void restore_backup_log(const char *backup_id, const char *restore_dir, chunk_store_t *store) {
 
-    char backup_log_path[MAX_PATH];
-    if (snprintf(backup_log_path, sizeof(backup_log_path), "%s/.backup_log", backup_id) >= sizeof(backup_log_path)) {
-        fprintf(stderr, "Erreur : chemin de log trop long.\n");
+    char *backup_log_path = walk_join(backup_id, ".backup_log");
+    if (!backup_log_path) {
         return;
     }
-    printf("oui : %s\n",backup_log_path);
     log_t logs = read_backup_log(backup_log_path);
+    free(backup_log_path);
     log_element *current = logs.head;
 
     if (current == NULL) {
         printf("Aucun élément dans le log de sauvegarde.\n");
         return;
     }
+
     mkdir(restore_dir,0755);
     while (current != NULL) {
-        char backup_file_path[MAX_PATH];
+        char *backup_file_path;
 
         // Si le chemin de `current->path` est déjà absolu ou contient `backup_id`, ne pas préfixer
         if (strncmp(current->path, backup_id, strlen(backup_id)) == 0) {
-            strncpy(backup_file_path, current->path, sizeof(backup_file_path));
+            backup_file_path = strdup(current->path);
         } else {
-            if (snprintf(backup_file_path, sizeof(backup_file_path), "%s/%s", backup_id, current->path) >= sizeof(backup_file_path)) {
-                fprintf(stderr, "Erreur : chemin de fichier trop long pour '%s'.\n", current->path);
-                current = current->next;
-                continue;
-            }
+            backup_file_path = walk_join(backup_id, current->path);
+        }
+        if (!backup_file_path) {
+            current = current->next;
+            continue;
         }
-        printf("Tentative d'ouverture du fichier : %s\n", backup_file_path);
         FILE *backup_file = fopen(backup_file_path, "rb");
 
         if (!backup_file) {
             fprintf(stderr, "Erreur lors de l'ouverture du fichier de sauvegarde '%s': %s\n", backup_file_path, strerror(errno));
+            free(backup_file_path);
             current = current->next;
             continue;
         }
+        free(backup_file_path);
 
-        // Récupération et traitement des chunks
-        Chunk *chunks = NULL;
-        int chunk_count = 0;
-        undeduplicate_file(backup_file, &chunks, &chunk_count);
-        fclose(backup_file);
-
-        if (chunk_count == 0) {
+        // Lecture de l'en-tête de la recette ; ses références sont lues pendant la restauration
+        chunk_source source;
+        if (recipe_open(backup_file, &source) != 0) {
+            fclose(backup_file);
             current = current->next;
             continue;
         }
         char *last_slash = strrchr(current->path, '/');
         // Création du répertoire cible
-        char restored_file_path[MAX_PATH];
-        snprintf(restored_file_path, sizeof(restored_file_path), "%s%s", restore_dir, last_slash);
-        printf("%s\n",restored_file_path);
+        char *restored_file_path = walk_join(restore_dir, last_slash ? last_slash + 1 : current->path);
+        if (restored_file_path) {
+            if (verbose) {
+                printf("%s\n", restored_file_path);
+            }
 
-        fopen(restored_file_path,"w");
-        // Écriture du fichier restauré
-        if (write_restored_files(restored_file_path, chunks, chunk_count) != 0) {
-            fprintf(stderr, "Échec de la restauration de '%s'.\n", current->path);
+            // Écriture du fichier restauré
+            if (write_restored_files(restored_file_path, &source, store) != 0) {
+                fprintf(stderr, "Échec de la restauration de '%s'.\n", current->path);
+            }
         }
-
-        free(chunks);
+        free(restored_file_path);
+        fclose(backup_file);
         current = current->next;
     }
+    free_backup_log(&logs);
+}
+
+// Restauration d'un fichier décrit par une entrée d'index ou d'arbre
+static int restaurer_fichier(chunk_store_t *store, const snapshot_index_t *index, const snapshot_entry *entry,
+                             const char *restored_file_path) {
+    chunk_source source;
+    snapshot_entry_source(index, entry, store, NULL, &source);
+
+    // Écriture du fichier restauré
+    if (verbose) {
+        printf("%s\n", restored_file_path);
+    }
+    int status = write_restored_files(restored_file_path, &source, store);
+    chunk_source_free(&source);
+    return status;
+}
+
+// Restauration récursive de l'arbre d'un répertoire
+static void restaurer_arbre(chunk_store_t *store, const unsigned char *id, const char *dir) {
+    snapshot_index_t tree;
+    if (snapshot_tree_open(&tree, store, id) != 0) {
+        fprintf(stderr, "Échec de la restauration de '%s'.\n", dir);
+        return;
+    }
+    for (size_t i = 0; i < tree.count; i++) {
+        const snapshot_entry *entry = &tree.entries[i];
+        char *path = walk_join(dir, snapshot_entry_path(&tree, entry));
+        if (!path) {
+            continue;
+        }
+        if (S_ISDIR(entry->mode)) {
+            if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+                perror("Erreur lors de la création du répertoire");
+            } else {
+                restaurer_arbre(store, entry->digest, path);
+            }
+        } else if (restaurer_fichier(store, &tree, entry, path) != 0) {
+            fprintf(stderr, "Échec de la restauration de '%s'.\n", path);
+        }
+        free(path);
+    }
+    snapshot_index_close(&tree);
+}
+
+// Restauration d'une sauvegarde à index plat (.backup_index), antérieure aux arbres
+static void restore_backup_index(const char *backup_id, const char *restore_dir, chunk_store_t *store) {
+    char *index_path = walk_join(backup_id, SNAPSHOT_INDEX_NAME);
+    snapshot_index_t index;
+    if (!index_path || snapshot_index_open(&index, index_path) != 0) {
+        free(index_path);
+        restore_backup_log(backup_id, restore_dir, store);
+        return;
+    }
+    free(index_path);
+
+    // Les fichiers sont restaurés avec leur arborescence, dans l'ordre de l'index
+    mkdir(restore_dir, 0755);
+    for (size_t i = 0; i < index.count; i++) {
+        const snapshot_entry *entry = &index.entries[i];
+        const char *path = snapshot_entry_path(&index, entry);
+        char *restored_file_path = walk_join(restore_dir, path);
+        if (restored_file_path) {
+            creer_parents(restored_file_path, strlen(restore_dir));
+            if (restaurer_fichier(store, &index, entry, restored_file_path) != 0) {
+                fprintf(stderr, "Échec de la restauration de '%s'.\n", path);
+            }
+        }
+        free(restored_file_path);
+    }
+    snapshot_index_close(&index);
+}
+
+void restore_backup(const char *backup_id, const char *restore_dir) {
+    if (dry_run) {
+        printf("Restauration de la sauvegarde %s dans '%s'.\n", backup_id, restore_dir);
+        printf("Les fichiers seraient relus dans le dépôt de la destination, qui n'est pas modifié.\n");
+        return;
+    }
+
+    // Les données des fichiers sont dans le dépôt de la destination qui contient la sauvegarde ;
+    // une restauration ne fait que le lire
+    char *store_parent = store_dir_of_backup(backup_id);
+    chunk_store_t store;
+    if (!store_parent || store_open_read(&store, store_parent) != 0) {
+        fprintf(stderr, "Erreur : dépôt de chunks introuvable pour '%s'.\n", backup_id);
+        free(store_parent);
+        return;
+    }
+    free(store_parent);
+
+    // Le manifeste référence l'arbre de la racine ; les sauvegardes plus anciennes n'ont qu'un index plat
+    snapshot_manifest manifest;
+    char *manifest_path = walk_join(backup_id, SNAPSHOT_MANIFEST_NAME);
+    if (manifest_path && snapshot_manifest_read(manifest_path, &manifest) == 0) {
+        if (manifest.digest_len != store.digest_len) {
+            fprintf(stderr, "Erreur : le manifeste de '%s' ne correspond pas au dépôt.\n", backup_id);
+        } else {
+            mkdir(restore_dir, 0755);
+            restaurer_arbre(&store, manifest.root, restore_dir);
+        }
+    } else {
+        restore_backup_index(backup_id, restore_dir, &store);
+    }
+    free(manifest_path);
+    restore_workers_stop();
+    store_close(&store);
+}
+
+// Répertoire d'une restauration distante dont l'arbre reste à recevoir
+typedef struct {
+    unsigned char digest[DIGEST_MAX_LENGTH];
+    char *path;
+} repertoire_distant;
+
+// Fichier d'une restauration distante, décrit par une entrée d'un arbre reçu
+typedef struct {
+    const snapshot_index_t *tree;
+    const snapshot_entry *entry;
+    char *path;
+} fichier_distant;
+
+// Chunk d'une fenêtre de la suite des chunks des fichiers
+typedef struct {
+    int32_t source;       // Position dans la fenêtre où le chunk est reçu, -1 s'il est reçu à cette position
+    uint32_t size;
+    uint32_t remaining;   // Réutilisations à venir de la copie conservée
+    unsigned char *data;  // Copie conservée pour ces réutilisations
+} morceau_distant;
+
+// Fenêtre planifiée : ses chunks, et les objets demandés pour eux
+typedef struct {
+    morceau_distant *plan;
+    size_t count;
+    remote_request *requests;
+    size_t request_count;
+} fenetre_distante;
+
+// Restauration distante en cours : les arbres sont reçus par lots de répertoires pris sur une pile, et
+// les fichiers d'un lot sont restaurés avant le lot suivant
+typedef struct {
+    remote_session *session;
+    size_t digest_len;
+    repertoire_distant *pending;             // Répertoires dont l'arbre reste à recevoir
+    size_t pending_count;
+    size_t pending_capacity;
+    snapshot_index_t trees[NET_GET_COUNT];   // Arbres du lot en cours
+    size_t tree_count;
+    fichier_distant *files;                  // Fichiers du lot, dans l'ordre de leurs chunks
+    size_t file_count;
+    size_t file_capacity;
+    chunk_source plan_source;                // Liste du fichier en cours de planification
+    bool plan_open;
+    chunk_ref plan_ref;                      // Chunk lu dans plan_source, pas encore planifié
+    bool plan_ready;
+    unsigned char *buffer;                   // Tampon d'écriture des fichiers
+    size_t buffer_size;
+    size_t received_trees;
+    size_t restored;
+    uint64_t reused;
+} restauration_distante;
+
+// Écriture complète d'un bloc à la suite du fichier (les écritures partielles sont reprises)
+static int ecrire_tout(int fd, const unsigned char *data, size_t size) {
+    uint64_t start = metrics_start();
+    uint64_t total = size;
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erreur d'écriture du fichier restauré");
+            return -1;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    metrics_stop(METRIC_WRITE, start, total);
+    return 0;
+}
+
+// Ajout d'un répertoire à recevoir ; path appartient ensuite à la restauration
+static int empiler_repertoire(restauration_distante *r, const unsigned char *digest, char *path) {
+    if (r->pending_count == r->pending_capacity) {
+        size_t capacity = r->pending_capacity ? r->pending_capacity * 2 : 64;
+        repertoire_distant *grown = realloc(r->pending, capacity * sizeof(*grown));
+        if (!grown) {
+            perror("Erreur d'allocation mémoire pour la restauration");
+            free(path);
+            return -1;
+        }
+        r->pending = grown;
+        r->pending_capacity = capacity;
+    }
+    memcpy(r->pending[r->pending_count].digest, digest, r->digest_len);
+    r->pending[r->pending_count++].path = path;
+    return 0;
+}
+
+// Réception des arbres d'un lot de répertoires : leurs sous-répertoires sont créés et empilés, leurs
+// fichiers listés dans l'ordre des arbres
+static int recevoir_lot(restauration_distante *r, const repertoire_distant *batch, size_t batch_count) {
+    // Des répertoires identiques partagent leur arbre : il n'est demandé qu'une fois
+    remote_request requests[NET_GET_COUNT];
+    size_t tree_of[NET_GET_COUNT];
+    chunk_index_t unique;
+    if (chunk_index_init(&unique, r->digest_len, batch_count) != 0) {
+        return -1;
+    }
+    size_t request_count = 0;
+    for (size_t i = 0; i < batch_count; i++) {
+        chunk_location location = {.offset = request_count};
+        if (chunk_index_find(&unique, batch[i].digest, &location) || chunk_index_insert(&unique, batch[i].digest, &location) != 1) {
+            tree_of[i] = location.offset;
+            continue;
+        }
+        memcpy(requests[request_count].digest, batch[i].digest, r->digest_len);
+        requests[request_count].size = 0;
+        tree_of[i] = request_count++;
+    }
+    chunk_index_free(&unique);
+
+    int status = remote_fetch_push(r->session, requests, request_count);
+    for (size_t q = 0; q < request_count && status == 0; q++) {
+        uint32_t size;
+        const unsigned char *data = remote_fetch_next(r->session, &size);
+        void *image = data ? malloc(size ? size : 1) : NULL;
+        if (!image) {
+            status = -1;
+            break;
+        }
+        memcpy(image, data, size);
+        snapshot_index_t *tree = &r->trees[r->tree_count];
+        if (snapshot_index_load(tree, image, size) != 0) {
+            status = -1;
+            break;
+        }
+        r->tree_count++;
+        if (!(tree->header->flags & SNAPSHOT_INDEX_TREE) || tree->digest_len != r->digest_len) {
+            status = -1;
+        }
+    }
+    if (status != 0) {
+        fprintf(stderr, "Erreur : arborescence de la sauvegarde illisible.\n");
+        return -1;
+    }
+    r->received_trees += request_count;
+
+    for (size_t i = 0; i < batch_count && status == 0; i++) {
+        const snapshot_index_t *tree = &r->trees[tree_of[i]];
+        for (size_t e = 0; e < tree->count && status == 0; e++) {
+            const snapshot_entry *entry = &tree->entries[e];
+            char *path = walk_join(batch[i].path, snapshot_entry_path(tree, entry));
+            if (!path) {
+                status = -1;
+            } else if (S_ISDIR(entry->mode)) {
+                if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+                    perror("Erreur lors de la création du répertoire");
+                    free(path);
+                    continue;
+                }
+                status = empiler_repertoire(r, entry->digest, path);
+            } else {
+                if (r->file_count == r->file_capacity) {
+                    size_t capacity = r->file_capacity ? r->file_capacity * 2 : 64;
+                    fichier_distant *grown = realloc(r->files, capacity * sizeof(*grown));
+                    if (!grown) {
+                        perror("Erreur d'allocation mémoire pour la restauration");
+                        free(path);
+                        status = -1;
+                        break;
+                    }
+                    r->files = grown;
+                    r->file_capacity = capacity;
+                }
+                r->files[r->file_count++] = (fichier_distant){tree, entry, path};
+            }
+        }
+    }
+    return status;
+}
+
+// Lecture d'un objet de liste sur le serveur pendant la planification : les chunks de la fenêtre en vol
+// qui arrivent avant lui sont gardés par la session jusqu'à leur écriture
+static unsigned char *recevoir_liste(void *arg, const unsigned char *record, size_t digest_len) {
+    remote_session *session = arg;
+    remote_request request;
+    uint32_t count, size;
+    memcpy(&count, record + digest_len, sizeof(count));
+    memcpy(request.digest, record, digest_len);
+    request.size = count * (uint32_t)CHUNK_REF_RECORD_SIZE(digest_len);
+    unsigned char *object = count > 0 && count <= CHUNK_LIST_MAX_RECORDS ? malloc(request.size) : NULL;
+    const unsigned char *data = NULL;
+    if (object && (data = remote_fetch_now(session, &request, &size)) != NULL) {
+        memcpy(object, data, size);
+    }
+    if (!data) {
+        fprintf(stderr, "Erreur : liste de chunks illisible sur le serveur.\n");
+        free(object);
+        return NULL;
+    }
+    return object;
+}
+
+// Plan d'une fenêtre de la suite des chunks du lot, à partir du chunk *chunk du fichier *file : au plus
+// NET_PREFETCH_COUNT chunks et NET_PREFETCH_BYTES octets, ce que le thread fetcher garde en vol. Un chunk
+// qui revient dans la fenêtre est recopié depuis sa première réception plutôt que redemandé.
+static int planifier_fenetre(restauration_distante *r, size_t *file, uint32_t *chunk, fenetre_distante *window) {
+    morceau_distant *plan = window->plan;
+    remote_request *requests = window->requests;
+    chunk_index_t seen;
+    if (chunk_index_init(&seen, r->digest_len, NET_PREFETCH_COUNT) != 0) {
+        return -1;
+    }
+    size_t count = 0, requested = 0;
+    uint64_t bytes = 0;
+    int status = 0;
+    while (*file < r->file_count && count < NET_PREFETCH_COUNT) {
+        const fichier_distant *current = &r->files[*file];
+        if (*chunk == current->entry->chunk_count) {
+            chunk_source_free(&r->plan_source);
+            r->plan_open = false;
+            (*file)++;
+            *chunk = 0;
+            continue;
+        }
+        // La liste du fichier est lue avec un chunk d'avance : celui qui ne tient plus dans la fenêtre
+        // est gardé pour la suivante
+        if (!r->plan_ready) {
+            if (!r->plan_open) {
+                snapshot_entry_source(current->tree, current->entry, NULL, NULL, &r->plan_source);
+                r->plan_source.fetch = recevoir_liste;
+                r->plan_source.fetch_arg = r->session;
+                r->plan_open = true;
+            }
+            if (chunk_source_next(&r->plan_source, &r->plan_ref) != 1) {
+                status = -1;
+                break;
+            }
+            r->plan_ready = true;
+        }
+        const unsigned char *record = r->plan_ref.digest;
+        uint32_t size = r->plan_ref.size;
+        // Le premier chunk de la fenêtre y entre toujours, même s'il dépasse NET_PREFETCH_BYTES
+        if (count > 0 && bytes + size > NET_PREFETCH_BYTES) {
+            break;
+        }
+        r->plan_ready = false;
+        chunk_location location = {.offset = count};
+        plan[count] = (morceau_distant){-1, size, 0, NULL};
+        if (chunk_index_find(&seen, record, &location)) {
+            plan[count].source = (int32_t)location.offset;
+            plan[location.offset].remaining++;
+        } else if (chunk_index_insert(&seen, record, &location) != 1) {
+            status = -1;
+            break;
+        } else {
+            memcpy(requests[requested].digest, record, r->digest_len);
+            requests[requested++].size = size;
+        }
+        bytes += size;
+        count++;
+        (*chunk)++;
+    }
+    chunk_index_free(&seen);
+    window->count = count;
+    window->request_count = requested;
+    return status;
+}
+
+// Fin de l'écriture d'un fichier : le reste du tampon est écrit, un fichier incomplet est supprimé
+static void terminer_fichier_distant(restauration_distante *r, const fichier_distant *file, int fd, bool failed,
+                                     size_t used, int status) {
+    if (!failed && status == 0 && used > 0) {
+        failed = ecrire_tout(fd, r->buffer, used) != 0;
+    }
+    if (fd >= 0 && close(fd) != 0) {
+        perror("Erreur lors de la fermeture du fichier restauré");
+        failed = true;
+    }
+    if (failed || status != 0) {
+        if (fd >= 0) {
+            unlink(file->path);
+        }
+        fprintf(stderr, "Échec de la restauration de '%s'.\n", file->path);
+    } else {
+        r->restored++;
+        if (verbose) {
+            printf("%s\n", file->path);
+        }
+    }
+}
+
+// Restauration des fichiers d'un lot, une fenêtre de chunks à la fois : la fenêtre suivante est planifiée
+// et demandée avant l'écriture de celle en cours, le thread fetcher l'envoie à mesure que la place se libère
+// et le lien ne se vide pas entre deux fenêtres
+static int restaurer_lot(restauration_distante *r) {
+    fenetre_distante windows[2];
+    int status = 0;
+    for (int w = 0; w < 2; w++) {
+        windows[w].plan = malloc(NET_PREFETCH_COUNT * sizeof(morceau_distant));
+        windows[w].requests = malloc(NET_PREFETCH_COUNT * sizeof(remote_request));
+        windows[w].count = 0;
+        if (!windows[w].plan || !windows[w].requests) {
+            status = -1;
+        }
+    }
+    if (status != 0) {
+        perror("Erreur d'allocation mémoire pour la restauration");
+        for (int w = 0; w < 2; w++) {
+            free(windows[w].plan);
+            free(windows[w].requests);
+        }
+        return -1;
+    }
+
+    fenetre_distante *window = &windows[0], *following = &windows[1];
+    size_t plan_file = 0, file = 0;
+    uint32_t plan_chunk = 0, chunk = 0;
+    int fd = -1;
+    bool opened = false, failed = false;
+    size_t used = 0;
+    status = planifier_fenetre(r, &plan_file, &plan_chunk, window);
+    if (status == 0) {
+        status = remote_fetch_push(r->session, window->requests, window->request_count);
+    }
+    while (status == 0 && file < r->file_count) {
+        status = planifier_fenetre(r, &plan_file, &plan_chunk, following);
+        if (status == 0) {
+            status = remote_fetch_push(r->session, following->requests, following->request_count);
+        }
+        morceau_distant *plan = window->plan;
+        size_t position = 0;
+        while (status == 0 && file < r->file_count) {
+            const fichier_distant *current = &r->files[file];
+            if (!opened) {
+                fd = open(current->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if (fd < 0) {
+                    perror("Erreur lors de l'ouverture du fichier de sortie");
+                }
+                // Une erreur d'écriture locale n'interrompt pas la suite : les chunks du fichier doivent être lus
+                failed = fd < 0;
+                opened = true;
+                used = 0;
+                chunk = 0;
+            }
+            if (chunk == current->entry->chunk_count) {
+                terminer_fichier_distant(r, current, fd, failed, used, 0);
+                opened = false;
+                file++;
+                continue;
+            }
+            if (position == window->count) {
+                break;
+            }
+
+            morceau_distant *morceau = &plan[position];
+            const unsigned char *data;
+            uint32_t size = morceau->size;
+            if (morceau->source < 0) {
+                data = remote_fetch_next(r->session, &size);
+                if (!data) {
+                    status = -1;
+                    break;
+                }
+                if (morceau->remaining > 0 && !(morceau->data = malloc(size ? size : 1))) {
+                    status = -1;
+                    break;
+                }
+                if (morceau->data) {
+                    memcpy(morceau->data, data, size);
+                }
+            } else {
+                data = plan[morceau->source].data;
+                r->reused++;
+            }
+
+            if (!failed) {
+                if (used + size > r->buffer_size && used > 0) {
+                    failed = ecrire_tout(fd, r->buffer, used) != 0;
+                    used = 0;
+                }
+                if (size > r->buffer_size) {
+                    failed = failed || ecrire_tout(fd, data, size) != 0;
+                } else {
+                    memcpy(r->buffer + used, data, size);
+                    used += size;
+                }
+            }
+            if (morceau->source >= 0 && --plan[morceau->source].remaining == 0) {
+                free(plan[morceau->source].data);
+                plan[morceau->source].data = NULL;
+            }
+            position++;
+            chunk++;
+        }
+        // Copies encore conservées : la fenêtre a été interrompue
+        for (size_t i = 0; i < window->count; i++) {
+            free(plan[i].data);
+        }
+        fenetre_distante *written = window;
+        window = following;
+        following = written;
+    }
+    if (opened) {
+        terminer_fichier_distant(r, &r->files[file], fd, failed, used, status);
+    }
+    for (int w = 0; w < 2; w++) {
+        free(windows[w].plan);
+        free(windows[w].requests);
+    }
+    return status;
+}
+
+// Libération des arbres et des fichiers d'un lot
+static void liberer_lot(restauration_distante *r) {
+    chunk_source_free(&r->plan_source);
+    r->plan_open = false;
+    r->plan_ready = false;
+    for (size_t i = 0; i < r->file_count; i++) {
+        free(r->files[i].path);
+    }
+    r->file_count = 0;
+    for (size_t i = 0; i < r->tree_count; i++) {
+        snapshot_index_close(&r->trees[i]);
+    }
+    r->tree_count = 0;
+}
+
+// Fonction pour restaurer une sauvegarde d'un serveur distant (--s-server, --s-port)
+void restore_remote_backup(const char *server, int port, const char *name, const char *restore_dir) {
+    /* @param: name est le nom de la sauvegarde sur le serveur, NULL pour la dernière
+    *           restore_dir est le répertoire local de restauration
+    */
+    if (dry_run) {
+        printf("Restauration de la sauvegarde %s du serveur %s:%d dans '%s'.\n",
+               name ? name : "la plus récente", server, port, restore_dir);
+        return;
+    }
+
+    chunk_store_t store;
+    remote_session session;
+    if (remote_open(&session, &store, server, port) != 0) {
+        fprintf(stderr, "Erreur : impossible d'ouvrir une session avec %s:%d.\n", server, port);
+        return;
+    }
+    char backup_name[NET_NAME_MAX];
+    snapshot_manifest manifest;
+    if (remote_snapshot(&session, name, backup_name, sizeof(backup_name), &manifest) != 0) {
+        fprintf(stderr, "Erreur : sauvegarde introuvable sur %s:%d.\n", server, port);
+        remote_close(&session);
+        store_close(&store);
+        return;
+    }
+    if (mkdir(restore_dir, 0755) == -1 && errno != EEXIST) {
+        perror("Erreur lors de la création du répertoire de restauration");
+        remote_close(&session);
+        store_close(&store);
+        return;
+    }
+
+    // Seuls les arbres du lot en cours et les répertoires restant à recevoir sont gardés en mémoire ;
+    // la pile fait descendre la restauration en profondeur, ce qui la garde courte
+    restauration_distante r;
+    memset(&r, 0, sizeof(r));
+    r.session = &session;
+    r.digest_len = store.digest_len;
+    r.buffer_size = restore_buffer_size ? restore_buffer_size : RESTORE_BUFFER_DEFAULT;
+    r.buffer = malloc(r.buffer_size);
+    char *root = strdup(restore_dir);
+    int status = -1;
+    if (!r.buffer || !root) {
+        perror("Erreur d'allocation mémoire pour la restauration");
+        free(root);
+    } else {
+        status = empiler_repertoire(&r, manifest.root, root);
+    }
+    while (status == 0 && r.pending_count > 0) {
+        repertoire_distant batch[NET_GET_COUNT];
+        size_t batch_count = r.pending_count < NET_GET_COUNT ? r.pending_count : NET_GET_COUNT;
+        r.pending_count -= batch_count;
+        memcpy(batch, r.pending + r.pending_count, batch_count * sizeof(*batch));
+        status = recevoir_lot(&r, batch, batch_count);
+        if (status == 0) {
+            status = restaurer_lot(&r);
+        }
+        liberer_lot(&r);
+        for (size_t i = 0; i < batch_count; i++) {
+            free(batch[i].path);
+        }
+    }
+
+    if (status == 0) {
+        printf("Sauvegarde %s de %s:%d restaurée dans '%s' (%zu fichiers).\n", backup_name, server, port,
+               restore_dir, r.restored);
+    } else {
+        fprintf(stderr, "Erreur : la restauration de %s depuis %s:%d est incomplète.\n", backup_name, server, port);
+    }
+    if (verbose) {
+        printf("Réseau : %zu arbres, %llu objets reçus (%llu octets), %llu chunks recopiés sans nouvelle demande.\n",
+               r.received_trees,
+               (unsigned long long)session.received_objects,
+               (unsigned long long)session.received_bytes,
+               (unsigned long long)r.reused);
+    }
+
+    for (size_t i = 0; i < r.pending_count; i++) {
+        free(r.pending[i].path);
+    }
+    free(r.pending);
+    free(r.files);
+    free(r.buffer);
+    remote_close(&session);
+    store_close(&store);
+}
+
+// Export récursif des fichiers d'un arbre, préfixés par le chemin de leur répertoire
+static int exporter_arbre(chunk_store_t *store, const unsigned char *id, const char *prefix, FILE *out) {
+    snapshot_index_t tree;
+    if (snapshot_tree_open(&tree, store, id) != 0) {
+        return -1;
+    }
+    int status = 0;
+    for (size_t i = 0; status == 0 && i < tree.count; i++) {
+        const snapshot_entry *entry = &tree.entries[i];
+        char *path = walk_join(prefix, snapshot_entry_path(&tree, entry));
+        if (!path) {
+            status = -1;
+        } else if (S_ISDIR(entry->mode)) {
+            status = exporter_arbre(store, entry->digest, path, out);
+        } else {
+            status = snapshot_entry_export(&tree, entry, path, out);
+        }
+        free(path);
+    }
+    snapshot_index_close(&tree);
+    return status;
+}
+
+// Fonction pour écrire l'index d'une sauvegarde au format texte de .backup_log
+int export_backup_log(const char *backup_id, FILE *out) {
+    snapshot_manifest manifest;
+    char *manifest_path = walk_join(backup_id, SNAPSHOT_MANIFEST_NAME);
+    if (manifest_path && snapshot_manifest_read(manifest_path, &manifest) == 0) {
+        free(manifest_path);
+        char *store_parent = store_dir_of_backup(backup_id);
+        chunk_store_t store;
+        if (!store_parent || store_open_read(&store, store_parent) != 0) {
+            fprintf(stderr, "Erreur : dépôt de chunks introuvable pour '%s'.\n", backup_id);
+            free(store_parent);
+            return -1;
+        }
+        free(store_parent);
+        int status = exporter_arbre(&store, manifest.root, backup_id, out);
+        store_close(&store);
+        return status;
+    }
+    free(manifest_path);
+
+    char *index_path = walk_join(backup_id, SNAPSHOT_INDEX_NAME);
+    snapshot_index_t index;
+    if (!index_path || snapshot_index_open(&index, index_path) != 0) {
+        fprintf(stderr, "Erreur : '%s' n'a pas d'index de sauvegarde.\n", backup_id);
+        free(index_path);
+        return -1;
+    }
+    free(index_path);
+    int status = snapshot_index_export(&index, backup_id, out);
+    snapshot_index_close(&index);
+    return status;
 }
 
 // Fonction permettant de lister les différentes sauvegardes présentes dans la destination
@@ -702,10 +1389,32 @@ void list_backups(const char *backup_dir){
         printf("Liste des sauvegardes dans %s:\n", backup_dir);
     }
 
+    // Les statistiques des sauvegardes sont lues dans le catalogue, sans ouvrir les sauvegardes
+    catalog_t catalog = {0};
+    char *store_path = walk_join(backup_dir, STORE_DIR);
+    if (store_path) {
+        catalog_load(&catalog, store_path);
+    }
+    free(store_path);
+
     // Parcourir les fichiers et dossiers
     while ((entry = readdir(dir)) != NULL) {
-        // Ignorer les entrées spéciales "." et ".."
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        // Ignorer les entrées cachées : ".", ".." et le dépôt de chunks
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        const catalog_record *record = catalog_find(&catalog, entry->d_name);
+        if (record) {
+            printf("- %s taille de l'enregistrement : %llu octets (%llu fichiers), %llu nouveaux octets",
+                   entry->d_name,
+                   (unsigned long long)record->logical_bytes,
+                   (unsigned long long)record->file_count,
+                   (unsigned long long)record->new_bytes);
+            if (record->new_bytes > 0) {
+                printf(", déduplication x%.1f", catalog_dedup_ratio(record));
+            }
+            printf(", durée %.2f s\n", (double)record->duration_ns / 1e9);
             continue;
         }
 
@@ -720,6 +1429,16 @@ void list_backups(const char *backup_dir){
 
         // Vérifier si c'est un répertoire
         if (S_ISDIR(file_stat.st_mode)) {
+            // Sauvegarde absente du catalogue (antérieure à celui-ci) : la taille est celle de son manifeste
+            snapshot_manifest manifest;
+            char *manifest_path = walk_join(full_path, SNAPSHOT_MANIFEST_NAME);
+            if (manifest_path && access(manifest_path, F_OK) == 0 && snapshot_manifest_read(manifest_path, &manifest) == 0) {
+                printf("- %s taille de l'enregistrement : %llu octets (%llu fichiers)\n", entry->d_name,
+                       (unsigned long long)manifest.total_size, (unsigned long long)manifest.file_count);
+                free(manifest_path);
+                continue;
+            }
+            free(manifest_path);
             long long taille = calculer_taille_dossier(full_path);
             if (taille == -1) {
                 fprintf(stderr, "Erreur lors du calcul de la taille du dossier.\n");
@@ -729,5 +1448,6 @@ void list_backups(const char *backup_dir){
         }
     }
 
+    catalog_free(&catalog);
     closedir(dir);
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 
 #include "deduplication.h"
 #include "file_handler.h"
+#include "chunk_store.h"
+#include "backup_pipeline.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,15 +17,21 @@ extern bool verbose;
 extern bool dry_run;
 
 // Fonction pour créer un nouveau backup incrémental
-void create_backup(const char *source_dir, const char *backup_dir);
+int create_backup(const char *source_dir, const char *backup_dir);
+// Fonction pour créer une sauvegarde sur un serveur distant
+int create_remote_backup(const char *source_dir, const char *server, int port);
 // Fonction pour restaurer une sauvegarde
 void restore_backup(const char *backup_id, const char *restore_dir);
-// Fonction permettant la restauration du fichier backup via le tableau de chunk
-void write_backup_file(const char *output_filename, Chunk *chunks, int chunk_count);
-// Fonction pour la sauvegarde de fichier dédupliqué
-void backup_file(const char *filename);
-// Fonction permettant la restauration du fichier backup via le tableau de chunk
-int write_restored_files(const char *output_filename, Chunk *chunks, int chunk_count);
+// Fonction pour restaurer une sauvegarde d'un serveur distant (la dernière si name est NULL)
+void restore_remote_backup(const char *server, int port, const char *name, const char *restore_dir);
+// Fonction pour supprimer un fichier ou un dossier récursivement
+int supprimer_recursivement(const char *chemin);
+// Fonction pour trouver la dernière sauvegarde d'une destination
+char *find_last_backup(const char *dest_dir);
+// Fonction permettant la restauration d'un fichier à partir de sa recette, en mémoire bornée
+int write_restored_files(const char *output_filename, chunk_source *source, chunk_store_t *store);
+// Fonction pour écrire l'index d'une sauvegarde au format texte de .backup_log
+int export_backup_log(const char *backup_id, FILE *out);
 // Fonction permettant de lister les différentes sauvegardes présentes dans la destination
 void list_backups(const char *backup_dir);
 
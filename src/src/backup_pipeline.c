@@ -0,0 +1,425 @@
+#include "backup_pipeline.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Nombre de lecteurs (0 : un par processeur)
+int backup_jobs = 0;
+
+// Lot vide, pris dans les réserves du pipeline
+static chunk_batch *batch_new(backup_pipeline *pipeline) {
+    chunk_batch *batch = buffer_pool_get(&pipeline->batch_pool);
+    if (!batch) {
+        return NULL;
+    }
+    memset(batch, 0, sizeof(chunk_batch));
+    batch->chunks = (batch_chunk *)(batch + 1);
+    batch->capacity = pipeline->batch_capacity;
+    batch->data = buffer_pool_get(&pipeline->data_pool);
+    // Un chunk n'est gardé compressé que s'il est plus petit : packed ne dépasse jamais data
+    if (pipeline->store->codec.algo != CODEC_NONE) {
+        batch->packed = buffer_pool_get(&pipeline->data_pool);
+    }
+    if (!batch->data || (pipeline->store->codec.algo != CODEC_NONE && !batch->packed)) {
+        buffer_pool_put(&pipeline->data_pool, batch->data);
+        buffer_pool_put(&pipeline->data_pool, batch->packed);
+        buffer_pool_put(&pipeline->batch_pool, batch);
+        return NULL;
+    }
+    return batch;
+}
+
+static void batch_free(backup_pipeline *pipeline, chunk_batch *batch) {
+    buffer_pool_put(&pipeline->data_pool, batch->data);
+    buffer_pool_put(&pipeline->data_pool, batch->packed);
+    buffer_pool_put(&pipeline->batch_pool, batch);
+}
+
+// Fichier en vol : la structure et ses chemins occupent un seul bloc, recyclé quand les chemins y tiennent
+static backup_job *job_new(backup_pipeline *pipeline, const char *src_path, const char *path) {
+    size_t src_len = strlen(src_path) + 1;
+    size_t path_len = strlen(path) + 1;
+    bool pooled = sizeof(backup_job) + src_len + path_len <= PIPELINE_JOB_BYTES;
+    backup_job *job = pooled ? buffer_pool_get(&pipeline->job_pool) : malloc(sizeof(backup_job) + src_len + path_len);
+    if (!job) {
+        return NULL;
+    }
+    job->pooled = pooled;
+    job->src_path = (char *)(job + 1);
+    job->path = job->src_path + src_len;
+    memcpy(job->src_path, src_path, src_len);
+    memcpy(job->path, path, path_len);
+    queue_init_items(&job->batches, job->batch_items, PIPELINE_BATCH_QUEUE);
+    job->batches.metric = METRIC_QUEUE_BATCHES;
+    return job;
+}
+
+static void job_free(backup_pipeline *pipeline, backup_job *job) {
+    queue_destroy(&job->batches);
+    if (job->pooled) {
+        buffer_pool_put(&pipeline->job_pool, job);
+    } else {
+        free(job);
+    }
+}
+
+// Chemin et taille d'un fichier pour la lecture anticipée
+static const char *job_source(void *arg, uint64_t *size) {
+    backup_job *job = arg;
+    *size = (uint64_t)job->st.st_size;
+    return job->src_path;
+}
+
+static long read_stream(void *source, void *buffer, size_t size) {
+    return prefetch_read(source, buffer, size);
+}
+
+// Lecture, découpage, hachage et compression d'un fichier ; les lots sont remis à l'écrivain au fil de l'eau.
+// stream est le fichier déjà ouvert par la lecture anticipée (NULL : le lecteur l'ouvre lui-même).
+static void process_job(backup_pipeline *pipeline, backup_job *job, prefetch_stream *stream, unsigned char *read_buffer,
+                        unsigned char *scratch, size_t scratch_size) {
+    chunk_store_t *store = pipeline->store;
+    chunk_batch *batch = batch_new(pipeline);
+    if (!batch) {
+        // Sans lot, l'écrivain ne peut pas être prévenu : on attend qu'un lot puisse être alloué
+        while (!(batch = batch_new(pipeline))) {
+            sleep(1);
+        }
+        if (stream) {
+            prefetch_release(stream);
+        }
+        batch->last = true;
+        batch->status = -1;
+        queue_push(&job->batches, batch);
+        return;
+    }
+
+    // Sans tampon de lecture (allocation du lecteur échouée), chaque fichier est signalé en échec.
+    // Avec la lecture anticipée, le fichier a déjà été ouvert par le moteur d'E/S.
+    FILE *file = NULL;
+    int error = stream ? prefetch_error(stream) : 0;
+    if (!stream && read_buffer) {
+        file = fopen(job->src_path, "rb");
+        error = file ? 0 : errno;
+    }
+    if (!read_buffer || error) {
+        if (error) {
+            errno = error;
+            perror("Erreur lors de l'ouverture du fichier");
+        }
+        if (stream) {
+            prefetch_release(stream);
+        }
+        batch->last = true;
+        batch->status = -1;
+        queue_push(&job->batches, batch);
+        return;
+    }
+
+    chunk_reader reader;
+    hash_ctx file_ctx;
+    const unsigned char *chunk;
+    long size = -1;
+    if (stream) {
+        chunk_reader_init_source(&reader, read_stream, stream, &store->chunker, read_buffer,
+                                 chunk_reader_buffer_size(&store->chunker));
+    } else {
+        // Les lectures vont directement dans le tampon du lecteur : pas de tampon stdio par fichier
+        setvbuf(file, NULL, _IONBF, 0);
+        chunk_reader_init_buffer(&reader, file, &store->chunker, read_buffer, chunk_reader_buffer_size(&store->chunker));
+    }
+    if (hash_init(&file_ctx, store->hash) == 0) {
+        while ((size = chunk_reader_next(&reader, &chunk)) > 0) {
+            // Lot plein : il part vers l'écrivain (bloque si ce fichier a déjà trop d'avance)
+            if (batch->used + (size_t)size > pipeline->batch_bytes || batch->count == batch->capacity) {
+                chunk_batch *next = batch_new(pipeline);
+                if (!next) {
+                    size = -1;
+                    break;
+                }
+                queue_push(&job->batches, batch);
+                batch = next;
+            }
+
+            batch_chunk *entry = &batch->chunks[batch->count];
+            if (compute_hash(store->hash, chunk, (size_t)size, entry->digest) != 0 ||
+                hash_update(&file_ctx, chunk, (size_t)size) != 0) {
+                size = -1;
+                break;
+            }
+            memcpy(batch->data + batch->used, chunk, (size_t)size);
+            entry->offset = batch->used;
+            entry->size = (uint32_t)size;
+            entry->codec = CODEC_NONE;
+
+            // Compression dans le lecteur : l'écrivain n'a plus qu'à copier les octets dans le pack
+            if (scratch) {
+                size_t packed = codec_compress(&store->codec, chunk, (size_t)size, scratch, scratch_size);
+                if (packed > 0) {
+                    memcpy(batch->packed + batch->packed_used, scratch, packed);
+                    entry->codec = (uint32_t)store->codec.algo;
+                    entry->packed_offset = batch->packed_used;
+                    entry->packed_size = (uint32_t)packed;
+                    batch->packed_used += packed;
+                }
+            }
+            batch->used += (size_t)size;
+            batch->count++;
+        }
+        if (size == 0) {
+            if (hash_final(&file_ctx, batch->file_digest) != 0) {
+                size = -1;
+            }
+        } else {
+            hash_free(&file_ctx);
+        }
+    }
+    chunk_reader_free(&reader);
+    if (stream) {
+        prefetch_release(stream);
+    } else {
+        fclose(file);
+    }
+
+    batch->last = true;
+    batch->status = size == 0 ? 0 : -1;
+    queue_push(&job->batches, batch);
+}
+
+// Thread lecteur : prend les fichiers dans l'ordre où ils se libèrent
+static void *worker_main(void *arg) {
+    backup_pipeline *pipeline = arg;
+    backup_job *job;
+
+    // Tampon de lecture du lecteur, réutilisé pour tous ses fichiers
+    void *read_buffer = NULL;
+    if (posix_memalign(&read_buffer, POOL_IO_ALIGN, chunk_reader_buffer_size(&pipeline->store->chunker)) != 0) {
+        fprintf(stderr, "Erreur d'allocation mémoire pour le tampon de lecture.\n");
+        read_buffer = NULL;
+    }
+
+    // Tampon de compression du lecteur, dimensionné pour le plus grand chunk
+    unsigned char *scratch = NULL;
+    size_t scratch_size = 0;
+    if (pipeline->store->codec.algo != CODEC_NONE) {
+        scratch_size = codec_bound(pipeline->store->codec.algo, pipeline->store->chunker.max_size);
+        scratch = malloc(scratch_size);
+        if (!scratch) {
+            perror("Erreur d'allocation mémoire pour la compression, chunks stockés bruts");
+        }
+    }
+    if (pipeline->prefetch) {
+        prefetch_stream *stream;
+        while ((stream = queue_pop(&pipeline->ready_queue)) != NULL) {
+            process_job(pipeline, prefetch_job(stream), stream, read_buffer, scratch, scratch_size);
+        }
+    } else {
+        while ((job = queue_pop(&pipeline->work_queue)) != NULL) {
+            process_job(pipeline, job, NULL, read_buffer, scratch, scratch_size);
+        }
+    }
+    free(read_buffer);
+    free(scratch);
+    return NULL;
+}
+
+// Thread écrivain : seul à toucher au dépôt et au log, il traite les fichiers dans l'ordre du parcours,
+// ce qui rend le résultat identique quel que soit le nombre de lecteurs
+static void *writer_main(void *arg) {
+    backup_pipeline *pipeline = arg;
+    chunk_store_t *store = pipeline->store;
+    backup_job *job;
+
+    // Chaque chunk stocké est aussitôt ajouté à la liste du fichier, dont les objets pleins partent dans
+    // le dépôt : rien ne grandit en mémoire avec la taille du fichier. Après un échec d'écriture (disque
+    // plein...), les lots restants sont seulement vidés pour libérer les lecteurs.
+    while ((job = queue_pop(&pipeline->order_queue)) != NULL) {
+        bool store_failed = __atomic_load_n(&pipeline->store_failed, __ATOMIC_RELAXED);
+        int status = store_failed ? -1 : 0;
+        chunk_list_ref list;
+        memset(&list, 0, sizeof(list));
+
+        for (;;) {
+            chunk_batch *batch = queue_pop(&job->batches);
+            for (int i = 0; i < batch->count && status == 0; i++) {
+                batch_chunk *entry = &batch->chunks[i];
+                // Recherche dans l'index puis écriture dans le pack si le chunk est nouveau
+                const unsigned char *stored = entry->codec == CODEC_NONE ? batch->data + entry->offset
+                                                                          : batch->packed + entry->packed_offset;
+                size_t stored_size = entry->codec == CODEC_NONE ? entry->size : entry->packed_size;
+                if (store_put_compressed(store, entry->digest, entry->size, (codec_algo)entry->codec, stored, stored_size) < 0 ||
+                    chunk_list_append(&pipeline->lists, entry->digest, entry->size) != 0) {
+                    status = -1;
+                    store_failed = true;
+                }
+                list.file_size += entry->size;
+            }
+            bool last = batch->last;
+            if (last) {
+                if (batch->status != 0) {
+                    status = -1;
+                }
+                memcpy(list.file_digest, batch->file_digest, store->digest_len);
+            }
+            batch_free(pipeline, batch);
+            if (last) {
+                break;
+            }
+        }
+
+        // Les objets de liste d'un fichier en échec restent orphelins jusqu'au prochain nettoyage
+        if (status == 0 && chunk_list_finish(&pipeline->lists, &list) != 0) {
+            status = -1;
+            store_failed = true;
+        } else if (status != 0) {
+            chunk_list_discard(&pipeline->lists);
+        }
+        if (status == 0 && pipeline->done(job, &list, pipeline->done_arg) != 0) {
+            store_failed = true;
+        }
+        if (store_failed) {
+            if (!__atomic_exchange_n(&pipeline->store_failed, true, __ATOMIC_RELAXED)) {
+                fprintf(stderr, "Erreur : '%s' n'a pas pu être écrit dans le dépôt, la sauvegarde est abandonnée.\n",
+                        job->src_path);
+            }
+        } else if (status == 0) {
+            pipeline->files_done++;
+        } else {
+            fprintf(stderr, "Échec de la sauvegarde de '%s'.\n", job->src_path);
+            pipeline->files_failed++;
+        }
+        job_free(pipeline, job);
+    }
+    return NULL;
+}
+
+// Fin des lectures : le moteur de lecture anticipée s'arrête une fois tous ses fichiers rendus,
+// les lecteurs ensuite
+static void stop_readers(backup_pipeline *pipeline) {
+    queue_close(&pipeline->work_queue);
+    if (pipeline->prefetch) {
+        prefetch_finish(pipeline->prefetch);
+        pipeline->prefetch = NULL;
+        queue_close(&pipeline->ready_queue);
+    }
+    for (int i = 0; i < pipeline->worker_count; i++) {
+        pthread_join(pipeline->workers[i], NULL);
+    }
+}
+
+// Libération des files, des réserves et du tableau des threads (aussi pour un pipeline à moitié démarré)
+static void pipeline_release(backup_pipeline *pipeline) {
+    free(pipeline->workers);
+    pipeline->workers = NULL;
+    queue_destroy(&pipeline->work_queue);
+    queue_destroy(&pipeline->order_queue);
+    if (pipeline->ready_queue.items) {
+        queue_destroy(&pipeline->ready_queue);
+    }
+    buffer_pool_destroy(&pipeline->batch_pool);
+    buffer_pool_destroy(&pipeline->data_pool);
+    buffer_pool_destroy(&pipeline->job_pool);
+    chunk_list_builder_free(&pipeline->lists);
+}
+
+// Fonction pour démarrer les threads du pipeline
+int pipeline_start(backup_pipeline *pipeline, chunk_store_t *store, int workers, pipeline_done_fn done, void *done_arg) {
+    /* @param: workers est le nombre de threads de lecture/découpage/hachage (0 : un par processeur)
+    *           done est appelé par l'écrivain pour chaque fichier complet, dans l'ordre de soumission
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    memset(pipeline, 0, sizeof(*pipeline));
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    pipeline->store = store;
+    chunk_list_builder_init(&pipeline->lists, store);
+    pipeline->done = done;
+    pipeline->done_arg = done_arg;
+    pipeline->batch_bytes = PIPELINE_BATCH_BYTES;
+    if (pipeline->batch_bytes < store->chunker.max_size) {
+        pipeline->batch_bytes = store->chunker.max_size;
+    }
+    // Un lot contient au plus batch_bytes / min_size chunks (plus le dernier, plus court)
+    pipeline->batch_capacity = (int)(pipeline->batch_bytes / store->chunker.min_size) + 1;
+
+    // Les réserves gardent de quoi couvrir les lots en attente de chaque lecteur et tous les fichiers en vol ;
+    // un tampon rendu au-delà est libéré, la mémoire reste donc bornée
+    size_t batches = (size_t)workers * (PIPELINE_BATCH_QUEUE + 2);
+    if (buffer_pool_init(&pipeline->batch_pool, sizeof(chunk_batch) + sizeof(batch_chunk) * pipeline->batch_capacity,
+                         64, batches) != 0 ||
+        buffer_pool_init(&pipeline->data_pool, pipeline->batch_bytes, POOL_IO_ALIGN,
+                         store->codec.algo != CODEC_NONE ? 2 * batches : batches) != 0 ||
+        buffer_pool_init(&pipeline->job_pool, PIPELINE_JOB_BYTES, 64, PIPELINE_JOB_QUEUE + (size_t)workers + 1) != 0 ||
+        queue_init(&pipeline->work_queue, PIPELINE_JOB_QUEUE) != 0 ||
+        queue_init(&pipeline->order_queue, PIPELINE_JOB_QUEUE) != 0) {
+        pipeline_release(pipeline);
+        return -1;
+    }
+    pipeline->work_queue.metric = METRIC_QUEUE_FILES;
+
+    // Lecture anticipée : le moteur d'E/S prend les fichiers de work_queue et les remet ouverts aux lecteurs
+    if (io_backend_choice != IO_BACKEND_SYNC &&
+        (queue_init(&pipeline->ready_queue, PREFETCH_MAX_FILES) != 0 ||
+         prefetch_start(&pipeline->prefetch, io_backend_choice, &pipeline->work_queue, &pipeline->ready_queue,
+                        job_source) != 0)) {
+        pipeline_release(pipeline);
+        return -1;
+    }
+    pipeline->workers = malloc(sizeof(pthread_t) * workers);
+    if (!pipeline->workers) {
+        perror("Erreur d'allocation mémoire pour les threads");
+        stop_readers(pipeline);
+        pipeline_release(pipeline);
+        return -1;
+    }
+
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&pipeline->workers[i], NULL, worker_main, pipeline) != 0) {
+            perror("Erreur lors de la création d'un thread de lecture");
+            break;
+        }
+        pipeline->worker_count++;
+    }
+    if (pipeline->worker_count == 0 || pthread_create(&pipeline->writer, NULL, writer_main, pipeline) != 0) {
+        perror("Erreur lors du démarrage du pipeline");
+        stop_readers(pipeline);
+        pipeline_release(pipeline);
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour confier un fichier au pipeline (dans l'ordre du parcours)
+int pipeline_submit(backup_pipeline *pipeline, const char *src_path, const char *path, const struct stat *st) {
+    // Inutile de lire d'autres fichiers : la sauvegarde ne sera pas enregistrée
+    if (__atomic_load_n(&pipeline->store_failed, __ATOMIC_RELAXED)) {
+        return -1;
+    }
+    backup_job *job = job_new(pipeline, src_path, path);
+    if (!job) {
+        perror("Erreur d'allocation mémoire pour un fichier à sauvegarder");
+        return -1;
+    }
+    job->st = *st;
+
+    // L'ordre des fichiers pour l'écrivain est réservé avant qu'un lecteur ne puisse le prendre ;
+    // la file d'ordre étant bornée, le parcours ne prend jamais trop d'avance
+    queue_push(&pipeline->order_queue, job);
+    queue_push(&pipeline->work_queue, job);
+    return 0;
+}
+
+// Fonction pour attendre la fin du pipeline, renvoie le nombre de fichiers illisibles
+uint64_t pipeline_finish(backup_pipeline *pipeline) {
+    queue_close(&pipeline->order_queue);
+    stop_readers(pipeline);
+    pthread_join(pipeline->writer, NULL);
+
+    pipeline_release(pipeline);
+    return pipeline->files_failed;
+}
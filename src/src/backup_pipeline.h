@@ -0,0 +1,96 @@
+#ifndef BACKUP_PIPELINE_H
+#define BACKUP_PIPELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "queue.h"
+#include "pool.h"
+#include "prefetch.h"
+#include "chunk_store.h"
+#include "deduplication.h"
+
+// Taille des lots de chunks transmis des lecteurs à l'écrivain
+#define PIPELINE_BATCH_BYTES (4u * 1024u * 1024u)
+// Nombre de lots en attente par fichier : borne la mémoire d'un lecteur en avance
+#define PIPELINE_BATCH_QUEUE 4
+// Nombre de fichiers en vol entre le parcours et l'écrivain
+#define PIPELINE_JOB_QUEUE 256
+// Bloc recyclé d'un fichier en vol : sa structure et ses deux chemins
+#define PIPELINE_JOB_BYTES 4096
+
+// Chunk découpé et haché par un lecteur
+typedef struct {
+    unsigned char digest[DIGEST_MAX_LENGTH];
+    size_t offset; // Position des données dans le lot
+    uint32_t size;
+    uint32_t codec;        // Compression appliquée par le lecteur (CODEC_NONE : chunk brut)
+    size_t packed_offset;  // Position des données compressées dans packed
+    uint32_t packed_size;
+} batch_chunk;
+
+// Lot de chunks consécutifs d'un même fichier ; le tableau chunks suit la structure dans le même bloc
+typedef struct {
+    unsigned char *data;   // Données des chunks, à la suite (tampon aligné sur une page)
+    size_t used;           // Octets utilisés dans data
+    unsigned char *packed; // Données compressées des chunks (si la compression est active)
+    size_t packed_used;
+    batch_chunk *chunks;
+    int count;
+    int capacity;
+    bool last;             // Dernier lot du fichier
+    int status;            // 0, ou -1 si la lecture a échoué (dernier lot)
+    unsigned char file_digest[DIGEST_MAX_LENGTH]; // Digest du fichier (dernier lot)
+} chunk_batch;
+
+// Fichier à sauvegarder ; les chemins sont rangés à la suite de la structure
+typedef struct {
+    char *src_path;        // Fichier source
+    char *path;            // Chemin du fichier dans la sauvegarde (relatif à la source)
+    struct stat st;        // Métadonnées relevées par le parcours
+    bounded_queue batches; // Lots produits par le lecteur, consommés dans l'ordre par l'écrivain
+    void *batch_items[PIPELINE_BATCH_QUEUE]; // Tampon de la file batches
+    bool pooled;           // Bloc pris dans la réserve des fichiers (sinon alloué pour des chemins très longs)
+} backup_job;
+
+// Fonction appelée par l'écrivain quand la liste de chunks d'un fichier est rangée dans le dépôt
+typedef int (*pipeline_done_fn)(const backup_job *job, const chunk_list_ref *list, void *arg);
+
+// Pipeline de sauvegarde : parcours -> lecture/découpage/hachage (N threads) -> index/pack/log (1 thread)
+typedef struct {
+    chunk_store_t *store;
+    chunk_list_builder lists;  // Liste de chunks du fichier en cours, construite par l'écrivain au fil des chunks stockés
+    pipeline_done_fn done;
+    void *done_arg;
+    int worker_count;
+    pthread_t *workers;
+    pthread_t writer;
+    bounded_queue work_queue;  // Fichiers à lire, pris par le premier lecteur libre
+    bounded_queue order_queue; // Mêmes fichiers, dans l'ordre du parcours, pour l'écrivain
+    prefetcher *prefetch;      // Lecture anticipée (--io uring|threads) : elle prend work_queue
+    bounded_queue ready_queue; // Fichiers ouverts par la lecture anticipée, pris par les lecteurs
+    size_t batch_bytes;        // Capacité d'un lot (au moins la taille maximale d'un chunk)
+    int batch_capacity;        // Nombre maximal de chunks d'un lot
+    // Réserves recyclées : en régime établi, un fichier ou un chunk ne coûte aucune allocation
+    buffer_pool batch_pool;    // Structures des lots et leurs tableaux de chunks
+    buffer_pool data_pool;     // Données des lots, brutes et compressées
+    buffer_pool job_pool;      // Fichiers en vol
+    uint64_t files_done;
+    uint64_t files_failed;     // Fichiers illisibles, absents de la sauvegarde
+    bool store_failed;         // Écriture dans le dépôt impossible : la sauvegarde doit échouer
+} backup_pipeline;
+
+// Nombre de lecteurs (0 : un par processeur)
+extern int backup_jobs;
+
+// Fonction pour démarrer les threads du pipeline
+int pipeline_start(backup_pipeline *pipeline, chunk_store_t *store, int workers, pipeline_done_fn done, void *done_arg);
+// Fonction pour confier un fichier au pipeline (dans l'ordre du parcours), -1 si le dépôt a déjà échoué
+int pipeline_submit(backup_pipeline *pipeline, const char *src_path, const char *path, const struct stat *st);
+// Fonction pour attendre la fin du pipeline, renvoie le nombre de fichiers illisibles
+// (store_failed indique ensuite si le dépôt a échoué)
+uint64_t pipeline_finish(backup_pipeline *pipeline);
+
+#endif // BACKUP_PIPELINE_H
@@ -0,0 +1,1032 @@
+#define _GNU_SOURCE
+#include "backup_server.h"
+#include "backup_pipeline.h"
+#include "walker.h"
+#include "backup_manager.h"
+#include "catalog.h"
+#include "metrics.h"
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Trame reçue, en attente de traitement par un thread du groupe
+typedef struct server_task {
+    uint32_t type;
+    uint32_t length;
+    unsigned char *data;
+    struct server_task *next;
+} server_task;
+
+// Connexion d'un client. Ses trames sont traitées dans l'ordre, par un seul thread à la fois :
+// les réponses WANT suivent l'ordre des HAVE et le manifeste arrive après tous les chunks.
+typedef struct server_conn {
+    int fd;
+    atomic_int refs;             // Boucle, file des threads et liste des notifications
+    pthread_mutex_t lock;        // Protège les tâches, la sortie et les indicateurs partagés
+
+    // Lecture (thread de la boucle uniquement)
+    unsigned char header[sizeof(net_header)];
+    size_t header_got;
+    server_task *reading;        // Trame dont les données arrivent
+    size_t payload_got;
+    size_t payload_capacity;     // Place allouée pour ses données, qui grandit avec elles
+    uint32_t events;             // Événements epoll demandés
+    bool eof;                    // Le client a fermé ou la connexion est perdue
+    struct server_conn *prev, *next; // Connexions ouvertes
+
+    // Partagé entre la boucle et les threads (lock)
+    server_task *head, *tail;    // Trames à traiter, dans l'ordre d'arrivée
+    size_t queued_bytes;
+    bool paused;                 // Lecture suspendue : trop de trames ou de réponses en attente
+    bool scheduled;              // Dans la file des threads ou en cours de traitement
+    bool stalled;                // Traitement suspendu : le client ne lit pas assez vite les réponses
+    bool closing;                // Après ERROR ou BYE : fermer une fois la sortie envoyée
+    unsigned char *out;          // Réponses à envoyer
+    size_t out_used;
+    size_t out_sent;
+    size_t out_capacity;
+
+    // Protégés par le verrou du serveur
+    bool notified;
+    struct server_conn *ready_next;
+    struct server_conn *notify_next;
+
+    // Protocole (thread qui traite la connexion)
+    bool greeted;
+    unsigned char *scratch;      // Décompression des chunks reçus, réponses DATA
+    size_t scratch_size;
+    pack_reader reader;          // Lecture des packs pour les restaurations
+    unsigned char *want;         // Réponse WANT en construction
+    size_t want_size;
+    catalog_record record;       // Statistiques de la sauvegarde en cours, pour le catalogue
+    int64_t start_ns;            // Début de cette sauvegarde (horloge monotone)
+} server_conn;
+
+// État du serveur
+typedef struct {
+    const char *dest_dir;
+    chunk_store_t store;         // Dépôt partagé par tous les clients
+    unsigned char epoch[STORE_EPOCH_LENGTH]; // Génération du dépôt, fixe tant que le serveur le verrouille
+    pthread_rwlock_t index_lock; // Index du dépôt : les HAVE et les GET le lisent en parallèle
+    pthread_mutex_t write_lock;  // Écritures dans les packs et le catalogue, une à la fois
+    atomic_uint pack_id;         // Pack courant, le seul dont des données peuvent être encore en tampon
+    atomic_uint_fast64_t readable_end; // Fin des données du pack courant déjà lisibles par les GET
+    int epoll_fd;
+    int listen_fd;
+    int event_fd;                // Réveille la boucle quand un thread a des réponses prêtes
+    server_conn *conns;          // Connexions ouvertes (boucle)
+    server_conn *closed;         // Connexions fermées pendant le tour de boucle, libérées à la fin du tour
+    pthread_mutex_t lock;        // Protège les deux listes suivantes
+    pthread_cond_t ready_cond;
+    server_conn *ready_head;     // Connexions qui ont des trames à traiter
+    server_conn *ready_tail;
+    server_conn *notify_head;    // Connexions à revoir par la boucle
+    atomic_bool stopping;
+    pthread_t *workers;
+    int worker_count;
+} backup_server;
+
+static volatile sig_atomic_t server_stop;
+
+static void server_signal(int sig) {
+    (void)sig;
+    server_stop = 1;
+}
+
+static void conn_release(server_conn *conn) {
+    if (atomic_fetch_sub(&conn->refs, 1) != 1) {
+        return;
+    }
+    while (conn->head) {
+        server_task *task = conn->head;
+        conn->head = task->next;
+        free(task->data);
+        free(task);
+    }
+    if (conn->reading) {
+        free(conn->reading->data);
+        free(conn->reading);
+    }
+    pthread_mutex_destroy(&conn->lock);
+    pack_reader_free(&conn->reader);
+    free(conn->out);
+    free(conn->scratch);
+    free(conn->want);
+    free(conn);
+}
+
+// Demande à la boucle de revoir une connexion (réponses à envoyer, lecture à reprendre, fermeture)
+static void conn_notify(backup_server *server, server_conn *conn) {
+    pthread_mutex_lock(&server->lock);
+    bool wake = !conn->notified;
+    if (wake) {
+        conn->notified = true;
+        atomic_fetch_add(&conn->refs, 1);
+        conn->notify_next = server->notify_head;
+        server->notify_head = conn;
+    }
+    pthread_mutex_unlock(&server->lock);
+    if (wake) {
+        uint64_t one = 1;
+        if (write(server->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            perror("Erreur lors du réveil de la boucle du serveur");
+        }
+    }
+}
+
+// Ajout d'une réponse à la sortie de la connexion ; elle est envoyée par la boucle
+static int conn_reply(backup_server *server, server_conn *conn, uint32_t type, const void *data, size_t size) {
+    net_header header = {htonl((uint32_t)size), htonl(type)};
+    pthread_mutex_lock(&conn->lock);
+    if (conn->out_sent > 0) {
+        memmove(conn->out, conn->out + conn->out_sent, conn->out_used - conn->out_sent);
+        conn->out_used -= conn->out_sent;
+        conn->out_sent = 0;
+    }
+    size_t needed = conn->out_used + sizeof(header) + size;
+    if (needed > conn->out_capacity) {
+        size_t capacity = conn->out_capacity ? conn->out_capacity : 4096;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        unsigned char *out = realloc(conn->out, capacity);
+        if (!out) {
+            pthread_mutex_unlock(&conn->lock);
+            perror("Erreur d'allocation mémoire pour une réponse");
+            return -1;
+        }
+        conn->out = out;
+        conn->out_capacity = capacity;
+    }
+    memcpy(conn->out + conn->out_used, &header, sizeof(header));
+    if (size > 0) {
+        memcpy(conn->out + conn->out_used + sizeof(header), data, size);
+    }
+    conn->out_used = needed;
+    pthread_mutex_unlock(&conn->lock);
+    conn_notify(server, conn);
+    return 0;
+}
+
+// Message d'erreur envoyé au client ; la connexion est fermée ensuite
+static int server_error(backup_server *server, server_conn *conn, const char *message) {
+    fprintf(stderr, "Client refusé : %s\n", message);
+    conn_reply(server, conn, NET_ERROR, message, strlen(message));
+    pthread_mutex_lock(&conn->lock);
+    conn->closing = true;
+    pthread_mutex_unlock(&conn->lock);
+    return -1;
+}
+
+// Agrandissement du tampon de travail de la connexion
+static int conn_scratch(server_conn *conn, size_t size) {
+    if (size <= conn->scratch_size) {
+        return 0;
+    }
+    unsigned char *buffer = realloc(conn->scratch, size);
+    if (!buffer) {
+        return -1;
+    }
+    conn->scratch = buffer;
+    conn->scratch_size = size;
+    return 0;
+}
+
+// Vérification qu'un chunk reçu correspond bien à son digest avant de l'écrire dans le dépôt
+static int verify_chunk(const chunk_store_t *store, server_conn *conn, const unsigned char *digest, uint32_t size,
+                        codec_algo codec, const unsigned char *data, size_t stored_size) {
+    const unsigned char *raw = data;
+    if (codec != CODEC_NONE) {
+        if (!codec_available(codec) || store->version < 2) {
+            return -1;
+        }
+        if (conn_scratch(conn, size) != 0) {
+            return -1;
+        }
+        if (codec_decompress(codec, data, stored_size, conn->scratch, size) != 0) {
+            return -1;
+        }
+        raw = conn->scratch;
+    } else if (stored_size != size) {
+        return -1;
+    }
+
+    unsigned char check[DIGEST_MAX_LENGTH];
+    if (compute_hash(store->hash, raw, size, check) != 0) {
+        return -1;
+    }
+    return memcmp(check, digest, store->digest_len) == 0 ? 0 : -1;
+}
+
+// Lecture d'une horloge en nanosecondes
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Début d'une sauvegarde sur la connexion : les chunks écrits ensuite lui sont comptés
+static void conn_start_backup(server_conn *conn) {
+    memset(&conn->record, 0, sizeof(conn->record));
+    conn->record.start_ns = clock_ns(CLOCK_REALTIME);
+    conn->start_ns = clock_ns(CLOCK_MONOTONIC);
+}
+
+// Enregistrement d'une sauvegarde reçue : son répertoire ne contient que le manifeste
+static int commit_backup(backup_server *server, server_conn *conn, const server_task *task) {
+    chunk_store_t *store = &server->store;
+    if (task->length != NET_NAME_MAX + sizeof(snapshot_manifest)) {
+        return server_error(server, conn, "manifeste invalide");
+    }
+    char name[NET_NAME_MAX];
+    memcpy(name, task->data, NET_NAME_MAX);
+    name[NET_NAME_MAX - 1] = '\0';
+    // Le nom devient un répertoire de la destination : ni chemin, ni entrée cachée
+    if (name[0] == '\0' || name[0] == '.' || strchr(name, '/')) {
+        return server_error(server, conn, "nom de sauvegarde invalide");
+    }
+
+    snapshot_manifest manifest;
+    memcpy(&manifest, task->data + NET_NAME_MAX, sizeof(manifest));
+    if (memcmp(manifest.magic, SNAPSHOT_MANIFEST_MAGIC, sizeof(manifest.magic)) != 0 ||
+        manifest.digest_len != store->digest_len || manifest.hash != (uint8_t)store->hash) {
+        return server_error(server, conn, "manifeste invalide");
+    }
+    pthread_rwlock_rdlock(&server->index_lock);
+    int present = store_lookup(store, manifest.root, NULL);
+    pthread_rwlock_unlock(&server->index_lock);
+    // Les objets reçus doivent être dans les packs avant que le manifeste ne les référence
+    pthread_mutex_lock(&server->write_lock);
+    int flushed = store_flush(store);
+    if (flushed == 0) {
+        atomic_store(&server->readable_end, store->pack_size);
+    }
+    pthread_mutex_unlock(&server->write_lock);
+    if (!present) {
+        return server_error(server, conn, "arbre racine absent du dépôt");
+    }
+    if (flushed != 0) {
+        return server_error(server, conn, "écriture du dépôt impossible");
+    }
+
+    char *backup_path = walk_join(server->dest_dir, name);
+    char *manifest_path = backup_path ? walk_join(backup_path, SNAPSHOT_MANIFEST_NAME) : NULL;
+    int status = 0;
+    if (!manifest_path) {
+        status = server_error(server, conn, "mémoire insuffisante");
+    } else if (mkdir(backup_path, 0755) != 0) {
+        status = server_error(server, conn, "impossible de créer la sauvegarde");
+    } else if (snapshot_manifest_write(manifest_path, &manifest) != 0) {
+        rmdir(backup_path);
+        status = server_error(server, conn, "impossible d'écrire la sauvegarde");
+    }
+    free(manifest_path);
+    free(backup_path);
+    if (status != 0) {
+        return status;
+    }
+    // Statistiques de la sauvegarde dans le catalogue de la destination
+    catalog_record *record = &conn->record;
+    snprintf(record->name, sizeof(record->name), "%s", name);
+    record->duration_ns = (uint64_t)(clock_ns(CLOCK_MONOTONIC) - conn->start_ns);
+    record->file_count = manifest.file_count;
+    record->tree_count = manifest.tree_count;
+    record->logical_bytes = manifest.total_size;
+    pthread_mutex_lock(&server->write_lock);
+    catalog_append(store->path, record);
+    pthread_mutex_unlock(&server->write_lock);
+    conn_start_backup(conn);
+
+    printf("Sauvegarde %s reçue (%llu fichiers).\n", name, (unsigned long long)manifest.file_count);
+    fflush(stdout);
+    return conn_reply(server, conn, NET_DONE, NULL, 0);
+}
+
+// Ouverture d'une sauvegarde à restaurer : le client reçoit son nom et son manifeste
+static int open_backup(backup_server *server, server_conn *conn, const server_task *task) {
+    char *last = NULL;
+    const char *name = (const char *)task->data;
+    if (task->length == 0) {
+        name = last = find_last_backup(server->dest_dir);
+        if (!last) {
+            return server_error(server, conn, "aucune sauvegarde sur le serveur");
+        }
+    }
+    if (strlen(name) >= NET_NAME_MAX || name[0] == '.' || strchr(name, '/')) {
+        free(last);
+        return server_error(server, conn, "nom de sauvegarde invalide");
+    }
+
+    unsigned char reply[NET_NAME_MAX + sizeof(snapshot_manifest)] = {0};
+    memcpy(reply, name, strlen(name));
+    char *backup_path = walk_join(server->dest_dir, name);
+    char *manifest_path = backup_path ? walk_join(backup_path, SNAPSHOT_MANIFEST_NAME) : NULL;
+    snapshot_manifest manifest;
+    int status = manifest_path && snapshot_manifest_read(manifest_path, &manifest) == 0 ? 0 : -1;
+    free(manifest_path);
+    free(backup_path);
+    free(last);
+    if (status != 0) {
+        return server_error(server, conn, "sauvegarde introuvable");
+    }
+    memcpy(reply + NET_NAME_MAX, &manifest, sizeof(manifest));
+    return conn_reply(server, conn, NET_MANIFEST, reply, sizeof(reply));
+}
+
+// Données d'un objet rendues lisibles dans son pack : seul le pack courant peut en garder en tampon, et il
+// n'est vidé que si l'objet n'est pas encore écrit
+static int make_readable(backup_server *server, const chunk_location *location) {
+    uint64_t end = location->offset + location->stored_size;
+    if (location->pack_id != atomic_load(&server->pack_id) || end <= atomic_load(&server->readable_end)) {
+        return 0;
+    }
+    int status = 0;
+    pthread_mutex_lock(&server->write_lock);
+    if (location->pack_id == server->store.pack_id && end > atomic_load(&server->readable_end)) {
+        status = store_flush(&server->store);
+        if (status == 0) {
+            atomic_store(&server->readable_end, server->store.pack_size);
+        }
+    }
+    pthread_mutex_unlock(&server->write_lock);
+    return status;
+}
+
+// Envoi des objets demandés, tels qu'ils sont stockés : un chunk compressé part compressé
+static int send_objects(backup_server *server, server_conn *conn, const server_task *task) {
+    chunk_store_t *store = &server->store;
+    size_t digest_len = store->digest_len;
+    size_t header = digest_len + 2 * sizeof(uint32_t);
+    if (task->length % digest_len != 0) {
+        return server_error(server, conn, "lot de digests invalide");
+    }
+    for (size_t i = 0; i < task->length / digest_len; i++) {
+        const unsigned char *digest = task->data + i * digest_len;
+        chunk_location location;
+        pthread_rwlock_rdlock(&server->index_lock);
+        int present = store_lookup(store, digest, &location);
+        pthread_rwlock_unlock(&server->index_lock);
+        if (!present) {
+            return server_error(server, conn, "objet absent du dépôt");
+        }
+        if (make_readable(server, &location) != 0) {
+            return server_error(server, conn, "écriture du dépôt impossible");
+        }
+        if (location.stored_size > NET_MAX_FRAME - header) {
+            return server_error(server, conn, "objet trop grand pour une trame");
+        }
+
+        // Réponse construite dans le tampon de la connexion : en-tête DATA puis données lues du pack
+        if (conn_scratch(conn, header + location.stored_size) != 0) {
+            return server_error(server, conn, "mémoire insuffisante");
+        }
+        memcpy(conn->scratch, digest, digest_len);
+        net_put_u32(conn->scratch + digest_len, location.size);
+        net_put_u32(conn->scratch + digest_len + 4, location.codec);
+        if (store_read_stored(store, &conn->reader, &location, conn->scratch + header) != 0) {
+            return server_error(server, conn, "objet illisible");
+        }
+        if (conn_reply(server, conn, NET_DATA, conn->scratch, header + location.stored_size) != 0) {
+            return server_error(server, conn, "mémoire insuffisante");
+        }
+    }
+    return 0;
+}
+
+// Traitement d'une trame par un thread du groupe
+static int handle_task(backup_server *server, server_conn *conn, const server_task *task) {
+    chunk_store_t *store = &server->store;
+    size_t digest_len = store->digest_len;
+
+    // Première trame : signature et version, puis la configuration du dépôt
+    if (!conn->greeted) {
+        if (task->type != NET_HELLO || task->length != 2 * sizeof(uint32_t) || net_get_u32(task->data) != NET_MAGIC) {
+            return server_error(server, conn, "protocole inconnu");
+        }
+        if (net_get_u32(task->data + 4) != NET_VERSION) {
+            return server_error(server, conn, "version du protocole non supportée");
+        }
+        unsigned char config[sizeof(net_config)];
+        net_put_u32(config, (uint32_t)store->version);
+        net_put_u32(config + 4, (uint32_t)store->hash);
+        net_put_u32(config + 8, store->chunker.min_size);
+        net_put_u32(config + 12, store->chunker.avg_size);
+        net_put_u32(config + 16, store->chunker.max_size);
+        memcpy(config + 20, server->epoch, STORE_EPOCH_LENGTH);
+        conn->greeted = true;
+        conn_start_backup(conn);
+        return conn_reply(server, conn, NET_CONFIG, config, sizeof(config));
+    }
+
+    switch (task->type) {
+        case NET_HAVE: {
+            // Un bit par digest proposé : 1 si le chunk manque au dépôt
+            if (task->length % digest_len != 0) {
+                return server_error(server, conn, "lot de digests invalide");
+            }
+            size_t count = task->length / digest_len;
+            size_t size = (count + 7) / 8;
+            if (size > conn->want_size) {
+                unsigned char *want = realloc(conn->want, size);
+                if (!want) {
+                    return server_error(server, conn, "mémoire insuffisante");
+                }
+                conn->want = want;
+                conn->want_size = size;
+            }
+            memset(conn->want, 0, size);
+            pthread_rwlock_rdlock(&server->index_lock);
+            for (size_t i = 0; i < count; i++) {
+                if (!store_lookup(store, task->data + i * digest_len, NULL)) {
+                    conn->want[i / 8] |= (unsigned char)(1u << (i % 8));
+                }
+            }
+            pthread_rwlock_unlock(&server->index_lock);
+            return conn_reply(server, conn, NET_WANT, conn->want, size);
+        }
+        case NET_CHUNK: {
+            // Le digest est vérifié hors des verrous : seule l'écriture dans le pack est sérialisée, et
+            // l'index n'est verrouillé que le temps d'y ajouter le chunk (store->index_lock)
+            size_t chunk_header = digest_len + 2 * sizeof(uint32_t);
+            if (task->length < chunk_header) {
+                return server_error(server, conn, "chunk invalide");
+            }
+            const unsigned char *digest = task->data;
+            uint32_t size = net_get_u32(task->data + digest_len);
+            codec_algo codec = (codec_algo)net_get_u32(task->data + digest_len + 4);
+            const unsigned char *stored = task->data + chunk_header;
+            size_t stored_size = task->length - chunk_header;
+            if (size > NET_MAX_FRAME || verify_chunk(store, conn, digest, size, codec, stored, stored_size) != 0) {
+                return server_error(server, conn, "chunk corrompu");
+            }
+            pthread_mutex_lock(&server->write_lock);
+            int status = store_put_compressed(store, digest, size, codec, stored, stored_size);
+            if (store->pack_id != atomic_load(&server->pack_id)) {
+                // Nouveau pack : rien n'y est encore lisible, l'ancien a été vidé en le fermant
+                atomic_store(&server->readable_end, 0);
+                atomic_store(&server->pack_id, store->pack_id);
+            }
+            pthread_mutex_unlock(&server->write_lock);
+            if (status < 0) {
+                return server_error(server, conn, "écriture dans le dépôt impossible");
+            }
+            if (status == 1) {
+                conn->record.new_chunks++;
+                conn->record.new_bytes += size;
+                conn->record.stored_bytes += stored_size;
+            }
+            return 0;
+        }
+        case NET_COMMIT:
+            return commit_backup(server, conn, task);
+        case NET_OPEN:
+            return open_backup(server, conn, task);
+        case NET_GET:
+            return send_objects(server, conn, task);
+        case NET_BYE:
+            pthread_mutex_lock(&conn->lock);
+            conn->closing = true;
+            pthread_mutex_unlock(&conn->lock);
+            return 0;
+        default:
+            return server_error(server, conn, "trame inattendue");
+    }
+}
+
+// Thread du groupe : traite toutes les trames en attente d'une connexion, puis passe à la suivante
+static void *server_worker(void *arg) {
+    backup_server *server = arg;
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while (!server->ready_head && !atomic_load(&server->stopping)) {
+            pthread_cond_wait(&server->ready_cond, &server->lock);
+        }
+        server_conn *conn = server->ready_head;
+        if (atomic_load(&server->stopping) || !conn) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        server->ready_head = conn->ready_next;
+        if (!server->ready_head) {
+            server->ready_tail = NULL;
+        }
+        pthread_mutex_unlock(&server->lock);
+
+        for (;;) {
+            pthread_mutex_lock(&conn->lock);
+            server_task *task = conn->head;
+            if (!task || atomic_load(&server->stopping)) {
+                conn->scheduled = false;
+                pthread_mutex_unlock(&conn->lock);
+                break;
+            }
+            // Trop de réponses non lues par le client : la boucle relancera le traitement
+            if (conn->out_used - conn->out_sent > SERVER_CONN_HIGH_WATER) {
+                conn->scheduled = false;
+                conn->stalled = true;
+                pthread_mutex_unlock(&conn->lock);
+                break;
+            }
+            conn->head = task->next;
+            if (!conn->head) {
+                conn->tail = NULL;
+            }
+            bool closing = conn->closing;
+            pthread_mutex_unlock(&conn->lock);
+
+            // Après une erreur, les trames restantes sont ignorées
+            if (!closing) {
+                handle_task(server, conn, task);
+            }
+
+            pthread_mutex_lock(&conn->lock);
+            conn->queued_bytes -= task->length;
+            bool resume = conn->paused && conn->queued_bytes < SERVER_CONN_LOW_WATER;
+            pthread_mutex_unlock(&conn->lock);
+            free(task->data);
+            free(task);
+            if (resume) {
+                conn_notify(server, conn);
+            }
+        }
+        // La boucle décide de la suite : reprise de la lecture ou fermeture
+        conn_notify(server, conn);
+        conn_release(conn);
+    }
+    return NULL;
+}
+
+// Ajout de la connexion à la file des threads (l'appelant vient de passer scheduled à vrai)
+static void conn_schedule(backup_server *server, server_conn *conn) {
+    atomic_fetch_add(&conn->refs, 1);
+    pthread_mutex_lock(&server->lock);
+    conn->ready_next = NULL;
+    if (server->ready_tail) {
+        server->ready_tail->ready_next = conn;
+    } else {
+        server->ready_head = conn;
+    }
+    server->ready_tail = conn;
+    pthread_cond_signal(&server->ready_cond);
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Ajout d'une trame complète aux tâches de la connexion
+static void conn_push_task(backup_server *server, server_conn *conn, server_task *task) {
+    pthread_mutex_lock(&conn->lock);
+    if (conn->tail) {
+        conn->tail->next = task;
+    } else {
+        conn->head = task;
+    }
+    conn->tail = task;
+    conn->queued_bytes += task->length;
+    if (conn->queued_bytes > SERVER_CONN_HIGH_WATER) {
+        conn->paused = true;
+    }
+    bool schedule = !conn->scheduled && !conn->stalled;
+    conn->scheduled = conn->scheduled || schedule;
+    pthread_mutex_unlock(&conn->lock);
+
+    if (schedule) {
+        conn_schedule(server, conn);
+    }
+}
+
+static void conn_close(backup_server *server, server_conn *conn) {
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        server->conns = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    // D'autres événements du même tour peuvent encore désigner la connexion
+    conn->next = server->closed;
+    server->closed = conn;
+}
+
+// Libération des connexions fermées pendant le tour de boucle
+static void release_closed(backup_server *server) {
+    while (server->closed) {
+        server_conn *conn = server->closed;
+        server->closed = conn->next;
+        conn_release(conn);
+    }
+}
+
+// Envoi de la sortie en attente, sans bloquer
+static void conn_flush(server_conn *conn) {
+    pthread_mutex_lock(&conn->lock);
+    while (conn->out_sent < conn->out_used) {
+        uint64_t start = metrics_start();
+        ssize_t sent = send(conn->fd, conn->out + conn->out_sent, conn->out_used - conn->out_sent,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn->eof = true;
+            }
+            break;
+        }
+        metrics_stop(METRIC_NET_SEND, start, (uint64_t)sent);
+        conn->out_sent += (size_t)sent;
+    }
+    if (conn->out_sent == conn->out_used) {
+        conn->out_sent = conn->out_used = 0;
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+// Mise à jour d'une connexion par la boucle : envoi, contre-pression, événements epoll, fermeture
+static void conn_service(backup_server *server, server_conn *conn) {
+    if (conn->fd < 0) {
+        return;
+    }
+    conn_flush(conn);
+
+    pthread_mutex_lock(&conn->lock);
+    size_t pending_out = conn->out_used - conn->out_sent;
+    if (!conn->paused && pending_out > SERVER_CONN_HIGH_WATER) {
+        conn->paused = true;
+    } else if (conn->paused && conn->queued_bytes < SERVER_CONN_LOW_WATER && pending_out < SERVER_CONN_LOW_WATER) {
+        conn->paused = false;
+    }
+    bool paused = conn->paused;
+    bool done = (conn->closing || conn->eof) && !conn->scheduled && (pending_out == 0 || conn->eof);
+    bool closing = conn->closing;
+    // Les réponses ont été lues : le traitement suspendu reprend
+    bool resume = !done && conn->stalled && pending_out < SERVER_CONN_LOW_WATER;
+    if (resume) {
+        conn->stalled = false;
+        resume = conn->head != NULL;
+        conn->scheduled = resume;
+    }
+    pthread_mutex_unlock(&conn->lock);
+
+    if (done) {
+        conn_close(server, conn);
+        return;
+    }
+    if (resume) {
+        conn_schedule(server, conn);
+    }
+    uint32_t events = (!paused && !closing && !conn->eof ? EPOLLIN : 0) | (pending_out > 0 && !conn->eof ? EPOLLOUT : 0);
+    if (events != conn->events) {
+        struct epoll_event event = {0};
+        event.events = events;
+        event.data.ptr = conn;
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+        conn->events = events;
+    }
+}
+
+// Agrandissement de la trame en cours de réception, jusqu'à sa taille annoncée
+static int grow_payload(server_conn *conn) {
+    size_t length = conn->reading->length;
+    size_t capacity = conn->payload_capacity * 2;
+    if (capacity > length) {
+        capacity = length;
+    }
+    unsigned char *data = realloc(conn->reading->data, capacity + 1);
+    if (!data) {
+        return -1;
+    }
+    conn->reading->data = data;
+    conn->payload_capacity = capacity;
+    return 0;
+}
+
+// Lecture sans blocage des trames d'un client ; chaque trame complète devient une tâche
+static void conn_read(backup_server *server, server_conn *conn) {
+    for (;;) {
+        pthread_mutex_lock(&conn->lock);
+        bool stop = conn->paused || conn->closing;
+        pthread_mutex_unlock(&conn->lock);
+        if (stop) {
+            break;
+        }
+
+        ssize_t got;
+        uint64_t start = metrics_start();
+        if (!conn->reading) {
+            got = recv(conn->fd, conn->header + conn->header_got, sizeof(conn->header) - conn->header_got, 0);
+        } else {
+            if (conn->payload_got == conn->payload_capacity && grow_payload(conn) != 0) {
+                server_error(server, conn, "mémoire insuffisante");
+                break;
+            }
+            got = recv(conn->fd, conn->reading->data + conn->payload_got, conn->payload_capacity - conn->payload_got, 0);
+        }
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (got <= 0) {
+            conn->eof = true;
+            break;
+        }
+        metrics_stop(METRIC_NET_RECV, start, (uint64_t)got);
+
+        if (!conn->reading) {
+            conn->header_got += (size_t)got;
+            if (conn->header_got < sizeof(conn->header)) {
+                continue;
+            }
+            // En-tête complet : les données sont reçues directement dans la trame, dont la place grandit
+            // avec ce qui arrive. Un en-tête seul n'engage pas NET_MAX_FRAME octets : la mémoire d'une
+            // connexion reste celle des données déjà envoyées, que la contre-pression borne.
+            net_header header;
+            memcpy(&header, conn->header, sizeof(header));
+            conn->header_got = 0;
+            uint32_t length = ntohl(header.length);
+            if (length > NET_MAX_FRAME) {
+                server_error(server, conn, "trame trop grande");
+                break;
+            }
+            size_t capacity = length < SERVER_FRAME_STEP ? length : SERVER_FRAME_STEP;
+            server_task *task = calloc(1, sizeof(server_task));
+            if (!task || !(task->data = malloc(capacity + 1))) {
+                free(task);
+                server_error(server, conn, "mémoire insuffisante");
+                break;
+            }
+            task->type = ntohl(header.type);
+            task->length = length;
+            conn->reading = task;
+            conn->payload_got = 0;
+            conn->payload_capacity = capacity;
+        } else {
+            conn->payload_got += (size_t)got;
+        }
+
+        if (conn->payload_got == conn->reading->length) {
+            conn->reading->data[conn->reading->length] = '\0';
+            conn_push_task(server, conn, conn->reading);
+            conn->reading = NULL;
+        }
+    }
+    conn_service(server, conn);
+}
+
+// Acceptation de tous les clients en attente
+static void server_accept(backup_server *server) {
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Échec de l'acceptation");
+            }
+            return;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        server_conn *conn = calloc(1, sizeof(server_conn));
+        if (!conn) {
+            perror("Erreur d'allocation mémoire pour une connexion");
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        atomic_init(&conn->refs, 1);
+        pthread_mutex_init(&conn->lock, NULL);
+        pack_reader_init(&conn->reader);
+        conn->events = EPOLLIN;
+        struct epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            perror("Erreur lors de l'ajout d'une connexion à epoll");
+            close(fd);
+            conn_release(conn);
+            continue;
+        }
+        conn->next = server->conns;
+        if (server->conns) {
+            server->conns->prev = conn;
+        }
+        server->conns = conn;
+    }
+}
+
+// Connexions signalées par les threads depuis le dernier réveil
+static void server_notified(backup_server *server) {
+    uint64_t count;
+    if (read(server->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("Erreur de lecture de l'eventfd");
+    }
+    pthread_mutex_lock(&server->lock);
+    server_conn *conn = server->notify_head;
+    server->notify_head = NULL;
+    pthread_mutex_unlock(&server->lock);
+
+    while (conn) {
+        // Une connexion à nouveau notifiée réutilise notify_next : il est lu avant de lever notified
+        pthread_mutex_lock(&server->lock);
+        server_conn *next = conn->notify_next;
+        conn->notified = false;
+        pthread_mutex_unlock(&server->lock);
+        conn_service(server, conn);
+        conn_release(conn);
+        conn = next;
+    }
+}
+
+// Préparation de la socket d'écoute, de l'eventfd et de l'instance epoll
+static int server_listen(backup_server *server, int port) {
+    server->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0) {
+        perror("Échec de la création de la socket");
+        return -1;
+    }
+    int one = 1;
+    setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons((uint16_t)port);
+    if (bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(server->listen_fd, SOMAXCONN) < 0) {
+        perror("Échec de la mise en écoute");
+        return -1;
+    }
+
+    server->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->event_fd < 0 || server->epoll_fd < 0) {
+        perror("Erreur lors de la création de la boucle d'événements");
+        return -1;
+    }
+    // Les deux descripteurs du serveur sont reconnus par l'adresse de leur champ
+    struct epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.ptr = &server->listen_fd;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event) != 0) {
+        perror("Erreur lors de l'ajout de la socket d'écoute à epoll");
+        return -1;
+    }
+    event.data.ptr = &server->event_fd;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->event_fd, &event) != 0) {
+        perror("Erreur lors de l'ajout de l'eventfd à epoll");
+        return -1;
+    }
+    return 0;
+}
+
+// Arrêt du serveur : les threads terminent leur trame en cours, les connexions sont fermées
+static void server_shutdown(backup_server *server) {
+    pthread_mutex_lock(&server->lock);
+    atomic_store(&server->stopping, true);
+    pthread_cond_broadcast(&server->ready_cond);
+    pthread_mutex_unlock(&server->lock);
+    for (int i = 0; i < server->worker_count; i++) {
+        pthread_join(server->workers[i], NULL);
+    }
+    free(server->workers);
+
+    // Les références des files sont rendues avant de fermer les connexions
+    for (server_conn *conn = server->ready_head, *next; conn; conn = next) {
+        next = conn->ready_next;
+        conn_release(conn);
+    }
+    for (server_conn *conn = server->notify_head, *next; conn; conn = next) {
+        next = conn->notify_next;
+        conn_release(conn);
+    }
+    while (server->conns) {
+        conn_close(server, server->conns);
+    }
+    release_closed(server);
+
+    if (server->epoll_fd >= 0) {
+        close(server->epoll_fd);
+    }
+    if (server->event_fd >= 0) {
+        close(server->event_fd);
+    }
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+    }
+    pthread_cond_destroy(&server->ready_cond);
+    pthread_mutex_destroy(&server->lock);
+    pthread_rwlock_destroy(&server->index_lock);
+    pthread_mutex_destroy(&server->write_lock);
+    store_close(&server->store);
+}
+
+// Fonction pour servir les sauvegardes distantes dans un répertoire de destination
+int serve_backups(const char *dest_dir, int port) {
+    /* @param: dest_dir reçoit les sauvegardes et leur dépôt de chunks, comme une destination locale
+    *           port est le port TCP d'écoute
+    *  @return: 0 après un arrêt demandé par SIGINT ou SIGTERM, -1 en cas d'erreur
+    */
+    backup_server server;
+    memset(&server, 0, sizeof(server));
+    server.dest_dir = dest_dir;
+    server.epoll_fd = server.listen_fd = server.event_fd = -1;
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_rwlock_init(&server.index_lock, NULL);
+    pthread_mutex_init(&server.write_lock, NULL);
+    pthread_cond_init(&server.ready_cond, NULL);
+
+    // Un seul dépôt pour tous les clients : un chunk envoyé par l'un n'est plus demandé aux autres
+    if (store_open(&server.store, dest_dir) != 0 || store_epoch(&server.store, server.epoch) != 0) {
+        server_shutdown(&server);
+        return -1;
+    }
+    server.store.index_lock = &server.index_lock;
+    atomic_store(&server.pack_id, server.store.pack_id);
+    atomic_store(&server.readable_end, server.store.pack_size);
+    if (server_listen(&server, port) != 0) {
+        server_shutdown(&server);
+        return -1;
+    }
+
+    int workers = backup_jobs;
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    server.workers = malloc(sizeof(pthread_t) * workers);
+    if (!server.workers) {
+        perror("Erreur d'allocation mémoire pour les threads");
+        server_shutdown(&server);
+        return -1;
+    }
+    for (; server.worker_count < workers; server.worker_count++) {
+        if (pthread_create(&server.workers[server.worker_count], NULL, server_worker, &server) != 0) {
+            perror("Erreur lors de la création d'un thread du serveur");
+            server_shutdown(&server);
+            return -1;
+        }
+    }
+
+    // Arrêt propre sur SIGINT/SIGTERM : epoll_wait est interrompu (pas de SA_RESTART)
+    struct sigaction action = {0};
+    action.sa_handler = server_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    printf("Serveur de sauvegarde en écoute sur le port %d (destination %s, %d threads).\n", port, dest_dir, workers);
+    fflush(stdout);
+
+    int status = 0;
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!server_stop) {
+        int count = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erreur de la boucle d'événements");
+            status = -1;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            void *ptr = events[i].data.ptr;
+            if (ptr == &server.listen_fd) {
+                server_accept(&server);
+            } else if (ptr == &server.event_fd) {
+                server_notified(&server);
+            } else {
+                server_conn *conn = ptr;
+                if (conn->fd < 0) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    conn_read(&server, conn);
+                } else {
+                    conn_service(&server, conn);
+                }
+            }
+        }
+        release_closed(&server);
+    }
+
+    printf("Arrêt du serveur de sauvegarde.\n");
+    server_shutdown(&server);
+    return status;
+}
@@ -0,0 +1,22 @@
+#ifndef BACKUP_SERVER_H
+#define BACKUP_SERVER_H
+
+#include "network.h"
+
+// Serveur de sauvegarde : une boucle epoll lit les trames de tous les clients sans bloquer,
+// un groupe de threads vérifie et écrit les chunks dans le dépôt partagé de la destination.
+
+// Au-delà de ce volume de trames en attente (ou de réponses non lues par le client),
+// la connexion n'est plus lue : la fenêtre TCP se remplit et le client ralentit
+#define SERVER_CONN_HIGH_WATER (32u * 1024u * 1024u)
+// La lecture reprend quand le volume en attente redescend sous ce seuil
+#define SERVER_CONN_LOW_WATER (8u * 1024u * 1024u)
+// Place allouée au début d'une trame reçue, doublée au fil de ses données
+#define SERVER_FRAME_STEP (1024u * 1024u)
+// Nombre maximal d'événements traités par tour de boucle
+#define SERVER_MAX_EVENTS 64
+
+// Fonction pour servir les sauvegardes distantes dans un répertoire de destination
+int serve_backups(const char *dest_dir, int port);
+
+#endif // BACKUP_SERVER_H
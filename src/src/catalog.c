@@ -0,0 +1,192 @@
+#include "catalog.h"
+#include "walker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Écriture complète d'un bloc (les écritures partielles sont reprises)
+static int write_all(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t written = write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+// Fonction pour ajouter l'enregistrement d'une sauvegarde au catalogue d'un dépôt
+int catalog_append(const char *store_path, const catalog_record *record) {
+    /* @param: store_path est le répertoire du dépôt (.store)
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    char *path = walk_join(store_path, CATALOG_NAME);
+    if (!path) {
+        return -1;
+    }
+    // Un arrêt brutal pendant un ajout laisse un enregistrement incomplet en fin de fichier : il est retiré
+    // (fichier ramené à un nombre entier d'enregistrements, mis sur disque) avant d'écrire le suivant,
+    // sans quoi tous les enregistrements ajoutés ensuite seraient décalés
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    free(path);
+    if (fd < 0) {
+        perror("Erreur lors de l'ouverture du catalogue");
+        return -1;
+    }
+    struct stat st;
+    int status = fstat(fd, &st);
+    uint64_t size = status == 0 ? (uint64_t)st.st_size : 0;
+    uint64_t valid = 0;
+    if (size >= sizeof(catalog_header)) {
+        valid = sizeof(catalog_header) + (size - sizeof(catalog_header)) / sizeof(catalog_record) * sizeof(catalog_record);
+    }
+    if (status == 0 && valid != size) {
+        fprintf(stderr, "Enregistrement incomplet en fin de catalogue ignoré (%llu octets).\n",
+                (unsigned long long)(size - valid));
+        status = ftruncate(fd, (off_t)valid) == 0 && fsync(fd) == 0 ? 0 : -1;
+    }
+    if (status == 0 && lseek(fd, (off_t)valid, SEEK_SET) < 0) {
+        status = -1;
+    }
+    if (status == 0 && valid == 0) {
+        catalog_header header = {.version = CATALOG_VERSION, .record_size = sizeof(catalog_record)};
+        memcpy(header.magic, CATALOG_MAGIC, CATALOG_MAGIC_LENGTH);
+        status = write_all(fd, &header, sizeof(header));
+    }
+    // L'enregistrement est écrit d'un seul appel en fin de fichier
+    if (status == 0) {
+        status = write_all(fd, record, sizeof(*record));
+    }
+    if (status != 0) {
+        perror("Erreur lors de l'écriture du catalogue");
+    }
+    if (close(fd) != 0 && status == 0) {
+        perror("Erreur lors de la fermeture du catalogue");
+        status = -1;
+    }
+    return status;
+}
+
+// Fonction pour remplacer le catalogue d'un dépôt (après la suppression de sauvegardes)
+int catalog_write(const char *store_path, const catalog_t *catalog) {
+    /* @param: catalog contient les enregistrements à conserver
+    *  @return: 0 en cas de succès, -1 sinon (l'ancien catalogue reste en place)
+    */
+    char *path = walk_join(store_path, CATALOG_NAME);
+    char *tmp_path = walk_join(store_path, CATALOG_NAME ".tmp");
+    if (!path || !tmp_path) {
+        free(path);
+        free(tmp_path);
+        return -1;
+    }
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int status = fd < 0 ? -1 : 0;
+    if (status == 0) {
+        catalog_header header = {.version = CATALOG_VERSION, .record_size = sizeof(catalog_record)};
+        memcpy(header.magic, CATALOG_MAGIC, CATALOG_MAGIC_LENGTH);
+        status = write_all(fd, &header, sizeof(header));
+    }
+    if (status == 0 && catalog->count > 0) {
+        status = write_all(fd, catalog->records, catalog->count * sizeof(catalog_record));
+    }
+    if (fd >= 0 && close(fd) != 0) {
+        status = -1;
+    }
+    if (status == 0 && rename(tmp_path, path) != 0) {
+        status = -1;
+    }
+    if (status != 0) {
+        perror("Erreur lors de l'écriture du catalogue");
+        unlink(tmp_path);
+    }
+    free(path);
+    free(tmp_path);
+    return status;
+}
+
+static int compare_records(const void *a, const void *b) {
+    return strncmp(((const catalog_record *)a)->name, ((const catalog_record *)b)->name, CATALOG_NAME_MAX);
+}
+
+// Fonction pour charger le catalogue d'un dépôt (vide s'il n'existe pas)
+int catalog_load(catalog_t *catalog, const char *store_path) {
+    /* @return: 0 en cas de succès (catalogue vide s'il est absent ou invalide), -1 en cas d'erreur de lecture
+    */
+    catalog->records = NULL;
+    catalog->count = 0;
+    char *path = walk_join(store_path, CATALOG_NAME);
+    if (!path) {
+        return -1;
+    }
+    FILE *file = fopen(path, "rb");
+    free(path);
+    if (!file) {
+        return errno == ENOENT ? 0 : -1;
+    }
+
+    catalog_header header;
+    struct stat st;
+    if (fread(&header, sizeof(header), 1, file) != 1 || fstat(fileno(file), &st) != 0 ||
+        memcmp(header.magic, CATALOG_MAGIC, CATALOG_MAGIC_LENGTH) != 0 ||
+        header.version != CATALOG_VERSION || header.record_size != sizeof(catalog_record)) {
+        fprintf(stderr, "Catalogue des sauvegardes invalide, il est ignoré.\n");
+        fclose(file);
+        return 0;
+    }
+    // Un enregistrement incomplet en fin de fichier (ajout interrompu) n'est pas lu ; catalog_append le retire
+    size_t count = ((size_t)st.st_size - sizeof(header)) / sizeof(catalog_record);
+    catalog_record *records = malloc((count ? count : 1) * sizeof(*records));
+    if (!records) {
+        fclose(file);
+        return -1;
+    }
+    count = fread(records, sizeof(*records), count, file);
+    fclose(file);
+
+    for (size_t i = 0; i < count; i++) {
+        records[i].name[CATALOG_NAME_MAX - 1] = '\0';
+    }
+    // Les sauvegardes d'un serveur peuvent se terminer dans un autre ordre que celui de leurs noms
+    qsort(records, count, sizeof(*records), compare_records);
+    catalog->records = records;
+    catalog->count = count;
+    return 0;
+}
+
+// Fonction pour chercher une sauvegarde par son nom
+const catalog_record *catalog_find(const catalog_t *catalog, const char *name) {
+    catalog_record key;
+    memset(key.name, 0, sizeof(key.name));
+    strncpy(key.name, name, CATALOG_NAME_MAX - 1);
+    if (catalog->count == 0) {
+        return NULL;
+    }
+    return bsearch(&key, catalog->records, catalog->count, sizeof(catalog_record), compare_records);
+}
+
+// Fonction qui renvoie le facteur de déduplication d'une sauvegarde (taille logique / nouvelles données)
+double catalog_dedup_ratio(const catalog_record *record) {
+    /* @return: le facteur, 0 si la sauvegarde n'a ajouté aucune donnée au dépôt
+    */
+    if (record->new_bytes == 0) {
+        return 0.0;
+    }
+    return (double)record->logical_bytes / (double)record->new_bytes;
+}
+
+// Fonction pour libérer le catalogue
+void catalog_free(catalog_t *catalog) {
+    free(catalog->records);
+    catalog->records = NULL;
+    catalog->count = 0;
+}
@@ -0,0 +1,55 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Catalogue des sauvegardes d'une destination (.store/catalog) : les statistiques de chaque sauvegarde
+// y sont ajoutées quand elle est enregistrée, la liste des sauvegardes ne parcourt plus leurs fichiers
+#define CATALOG_NAME "catalog"
+#define CATALOG_MAGIC "LP25CTLG"
+#define CATALOG_MAGIC_LENGTH 8
+#define CATALOG_VERSION 1
+// Longueur maximale du nom d'une sauvegarde (égale à NET_NAME_MAX)
+#define CATALOG_NAME_MAX 64
+
+// En-tête du fichier (16 octets), suivi des enregistrements dans l'ordre où les sauvegardes sont terminées
+typedef struct {
+    char magic[CATALOG_MAGIC_LENGTH];
+    uint32_t version;
+    uint32_t record_size;
+} catalog_header;
+
+// Enregistrement d'une sauvegarde (128 octets)
+typedef struct {
+    char name[CATALOG_NAME_MAX]; // Nom du répertoire de la sauvegarde
+    int64_t start_ns;            // Début de la sauvegarde (temps réel)
+    uint64_t duration_ns;        // Durée jusqu'à l'écriture du manifeste
+    uint64_t file_count;
+    uint64_t tree_count;
+    uint64_t logical_bytes;      // Taille cumulée des fichiers sauvegardés
+    uint64_t new_bytes;          // Taille d'origine des chunks ajoutés au dépôt (données uniques nouvelles)
+    uint64_t stored_bytes;       // Octets écrits dans les packs pour ces chunks (après compression)
+    uint64_t new_chunks;
+} catalog_record;
+
+// Catalogue chargé en mémoire, trié par nom
+typedef struct {
+    catalog_record *records;
+    size_t count;
+} catalog_t;
+
+// Fonction pour ajouter l'enregistrement d'une sauvegarde au catalogue d'un dépôt
+int catalog_append(const char *store_path, const catalog_record *record);
+// Fonction pour charger le catalogue d'un dépôt (vide s'il n'existe pas)
+int catalog_load(catalog_t *catalog, const char *store_path);
+// Fonction pour remplacer le catalogue d'un dépôt
+int catalog_write(const char *store_path, const catalog_t *catalog);
+// Fonction pour chercher une sauvegarde par son nom
+const catalog_record *catalog_find(const catalog_t *catalog, const char *name);
+// Fonction qui renvoie le facteur de déduplication d'une sauvegarde (taille logique / nouvelles données)
+double catalog_dedup_ratio(const catalog_record *record);
+// Fonction pour libérer le catalogue
+void catalog_free(catalog_t *catalog);
+
+#endif // CATALOG_H
@@ -0,0 +1,528 @@
+#include "check.h"
+#include "backup_manager.h"
+#include "snapshot_index.h"
+#include "walker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+// Débit de lecture des packs en Mio/s, 0 : sans limite
+unsigned check_rate = 0;
+
+// Chunk de l'index à relire ; trié par pack puis par position pour lire chaque pack d'un bout à l'autre
+typedef struct {
+    uint32_t pack_id;
+    uint32_t entry;       // Numéro d'entrée dans l'index
+    uint64_t offset;
+} scrub_item;
+
+// Relecture des packs, partagée par les threads
+typedef struct {
+    chunk_store_t *store;
+    scrub_item *items;
+    size_t *pack_starts;      // Premier chunk de chaque pack dans items, suivi de la fin
+    size_t pack_count;
+    size_t next_pack;         // Prochain pack à relire (atomique)
+    unsigned char *result;    // chunk_check de chaque entrée de l'index
+    pthread_mutex_t lock;     // Limite de débit
+    uint64_t start_ns;
+    uint64_t reserved;        // Octets autorisés depuis start_ns
+    uint64_t bytes;           // Octets relus (atomique)
+} scrub_state;
+
+// État d'un arbre dans le parcours des sauvegardes
+#define TREE_UNSEEN 0
+#define TREE_CLEAN 1
+#define TREE_DAMAGED 2
+
+// Parcours des sauvegardes, une fois les packs relus
+typedef struct {
+    chunk_store_t *store;
+    const unsigned char *result;  // Résultat de la relecture de chaque entrée de l'index
+    unsigned char *trees;         // TREE_* de chaque entrée de l'index (arbres déjà parcourus)
+    pack_reader reader;
+    uint64_t trees_read;
+    uint64_t damaged_files;       // Fichiers dont un chunk est absent ou abîmé
+    uint64_t damaged_trees;       // Arbres absents ou illisibles
+} audit_state;
+
+static const char *chunk_check_name(chunk_check result) {
+    switch (result) {
+        case CHUNK_OK: return "intact";
+        case CHUNK_MISSING: return "pack absent";
+        case CHUNK_TRUNCATED: return "pack tronqué";
+        case CHUNK_BAD_HEADER: return "en-tête incohérent";
+        case CHUNK_CORRUPT: return "données abîmées";
+    }
+    return "inconnu";
+}
+
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Limite de débit commune à tous les threads : chaque lecture réserve ses octets,
+// puis attend l'instant où le débit demandé les autorise
+static void throttle(scrub_state *state, uint64_t bytes) {
+    if (check_rate == 0) {
+        return;
+    }
+    pthread_mutex_lock(&state->lock);
+    state->reserved += bytes;
+    uint64_t due = state->start_ns + (uint64_t)((double)state->reserved * 1e9 / ((double)check_rate * 1024 * 1024));
+    pthread_mutex_unlock(&state->lock);
+    uint64_t now = clock_ns();
+    if (due > now) {
+        struct timespec wait = {(time_t)((due - now) / 1000000000u), (long)((due - now) % 1000000000u)};
+        while (nanosleep(&wait, &wait) != 0 && errno == EINTR) {
+        }
+    }
+}
+
+// Thread de relecture : les packs sont pris un par un, leurs chunks relus dans l'ordre du fichier
+static void *scrub_worker(void *arg) {
+    scrub_state *state = arg;
+    const chunk_store_t *store = state->store;
+    pack_reader reader;
+    pack_reader_init(&reader);
+    for (;;) {
+        size_t p = __atomic_fetch_add(&state->next_pack, 1, __ATOMIC_RELAXED);
+        if (p >= state->pack_count) {
+            break;
+        }
+        uint64_t bytes = 0;
+        bool absent = false;
+        for (size_t i = state->pack_starts[p]; i < state->pack_starts[p + 1]; i++) {
+            uint32_t entry = state->items[i].entry;
+            const chunk_location *location = &store->index.values[entry];
+            // Pack absent : ses autres chunks ne sont pas relus
+            if (absent) {
+                state->result[entry] = CHUNK_MISSING;
+                continue;
+            }
+            throttle(state, location->stored_size);
+            chunk_check result = store_check_chunk(store, &reader, store->index.keys + (size_t)entry * store->digest_len,
+                                                   location);
+            state->result[entry] = (unsigned char)result;
+            absent = result == CHUNK_MISSING;
+            if (result != CHUNK_MISSING && result != CHUNK_TRUNCATED) {
+                bytes += location->stored_size;
+            }
+        }
+        __atomic_fetch_add(&state->bytes, bytes, __ATOMIC_RELAXED);
+    }
+    pack_reader_free(&reader);
+    return NULL;
+}
+
+static int compare_items(const void *a, const void *b) {
+    const scrub_item *x = a, *y = b;
+    if (x->pack_id != y->pack_id) {
+        return x->pack_id < y->pack_id ? -1 : 1;
+    }
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// Relecture parallèle de tous les chunks de l'index ; renvoie le nombre de chunks en défaut
+static int64_t scrub_packs(scrub_state *state) {
+    chunk_store_t *store = state->store;
+    uint32_t count = store->index.count;
+    state->items = malloc((count ? count : 1) * sizeof(scrub_item));
+    state->pack_starts = malloc(((size_t)count + 1) * sizeof(size_t));
+    if (!state->items || !state->pack_starts) {
+        perror("Erreur d'allocation mémoire pour la vérification");
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        state->items[i].pack_id = store->index.values[i].pack_id;
+        state->items[i].entry = i;
+        state->items[i].offset = store->index.values[i].offset;
+    }
+    qsort(state->items, count, sizeof(scrub_item), compare_items);
+    for (uint32_t i = 0; i < count; i++) {
+        if (i == 0 || state->items[i].pack_id != state->items[i - 1].pack_id) {
+            state->pack_starts[state->pack_count++] = i;
+        }
+    }
+    state->pack_starts[state->pack_count] = count;
+
+    int threads = backup_jobs > 0 ? backup_jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > CHECK_MAX_THREADS) {
+        threads = CHECK_MAX_THREADS;
+    }
+    if ((size_t)threads > state->pack_count) {
+        threads = state->pack_count ? (int)state->pack_count : 1;
+    }
+    state->start_ns = clock_ns();
+    pthread_t workers[CHECK_MAX_THREADS];
+    int started = 0;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&workers[started], NULL, scrub_worker, state) != 0) {
+            break;
+        }
+        started++;
+    }
+    // Le thread appelant participe à la relecture
+    scrub_worker(state);
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+
+    // Rapport dans l'ordre des packs ; un pack absent ou tronqué n'est signalé qu'une fois
+    int64_t bad = 0;
+    char hex[DIGEST_MAX_LENGTH * 2 + 1];
+    for (size_t p = 0; p < state->pack_count; p++) {
+        size_t first = state->pack_starts[p], end = state->pack_starts[p + 1];
+        if (state->result[state->items[first].entry] == CHUNK_MISSING) {
+            fprintf(stderr, "Pack %06u absent ou illisible : %zu chunks perdus.\n", state->items[first].pack_id, end - first);
+            bad += (int64_t)(end - first);
+            continue;
+        }
+        size_t truncated = 0;
+        uint64_t truncated_at = 0;
+        for (size_t i = first; i < end; i++) {
+            uint32_t entry = state->items[i].entry;
+            if (state->result[entry] == CHUNK_OK) {
+                continue;
+            }
+            bad++;
+            if (state->result[entry] == CHUNK_TRUNCATED) {
+                if (truncated++ == 0) {
+                    truncated_at = state->items[i].offset;
+                }
+                continue;
+            }
+            digest_to_hex(store->index.keys + (size_t)entry * store->digest_len, store->digest_len, hex);
+            fprintf(stderr, "Chunk %s (pack %06u, position %llu) : %s.\n", hex, state->items[i].pack_id,
+                    (unsigned long long)state->items[i].offset, chunk_check_name((chunk_check)state->result[entry]));
+        }
+        if (truncated) {
+            fprintf(stderr, "Pack %06u tronqué avant la position %llu : %zu chunks perdus.\n", state->items[first].pack_id,
+                    (unsigned long long)truncated_at, truncated);
+        }
+    }
+    return bad;
+}
+
+// État d'un chunk référencé par une sauvegarde
+static chunk_check check_digest(const audit_state *audit, const unsigned char *digest) {
+    int64_t entry = chunk_index_entry(&audit->store->index, digest);
+    return entry < 0 ? CHUNK_MISSING : (chunk_check)audit->result[entry];
+}
+
+// Décompte des chunks absents ou abîmés d'une liste sérialisée (digest puis taille sur 32 bits)
+static void count_records(const audit_state *audit, const unsigned char *records, uint32_t count, uint32_t *missing,
+                          uint32_t *corrupt) {
+    size_t record_size = CHUNK_REF_RECORD_SIZE(audit->store->digest_len);
+    for (uint32_t c = 0; c < count; c++) {
+        chunk_check result = check_digest(audit, records + (size_t)c * record_size);
+        if (result == CHUNK_MISSING) {
+            (*missing)++;
+        } else if (result != CHUNK_OK) {
+            (*corrupt)++;
+        }
+    }
+}
+
+// Décompte des chunks d'une liste rangée en objets de liste ; un objet de liste absent ou abîmé
+// compte pour un chunk, ceux qu'il référence ne pouvant plus être retrouvés
+static void count_list(audit_state *audit, const unsigned char *record, uint32_t levels, uint32_t *missing,
+                       uint32_t *corrupt) {
+    size_t record_size = CHUNK_REF_RECORD_SIZE(audit->store->digest_len);
+    chunk_check result = check_digest(audit, record);
+    unsigned char *object = result == CHUNK_OK ? chunk_list_load(audit->store, &audit->reader, record) : NULL;
+    if (!object) {
+        if (result == CHUNK_MISSING) {
+            (*missing)++;
+        } else {
+            (*corrupt)++;
+        }
+        return;
+    }
+    uint32_t count;
+    memcpy(&count, record + audit->store->digest_len, sizeof(count));
+    if (levels == 1) {
+        count_records(audit, object, count, missing, corrupt);
+    }
+    for (uint32_t c = 0; levels > 1 && c < count; c++) {
+        count_list(audit, object + (size_t)c * record_size, levels - 1, missing, corrupt);
+    }
+    free(object);
+}
+
+// Vérification des chunks d'un fichier d'un arbre ou d'un index plat
+static bool check_entry(audit_state *audit, const snapshot_index_t *index, const snapshot_entry *entry, const char *path) {
+    uint32_t missing = 0, corrupt = 0;
+    if (entry->list_levels > 0) {
+        count_list(audit, index->chunks + entry->chunk_offset, entry->list_levels, &missing, &corrupt);
+    } else {
+        count_records(audit, index->chunks + entry->chunk_offset, entry->chunk_count, &missing, &corrupt);
+    }
+    if (missing + corrupt == 0) {
+        return false;
+    }
+    fprintf(stderr, "Fichier %s : %u chunks absents, %u abîmés.\n", path, missing, corrupt);
+    audit->damaged_files++;
+    return true;
+}
+
+// Vérification récursive d'un arbre ; un arbre déjà parcouru (partagé avec une autre sauvegarde)
+// n'est pas relu, son état est repris. Renvoie true si l'arbre est endommagé.
+static bool check_tree(audit_state *audit, const unsigned char *digest, const char *prefix) {
+    int64_t entry = chunk_index_entry(&audit->store->index, digest);
+    if (entry < 0 || audit->result[entry] != CHUNK_OK) {
+        if (entry < 0) {
+            fprintf(stderr, "Répertoire %s : arbre absent du dépôt.\n", prefix);
+        } else {
+            fprintf(stderr, "Répertoire %s : arbre illisible (%s).\n", prefix, chunk_check_name((chunk_check)audit->result[entry]));
+        }
+        audit->damaged_trees++;
+        return true;
+    }
+    if (audit->trees[entry] != TREE_UNSEEN) {
+        return audit->trees[entry] == TREE_DAMAGED;
+    }
+
+    snapshot_index_t tree;
+    bool damaged = false;
+    if (snapshot_tree_read(&tree, audit->store, &audit->reader, digest) != 0) {
+        fprintf(stderr, "Répertoire %s : arbre illisible.\n", prefix);
+        audit->damaged_trees++;
+        audit->trees[entry] = TREE_DAMAGED;
+        return true;
+    }
+    audit->trees_read++;
+    for (size_t i = 0; i < tree.count; i++) {
+        const snapshot_entry *file = &tree.entries[i];
+        char *path = walk_join(prefix, snapshot_entry_path(&tree, file));
+        if (!path) {
+            damaged = true;
+        } else if (S_ISDIR(file->mode)) {
+            damaged |= check_tree(audit, file->digest, path);
+        } else {
+            damaged |= check_entry(audit, &tree, file, path);
+        }
+        free(path);
+    }
+    snapshot_index_close(&tree);
+    audit->trees[entry] = damaged ? TREE_DAMAGED : TREE_CLEAN;
+    return damaged;
+}
+
+// Vérification d'une sauvegarde à index plat (.backup_index)
+static bool check_flat_index(audit_state *audit, const char *index_path) {
+    snapshot_index_t index;
+    if (snapshot_index_open(&index, index_path) != 0) {
+        return true;
+    }
+    bool damaged = false;
+    if (index.digest_len != audit->store->digest_len) {
+        fprintf(stderr, "L'index %s ne correspond pas au dépôt.\n", index_path);
+        damaged = true;
+    }
+    for (size_t i = 0; !damaged && i < index.count; i++) {
+        const snapshot_entry *entry = &index.entries[i];
+        damaged |= check_entry(audit, &index, entry, snapshot_entry_path(&index, entry));
+    }
+    snapshot_index_close(&index);
+    return damaged;
+}
+
+// Vérification d'une sauvegarde antérieure à l'index binaire : une recette par fichier, listées par .backup_log
+static bool check_backup_log(audit_state *audit, const char *backup_path, const char *log_path) {
+    log_t logs = read_backup_log(log_path);
+    bool damaged = false;
+    for (log_element *current = logs.head; current; current = current->next) {
+        char *recipe_path = strncmp(current->path, backup_path, strlen(backup_path)) == 0
+                            ? strdup(current->path) : walk_join(backup_path, current->path);
+        FILE *file = recipe_path ? fopen(recipe_path, "rb") : NULL;
+        recipe_t recipe;
+        // Les répertoires du journal n'ont pas de recette
+        if (!file || read_recipe(file, &recipe) != 0) {
+            if (file) {
+                fprintf(stderr, "Recette %s illisible.\n", recipe_path);
+                audit->damaged_files++;
+                damaged = true;
+                fclose(file);
+            }
+            free(recipe_path);
+            continue;
+        }
+        fclose(file);
+        uint32_t missing = 0, corrupt = 0;
+        for (int c = 0; c < recipe.count; c++) {
+            chunk_check result = recipe.digest_len == audit->store->digest_len
+                                 ? check_digest(audit, recipe.refs[c].digest) : CHUNK_MISSING;
+            if (result == CHUNK_MISSING) {
+                missing++;
+            } else if (result != CHUNK_OK) {
+                corrupt++;
+            }
+        }
+        if (missing + corrupt > 0) {
+            fprintf(stderr, "Fichier %s : %u chunks absents, %u abîmés.\n", recipe_path, missing, corrupt);
+            audit->damaged_files++;
+            damaged = true;
+        }
+        free_recipe(&recipe);
+        free(recipe_path);
+    }
+    free_backup_log(&logs);
+    return damaged;
+}
+
+// Vérification d'une sauvegarde selon son format ; renvoie true si elle est endommagée
+static bool check_backup(audit_state *audit, const char *backup_path) {
+    snapshot_manifest manifest;
+    char *path = NULL;
+    bool damaged = true;
+    switch (snapshot_format_of(backup_path)) {
+        case SNAPSHOT_FORMAT_MANIFEST:
+            path = walk_join(backup_path, SNAPSHOT_MANIFEST_NAME);
+            if (!path || snapshot_manifest_read(path, &manifest) != 0 || manifest.digest_len != audit->store->digest_len) {
+                fprintf(stderr, "Manifeste de %s illisible.\n", backup_path);
+            } else {
+                damaged = check_tree(audit, manifest.root, backup_path);
+            }
+            break;
+        case SNAPSHOT_FORMAT_FLAT_INDEX:
+            path = walk_join(backup_path, SNAPSHOT_INDEX_NAME);
+            damaged = !path || check_flat_index(audit, path);
+            break;
+        case SNAPSHOT_FORMAT_BACKUP_LOG:
+            path = walk_join(backup_path, SNAPSHOT_BACKUP_LOG_NAME);
+            damaged = !path || check_backup_log(audit, backup_path, path);
+            break;
+        case SNAPSHOT_FORMAT_NONE:
+            fprintf(stderr, "%s n'a ni manifeste ni index de sauvegarde.\n", backup_path);
+            break;
+    }
+    free(path);
+    return damaged;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Parcours des sauvegardes de la destination, dans l'ordre de leurs noms (donc de leurs dates)
+static int audit_backups(audit_state *audit, const char *dest_dir, size_t *backups, size_t *damaged) {
+    DIR *dir = opendir(dest_dir);
+    if (!dir) {
+        perror("Erreur lors de l'ouverture du répertoire destination");
+        return -1;
+    }
+    char **names = NULL;
+    size_t count = 0, capacity = 0;
+    int status = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Ignorer les entrées cachées : ".", ".." et le dépôt de chunks
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            char **grown = realloc(names, capacity * sizeof(char *));
+            if (!grown) {
+                perror("Erreur d'allocation mémoire pour la liste des sauvegardes");
+                status = -1;
+                break;
+            }
+            names = grown;
+        }
+        names[count] = strdup(entry->d_name);
+        if (!names[count]) {
+            status = -1;
+            break;
+        }
+        count++;
+    }
+    closedir(dir);
+    qsort(names, count, sizeof(char *), compare_names);
+
+    for (size_t i = 0; status == 0 && i < count; i++) {
+        char *backup_path = walk_join(dest_dir, names[i]);
+        struct stat backup_stat;
+        if (!backup_path) {
+            status = -1;
+        } else if (stat(backup_path, &backup_stat) == 0 && S_ISDIR(backup_stat.st_mode)) {
+            bool bad = check_backup(audit, backup_path);
+            printf("%s : %s\n", names[i], bad ? "endommagée" : "intacte");
+            (*backups)++;
+            *damaged += bad;
+        }
+        free(backup_path);
+    }
+    for (size_t i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    return status;
+}
+
+// Fonction pour vérifier les packs et les sauvegardes de dest_dir
+int check_repository(const char *dest_dir) {
+    /* @param: dest_dir est la destination qui contient les sauvegardes et leur dépôt
+    *  @return: 0 si tous les chunks et toutes les sauvegardes sont intacts, -1 sinon
+    */
+    chunk_store_t store;
+    if (store_open_read(&store, dest_dir) != 0) {
+        fprintf(stderr, "Erreur : dépôt de chunks introuvable dans '%s'.\n", dest_dir);
+        return -1;
+    }
+
+    scrub_state scrub;
+    memset(&scrub, 0, sizeof(scrub));
+    scrub.store = &store;
+    scrub.result = calloc(store.index.count ? store.index.count : 1, 1);
+    if (!scrub.result) {
+        perror("Erreur d'allocation mémoire pour la vérification");
+    }
+    pthread_mutex_init(&scrub.lock, NULL);
+    int64_t bad_chunks = scrub.result ? scrub_packs(&scrub) : -1;
+
+    int status = bad_chunks == 0 ? 0 : -1;
+    if (bad_chunks >= 0) {
+        printf("Packs : %zu, %u chunks vérifiés (%llu octets relus), %lld en défaut.\n", scrub.pack_count,
+               store.index.count, (unsigned long long)scrub.bytes, (long long)bad_chunks);
+
+        audit_state audit;
+        memset(&audit, 0, sizeof(audit));
+        audit.store = &store;
+        audit.result = scrub.result;
+        audit.trees = calloc(store.index.count ? store.index.count : 1, 1);
+        pack_reader_init(&audit.reader);
+        size_t backups = 0, damaged = 0;
+        if (!audit.trees || audit_backups(&audit, dest_dir, &backups, &damaged) != 0) {
+            fprintf(stderr, "Erreur : les sauvegardes de '%s' n'ont pas pu être parcourues.\n", dest_dir);
+            status = -1;
+        } else {
+            printf("Sauvegardes : %zu vérifiées (%llu arbres), %zu endommagées, %llu fichiers touchés, %llu arbres perdus.\n",
+                   backups, (unsigned long long)audit.trees_read, damaged, (unsigned long long)audit.damaged_files,
+                   (unsigned long long)audit.damaged_trees);
+            if (damaged) {
+                status = -1;
+            }
+        }
+        pack_reader_free(&audit.reader);
+        free(audit.trees);
+    } else {
+        fprintf(stderr, "Erreur : vérification des packs interrompue.\n");
+    }
+
+    pthread_mutex_destroy(&scrub.lock);
+    free(scrub.items);
+    free(scrub.pack_starts);
+    free(scrub.result);
+    store_close(&store);
+    return status;
+}
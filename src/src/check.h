@@ -0,0 +1,21 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Vérification d'une destination (--check) : chaque chunk de l'index est relu dans son pack,
+// décompressé et haché à nouveau (un pack par thread, dans l'ordre du fichier), puis les arbres
+// et index des sauvegardes sont parcourus pour signaler les fichiers dont un chunk est absent ou abîmé.
+// Rien n'est modifié.
+
+// Nombre maximal de threads de relecture
+#define CHECK_MAX_THREADS 64
+
+// Débit de lecture des packs en Mio/s (--check-rate), 0 : sans limite
+extern unsigned check_rate;
+
+// Fonction pour vérifier les packs et les sauvegardes de dest_dir
+int check_repository(const char *dest_dir);
+
+#endif // CHECK_H
@@ -0,0 +1,183 @@
+#include "chunk_index.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Les digests sont déjà uniformément répartis : leurs 8 premiers octets choisissent l'alvéole
+static inline uint64_t key_hash(const unsigned char *key) {
+    uint64_t hash;
+    memcpy(&hash, key, sizeof(hash));
+    return hash;
+}
+
+// Les 4 octets suivants servent d'étiquette, ce qui évite presque toujours de comparer le digest complet
+static inline uint32_t key_tag(const unsigned char *key) {
+    uint32_t tag;
+    memcpy(&tag, key + sizeof(uint64_t), sizeof(tag));
+    return tag ? tag : 1;
+}
+
+// Allocation d'une table d'alvéoles vides
+static index_bucket *alloc_buckets(size_t bucket_count) {
+    index_bucket *buckets = aligned_alloc(INDEX_CACHE_LINE, bucket_count * sizeof(index_bucket));
+    if (!buckets) {
+        perror("Erreur d'allocation mémoire pour l'index des chunks");
+        return NULL;
+    }
+    memset(buckets, 0, bucket_count * sizeof(index_bucket));
+    return buckets;
+}
+
+// Placement d'une entrée dans le premier emplacement libre de sa séquence de sondage
+static void place_entry(index_bucket *buckets, size_t bucket_count, uint64_t hash, uint32_t tag, uint32_t entry) {
+    size_t mask = bucket_count - 1;
+    for (size_t b = hash & mask;; b = (b + 1) & mask) {
+        for (int s = 0; s < INDEX_BUCKET_SLOTS; s++) {
+            if (buckets[b].tags[s] == 0) {
+                buckets[b].tags[s] = tag;
+                buckets[b].entries[s] = entry;
+                return;
+            }
+        }
+    }
+}
+
+// Doublement de la table d'alvéoles : les entrées sont replacées à partir de leurs digests
+static int grow_buckets(chunk_index_t *index) {
+    size_t bucket_count = index->bucket_count * 2;
+    index_bucket *buckets = alloc_buckets(bucket_count);
+    if (!buckets) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < index->count; i++) {
+        const unsigned char *key = index->keys + (size_t)i * index->key_len;
+        place_entry(buckets, bucket_count, key_hash(key), key_tag(key), i);
+    }
+    free(index->buckets);
+    index->buckets = buckets;
+    index->bucket_count = bucket_count;
+    return 0;
+}
+
+// Agrandissement des tableaux d'entrées
+static int grow_entries(chunk_index_t *index) {
+    uint32_t capacity = index->capacity ? index->capacity * 2 : 1024;
+    unsigned char *keys = realloc(index->keys, (size_t)capacity * index->key_len);
+    if (!keys) {
+        perror("Erreur d'allocation mémoire pour l'index des chunks");
+        return -1;
+    }
+    index->keys = keys;
+    chunk_location *values = realloc(index->values, (size_t)capacity * sizeof(chunk_location));
+    if (!values) {
+        perror("Erreur d'allocation mémoire pour l'index des chunks");
+        return -1;
+    }
+    index->values = values;
+    index->capacity = capacity;
+    return 0;
+}
+
+// Fonction pour initialiser un index vide prévu pour 'expected' entrées
+int chunk_index_init(chunk_index_t *index, size_t key_len, size_t expected) {
+    /* @param: key_len est la taille des digests (au moins 12 octets)
+    *           expected est une estimation du nombre d'entrées, pour éviter les agrandissements
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    memset(index, 0, sizeof(*index));
+    if (key_len < sizeof(uint64_t) + sizeof(uint32_t)) {
+        fprintf(stderr, "Digest trop court pour l'index (%zu octets).\n", key_len);
+        return -1;
+    }
+    index->key_len = key_len;
+
+    size_t bucket_count = 16;
+    while (bucket_count * INDEX_BUCKET_SLOTS * INDEX_MAX_LOAD / 8 < expected) {
+        bucket_count *= 2;
+    }
+    index->buckets = alloc_buckets(bucket_count);
+    if (!index->buckets) {
+        return -1;
+    }
+    index->bucket_count = bucket_count;
+    return 0;
+}
+
+// Fonction pour libérer un index
+void chunk_index_free(chunk_index_t *index) {
+    free(index->buckets);
+    free(index->keys);
+    free(index->values);
+    memset(index, 0, sizeof(*index));
+}
+
+// Fonction qui renvoie le numéro d'entrée d'un digest (position dans keys/values)
+int64_t chunk_index_entry(const chunk_index_t *index, const unsigned char *key) {
+    /* @return: le numéro d'entrée, -1 si le digest est absent
+    */
+    uint64_t hash = key_hash(key);
+    uint32_t tag = key_tag(key);
+    size_t mask = index->bucket_count - 1;
+
+    for (size_t b = hash & mask;; b = (b + 1) & mask) {
+        const index_bucket *bucket = &index->buckets[b];
+        for (int s = 0; s < INDEX_BUCKET_SLOTS; s++) {
+            if (bucket->tags[s] == 0) {
+                // Pas de suppression : un emplacement libre termine la séquence de sondage
+                return -1;
+            }
+            if (bucket->tags[s] == tag) {
+                uint32_t entry = bucket->entries[s];
+                if (memcmp(index->keys + (size_t)entry * index->key_len, key, index->key_len) == 0) {
+                    return entry;
+                }
+            }
+        }
+    }
+}
+
+// Fonction pour chercher un digest dans l'index
+int chunk_index_find(const chunk_index_t *index, const unsigned char *key, chunk_location *location) {
+    /* @return: 1 si le digest est présent (location est alors rempli s'il n'est pas NULL), 0 sinon
+    */
+    int64_t entry = chunk_index_entry(index, key);
+    if (entry < 0) {
+        return 0;
+    }
+    if (location) {
+        *location = index->values[entry];
+    }
+    return 1;
+}
+
+// Fonction pour ajouter un digest à l'index s'il n'y est pas déjà
+int chunk_index_insert(chunk_index_t *index, const unsigned char *key, const chunk_location *location) {
+    /* @return: 1 si l'entrée a été ajoutée, 0 si le digest était déjà présent, -1 en cas d'erreur
+    */
+    if (chunk_index_find(index, key, NULL)) {
+        return 0;
+    }
+    if (index->count == UINT32_MAX) {
+        fprintf(stderr, "Index des chunks plein.\n");
+        return -1;
+    }
+    if (index->count == index->capacity && grow_entries(index) != 0) {
+        return -1;
+    }
+    if ((size_t)(index->count + 1) * 8 > index->bucket_count * INDEX_BUCKET_SLOTS * INDEX_MAX_LOAD &&
+        grow_buckets(index) != 0) {
+        return -1;
+    }
+
+    uint32_t entry = index->count++;
+    memcpy(index->keys + (size_t)entry * index->key_len, key, index->key_len);
+    index->values[entry] = *location;
+    place_entry(index->buckets, index->bucket_count, key_hash(key), key_tag(key), entry);
+    return 1;
+}
+
+// Fonction qui renvoie la mémoire occupée par l'index (octets)
+size_t chunk_index_memory(const chunk_index_t *index) {
+    return index->bucket_count * sizeof(index_bucket) +
+           (size_t)index->capacity * (index->key_len + sizeof(chunk_location));
+}
@@ -0,0 +1,54 @@
+#ifndef CHUNK_INDEX_H
+#define CHUNK_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Nombre d'emplacements par alvéole : 8 x (étiquette 4 octets + numéro d'entrée 4 octets)
+// occupent exactement une ligne de cache de 64 octets
+#define INDEX_BUCKET_SLOTS 8
+#define INDEX_CACHE_LINE 64
+
+// Taux de remplissage maximal (en huitièmes) avant agrandissement de la table
+#define INDEX_MAX_LOAD 7
+
+// Emplacement d'un chunk dans les fichiers pack
+typedef struct {
+    uint64_t offset;      // Position des données dans le pack
+    uint32_t pack_id;     // Numéro du fichier pack
+    uint32_t size;        // Taille des données du chunk
+    uint32_t stored_size; // Taille occupée dans le pack (compressée ou égale à size)
+    uint32_t codec;       // Compression des données dans le pack (codec_algo)
+} chunk_location;
+
+// Alvéole de la table, alignée sur une ligne de cache
+typedef struct {
+    uint32_t tags[INDEX_BUCKET_SLOTS];    // Étiquettes (0 : emplacement libre)
+    uint32_t entries[INDEX_BUCKET_SLOTS]; // Numéros d'entrée dans keys/values
+} __attribute__((aligned(INDEX_CACHE_LINE))) index_bucket;
+
+// Index digest -> emplacement, à adressage ouvert et agrandissable
+typedef struct {
+    index_bucket *buckets;  // Table des alvéoles (sondage linéaire par alvéole)
+    size_t bucket_count;    // Nombre d'alvéoles (puissance de 2)
+    size_t key_len;         // Taille des digests
+    unsigned char *keys;    // Digests des entrées, contigus
+    chunk_location *values; // Emplacements des entrées
+    uint32_t count;         // Nombre d'entrées
+    uint32_t capacity;      // Capacité allouée de keys/values
+} chunk_index_t;
+
+// Fonction pour initialiser un index vide prévu pour 'expected' entrées
+int chunk_index_init(chunk_index_t *index, size_t key_len, size_t expected);
+// Fonction pour libérer un index
+void chunk_index_free(chunk_index_t *index);
+// Fonction pour chercher un digest dans l'index
+int chunk_index_find(const chunk_index_t *index, const unsigned char *key, chunk_location *location);
+// Fonction qui renvoie le numéro d'entrée d'un digest, -1 s'il est absent
+int64_t chunk_index_entry(const chunk_index_t *index, const unsigned char *key);
+// Fonction pour ajouter un digest à l'index s'il n'y est pas déjà
+int chunk_index_insert(chunk_index_t *index, const unsigned char *key, const chunk_location *location);
+// Fonction qui renvoie la mémoire occupée par l'index (octets)
+size_t chunk_index_memory(const chunk_index_t *index);
+
+#endif // CHUNK_INDEX_H
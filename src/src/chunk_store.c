@@ -0,0 +1,1172 @@
+#include "chunk_store.h"
+#include "network.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/random.h>
+
+// Paramètres de découpage utilisés à la création d'un nouveau dépôt (taille nulle : valeurs par défaut)
+chunker_params store_default_chunker;
+hash_algo store_default_hash = HASH_DEFAULT;
+codec_params store_default_codec = {CODEC_NONE, 0};
+
+// Enregistrement d'index d'un chunk : digest, pack, position, taille (puis taille stockée et compression)
+static size_t index_record(const chunk_store_t *store, const unsigned char *digest, const chunk_location *location,
+                           unsigned char *record) {
+    /* @param: record reçoit au plus INDEX_RECORD_SIZE_V2(DIGEST_MAX_LENGTH) octets
+    *  @return: la taille de l'enregistrement
+    */
+    size_t len = 0;
+    memcpy(record, digest, store->digest_len);
+    len += store->digest_len;
+    memcpy(record + len, &location->pack_id, sizeof(location->pack_id));
+    len += sizeof(location->pack_id);
+    memcpy(record + len, &location->offset, sizeof(location->offset));
+    len += sizeof(location->offset);
+    memcpy(record + len, &location->size, sizeof(location->size));
+    len += sizeof(location->size);
+    if (store->version >= 2) {
+        memcpy(record + len, &location->stored_size, sizeof(location->stored_size));
+        len += sizeof(location->stored_size);
+        memcpy(record + len, &location->codec, sizeof(location->codec));
+        len += sizeof(location->codec);
+    }
+    return len;
+}
+
+// Lecture d'un enregistrement d'index, renvoie 1 si un enregistrement complet a été lu
+static int read_index_record(FILE *file, int version, unsigned char *digest, size_t digest_len, chunk_location *location) {
+    if (fread(digest, 1, digest_len, file) != digest_len ||
+        fread(&location->pack_id, sizeof(location->pack_id), 1, file) != 1 ||
+        fread(&location->offset, sizeof(location->offset), 1, file) != 1 ||
+        fread(&location->size, sizeof(location->size), 1, file) != 1) {
+        return 0;
+    }
+    // Un dépôt version 1 ne contient que des chunks bruts
+    location->stored_size = location->size;
+    location->codec = CODEC_NONE;
+    if (version >= 2 &&
+        (fread(&location->stored_size, sizeof(location->stored_size), 1, file) != 1 ||
+         fread(&location->codec, sizeof(location->codec), 1, file) != 1)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Construction du chemin d'un pack à partir de son numéro
+static void pack_path(const chunk_store_t *store, uint32_t pack_id, char *buffer, size_t size) {
+    snprintf(buffer, size, "%s/pack-%06u.pack", store->path, pack_id);
+}
+
+// Ouverture en ajout du pack courant, en passant au suivant s'il est plein
+static int open_current_pack(chunk_store_t *store) {
+    char path[4096];
+    struct stat pack_stat;
+
+    for (;;) {
+        pack_path(store, store->pack_id, path, sizeof(path));
+        if (stat(path, &pack_stat) == -1) {
+            store->pack_size = 0;
+            break;
+        }
+        if ((uint64_t)pack_stat.st_size < PACK_MAX_SIZE) {
+            store->pack_size = pack_stat.st_size;
+            break;
+        }
+        store->pack_id++;
+    }
+
+    // Les tampons d'écriture en arrière-plan visent une position précise : pas d'ouverture en ajout
+    if (store->writer) {
+        store->pack_fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (store->pack_fd < 0) {
+            perror("Erreur lors de l'ouverture du fichier pack");
+            return -1;
+        }
+        return 0;
+    }
+    store->pack = fopen(path, "ab");
+    if (!store->pack) {
+        perror("Erreur lors de l'ouverture du fichier pack");
+        return -1;
+    }
+    return 0;
+}
+
+// Fermeture du pack courant, une fois ses données écrites
+static int close_current_pack(chunk_store_t *store) {
+    int status = 0;
+    if (store->writer) {
+        status = store_flush(store);
+        if (store->pack_fd >= 0) {
+            close(store->pack_fd);
+            store->pack_fd = -1;
+        }
+    } else if (store->pack) {
+        if (fclose(store->pack) != 0) {
+            perror("Erreur d'écriture dans le fichier pack");
+            status = -1;
+        }
+        store->pack = NULL;
+    }
+    return status;
+}
+
+// Création du fichier de configuration du dépôt s'il n'existe pas encore
+static int write_store_config(const chunk_store_t *store, const char *path) {
+    FILE *config = fopen(path, "w");
+    if (!config) {
+        perror("Erreur lors de la création de la configuration du dépôt");
+        return -1;
+    }
+    fprintf(config, "version=%d\n", STORE_VERSION);
+    fprintf(config, "hash=%s\n", hash_algo_name(store->hash));
+    fprintf(config, "chunk_min=%u\n", store->chunker.min_size);
+    fprintf(config, "chunk_avg=%u\n", store->chunker.avg_size);
+    fprintf(config, "chunk_max=%u\n", store->chunker.max_size);
+    fclose(config);
+    return 0;
+}
+
+// Lecture (ou création) de la configuration du dépôt : elle fixe le découpage de toutes les sauvegardes
+static int load_store_config(chunk_store_t *store) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/config", store->path);
+
+    FILE *config = fopen(path, "r");
+    if (!config) {
+        // Nouveau dépôt : les paramètres choisis sont enregistrés une fois pour toutes
+        store->version = STORE_VERSION;
+        store->hash = store_default_hash;
+        store->digest_len = hash_digest_length(store->hash);
+        if (!hash_algo_available(store->hash)) {
+            fprintf(stderr, "Algorithme de hachage %s non disponible dans cette version.\n", hash_algo_name(store->hash));
+            return -1;
+        }
+        if (store_default_chunker.max_size != 0) {
+            store->chunker = store_default_chunker;
+        } else if (chunker_params_init(&store->chunker, CHUNK_MIN_SIZE, CHUNK_AVG_SIZE, CHUNK_MAX_SIZE) != 0) {
+            return -1;
+        }
+        return write_store_config(store, path);
+    }
+
+    unsigned long min_size = CHUNK_MIN_SIZE, avg_size = CHUNK_AVG_SIZE, max_size = CHUNK_MAX_SIZE;
+    char line[256];
+    // Les dépôts créés avant l'enregistrement de la version sont en version 1
+    store->version = 1;
+    // Les dépôts créés avant l'enregistrement de l'algorithme utilisent MD5
+    store->hash = HASH_MD5;
+    while (fgets(line, sizeof(line), config)) {
+        char *value = strchr(line, '=');
+        if (!value) {
+            continue;
+        }
+        *value++ = '\0';
+        value[strcspn(value, "\n")] = '\0';
+
+        if (strcmp(line, "version") == 0) {
+            store->version = atoi(value);
+            if (store->version > STORE_VERSION) {
+                fprintf(stderr, "Version du dépôt non supportée : %s.\n", value);
+                fclose(config);
+                return -1;
+            }
+        } else if (strcmp(line, "hash") == 0) {
+            if (hash_algo_from_name(value, &store->hash) != 0) {
+                fclose(config);
+                return -1;
+            }
+        } else if (strcmp(line, "chunk_min") == 0) {
+            min_size = strtoul(value, NULL, 10);
+        } else if (strcmp(line, "chunk_avg") == 0) {
+            avg_size = strtoul(value, NULL, 10);
+        } else if (strcmp(line, "chunk_max") == 0) {
+            max_size = strtoul(value, NULL, 10);
+        }
+    }
+    fclose(config);
+
+    if (!hash_algo_available(store->hash)) {
+        fprintf(stderr, "Le dépôt utilise %s, non disponible dans cette version.\n", hash_algo_name(store->hash));
+        return -1;
+    }
+    store->digest_len = hash_digest_length(store->hash);
+
+    if (chunker_params_init(&store->chunker, (uint32_t)min_size, (uint32_t)avg_size, (uint32_t)max_size) != 0) {
+        fprintf(stderr, "Configuration de découpage du dépôt invalide.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Retrait d'un enregistrement incomplet en fin de journal (écriture interrompue) : sans cela, tous les
+// enregistrements ajoutés ensuite seraient décalés. Le journal est ramené à valid octets et mis sur disque
+// avant tout ajout.
+static int drop_torn_record(const char *index_path, uint64_t valid) {
+    struct stat index_stat;
+    if (stat(index_path, &index_stat) != 0 || (uint64_t)index_stat.st_size <= valid) {
+        return 0;
+    }
+    fprintf(stderr, "Enregistrement incomplet en fin d'index ignoré (%llu octets).\n",
+            (unsigned long long)((uint64_t)index_stat.st_size - valid));
+    int fd = open(index_path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, (off_t)valid) != 0 || fsync(fd) != 0) {
+        perror("Erreur lors de la réparation de l'index du dépôt");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// Verrou du dépôt : partagé par les sauvegardes, le serveur et les relectures, exclusif pour --prune.
+// Un nettoyage n'attend pas : il échoue si le dépôt est utilisé ; les autres attendent la fin du nettoyage.
+static int lock_store(chunk_store_t *store, int operation) {
+    store->lock_fd = open(store->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (store->lock_fd < 0) {
+        perror("Erreur lors de l'ouverture du dépôt de chunks");
+        return -1;
+    }
+    if (flock(store->lock_fd, operation | LOCK_NB) == 0) {
+        return 0;
+    }
+    if (errno == EWOULDBLOCK && operation == LOCK_EX) {
+        fprintf(stderr, "Erreur : le dépôt %s est utilisé par une autre opération.\n", store->path);
+        return -1;
+    }
+    if (errno == EWOULDBLOCK) {
+        fprintf(stderr, "Nettoyage du dépôt %s en cours, attente de sa fin...\n", store->path);
+        int status;
+        while ((status = flock(store->lock_fd, operation)) != 0 && errno == EINTR) {
+        }
+        if (status == 0) {
+            return 0;
+        }
+    }
+    perror("Erreur lors du verrouillage du dépôt de chunks");
+    return -1;
+}
+
+// Ouverture d'un dépôt ; en lecture seule, rien n'est créé et aucun pack n'est ouvert en écriture
+static int store_load(chunk_store_t *store, const char *backup_dir, bool writable, int lock) {
+    memset(store, 0, sizeof(*store));
+    pack_reader_init(&store->reader);
+    store->pack_fd = -1;
+    store->lock_fd = -1;
+
+    size_t len = strlen(backup_dir) + strlen(STORE_DIR) + 2;
+    store->path = malloc(len);
+    if (!store->path) {
+        perror("Erreur d'allocation mémoire pour le chemin du dépôt");
+        return -1;
+    }
+    snprintf(store->path, len, "%s/%s", backup_dir, STORE_DIR);
+
+    if (writable && mkdir(store->path, 0755) == -1 && errno != EEXIST) {
+        perror("Erreur lors de la création du dépôt de chunks");
+        store_close(store);
+        return -1;
+    }
+    if (lock_store(store, lock) != 0) {
+        store_close(store);
+        return -1;
+    }
+    char config_path[4096];
+    snprintf(config_path, sizeof(config_path), "%s/config", store->path);
+    if (!writable && access(config_path, R_OK) != 0) {
+        perror("Erreur lors de l'ouverture de la configuration du dépôt");
+        store_close(store);
+        return -1;
+    }
+    if (load_store_config(store) != 0) {
+        store_close(store);
+        return -1;
+    }
+
+    // La compression est choisie à chaque sauvegarde ; un dépôt version 1 ne peut pas la noter dans son index
+    store->codec = store_default_codec;
+    if (store->version < 2 && store->codec.algo != CODEC_NONE) {
+        fprintf(stderr, "Dépôt version %d : les nouveaux chunks ne seront pas compressés.\n", store->version);
+        store->codec.algo = CODEC_NONE;
+    }
+
+    // Chargement du journal d'index : chaque chunk déjà stocké y a un enregistrement.
+    // La taille du journal permet de dimensionner la table dès le départ.
+    char index_path[4096];
+    struct stat index_stat;
+    size_t expected = 0;
+    size_t record = store->version >= 2 ? INDEX_RECORD_SIZE_V2(store->digest_len) : INDEX_RECORD_SIZE(store->digest_len);
+    uint64_t records = 0;
+    snprintf(index_path, sizeof(index_path), "%s/index", store->path);
+    if (stat(index_path, &index_stat) == 0) {
+        expected = (size_t)index_stat.st_size / record;
+    }
+    if (chunk_index_init(&store->index, store->digest_len, expected) != 0) {
+        store_close(store);
+        return -1;
+    }
+
+    FILE *index = fopen(index_path, "rb");
+    if (index) {
+        unsigned char digest[DIGEST_MAX_LENGTH];
+        chunk_location location;
+        while (read_index_record(index, store->version, digest, store->digest_len, &location)) {
+            if (chunk_index_insert(&store->index, digest, &location) < 0) {
+                fclose(index);
+                store_close(store);
+                return -1;
+            }
+            if (location.pack_id > store->pack_id) {
+                store->pack_id = location.pack_id;
+            }
+            records++;
+        }
+        // Une erreur de lecture ne doit pas être prise pour une fin de journal
+        int failed = ferror(index);
+        fclose(index);
+        if (failed) {
+            fprintf(stderr, "Erreur de lecture de l'index du dépôt.\n");
+            store_close(store);
+            return -1;
+        }
+    }
+    if (!writable) {
+        return 0;
+    }
+    if (drop_torn_record(index_path, records * record) != 0) {
+        store_close(store);
+        return -1;
+    }
+
+    store->index_file = fopen(index_path, "ab");
+    if (!store->index_file) {
+        perror("Erreur lors de l'ouverture de l'index du dépôt");
+        store_close(store);
+        return -1;
+    }
+
+    // Écriture en arrière-plan : l'index passe alors par le même moteur, jamais par le tampon stdio
+    if (io_backend_choice != IO_BACKEND_SYNC) {
+        store->writer = malloc(sizeof(pack_writer));
+        if (!store->writer || pack_writer_init(store->writer, io_backend_choice, fileno(store->index_file)) != 0) {
+            if (!store->writer) {
+                perror("Erreur d'allocation mémoire pour l'écriture des packs");
+            }
+            free(store->writer);
+            store->writer = NULL;
+            store_close(store);
+            return -1;
+        }
+    }
+
+    if (open_current_pack(store) != 0) {
+        store_close(store);
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour ouvrir (ou créer) le dépôt de chunks d'un répertoire de sauvegarde
+int store_open(chunk_store_t *store, const char *backup_dir) {
+    /* @param: store est la structure du dépôt à initialiser
+    *           backup_dir est le répertoire de destination qui contient toutes les sauvegardes
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    return store_load(store, backup_dir, true, LOCK_SH);
+}
+
+// Fonction pour ouvrir (ou créer) le dépôt de chunks sans qu'aucune autre opération ne l'utilise
+int store_open_exclusive(chunk_store_t *store, const char *backup_dir) {
+    /* @param: backup_dir est le répertoire de destination qui contient toutes les sauvegardes
+    *  @return: 0 en cas de succès, -1 sinon (en particulier si une sauvegarde ou un serveur utilise le dépôt)
+    */
+    return store_load(store, backup_dir, true, LOCK_EX);
+}
+
+// Fonction pour ouvrir un dépôt existant en lecture seule
+int store_open_read(chunk_store_t *store, const char *backup_dir) {
+    /* @param: backup_dir est le répertoire de destination qui contient toutes les sauvegardes.
+    *           Seuls store_lookup, store_read et les fonctions de relecture peuvent être utilisés.
+    *  @return: 0 en cas de succès, -1 si le dépôt n'existe pas ou est illisible
+    */
+    return store_load(store, backup_dir, false, LOCK_SH);
+}
+
+// Fonction pour fermer le dépôt et libérer l'index en mémoire
+void store_close(chunk_store_t *store) {
+    close_current_pack(store);
+    if (store->writer) {
+        pack_writer_free(store->writer);
+        free(store->writer);
+    }
+    if (store->index_file) {
+        fclose(store->index_file);
+    }
+    pack_reader_free(&store->reader);
+    free(store->codec_buffer);
+    chunk_index_free(&store->index);
+    free(store->path);
+    // Le verrou est relâché en dernier, une fois les packs et l'index fermés
+    if (store->lock_fd >= 0) {
+        close(store->lock_fd);
+    }
+    memset(store, 0, sizeof(*store));
+    store->lock_fd = -1;
+}
+
+// Fonction pour chercher un chunk dans le dépôt
+int store_lookup(chunk_store_t *store, const unsigned char *digest, chunk_location *location) {
+    /* @return: 1 si le chunk est présent (location est alors rempli), 0 sinon
+    */
+    uint64_t start = metrics_start();
+    int found = chunk_index_find(&store->index, digest, location);
+    metrics_stop(METRIC_LOOKUP, start, 0);
+    return found;
+}
+
+// Fonction pour ajouter un chunk au dépôt s'il n'y est pas déjà
+int store_put(chunk_store_t *store, const unsigned char *digest, const void *data, size_t size) {
+    /* @param: digest est le digest du chunk, qui sert de clé dans le dépôt
+    *           data et size décrivent les données du chunk
+    *  @return: 1 si le chunk a été écrit, 0 s'il était déjà stocké, -1 en cas d'erreur
+    */
+    if (store_lookup(store, digest, NULL)) {
+        return 0;
+    }
+
+    // Compression dans le thread appelant (le pipeline de sauvegarde compresse dans ses lecteurs)
+    if (store->codec.algo != CODEC_NONE) {
+        size_t bound = codec_bound(store->codec.algo, size);
+        if (bound > store->codec_capacity) {
+            unsigned char *buffer = realloc(store->codec_buffer, bound);
+            if (!buffer) {
+                perror("Erreur d'allocation mémoire pour la compression");
+                return -1;
+            }
+            store->codec_buffer = buffer;
+            store->codec_capacity = bound;
+        }
+        size_t compressed = codec_compress(&store->codec, data, size, store->codec_buffer, store->codec_capacity);
+        if (compressed > 0) {
+            return store_put_compressed(store, digest, (uint32_t)size, store->codec.algo, store->codec_buffer, compressed);
+        }
+    }
+    return store_put_compressed(store, digest, (uint32_t)size, CODEC_NONE, data, size);
+}
+
+// Écriture d'un chunk à la fin du pack courant et de son enregistrement dans le journal d'index
+static int append_chunk(chunk_store_t *store, const unsigned char *digest, uint32_t size,
+                        codec_algo codec, const void *stored, size_t stored_size, chunk_location *location) {
+    /* @param: location reçoit l'emplacement du chunk écrit (l'index en mémoire n'est pas modifié)
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    // Le pack courant est plein : on passe au suivant, les packs existants ne sont jamais réécrits
+    if (store->pack_size >= PACK_MAX_SIZE) {
+        if (close_current_pack(store) != 0) {
+            return -1;
+        }
+        store->pack_id++;
+        if (open_current_pack(store) != 0) {
+            return -1;
+        }
+    }
+
+    // En-tête du chunk dans le pack (permet de reconstruire l'index) : signature, taille stockée, digest,
+    // puis taille d'origine et compression pour un chunk compressé
+    uint32_t magic = codec == CODEC_NONE ? PACK_CHUNK_MAGIC : PACK_ZCHUNK_MAGIC;
+    uint32_t size32 = (uint32_t)stored_size;
+    uint32_t codec32 = (uint32_t)codec;
+    unsigned char header[4 * sizeof(uint32_t) + DIGEST_MAX_LENGTH];
+    size_t header_size = 0;
+    memcpy(header, &magic, sizeof(magic));
+    header_size += sizeof(magic);
+    memcpy(header + header_size, &size32, sizeof(size32));
+    header_size += sizeof(size32);
+    memcpy(header + header_size, digest, store->digest_len);
+    header_size += store->digest_len;
+    if (codec != CODEC_NONE) {
+        memcpy(header + header_size, &size, sizeof(size));
+        header_size += sizeof(size);
+        memcpy(header + header_size, &codec32, sizeof(codec32));
+        header_size += sizeof(codec32);
+    }
+    location->pack_id = store->pack_id;
+    location->offset = store->pack_size + header_size;
+    location->size = size;
+    location->stored_size = size32;
+    location->codec = codec32;
+    unsigned char record[INDEX_RECORD_SIZE_V2(DIGEST_MAX_LENGTH)];
+    size_t record_size = index_record(store, digest, location, record);
+
+    if (store->writer) {
+        // Copié dans le tampon d'écriture : l'index suivra les données
+        if (pack_writer_append(store->writer, store->pack_fd, store->pack_size, header, header_size,
+                               stored, stored_size, record, record_size) != 0) {
+            perror("Erreur d'écriture dans le fichier pack");
+            return -1;
+        }
+    } else {
+        uint64_t start = metrics_start();
+        if (fwrite(header, 1, header_size, store->pack) != header_size ||
+            fwrite(stored, 1, stored_size, store->pack) != stored_size) {
+            perror("Erreur d'écriture dans le fichier pack");
+            return -1;
+        }
+        // Les données doivent être dans le pack avant que l'index ne les référence
+        fflush(store->pack);
+
+        if (fwrite(record, 1, record_size, store->index_file) != record_size) {
+            perror("Erreur d'écriture dans l'index du dépôt");
+            return -1;
+        }
+        fflush(store->index_file);
+        metrics_stop(METRIC_WRITE, start, header_size + stored_size);
+    }
+
+    store->pack_size = location->offset + stored_size;
+    return 0;
+}
+
+// Fonction pour ajouter un chunk déjà compressé (ou à stocker brut) s'il n'y est pas déjà
+int store_put_compressed(chunk_store_t *store, const unsigned char *digest, uint32_t size,
+                         codec_algo codec, const void *stored, size_t stored_size) {
+    /* @param: size est la taille d'origine du chunk
+    *           stored et stored_size sont les données écrites dans le pack (compressées par codec)
+    *  @return: 1 si le chunk a été écrit, 0 s'il était déjà stocké, -1 en cas d'erreur
+    */
+    if (store_lookup(store, digest, NULL)) {
+        return 0;
+    }
+    // Dépôt distant : le serveur ne demandera les données que s'il ne les a pas
+    if (store->remote) {
+        return remote_put(store->remote, digest, size, codec, stored, stored_size);
+    }
+    if (codec != CODEC_NONE && store->version < 2) {
+        fprintf(stderr, "Chunk compressé refusé par un dépôt version %d.\n", store->version);
+        return -1;
+    }
+
+    chunk_location location;
+    if (append_chunk(store, digest, size, codec, stored, stored_size, &location) != 0) {
+        return -1;
+    }
+    store->new_chunks++;
+    store->new_bytes += stored_size;
+    store->new_raw_bytes += size;
+    // Les données sont déjà dans le pack : les lecteurs de l'index n'attendent que l'ajout en mémoire
+    if (store->index_lock) {
+        pthread_rwlock_wrlock(store->index_lock);
+    }
+    int inserted = chunk_index_insert(&store->index, digest, &location);
+    if (store->index_lock) {
+        pthread_rwlock_unlock(store->index_lock);
+    }
+    return inserted < 0 ? -1 : 1;
+}
+
+// Fonction pour initialiser un lecteur de packs
+void pack_reader_init(pack_reader *reader) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+}
+
+// Fonction pour libérer un lecteur de packs
+void pack_reader_free(pack_reader *reader) {
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+    free(reader->scratch);
+    free(reader->plain);
+    pack_reader_init(reader);
+}
+
+// Lecture complète d'une zone d'un pack
+static int read_at(int fd, void *buffer, size_t size, uint64_t offset) {
+    uint64_t start = metrics_start();
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = pread(fd, (char *)buffer + done, size - done, (off_t)(offset + done));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        done += (size_t)got;
+    }
+    metrics_stop(METRIC_READ, start, size);
+    return 0;
+}
+
+// Ouverture du pack d'un chunk ; le dernier pack lu reste ouvert, une restauration lit
+// le plus souvent des chunks voisins
+static int reader_open_pack(const chunk_store_t *store, pack_reader *reader, uint32_t pack_id) {
+    if (reader->fd >= 0 && reader->pack_id == pack_id) {
+        return 0;
+    }
+    char path[4096];
+    pack_path(store, pack_id, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat pack_stat;
+    if (fd < 0 || fstat(fd, &pack_stat) != 0) {
+        perror("Erreur lors de l'ouverture du fichier pack");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+    reader->fd = fd;
+    reader->pack_id = pack_id;
+    reader->pack_size = (uint64_t)pack_stat.st_size;
+    return 0;
+}
+
+// Fonction pour relire les données d'un chunk telles qu'elles sont dans le pack (sans décompression)
+int store_read_stored(const chunk_store_t *store, pack_reader *reader, const chunk_location *location, void *buffer) {
+    /* @param: location vient de store_lookup ; buffer doit contenir location->stored_size octets.
+    *           Si le chunk est dans le pack courant, l'appelant doit avoir appelé store_flush avant.
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    if (reader_open_pack(store, reader, location->pack_id) != 0) {
+        return -1;
+    }
+    if (read_at(reader->fd, buffer, location->stored_size, location->offset) != 0) {
+        fprintf(stderr, "Chunk tronqué dans le pack %06u.\n", location->pack_id);
+        return -1;
+    }
+    return 0;
+}
+
+// Agrandissement d'un tampon de lecteur
+static int reserve(unsigned char **buffer, size_t *size, size_t needed) {
+    if (needed <= *size) {
+        return 0;
+    }
+    unsigned char *grown = realloc(*buffer, needed);
+    if (!grown) {
+        perror("Erreur d'allocation mémoire pour la lecture d'un chunk");
+        return -1;
+    }
+    *buffer = grown;
+    *size = needed;
+    return 0;
+}
+
+// Fonction pour relire un chunk dans son pack et vérifier son en-tête, sa décompression et son digest
+chunk_check store_check_chunk(const chunk_store_t *store, pack_reader *reader, const unsigned char *digest,
+                              const chunk_location *location) {
+    /* @param: digest et location forment l'enregistrement d'index du chunk
+    *           reader garde ouvert le dernier pack lu ; ses tampons sont réutilisés d'un chunk à l'autre
+    *  @return: CHUNK_OK si le chunk relu a bien ce digest, la nature du défaut sinon
+    */
+    // En-tête écrit par append_chunk : signature, taille stockée, digest, puis taille et compression
+    uint64_t header_size = 2 * sizeof(uint32_t) + store->digest_len;
+    if (location->codec != CODEC_NONE) {
+        header_size += 2 * sizeof(uint32_t);
+    }
+    if (location->offset < header_size) {
+        return CHUNK_BAD_HEADER;
+    }
+    // Un enregistrement d'index abîmé ne doit pas provoquer d'allocation démesurée : les octets stockés
+    // sont bornés par la taille réelle du pack (un arbre peut dépasser PACK_MAX_SIZE et la taille maximale
+    // des chunks), la taille décompressée n'est allouée qu'une fois l'en-tête du pack trouvé identique
+    if (reader_open_pack(store, reader, location->pack_id) != 0) {
+        return CHUNK_MISSING;
+    }
+    if (location->offset > reader->pack_size || location->stored_size > reader->pack_size - location->offset) {
+        return CHUNK_TRUNCATED;
+    }
+    size_t total = (size_t)(header_size + location->stored_size);
+    if (reserve(&reader->scratch, &reader->scratch_size, total) != 0) {
+        return CHUNK_MISSING;
+    }
+    if (read_at(reader->fd, reader->scratch, total, location->offset - header_size) != 0) {
+        return CHUNK_TRUNCATED;
+    }
+
+    const unsigned char *header = reader->scratch;
+    uint32_t magic, stored_size, size = location->stored_size, codec = CODEC_NONE;
+    memcpy(&magic, header, sizeof(magic));
+    memcpy(&stored_size, header + sizeof(magic), sizeof(stored_size));
+    const unsigned char *header_digest = header + 2 * sizeof(uint32_t);
+    if (location->codec != CODEC_NONE) {
+        memcpy(&size, header_digest + store->digest_len, sizeof(size));
+        memcpy(&codec, header_digest + store->digest_len + sizeof(size), sizeof(codec));
+    }
+    if (magic != (location->codec == CODEC_NONE ? PACK_CHUNK_MAGIC : PACK_ZCHUNK_MAGIC) ||
+        stored_size != location->stored_size || size != location->size || codec != location->codec ||
+        memcmp(header_digest, digest, store->digest_len) != 0) {
+        return CHUNK_BAD_HEADER;
+    }
+
+    const unsigned char *data = header + header_size;
+    if (location->codec != CODEC_NONE) {
+        if (reserve(&reader->plain, &reader->plain_size, location->size ? location->size : 1) != 0) {
+            return CHUNK_MISSING;
+        }
+        if (codec_decompress((codec_algo)location->codec, data, location->stored_size, reader->plain, location->size) != 0) {
+            return CHUNK_CORRUPT;
+        }
+        data = reader->plain;
+    }
+    unsigned char computed[DIGEST_MAX_LENGTH];
+    if (compute_hash(store->hash, data, location->size, computed) != 0 ||
+        memcmp(computed, digest, store->digest_len) != 0) {
+        return CHUNK_CORRUPT;
+    }
+    return CHUNK_OK;
+}
+
+// Fonction pour relire un chunk avec un lecteur propre au thread appelant (lectures concurrentes)
+long store_read(chunk_store_t *store, pack_reader *reader, const unsigned char *digest, void *buffer, size_t buffer_size) {
+    /* @param: reader garde ouvert le dernier pack lu et le tampon de décompression
+    *  @return: la taille (décompressée) du chunk lu dans buffer, -1 si le chunk est absent ou illisible
+    */
+    chunk_location location;
+    if (!store_lookup(store, digest, &location)) {
+        fprintf(stderr, "Chunk absent du dépôt.\n");
+        return -1;
+    }
+    if (location.size > buffer_size) {
+        fprintf(stderr, "Tampon trop petit pour le chunk (%u octets).\n", location.size);
+        return -1;
+    }
+
+    // Le pack courant peut contenir des données encore en tampon
+    if (location.pack_id == store->pack_id && store_flush(store) != 0) {
+        return -1;
+    }
+    if (reader_open_pack(store, reader, location.pack_id) != 0) {
+        return -1;
+    }
+
+    if (location.codec == CODEC_NONE) {
+        if (read_at(reader->fd, buffer, location.size, location.offset) != 0) {
+            fprintf(stderr, "Chunk tronqué dans le pack %06u.\n", location.pack_id);
+            return -1;
+        }
+        return (long)location.size;
+    }
+
+    // Chunk compressé : lu dans le tampon du lecteur puis décompressé dans celui de l'appelant
+    if (location.stored_size > reader->scratch_size) {
+        unsigned char *scratch = realloc(reader->scratch, location.stored_size);
+        if (!scratch) {
+            perror("Erreur d'allocation mémoire pour la décompression");
+            return -1;
+        }
+        reader->scratch = scratch;
+        reader->scratch_size = location.stored_size;
+    }
+    if (read_at(reader->fd, reader->scratch, location.stored_size, location.offset) != 0) {
+        fprintf(stderr, "Chunk tronqué dans le pack %06u.\n", location.pack_id);
+        return -1;
+    }
+    if (codec_decompress((codec_algo)location.codec, reader->scratch, location.stored_size, buffer, location.size) != 0) {
+        return -1;
+    }
+    return (long)location.size;
+}
+
+// Fonction pour rendre lisibles dans les packs tous les chunks déjà ajoutés
+int store_flush(chunk_store_t *store) {
+    /* @return: 0 en cas de succès, -1 si une écriture a échoué
+    */
+    if (store->writer) {
+        if (pack_writer_sync(store->writer) != 0) {
+            perror("Erreur d'écriture dans le fichier pack");
+            return -1;
+        }
+        return 0;
+    }
+    if (store->pack && fflush(store->pack) != 0) {
+        perror("Erreur d'écriture dans le fichier pack");
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour relire les données d'un chunk depuis son pack
+long store_get(chunk_store_t *store, const unsigned char *digest, void *buffer, size_t buffer_size) {
+    /* @return: la taille du chunk lu dans buffer, -1 si le chunk est absent ou illisible
+    */
+    return store_read(store, &store->reader, digest, buffer, buffer_size);
+}
+
+// Tirage d'une nouvelle génération, écrite dans un fichier temporaire puis renommée
+static int write_epoch(const chunk_store_t *store, unsigned char *epoch) {
+    char path[4096], tmp_path[4096 + 8];
+    snprintf(path, sizeof(path), "%s/%s", store->path, STORE_EPOCH_NAME);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (getrandom(epoch, STORE_EPOCH_LENGTH, 0) != STORE_EPOCH_LENGTH) {
+        perror("Erreur lors du tirage de la génération du dépôt");
+        return -1;
+    }
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        perror("Erreur lors de l'écriture de la génération du dépôt");
+        return -1;
+    }
+    int ok = fwrite(epoch, 1, STORE_EPOCH_LENGTH, file) == STORE_EPOCH_LENGTH;
+    if (fclose(file) != 0 || !ok || rename(tmp_path, path) != 0) {
+        perror("Erreur lors de l'écriture de la génération du dépôt");
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour lire la génération du dépôt (tirée au premier appel)
+int store_epoch(chunk_store_t *store, unsigned char *epoch) {
+    /* @param: epoch reçoit STORE_EPOCH_LENGTH octets
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", store->path, STORE_EPOCH_NAME);
+    FILE *file = fopen(path, "rb");
+    if (file) {
+        size_t got = fread(epoch, 1, STORE_EPOCH_LENGTH, file);
+        fclose(file);
+        if (got == STORE_EPOCH_LENGTH) {
+            return 0;
+        }
+    }
+    return write_epoch(store, epoch);
+}
+
+// Fonction pour renouveler la génération du dépôt avant de supprimer des chunks
+int store_renew_epoch(chunk_store_t *store) {
+    /* @return: 0 en cas de succès, -1 sinon (rien ne doit alors être supprimé)
+    */
+    // Un dépôt qui n'a jamais été servi n'a pas de génération : aucun client n'en garde de cache
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", store->path, STORE_EPOCH_NAME);
+    if (access(path, F_OK) != 0) {
+        return 0;
+    }
+    unsigned char epoch[STORE_EPOCH_LENGTH];
+    return write_epoch(store, epoch);
+}
+
+// Fonction pour retrouver le dépôt à partir du chemin d'une sauvegarde
+char *store_dir_of_backup(const char *backup_id) {
+    /* @param: backup_id est le chemin d'une sauvegarde (destination/YYYY-MM-DD-hh:mm:ss.sss)
+    *  @return: le répertoire de destination qui contient le dépôt, à libérer par l'appelant
+    */
+    char *parent = strdup(backup_id);
+    if (!parent) {
+        perror("Erreur d'allocation mémoire");
+        return NULL;
+    }
+
+    // Suppression des '/' finaux puis du dernier composant
+    size_t len = strlen(parent);
+    while (len > 1 && parent[len - 1] == '/') {
+        parent[--len] = '\0';
+    }
+    char *last_slash = strrchr(parent, '/');
+    if (!last_slash) {
+        free(parent);
+        return strdup(".");
+    }
+    if (last_slash == parent) {
+        parent[1] = '\0';
+    } else {
+        *last_slash = '\0';
+    }
+    return parent;
+}
+
+// Occupation d'un pack, relevée dans l'index par store_sweep
+typedef struct {
+    uint64_t file_size;   // Taille du fichier pack
+    uint64_t live_bytes;  // Octets des chunks encore référencés (en-têtes compris)
+    uint64_t dead_bytes;
+    bool exists;
+    bool repack;          // Chunks vivants à recopier, puis pack supprimé
+    bool remove;          // Pack supprimé
+} pack_usage;
+
+// Place occupée dans un pack par un chunk : son en-tête puis ses données
+static uint64_t chunk_footprint(const chunk_store_t *store, const chunk_location *location) {
+    uint64_t header = 2 * sizeof(uint32_t) + store->digest_len;
+    if (location->codec != CODEC_NONE) {
+        header += 2 * sizeof(uint32_t);
+    }
+    return header + location->stored_size;
+}
+
+// Recensement des fichiers pack du dépôt (y compris ceux qu'aucun enregistrement d'index ne cite)
+static pack_usage *list_packs(const chunk_store_t *store, uint32_t *pack_count) {
+    uint32_t count = store->pack_id + 1;
+    for (uint32_t i = 0; i < store->index.count; i++) {
+        if (store->index.values[i].pack_id >= count) {
+            count = store->index.values[i].pack_id + 1;
+        }
+    }
+    DIR *dir = opendir(store->path);
+    if (!dir) {
+        perror("Erreur lors de l'ouverture du dépôt");
+        return NULL;
+    }
+    struct dirent *entry;
+    unsigned id;
+    char suffix;
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "pack-%6u.pac%c", &id, &suffix) == 2 && suffix == 'k' && id >= count) {
+            count = id + 1;
+        }
+    }
+    pack_usage *packs = calloc(count, sizeof(pack_usage));
+    if (!packs) {
+        perror("Erreur d'allocation mémoire pour le nettoyage du dépôt");
+        closedir(dir);
+        return NULL;
+    }
+    rewinddir(dir);
+    while ((entry = readdir(dir)) != NULL) {
+        struct stat pack_stat;
+        if (sscanf(entry->d_name, "pack-%6u.pac%c", &id, &suffix) == 2 && suffix == 'k' && id < count &&
+            fstatat(dirfd(dir), entry->d_name, &pack_stat, 0) == 0) {
+            packs[id].exists = true;
+            packs[id].file_size = (uint64_t)pack_stat.st_size;
+        }
+    }
+    closedir(dir);
+    *pack_count = count;
+    return packs;
+}
+
+// Chunk vivant à recopier
+typedef struct {
+    uint32_t pack_id;
+    uint32_t entry;       // Numéro d'entrée dans l'index
+    uint64_t offset;
+} moved_chunk;
+
+// Les chunks sont recopiés pack par pack, dans l'ordre du fichier
+static int compare_moved(const void *a, const void *b) {
+    const moved_chunk *ma = a, *mb = b;
+    if (ma->pack_id != mb->pack_id) {
+        return ma->pack_id < mb->pack_id ? -1 : 1;
+    }
+    return ma->offset < mb->offset ? -1 : ma->offset > mb->offset;
+}
+
+// Recopie des chunks vivants des packs à réécrire à la fin du pack courant
+static int repack_chunks(chunk_store_t *store, const unsigned char *live, const pack_usage *packs) {
+    moved_chunk *moved = NULL;
+    size_t count = 0, capacity = 0;
+    for (uint32_t i = 0; i < store->index.count; i++) {
+        const chunk_location *location = &store->index.values[i];
+        if (live[i] && packs[location->pack_id].repack) {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 1024;
+                moved_chunk *grown = realloc(moved, capacity * sizeof(*moved));
+                if (!grown) {
+                    perror("Erreur d'allocation mémoire pour le nettoyage du dépôt");
+                    free(moved);
+                    return -1;
+                }
+                moved = grown;
+            }
+            moved[count++] = (moved_chunk){location->pack_id, i, location->offset};
+        }
+    }
+    if (count > 0) {
+        qsort(moved, count, sizeof(*moved), compare_moved);
+    }
+
+    unsigned char *buffer = NULL;
+    size_t buffer_size = 0;
+    int status = 0;
+    for (size_t m = 0; status == 0 && m < count; m++) {
+        chunk_location *location = &store->index.values[moved[m].entry];
+        if (location->stored_size > buffer_size) {
+            unsigned char *grown = realloc(buffer, location->stored_size);
+            if (!grown) {
+                perror("Erreur d'allocation mémoire pour le nettoyage du dépôt");
+                status = -1;
+                break;
+            }
+            buffer = grown;
+            buffer_size = location->stored_size;
+        }
+        // Les données sont recopiées telles quelles, sans décompression
+        chunk_location moved_to;
+        const unsigned char *digest = store->index.keys + (size_t)moved[m].entry * store->digest_len;
+        if (store_read_stored(store, &store->reader, location, buffer) != 0 ||
+            append_chunk(store, digest, location->size, (codec_algo)location->codec, buffer,
+                         location->stored_size, &moved_to) != 0) {
+            status = -1;
+            break;
+        }
+        *location = moved_to;
+    }
+    free(buffer);
+    free(moved);
+    return status;
+}
+
+// Mise sur disque des packs first..store->pack_id (le pack courant et ceux remplis pendant la recopie)
+static int sync_packs(chunk_store_t *store, uint32_t first) {
+    if (fflush(store->pack) != 0) {
+        perror("Erreur d'écriture dans le fichier pack");
+        return -1;
+    }
+    for (uint32_t p = first; p <= store->pack_id; p++) {
+        char path[4096];
+        pack_path(store, p, path, sizeof(path));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0 || fsync(fd) != 0) {
+            perror("Erreur d'écriture dans le fichier pack");
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+// Réécriture complète du journal d'index avec les seuls chunks vivants, remplacé d'un coup
+static int rewrite_index(chunk_store_t *store, const unsigned char *live) {
+    char path[4096], tmp_path[4096 + 8];
+    snprintf(path, sizeof(path), "%s/index", store->path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/index.tmp", store->path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        perror("Erreur lors de la création de l'index du dépôt");
+        return -1;
+    }
+    int ok = 1;
+    unsigned char record[INDEX_RECORD_SIZE_V2(DIGEST_MAX_LENGTH)];
+    for (uint32_t i = 0; ok && i < store->index.count; i++) {
+        if (live[i]) {
+            size_t size = index_record(store, store->index.keys + (size_t)i * store->digest_len,
+                                       &store->index.values[i], record);
+            ok = fwrite(record, 1, size, file) == size;
+        }
+    }
+    // Les packs supprimés ensuite ne doivent plus être cités par l'index sur le disque
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp_path, path) != 0) {
+        perror("Erreur d'écriture de l'index du dépôt");
+        unlink(tmp_path);
+        return -1;
+    }
+
+    // Les prochains ajouts vont dans le nouveau journal
+    fclose(store->index_file);
+    store->index_file = fopen(path, "ab");
+    if (!store->index_file) {
+        perror("Erreur lors de l'ouverture de l'index du dépôt");
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour supprimer du dépôt les chunks qui ne sont plus référencés
+int store_sweep(chunk_store_t *store, const unsigned char *live, unsigned repack_percent, bool apply,
+                store_sweep_stats *stats) {
+    /* @param: live contient un octet par entrée de l'index (non nul : chunk référencé)
+    *           repack_percent : un pack dont les chunks vivants occupent moins de ce pourcentage est réécrit
+    *           apply : faux pour seulement établir le bilan (--dry-run)
+    *           stats reçoit le bilan du nettoyage
+    *  @return: 0 en cas de succès, -1 sinon (l'index sur le disque reste alors valide)
+    */
+    memset(stats, 0, sizeof(*stats));
+    if (store->writer || store->remote) {
+        fprintf(stderr, "Le nettoyage du dépôt demande des écritures synchrones et locales.\n");
+        return -1;
+    }
+    uint32_t pack_count;
+    pack_usage *packs = list_packs(store, &pack_count);
+    if (!packs) {
+        return -1;
+    }
+
+    // Occupation des packs d'après l'index seul : aucun pack n'est lu pour la mesurer
+    for (uint32_t i = 0; i < store->index.count; i++) {
+        const chunk_location *location = &store->index.values[i];
+        uint64_t footprint = chunk_footprint(store, location);
+        if (live[i]) {
+            packs[location->pack_id].live_bytes += footprint;
+            stats->live_chunks++;
+        } else {
+            packs[location->pack_id].dead_bytes += footprint;
+            stats->dead_chunks++;
+            stats->dead_bytes += footprint;
+        }
+    }
+
+    // Le pack courant reçoit les chunks recopiés : il n'est jamais réécrit ni supprimé
+    for (uint32_t p = 0; p < pack_count; p++) {
+        if (!packs[p].exists || p == store->pack_id) {
+            continue;
+        }
+        if (packs[p].live_bytes == 0) {
+            packs[p].remove = true;
+            stats->packs_deleted++;
+            stats->freed_bytes += packs[p].file_size;
+        } else if (packs[p].live_bytes * 100 < packs[p].file_size * repack_percent) {
+            packs[p].repack = true;
+            packs[p].remove = true;
+            stats->packs_repacked++;
+            stats->repacked_bytes += packs[p].live_bytes;
+            stats->freed_bytes += packs[p].file_size - packs[p].live_bytes;
+        }
+    }
+
+    int status = 0;
+    if (apply) {
+        // Un pack orphelin plus récent que le pack courant (sauvegarde interrompue avant l'index) est supprimé
+        // plus bas : en passant au pack suivant, la recopie y écrirait. Elle part alors d'un pack neuf,
+        // après tous les packs présents.
+        if (stats->packs_repacked > 0 && store->pack_id + 1 < pack_count) {
+            status = close_current_pack(store);
+            store->pack_id = pack_count;
+            if (status == 0) {
+                status = open_current_pack(store);
+            }
+        }
+        // Les copies sont écrites et mises sur disque avant que le nouvel index ne les cite
+        // et que les anciens packs disparaissent ; un arrêt brutal laisse au pire des octets inutiles
+        uint32_t first = store->pack_id;
+        if (status == 0) {
+            status = repack_chunks(store, live, packs);
+        }
+        if (status == 0) {
+            status = sync_packs(store, first);
+        }
+        if (status == 0) {
+            status = rewrite_index(store, live);
+        }
+        for (uint32_t p = 0; status == 0 && p < pack_count; p++) {
+            char path[4096];
+            pack_path(store, p, path, sizeof(path));
+            if (packs[p].remove && unlink(path) != 0) {
+                perror("Erreur lors de la suppression d'un pack");
+            }
+        }
+    }
+    free(packs);
+    return status;
+}
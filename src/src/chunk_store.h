@@ -0,0 +1,148 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "hash.h"
+#include "chunker.h"
+#include "chunk_index.h"
+#include "compression.h"
+#include "pack_writer.h"
+
+// Nom du dépôt de chunks, partagé par toutes les sauvegardes d'une destination
+#define STORE_DIR ".store"
+
+// Taille au-delà de laquelle un nouveau fichier pack est commencé
+#define PACK_MAX_SIZE (64u * 1024u * 1024u)
+
+// Signature placée devant chaque chunk dans un fichier pack
+#define PACK_CHUNK_MAGIC 0x4b4e4843u // "CHNK"
+// Signature d'un chunk compressé : l'en-tête est suivi de la taille d'origine et de la compression (u32)
+#define PACK_ZCHUNK_MAGIC 0x5a4e4843u // "CHNZ"
+
+// Version du format du dépôt (écrite dans .store/config). Version 2 : chunks compressés
+#define STORE_VERSION 2
+
+// Taille d'un enregistrement du journal d'index : digest, pack, position, taille
+#define INDEX_RECORD_SIZE(digest_len) ((digest_len) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t))
+// Version 2 : suivis de la taille dans le pack et de la compression
+#define INDEX_RECORD_SIZE_V2(digest_len) (INDEX_RECORD_SIZE(digest_len) + 2 * sizeof(uint32_t))
+
+// Génération du dépôt (.store/epoch) : tirée au hasard à la création, renouvelée par chaque nettoyage qui
+// supprime des chunks. Un client qui garde son propre cache des fichiers ne le reprend que pour la même
+// génération : une liste de chunks du cache n'est alors jamais plus ancienne qu'un nettoyage.
+#define STORE_EPOCH_NAME "epoch"
+#define STORE_EPOCH_LENGTH 16
+
+// Pourcentage d'occupation par des chunks vivants en dessous duquel --prune réécrit un pack
+#define PRUNE_REPACK_DEFAULT 50
+
+// Bilan d'un nettoyage du dépôt (store_sweep)
+typedef struct {
+    uint64_t live_chunks;
+    uint64_t dead_chunks;     // Chunks retirés de l'index
+    uint64_t dead_bytes;      // Place qu'ils occupaient dans les packs (en-têtes compris)
+    uint32_t packs_deleted;   // Packs sans aucun chunk vivant, supprimés sans être lus
+    uint32_t packs_repacked;  // Packs peu occupés dont les chunks vivants ont été recopiés
+    uint64_t repacked_bytes;  // Octets recopiés
+    uint64_t freed_bytes;     // Place rendue (packs supprimés, moins les copies pour les packs réécrits)
+} store_sweep_stats;
+
+// Lecteur de packs : chaque thread qui relit des chunks a le sien
+typedef struct {
+    int fd;                 // Dernier pack ouvert (-1 : aucun)
+    uint32_t pack_id;
+    uint64_t pack_size;     // Taille du pack à son ouverture (borne des vérifications de store_check_chunk)
+    unsigned char *scratch; // Données compressées en attente de décompression
+    size_t scratch_size;
+    unsigned char *plain;   // Données décompressées d'un chunk vérifié (store_check_chunk)
+    size_t plain_size;
+} pack_reader;
+
+// Résultat de la vérification d'un chunk dans son pack
+typedef enum {
+    CHUNK_OK,
+    CHUNK_MISSING,    // Pack absent ou illisible
+    CHUNK_TRUNCATED,  // Pack plus court que l'emplacement indiqué par l'index
+    CHUNK_BAD_HEADER, // En-tête du pack différent de l'enregistrement d'index
+    CHUNK_CORRUPT     // Décompression impossible ou digest différent
+} chunk_check;
+
+struct remote_session;
+
+// Dépôt de chunks adressé par contenu
+typedef struct {
+    char *path;           // Chemin du répertoire .store
+    FILE *pack;           // Pack courant, ouvert en ajout
+    uint32_t pack_id;     // Numéro du pack courant
+    uint64_t pack_size;   // Taille actuelle du pack courant
+    pack_reader reader;   // Lecteur utilisé par store_get
+    FILE *index_file;     // Journal de l'index, ouvert en ajout
+    pack_writer *writer;  // Écriture des packs et de l'index en arrière-plan (--io uring|threads), sinon stdio
+    int pack_fd;          // Pack courant quand writer est utilisé
+    chunk_index_t index;  // Index digest -> emplacement
+    chunker_params chunker; // Paramètres de découpage enregistrés dans le dépôt
+    hash_algo hash;       // Algorithme des digests, enregistré dans le dépôt
+    size_t digest_len;    // Taille des digests de ce dépôt
+    int version;          // Version du format du dépôt
+    codec_params codec;   // Compression des nouveaux chunks (aucune pour un dépôt version 1)
+    unsigned char *codec_buffer; // Tampon de compression de store_put
+    size_t codec_capacity;
+    uint64_t new_chunks;  // Chunks écrits pendant cette session
+    uint64_t new_bytes;   // Octets écrits pendant cette session (après compression)
+    uint64_t new_raw_bytes; // Taille d'origine des chunks écrits
+    struct remote_session *remote; // Dépôt d'un serveur : les nouveaux chunks lui sont proposés (network.c)
+    int lock_fd;          // Répertoire du dépôt, verrouillé par flock tant qu'il est ouvert (-1 : aucun)
+    pthread_rwlock_t *index_lock; // Index lu par d'autres threads (serveur) : pris en écriture pour chaque
+                                  // ajout, NULL sinon
+} chunk_store_t;
+
+// Paramètres de découpage et algorithme de hachage utilisés à la création d'un nouveau dépôt
+extern chunker_params store_default_chunker;
+extern hash_algo store_default_hash;
+// Compression des nouveaux chunks (--compress), choisie à chaque sauvegarde
+extern codec_params store_default_codec;
+
+// Fonction pour ouvrir (ou créer) le dépôt de chunks d'un répertoire de sauvegarde
+int store_open(chunk_store_t *store, const char *backup_dir);
+// Fonction pour ouvrir (ou créer) le dépôt de chunks sans qu'aucune autre opération ne l'utilise
+int store_open_exclusive(chunk_store_t *store, const char *backup_dir);
+// Fonction pour ouvrir un dépôt existant en lecture seule
+int store_open_read(chunk_store_t *store, const char *backup_dir);
+// Fonction pour fermer le dépôt et libérer l'index en mémoire
+void store_close(chunk_store_t *store);
+// Fonction pour chercher un chunk dans le dépôt
+int store_lookup(chunk_store_t *store, const unsigned char *digest, chunk_location *location);
+// Fonction pour ajouter un chunk au dépôt s'il n'y est pas déjà
+int store_put(chunk_store_t *store, const unsigned char *digest, const void *data, size_t size);
+// Fonction pour ajouter un chunk déjà compressé (ou à stocker brut) s'il n'y est pas déjà
+int store_put_compressed(chunk_store_t *store, const unsigned char *digest, uint32_t size,
+                         codec_algo codec, const void *stored, size_t stored_size);
+// Fonction pour rendre lisibles dans les packs tous les chunks déjà ajoutés
+int store_flush(chunk_store_t *store);
+// Fonction pour relire les données d'un chunk depuis son pack
+long store_get(chunk_store_t *store, const unsigned char *digest, void *buffer, size_t buffer_size);
+// Fonction pour relire un chunk avec un lecteur propre au thread appelant (lectures concurrentes)
+long store_read(chunk_store_t *store, pack_reader *reader, const unsigned char *digest, void *buffer, size_t buffer_size);
+// Fonction pour relire les données d'un chunk telles qu'elles sont dans le pack (sans décompression)
+int store_read_stored(const chunk_store_t *store, pack_reader *reader, const chunk_location *location, void *buffer);
+// Fonction pour relire un chunk dans son pack et vérifier son en-tête, sa décompression et son digest
+chunk_check store_check_chunk(const chunk_store_t *store, pack_reader *reader, const unsigned char *digest,
+                              const chunk_location *location);
+// Fonction pour initialiser un lecteur de packs
+void pack_reader_init(pack_reader *reader);
+// Fonction pour libérer un lecteur de packs
+void pack_reader_free(pack_reader *reader);
+// Fonction pour supprimer du dépôt les chunks qui ne sont plus référencés (live : un octet par entrée de l'index)
+int store_sweep(chunk_store_t *store, const unsigned char *live, unsigned repack_percent, bool apply,
+                store_sweep_stats *stats);
+// Fonction pour lire la génération du dépôt (tirée au premier appel)
+int store_epoch(chunk_store_t *store, unsigned char *epoch);
+// Fonction pour renouveler la génération du dépôt avant de supprimer des chunks
+int store_renew_epoch(chunk_store_t *store);
+// Fonction pour retrouver le dépôt à partir du chemin d'une sauvegarde
+char *store_dir_of_backup(const char *backup_id);
+
+#endif // CHUNK_STORE_H
@@ -0,0 +1,210 @@
+#include "chunker.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Table gear : une valeur pseudo-aléatoire de 64 bits par valeur d'octet.
+// Elle fait partie du format du dépôt (elle fixe les points de coupure),
+// elle est donc générée de façon déterministe.
+static uint64_t gear[256];
+static bool gear_ready = false;
+
+// Générateur splitmix64, utilisé uniquement pour remplir la table gear
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static void gear_init(void) {
+    if (gear_ready) {
+        return;
+    }
+    uint64_t state = 0x4c503235u; // "LP25"
+    for (int i = 0; i < 256; i++) {
+        gear[i] = splitmix64(&state);
+    }
+    gear_ready = true;
+}
+
+// Masque de 'bits' bits pris dans les poids forts du hash :
+// avec un décalage d'un bit par octet, ce sont eux qui dépendent de la plus large fenêtre
+static uint64_t high_mask(int bits) {
+    if (bits <= 0) {
+        return 0;
+    }
+    if (bits >= 64) {
+        return ~0ull;
+    }
+    return ((1ull << bits) - 1) << (64 - bits);
+}
+
+// Fonction pour initialiser et valider des paramètres de découpage
+int chunker_params_init(chunker_params *params, uint32_t min_size, uint32_t avg_size, uint32_t max_size) {
+    /* @param: min_size, avg_size et max_size sont les tailles minimale, moyenne et maximale des chunks
+    *  @return: 0 si la configuration est valide, -1 sinon
+    */
+    if (min_size < CHUNK_LIMIT_MIN || max_size > CHUNK_LIMIT_MAX ||
+        min_size >= avg_size || avg_size >= max_size) {
+        fprintf(stderr, "Tailles de chunk invalides (%u, %u, %u) : il faut %u <= min < moy < max <= %u.\n",
+                min_size, avg_size, max_size, CHUNK_LIMIT_MIN, CHUNK_LIMIT_MAX);
+        return -1;
+    }
+    if ((avg_size & (avg_size - 1)) != 0) {
+        fprintf(stderr, "La taille moyenne des chunks doit être une puissance de 2 (%u).\n", avg_size);
+        return -1;
+    }
+
+    gear_init();
+
+    int bits = 0;
+    while ((1u << bits) < avg_size) {
+        bits++;
+    }
+
+    // Découpage normalisé : un masque plus strict avant la taille moyenne et plus lâche après
+    // resserre la distribution des tailles autour de avg_size
+    params->min_size = min_size;
+    params->avg_size = avg_size;
+    params->max_size = max_size;
+    params->mask_s = high_mask(bits + 2);
+    params->mask_l = high_mask(bits - 2);
+    return 0;
+}
+
+// Fonction pour analyser une configuration "MIN,AVG,MAX"
+int chunker_params_parse(chunker_params *params, const char *spec) {
+    unsigned long min_size, avg_size, max_size;
+    char extra;
+    if (sscanf(spec, "%lu,%lu,%lu%c", &min_size, &avg_size, &max_size, &extra) != 3) {
+        fprintf(stderr, "Format attendu pour les tailles de chunk : MIN,MOY,MAX (octets).\n");
+        return -1;
+    }
+    return chunker_params_init(params, (uint32_t)min_size, (uint32_t)avg_size, (uint32_t)max_size);
+}
+
+// Fonction qui renvoie la longueur du prochain chunk au début de data
+size_t chunker_cut(const chunker_params *params, const unsigned char *data, size_t len) {
+    /* @param: data contient au moins max_size octets, sauf en fin de fichier
+    *  @return: la longueur du chunk qui commence en data[0]
+    */
+    if (len <= params->min_size) {
+        return len;
+    }
+
+    size_t limit = len < params->max_size ? len : params->max_size;
+    size_t normal = params->avg_size < limit ? params->avg_size : limit;
+    uint64_t hash = 0;
+    size_t i = params->min_size;
+
+    // Les min_size premiers octets ne peuvent pas contenir de coupure : on ne les hache pas
+    for (; i < normal; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & params->mask_s)) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if (!(hash & params->mask_l)) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+// Fonction pour préparer la lecture d'un fichier en chunks
+int chunk_reader_init(chunk_reader *reader, FILE *file, const chunker_params *params) {
+    size_t capacity = chunk_reader_buffer_size(params);
+    unsigned char *buffer = malloc(capacity);
+    if (!buffer) {
+        perror("Erreur d'allocation mémoire pour le tampon de découpage");
+        return -1;
+    }
+    chunk_reader_init_buffer(reader, file, params, buffer, capacity);
+    reader->owns_buffer = true;
+    return 0;
+}
+
+// Fonction qui renvoie la taille du tampon de lecture pour ces paramètres
+size_t chunk_reader_buffer_size(const chunker_params *params) {
+    // Le tampon contient plusieurs chunks maximum pour amortir les lectures
+    size_t capacity = (size_t)params->max_size * 4;
+    return capacity < CHUNK_READ_SIZE ? CHUNK_READ_SIZE : capacity;
+}
+
+// Fonction pour préparer la lecture d'un fichier dans un tampon réutilisé d'un fichier à l'autre
+void chunk_reader_init_buffer(chunk_reader *reader, FILE *file, const chunker_params *params,
+                              unsigned char *buffer, size_t capacity) {
+    /* @param: buffer appartient à l'appelant et contient au moins chunk_reader_buffer_size(params) octets
+    */
+    memset(reader, 0, sizeof(*reader));
+    reader->file = file;
+    reader->params = params;
+    reader->buffer = buffer;
+    reader->capacity = capacity;
+}
+
+// Fonction pour préparer la lecture d'une source quelconque dans un tampon fourni par l'appelant
+void chunk_reader_init_source(chunk_reader *reader, chunk_read_fn read, void *source, const chunker_params *params,
+                              unsigned char *buffer, size_t capacity) {
+    /* @param: read est appelé jusqu'à remplir le tampon ; il peut rendre moins d'octets que demandé
+    */
+    chunk_reader_init_buffer(reader, NULL, params, buffer, capacity);
+    reader->read = read;
+    reader->source = source;
+}
+
+// Fonction pour obtenir le chunk suivant du fichier
+long chunk_reader_next(chunk_reader *reader, const unsigned char **chunk) {
+    /* @param: chunk reçoit un pointeur vers les données, valide jusqu'au prochain appel
+    *  @return: la taille du chunk, 0 en fin de fichier, -1 en cas d'erreur de lecture
+    */
+    // Il faut au moins max_size octets disponibles pour que la coupure ne dépende pas des lectures
+    if (reader->end - reader->start < reader->params->max_size && !reader->eof) {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        while (reader->end < reader->capacity && !reader->eof) {
+            uint64_t start = metrics_start();
+            long n;
+            if (reader->read) {
+                n = reader->read(reader->source, reader->buffer + reader->end, reader->capacity - reader->end);
+            } else {
+                n = (long)fread(reader->buffer + reader->end, 1, reader->capacity - reader->end, reader->file);
+                if (n == 0 && ferror(reader->file)) {
+                    n = -1;
+                }
+            }
+            if (n < 0) {
+                perror("Erreur de lecture du fichier à découper");
+                return -1;
+            }
+            metrics_stop(METRIC_READ, start, (uint64_t)n);
+            reader->end += (size_t)n;
+            if (n == 0) {
+                reader->eof = true;
+            }
+        }
+    }
+
+    size_t available = reader->end - reader->start;
+    if (available == 0) {
+        return 0;
+    }
+
+    size_t size = chunker_cut(reader->params, reader->buffer + reader->start, available);
+    *chunk = reader->buffer + reader->start;
+    reader->start += size;
+    return (long)size;
+}
+
+// Fonction pour libérer le tampon du lecteur
+void chunk_reader_free(chunk_reader *reader) {
+    if (reader->owns_buffer) {
+        free(reader->buffer);
+    }
+    reader->buffer = NULL;
+}
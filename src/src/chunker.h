@@ -0,0 +1,68 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Tailles de chunk par défaut (octets) : minimum, moyenne visée et maximum
+#define CHUNK_MIN_SIZE (16u * 1024u)
+#define CHUNK_AVG_SIZE (64u * 1024u)
+#define CHUNK_MAX_SIZE (256u * 1024u)
+
+// Bornes acceptées pour la configuration du découpage
+#define CHUNK_LIMIT_MIN 64u
+#define CHUNK_LIMIT_MAX (64u * 1024u * 1024u)
+
+// Taille minimale du tampon de lecture du découpeur
+#define CHUNK_READ_SIZE (1024u * 1024u)
+
+// Paramètres du découpage par contenu (gear / FastCDC)
+typedef struct {
+    uint32_t min_size; // Aucun point de coupure avant min_size octets
+    uint32_t avg_size; // Taille moyenne visée (puissance de 2)
+    uint32_t max_size; // Coupure forcée à max_size octets
+    uint64_t mask_s;   // Masque strict utilisé avant avg_size
+    uint64_t mask_l;   // Masque relâché utilisé après avg_size
+} chunker_params;
+
+// Lecture d'une source autre qu'un FILE : octets copiés dans buffer, 0 en fin de flux, -1 en cas d'erreur
+typedef long (*chunk_read_fn)(void *source, void *buffer, size_t size);
+
+// Lecteur qui découpe un flux en chunks de taille variable
+typedef struct {
+    FILE *file;
+    chunk_read_fn read;    // Si non nul, remplace fread sur file
+    void *source;          // Argument de read
+    const chunker_params *params;
+    unsigned char *buffer; // Tampon de lecture
+    size_t capacity;       // Taille du tampon
+    size_t start;          // Début des données non encore découpées
+    size_t end;            // Fin des données lues
+    bool eof;              // Fin du fichier atteinte
+    bool owns_buffer;      // Tampon alloué par chunk_reader_init (sinon fourni par l'appelant)
+} chunk_reader;
+
+// Fonction pour initialiser et valider des paramètres de découpage
+int chunker_params_init(chunker_params *params, uint32_t min_size, uint32_t avg_size, uint32_t max_size);
+// Fonction pour analyser une configuration "MIN,AVG,MAX"
+int chunker_params_parse(chunker_params *params, const char *spec);
+// Fonction qui renvoie la longueur du prochain chunk au début de data
+size_t chunker_cut(const chunker_params *params, const unsigned char *data, size_t len);
+// Fonction pour préparer la lecture d'un fichier en chunks
+int chunk_reader_init(chunk_reader *reader, FILE *file, const chunker_params *params);
+// Fonction qui renvoie la taille du tampon de lecture pour ces paramètres
+size_t chunk_reader_buffer_size(const chunker_params *params);
+// Fonction pour préparer la lecture d'un fichier dans un tampon réutilisé d'un fichier à l'autre
+void chunk_reader_init_buffer(chunk_reader *reader, FILE *file, const chunker_params *params,
+                              unsigned char *buffer, size_t capacity);
+// Fonction pour préparer la lecture d'une source quelconque dans un tampon fourni par l'appelant
+void chunk_reader_init_source(chunk_reader *reader, chunk_read_fn read, void *source, const chunker_params *params,
+                              unsigned char *buffer, size_t capacity);
+// Fonction pour obtenir le chunk suivant du fichier
+long chunk_reader_next(chunk_reader *reader, const unsigned char **chunk);
+// Fonction pour libérer le tampon du lecteur
+void chunk_reader_free(chunk_reader *reader);
+
+#endif // CHUNKER_H
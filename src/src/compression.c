@@ -0,0 +1,247 @@
+#include "compression.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <zlib.h>
+#ifdef WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+
+// Fonction qui renvoie le nom d'un algorithme de compression
+const char *codec_name(codec_algo algo) {
+    switch (algo) {
+        case CODEC_NONE: return "none";
+        case CODEC_ZLIB: return "zlib";
+        case CODEC_LZ4: return "lz4";
+        case CODEC_ZSTD: return "zstd";
+    }
+    return "inconnu";
+}
+
+// Niveau utilisé quand la compression est donnée sans niveau
+static int codec_default_level(codec_algo algo) {
+    switch (algo) {
+        case CODEC_ZLIB: return 6;
+        case CODEC_ZSTD: return 3;
+        default: return 0;
+    }
+}
+
+// Fonction pour lire une compression au format NOM[:NIVEAU] (none, zlib:6, lz4, zstd:3)
+int codec_params_parse(codec_params *params, const char *spec) {
+    /* @param: params reçoit l'algorithme et son niveau
+    *  @return: 0 si la compression est connue et disponible, -1 sinon
+    */
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    codec_algo algo;
+    if (len == 4 && strncmp(spec, "none", 4) == 0) {
+        algo = CODEC_NONE;
+    } else if (len == 4 && strncmp(spec, "zlib", 4) == 0) {
+        algo = CODEC_ZLIB;
+    } else if (len == 3 && strncmp(spec, "lz4", 3) == 0) {
+        algo = CODEC_LZ4;
+    } else if (len == 4 && strncmp(spec, "zstd", 4) == 0) {
+        algo = CODEC_ZSTD;
+    } else {
+        fprintf(stderr, "Compression inconnue : %s (none, zlib[:1-9], lz4, zstd[:1-19]).\n", spec);
+        return -1;
+    }
+    if (!codec_available(algo)) {
+        fprintf(stderr, "Compression %s non disponible dans cette version.\n", codec_name(algo));
+        return -1;
+    }
+
+    int level = codec_default_level(algo);
+    if (colon) {
+        level = atoi(colon + 1);
+        int max = algo == CODEC_ZLIB ? 9 : algo == CODEC_ZSTD ? 19 : 0;
+        if (level < 1 || level > max) {
+            fprintf(stderr, "Niveau de compression invalide pour %s : %s.\n", codec_name(algo), colon + 1);
+            return -1;
+        }
+    }
+    params->algo = algo;
+    params->level = level;
+    return 0;
+}
+
+// Fonction qui indique si un algorithme est disponible dans cette compilation
+bool codec_available(codec_algo algo) {
+    switch (algo) {
+        case CODEC_NONE:
+        case CODEC_ZLIB:
+            return true;
+        case CODEC_LZ4:
+#ifdef WITH_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case CODEC_ZSTD:
+#ifdef WITH_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+// Fonction qui renvoie la taille maximale des données compressées d'un bloc de size octets
+size_t codec_bound(codec_algo algo, size_t size) {
+    switch (algo) {
+        case CODEC_ZLIB:
+            return (size_t)compressBound((uLong)size);
+#ifdef WITH_LZ4
+        case CODEC_LZ4:
+            return (size_t)LZ4_compressBound((int)size);
+#endif
+#ifdef WITH_ZSTD
+        case CODEC_ZSTD:
+            return ZSTD_compressBound(size);
+#endif
+        default:
+            return size;
+    }
+}
+
+// Fonction qui estime, sur un échantillon, si un chunk peut gagner à être compressé
+bool codec_worth_trying(const void *data, size_t size) {
+    /* @return: false si l'échantillon est presque aléatoire (média, archive déjà compressée)
+    */
+    const unsigned char *bytes = data;
+    uint32_t counts[256] = {0};
+    size_t sampled = 0;
+
+    // Quatre extraits répartis sur le chunk, pour ne pas juger sur un en-tête seul
+    size_t part = CODEC_SAMPLE_SIZE / 4;
+    for (int i = 0; i < 4; i++) {
+        size_t start = size > part ? (size - part) / 3 * (size_t)i : 0;
+        size_t end = start + part < size ? start + part : size;
+        for (size_t j = start; j < end; j++) {
+            counts[bytes[j]]++;
+        }
+        sampled += end - start;
+        if (size <= part) {
+            break;
+        }
+    }
+    if (sampled < 64) {
+        return true;
+    }
+
+    // Entropie de Shannon de l'échantillon, en bits par octet
+    double entropy = 0.0;
+    for (int i = 0; i < 256; i++) {
+        if (counts[i]) {
+            double p = (double)counts[i] / (double)sampled;
+            entropy -= p * log2(p);
+        }
+    }
+    return entropy * 1000.0 < CODEC_MAX_ENTROPY;
+}
+
+static size_t compress_chunk(const codec_params *params, const void *src, size_t size, void *dst, size_t capacity) {
+    if (!codec_worth_trying(src, size)) {
+        return 0;
+    }
+
+    size_t compressed = 0;
+    switch (params->algo) {
+        case CODEC_ZLIB: {
+            uLongf len = (uLongf)capacity;
+            if (compress2(dst, &len, src, (uLong)size, params->level) == Z_OK) {
+                compressed = (size_t)len;
+            }
+            break;
+        }
+#ifdef WITH_LZ4
+        case CODEC_LZ4: {
+            int len = LZ4_compress_default(src, dst, (int)size, (int)capacity);
+            compressed = len > 0 ? (size_t)len : 0;
+            break;
+        }
+#endif
+#ifdef WITH_ZSTD
+        case CODEC_ZSTD: {
+            size_t len = ZSTD_compress(dst, capacity, src, size, params->level);
+            compressed = ZSTD_isError(len) ? 0 : len;
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+
+    // Un gain trop faible ne vaut pas le coût de la décompression
+    return compressed > 0 && compressed <= CODEC_MIN_GAIN(size) ? compressed : 0;
+}
+
+// Fonction pour compresser un chunk, renvoie la taille compressée ou 0 s'il doit être stocké brut
+size_t codec_compress(const codec_params *params, const void *src, size_t size, void *dst, size_t capacity) {
+    /* @param: dst doit pouvoir contenir codec_bound(params->algo, size) octets
+    *  @return: la taille compressée si elle est assez petite, 0 sinon (le chunk est alors stocké brut)
+    */
+    if (params->algo == CODEC_NONE || size == 0) {
+        return 0;
+    }
+    uint64_t start = metrics_start();
+    size_t compressed = compress_chunk(params, src, size, dst, capacity);
+    metrics_stop(METRIC_COMPRESS, start, size);
+    return compressed;
+}
+
+static int decompress_chunk(codec_algo algo, const void *src, size_t size, void *dst, size_t raw_size) {
+    switch (algo) {
+        case CODEC_NONE:
+            if (size != raw_size) {
+                break;
+            }
+            memcpy(dst, src, size);
+            return 0;
+        case CODEC_ZLIB: {
+            uLongf len = (uLongf)raw_size;
+            if (uncompress(dst, &len, src, (uLong)size) == Z_OK && len == raw_size) {
+                return 0;
+            }
+            break;
+        }
+#ifdef WITH_LZ4
+        case CODEC_LZ4:
+            if (LZ4_decompress_safe(src, dst, (int)size, (int)raw_size) == (int)raw_size) {
+                return 0;
+            }
+            break;
+#endif
+#ifdef WITH_ZSTD
+        case CODEC_ZSTD: {
+            size_t len = ZSTD_decompress(dst, raw_size, src, size);
+            if (!ZSTD_isError(len) && len == raw_size) {
+                return 0;
+            }
+            break;
+        }
+#endif
+        default:
+            fprintf(stderr, "Compression %s non disponible dans cette version.\n", codec_name(algo));
+            return -1;
+    }
+    fprintf(stderr, "Chunk compressé (%s) corrompu.\n", codec_name(algo));
+    return -1;
+}
+
+// Fonction pour décompresser un chunk dont la taille d'origine est connue
+int codec_decompress(codec_algo algo, const void *src, size_t size, void *dst, size_t raw_size) {
+    /* @return: 0 si exactement raw_size octets ont été produits, -1 sinon
+    */
+    uint64_t start = metrics_start();
+    int result = decompress_chunk(algo, src, size, dst, raw_size);
+    metrics_stop(METRIC_DECOMPRESS, start, raw_size);
+    return result;
+}
@@ -0,0 +1,44 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Échantillon analysé avant de tenter la compression d'un chunk
+#define CODEC_SAMPLE_SIZE 4096
+// Entropie (en millièmes de bit par octet) au-delà de laquelle un chunk est stocké brut
+#define CODEC_MAX_ENTROPY 7500
+// Gain minimal : un chunk compressé doit occuper au plus 31/32 de sa taille
+#define CODEC_MIN_GAIN(size) ((size) - (size) / 32)
+
+// Algorithmes de compression des chunks (la valeur est enregistrée dans les packs et l'index)
+typedef enum {
+    CODEC_NONE = 0, // Chunk stocké brut
+    CODEC_ZLIB = 1, // Deflate de zlib, niveaux 1 à 9
+    CODEC_LZ4 = 2,  // LZ4, rapide, disponible si compilé avec WITH_LZ4
+    CODEC_ZSTD = 3  // Zstandard, niveaux 1 à 19, disponible si compilé avec WITH_ZSTD
+} codec_algo;
+
+// Compression choisie pour les nouveaux chunks
+typedef struct {
+    codec_algo algo;
+    int level;
+} codec_params;
+
+// Fonction qui renvoie le nom d'un algorithme de compression
+const char *codec_name(codec_algo algo);
+// Fonction pour lire une compression au format NOM[:NIVEAU] (none, zlib:6, lz4, zstd:3)
+int codec_params_parse(codec_params *params, const char *spec);
+// Fonction qui indique si un algorithme est disponible dans cette compilation
+bool codec_available(codec_algo algo);
+// Fonction qui renvoie la taille maximale des données compressées d'un bloc de size octets
+size_t codec_bound(codec_algo algo, size_t size);
+// Fonction qui estime, sur un échantillon, si un chunk peut gagner à être compressé
+bool codec_worth_trying(const void *data, size_t size);
+// Fonction pour compresser un chunk, renvoie la taille compressée ou 0 s'il doit être stocké brut
+size_t codec_compress(const codec_params *params, const void *src, size_t size, void *dst, size_t capacity);
+// Fonction pour décompresser un chunk dont la taille d'origine est connue
+int codec_decompress(codec_algo algo, const void *src, size_t size, void *dst, size_t raw_size);
+
+#endif // COMPRESSION_H
@@ -3,133 +3,702 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#define OPENSSL_SUPPRESS_DEPRECATED
-#include <openssl/md5.h>
 #include <dirent.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "backup_pipeline.h"
+#include "metrics.h"
 
-// Fonction de hachage MD5 pour l'indexation
-// dans la table de hachage
-unsigned int hash_md5(unsigned char *md5) {
-    unsigned int hash = 0;
-    for (int i = 0; i < MD5_DIGEST_LENGTH; i++) {
-        hash = (hash << 5) + hash + md5[i];
+// Mémoire du tampon d'une restauration
+size_t restore_buffer_size = RESTORE_BUFFER_DEFAULT;
+// Restauration différentielle des fichiers déjà présents
+bool restore_delta = false;
+
+// Fonction pour initialiser une recette vide
+void recipe_init(recipe_t *recipe, hash_algo hash, size_t digest_len) {
+    memset(recipe, 0, sizeof(*recipe));
+    recipe->hash = hash;
+    recipe->digest_len = digest_len;
+}
+
+// Fonction pour ajouter une référence à la fin d'une recette
+int recipe_append(recipe_t *recipe, const unsigned char *digest, uint32_t size) {
+    if (recipe->count == recipe->capacity) {
+        int capacity = recipe->capacity ? recipe->capacity * 2 : 64;
+        chunk_ref *refs = realloc(recipe->refs, sizeof(chunk_ref) * capacity);
+        if (!refs) {
+            perror("Erreur d'allocation mémoire pour la recette");
+            return -1;
+        }
+        recipe->refs = refs;
+        recipe->capacity = capacity;
     }
-    return hash % HASH_TABLE_SIZE;
+    memcpy(recipe->refs[recipe->count].digest, digest, recipe->digest_len);
+    recipe->refs[recipe->count].size = size;
+    recipe->count++;
+    return 0;
 }
 
-// Fonction pour calculer le MD5 d'un chunk
-void compute_md5(void *data, size_t len, unsigned char *md5_out) {
-    MD5_CTX md5_ctx;
+// Coupure d'un objet de liste après un enregistrement de digest digest, le count-ième de l'objet
+static bool coupure_liste(const unsigned char *digest, uint32_t count) {
+    if (count >= CHUNK_LIST_MAX_RECORDS) {
+        return true;
+    }
+    if (count < CHUNK_LIST_MIN_RECORDS) {
+        return false;
+    }
+    uint32_t bits;
+    memcpy(&bits, digest, sizeof(bits));
+    return (bits & CHUNK_LIST_BOUNDARY_MASK) == 0;
+}
 
-    // Initialisation du contexte MD5
-    MD5_Init(&md5_ctx);
+// Fonction pour préparer la construction des listes de chunks d'une sauvegarde
+void chunk_list_builder_init(chunk_list_builder *builder, chunk_store_t *store) {
+    /* @param: store reçoit les objets de liste (store_put, dédupliqués comme des chunks)
+    */
+    memset(builder, 0, sizeof(*builder));
+    builder->store = store;
+}
 
-    // Mise à jour du contexte avec les données
-    MD5_Update(&md5_ctx, data, len);
+static int ranger_objet(chunk_list_builder *builder, uint32_t level);
 
-    // Finalisation du calcul du MD5 et stockage du résultat dans md5_out
-    MD5_Final(md5_out, &md5_ctx);
+// Ajout d'un enregistrement à l'objet en cours d'un niveau, rangé dans le dépôt à une coupure
+static int ajouter_a_liste(chunk_list_builder *builder, uint32_t level, const unsigned char *digest, uint32_t size) {
+    size_t digest_len = builder->store->digest_len;
+    size_t record = CHUNK_REF_RECORD_SIZE(digest_len);
+    if (level == CHUNK_LIST_MAX_LEVELS) {
+        fprintf(stderr, "Liste de chunks trop longue.\n");
+        return -1;
+    }
+    if (!builder->objects[level] && !(builder->objects[level] = malloc(CHUNK_LIST_MAX_RECORDS * record))) {
+        perror("Erreur d'allocation mémoire pour une liste de chunks");
+        return -1;
+    }
+    unsigned char *slot = builder->objects[level] + (size_t)builder->counts[level] * record;
+    memcpy(slot, digest, digest_len);
+    memcpy(slot + digest_len, &size, sizeof(size));
+    builder->counts[level]++;
+    if (level > builder->top) {
+        builder->top = level;
+    }
+    return coupure_liste(digest, builder->counts[level]) ? ranger_objet(builder, level) : 0;
+}
+
+// Rangement de l'objet en cours d'un niveau dans le dépôt ; il est référencé au niveau supérieur
+// par son digest et son nombre d'enregistrements
+static int ranger_objet(chunk_list_builder *builder, uint32_t level) {
+    chunk_store_t *store = builder->store;
+    unsigned char digest[DIGEST_MAX_LENGTH];
+    uint32_t count = builder->counts[level];
+    size_t size = (size_t)count * CHUNK_REF_RECORD_SIZE(store->digest_len);
+    builder->counts[level] = 0;
+    if (compute_hash(store->hash, builder->objects[level], size, digest) != 0 ||
+        store_put(store, digest, builder->objects[level], size) < 0) {
+        return -1;
+    }
+    return ajouter_a_liste(builder, level + 1, digest, count);
 }
 
-// Fonction permettant de chercher un MD5 dans la table de hachage
-int find_md5(Md5Entry *hash_table, unsigned char *md5) {
-    /* @param: hash_table est le tableau de hachage qui contient les MD5 et l'index des chunks unique
-    *           md5 est le md5 du chunk dont on veut déterminer l'unicité
-    *  @return: retourne l'index s'il trouve le md5 dans le tableau et -1 sinon
+// Fonction pour ajouter un chunk à la liste en cours
+int chunk_list_append(chunk_list_builder *builder, const unsigned char *digest, uint32_t size) {
+    /* @return: 0 en cas de succès, -1 si un objet de liste n'a pas pu être rangé
     */
-    for(int i = 0;i<HASH_TABLE_SIZE;i++) {
-        if (memcmp(hash_table[i].md5,md5,HASH_TABLE_SIZE) == 0){
-            return hash_table[i].index;
+    if (builder->total == UINT32_MAX) {
+        fprintf(stderr, "Fichier trop long (plus de %u chunks).\n", UINT32_MAX);
+        return -1;
+    }
+    builder->total++;
+    return ajouter_a_liste(builder, 0, digest, size);
+}
+
+// Fonction pour terminer la liste en cours et ranger ses derniers objets dans le dépôt
+int chunk_list_finish(chunk_list_builder *builder, chunk_list_ref *list) {
+    /* @param: list reçoit le nombre de chunks et la liste ou sa racine (file_size et file_digest sont
+    *           laissés à l'appelant)
+    *  @return: 0 en cas de succès, -1 sinon ; le constructeur est prêt pour la liste suivante
+    */
+    size_t record = CHUNK_REF_RECORD_SIZE(builder->store->digest_len);
+    int status = 0;
+    list->count = (uint32_t)builder->total;
+    if (builder->top == 0 && builder->counts[0] <= CHUNK_LIST_INLINE) {
+        list->levels = 0;
+        if (builder->counts[0] > 0) {
+            memcpy(list->records, builder->objects[0], builder->counts[0] * record);
+        }
+    } else {
+        // Les objets en cours sont rangés de bas en haut, jusqu'au niveau où il ne reste que la racine
+        uint32_t level = 0;
+        while (status == 0 && !(level > 0 && level == builder->top && builder->counts[level] == 1)) {
+            if (builder->counts[level] > 0) {
+                status = ranger_objet(builder, level);
+            }
+            level++;
         }
+        if (status == 0) {
+            list->levels = level;
+            memcpy(list->records, builder->objects[level], record);
+        }
+    }
+    chunk_list_discard(builder);
+    return status;
+}
+
+// Fonction pour abandonner la liste en cours
+void chunk_list_discard(chunk_list_builder *builder) {
+    /* Les objets déjà rangés restent dans le dépôt jusqu'au prochain nettoyage
+    */
+    memset(builder->counts, 0, sizeof(builder->counts));
+    builder->top = 0;
+    builder->total = 0;
+}
+
+// Fonction pour libérer les objets en cours
+void chunk_list_builder_free(chunk_list_builder *builder) {
+    for (int level = 0; level < CHUNK_LIST_MAX_LEVELS; level++) {
+        free(builder->objects[level]);
     }
-    return -1;
+    memset(builder, 0, sizeof(*builder));
 }
 
-// Ajouter un MD5 dans la table de hachage
-void add_md5(Md5Entry *hash_table, unsigned char *md5, int index) {
-    unsigned int position = hash_md5(md5);
-    while(hash_table[position].index == -1){
-        position = (position + 1) % HASH_TABLE_SIZE;
+// Fonction pour lire un objet de liste du dépôt
+unsigned char *chunk_list_load(chunk_store_t *store, pack_reader *reader, const unsigned char *record) {
+    /* @param: record est la référence de l'objet : digest puis nombre d'enregistrements (u32)
+    *           reader est le lecteur du thread appelant (NULL : celui du dépôt)
+    *  @return: les enregistrements de l'objet, à libérer avec free, NULL s'il est absent ou invalide
+    */
+    uint32_t count;
+    memcpy(&count, record + store->digest_len, sizeof(count));
+    size_t size = (size_t)count * CHUNK_REF_RECORD_SIZE(store->digest_len);
+    unsigned char *object = count > 0 && count <= CHUNK_LIST_MAX_RECORDS ? malloc(size) : NULL;
+    if (object && store_read(store, reader ? reader : &store->reader, record, object, size) == (long)size) {
+        return object;
     }
-    memcpy(hash_table[position].md5,md5,MD5_DIGEST_LENGTH);
-    hash_table[position].index = index;
+    char hex[DIGEST_MAX_LENGTH * 2 + 1];
+    digest_to_hex(record, store->digest_len, hex);
+    fprintf(stderr, "Objet de liste %s absent ou invalide.\n", hex);
+    free(object);
+    return NULL;
 }
 
-// Fonction pour convertir un fichier non dédupliqué en tableau de chunks
-void deduplicate_file(FILE *file, Chunk *chunks, Md5Entry *hash_table) {
-    /* @param:  file est le fichier qui sera dédupliqué
-    *           chunks est le tableau de chunks initialisés qui contiendra les chunks issu du fichier
-    *           hash_table est le tableau de hachage qui contient les MD5 et l'index des chunks unique
+// Fonction pour lire l'en-tête d'une recette, dont les références seront lues une à une
+int recipe_open(FILE *file, chunk_source *source) {
+    /* @param: file est la recette ouverte en lecture binaire, qui doit le rester pendant le parcours
+    *           source reçoit la description du fichier ; chunk_source_next lit ensuite ses références
+    *  @return: 0 en cas de succès, -1 si le fichier n'est pas une recette valide
     */
-    unsigned char buffer[CHUNK_SIZE];
-    int chunk_index = 0;
-    size_t octets_lu;
-    unsigned char md5[MD5_DIGEST_LENGTH];
-    //Lecture du fichier chunk par chunk
-    while ((octets_lu = fread(buffer,1,CHUNK_SIZE,file)) > 0) {
-        //On calcule le MD5 du chunck lu
-        compute_md5(buffer,octets_lu,md5);
-
-        //Verification que ce MD5 est dans la table de hachage, Si le MD5 n'existe pas encore, l'ajouter à la table de hachage et au tableau de chunks
-        int existing_index = find_md5(hash_table,md5);
-        if (existing_index == -1) {
-            chunks[chunk_index].data = malloc(octets_lu);
-            if (!chunks[chunk_index].data) {
-                perror("Erreur d'allocation mémore");
-                exit(EXIT_FAILURE);
+    char magic[RECIPE_MAGIC_LENGTH];
+    unsigned char algo[2];
+    uint32_t count;
+
+    memset(source, 0, sizeof(*source));
+    if (fread(magic, 1, RECIPE_MAGIC_LENGTH, file) != RECIPE_MAGIC_LENGTH) {
+        fprintf(stderr, "Recette invalide.\n");
+        return -1;
+    }
+    if (memcmp(magic, RECIPE_MAGIC_V1, RECIPE_MAGIC_LENGTH) == 0) {
+        source->hash = HASH_MD5;
+    } else if (memcmp(magic, RECIPE_MAGIC, RECIPE_MAGIC_LENGTH) == 0 &&
+               fread(algo, 1, sizeof(algo), file) == sizeof(algo)) {
+        source->hash = (hash_algo)algo[0];
+    } else {
+        fprintf(stderr, "Recette invalide.\n");
+        return -1;
+    }
+    source->digest_len = hash_digest_length(source->hash);
+    if (source->digest_len == 0 ||
+        fread(&source->file_size, sizeof(source->file_size), 1, file) != 1 ||
+        fread(source->file_digest, 1, source->digest_len, file) != source->digest_len ||
+        fread(&count, sizeof(count), 1, file) != 1) {
+        fprintf(stderr, "Recette invalide.\n");
+        return -1;
+    }
+    source->count = count;
+    source->file = file;
+    return 0;
+}
+
+// Lecture de l'objet de liste référencé par record, qui devient l'objet en cours du niveau level
+static int charger_objet(chunk_source *source, uint32_t level, const unsigned char *record) {
+    unsigned char *object = source->fetch ? source->fetch(source->fetch_arg, record, source->digest_len)
+                                          : chunk_list_load(source->store, source->reader, record);
+    if (!object) {
+        return -1;
+    }
+    free(source->objects[level]);
+    source->objects[level] = object;
+    memcpy(&source->object_count[level], record + source->digest_len, sizeof(uint32_t));
+    source->object_next[level] = 0;
+    return 0;
+}
+
+// Enregistrement suivant d'une liste rangée dans le dépôt : les objets sont lus en descendant depuis le
+// plus bas niveau qui a encore des enregistrements, la racine au premier appel
+static int suivant_dans_liste(chunk_source *source, const unsigned char **record) {
+    size_t record_size = CHUNK_REF_RECORD_SIZE(source->digest_len);
+    uint32_t level = 0;
+    while (level < source->levels && source->object_next[level] == source->object_count[level]) {
+        level++;
+    }
+    if (level == source->levels) {
+        if (source->root_read) {
+            fprintf(stderr, "Liste de chunks plus courte que le fichier.\n");
+            return -1;
+        }
+        if (charger_objet(source, source->levels - 1, source->records) != 0) {
+            return -1;
+        }
+        source->root_read = true;
+        level = source->levels - 1;
+    }
+    for (; level > 0; level--) {
+        const unsigned char *child = source->objects[level] + (size_t)source->object_next[level]++ * record_size;
+        if (charger_objet(source, level - 1, child) != 0) {
+            return -1;
+        }
+    }
+    *record = source->objects[0] + (size_t)source->object_next[0]++ * record_size;
+    return 0;
+}
+
+// Fonction pour lire la référence suivante d'une liste de chunks
+int chunk_source_next(chunk_source *source, chunk_ref *ref) {
+    /* @return: 1 si ref a été rempli, 0 à la fin de la liste, -1 si la recette est tronquée ou si un
+    *           objet de liste est illisible
+    */
+    if (source->next == source->count) {
+        return 0;
+    }
+    if (source->levels > 0) {
+        const unsigned char *record;
+        if (suivant_dans_liste(source, &record) != 0) {
+            return -1;
+        }
+        memcpy(ref->digest, record, source->digest_len);
+        memcpy(&ref->size, record + source->digest_len, sizeof(ref->size));
+    } else if (source->records) {
+        const unsigned char *record = source->records + source->next * CHUNK_REF_RECORD_SIZE(source->digest_len);
+        memcpy(ref->digest, record, source->digest_len);
+        memcpy(&ref->size, record + source->digest_len, sizeof(ref->size));
+    } else if (fread(ref->digest, 1, source->digest_len, source->file) != source->digest_len ||
+               fread(&ref->size, sizeof(ref->size), 1, source->file) != 1) {
+        fprintf(stderr, "Recette tronquée.\n");
+        return -1;
+    }
+    source->next++;
+    return 1;
+}
+
+// Fonction pour libérer les objets de liste lus par un parcours
+void chunk_source_free(chunk_source *source) {
+    for (int level = 0; level < CHUNK_LIST_MAX_LEVELS; level++) {
+        free(source->objects[level]);
+        source->objects[level] = NULL;
+    }
+}
+
+// Fonction pour lire une recette depuis un fichier
+int read_recipe(FILE *file, recipe_t *recipe) {
+    /* @param: file est la recette ouverte en lecture binaire
+    *           recipe reçoit la liste des chunks, à libérer avec free_recipe
+    *  @return: 0 en cas de succès, -1 si le fichier n'est pas une recette valide
+    */
+    chunk_source source;
+    chunk_ref ref;
+    int lue;
+
+    memset(recipe, 0, sizeof(*recipe));
+    if (recipe_open(file, &source) != 0) {
+        return -1;
+    }
+    recipe_init(recipe, source.hash, source.digest_len);
+    recipe->file_size = source.file_size;
+    memcpy(recipe->file_digest, source.file_digest, source.digest_len);
+    while ((lue = chunk_source_next(&source, &ref)) > 0) {
+        if (recipe_append(recipe, ref.digest, ref.size) != 0) {
+            lue = -1;
+            break;
+        }
+    }
+    if (lue < 0) {
+        free_recipe(recipe);
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour libérer une recette
+void free_recipe(recipe_t *recipe) {
+    free(recipe->refs);
+    recipe->refs = NULL;
+    recipe->count = 0;
+    recipe->capacity = 0;
+}
+
+// Écriture complète d'un bloc à une position donnée (les écritures partielles sont reprises)
+static int ecrire_bloc(int fd, const unsigned char *data, size_t size, off_t offset) {
+    uint64_t start = metrics_start();
+    uint64_t total = size;
+    while (size > 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            memcpy(chunks[chunk_index].data,buffer,octets_lu); //On copie les données dans le chunk
-            memcpy(chunks[chunk_index].md5,md5,MD5_DIGEST_LENGTH); //On copie le MD5 dans la structure
-            add_md5(hash_table,md5,chunk_index);//On ajoute le MD5 trouvé dans la table de hachage
-            chunk_index++;//Incrémente l'index des chunks
-        }else {
-            //Le chunk existe déjà, ainsi pas besoin de le dupliquer
-            printf("Chunk %d déjà sauvegardé avec l'index : %d \n",chunk_index,existing_index);
+            perror("Erreur d'écriture du fichier restauré");
+            return -1;
         }
+        data += written;
+        size -= (size_t)written;
+        offset += written;
     }
-    //Fichier bien dupliqué
-    printf("Fichier dédupliqué avec succés. Nombre de chunks unique : %d\n",chunk_index);
+    metrics_stop(METRIC_WRITE, start, total);
+    return 0;
 }
 
+// Chunk d'une fenêtre du tampon de restauration
+typedef struct {
+    chunk_ref ref;
+    size_t position; // Position dans le tampon
+    bool repeat;     // Même chunk que le précédent : recopié au lieu d'être relu
+} window_chunk;
 
-// Fonction permettant de charger un fichier dédupliqué en table de chunks
-// en remplaçant les références par les données correspondantes
-void undeduplicate_file(FILE *file, Chunk **chunks, int *chunk_count) {
-    /* @param: file est le nom du fichier dédupliqué présent dans le répertoire de sauvegarde
-    *           chunks représente le tableau de chunk qui contiendra les chunks restauré depuis filename
-    *           chunk_count est un compteur du nombre de chunk restauré depuis le fichier filename
+// Fenêtre de chunks consécutifs, lus (et décompressés) en parallèle dans le tampon
+typedef struct {
+    chunk_store_t *store;
+    unsigned char *buffer;
+    const window_chunk *chunks;
+    uint64_t first;          // Indice du premier chunk de la fenêtre dans le fichier
+    int count;
+    atomic_int next;         // Prochain chunk à lire
+    atomic_int failed;
+} restore_window;
+
+// Lecture des chunks de la fenêtre, partagée entre les threads au fil de l'eau
+static void fetch_window(restore_window *window, pack_reader *reader) {
+    int i;
+    while (!atomic_load(&window->failed) && (i = atomic_fetch_add(&window->next, 1)) < window->count) {
+        if (window->chunks[i].repeat) {
+            continue;
+        }
+        const chunk_ref *ref = &window->chunks[i].ref;
+        if (store_read(window->store, reader, ref->digest, window->buffer + window->chunks[i].position, ref->size) != (long)ref->size) {
+            fprintf(stderr, "Chunk %llu illisible, restauration interrompue.\n", (unsigned long long)(window->first + i));
+            atomic_store(&window->failed, 1);
+        }
+    }
+}
+
+// Threads de lecture des restaurations : créés à la première fenêtre qui en a besoin, puis réutilisés
+// pour toutes les fenêtres et tous les fichiers. Chacun garde son lecteur (et ses packs ouverts).
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;       // Fenêtre publiée ou arrêt demandé
+    pthread_cond_t done;       // Plus aucun thread ne lit la fenêtre
+    pthread_t threads[RESTORE_MAX_THREADS];
+    int count;
+    restore_window *window;    // Fenêtre en cours
+    int wanted;                // Threads encore attendus sur la fenêtre
+    int active;                // Threads qui lisent la fenêtre
+    bool stop;
+} restore_pool = {.lock = PTHREAD_MUTEX_INITIALIZER, .work = PTHREAD_COND_INITIALIZER,
+                  .done = PTHREAD_COND_INITIALIZER};
+
+static void *fetch_worker(void *arg) {
+    (void)arg;
+    pack_reader reader;
+    const chunk_store_t *store = NULL;
+    pack_reader_init(&reader);
+    pthread_mutex_lock(&restore_pool.lock);
+    for (;;) {
+        while (!restore_pool.stop && restore_pool.wanted == 0) {
+            pthread_cond_wait(&restore_pool.work, &restore_pool.lock);
+        }
+        if (restore_pool.stop) {
+            break;
+        }
+        restore_window *window = restore_pool.window;
+        restore_pool.wanted--;
+        restore_pool.active++;
+        pthread_mutex_unlock(&restore_pool.lock);
+
+        // Les packs ouverts ne valent que pour le dépôt qui les a fournis
+        if (window->store != store) {
+            pack_reader_free(&reader);
+            pack_reader_init(&reader);
+            store = window->store;
+        }
+        fetch_window(window, &reader);
+
+        pthread_mutex_lock(&restore_pool.lock);
+        if (--restore_pool.active == 0) {
+            pthread_cond_signal(&restore_pool.done);
+        }
+    }
+    pthread_mutex_unlock(&restore_pool.lock);
+    pack_reader_free(&reader);
+    return NULL;
+}
+
+// Fonction pour arrêter les threads de lecture des restaurations
+void restore_workers_stop(void) {
+    /* À appeler avant de fermer le dépôt d'une restauration ; les threads sont recréés au besoin
     */
-    unsigned char buffer[CHUNK_SIZE];
-    unsigned char md5[MD5_DIGEST_LENGTH];
+    pthread_mutex_lock(&restore_pool.lock);
+    restore_pool.stop = true;
+    pthread_cond_broadcast(&restore_pool.work);
+    pthread_mutex_unlock(&restore_pool.lock);
+    for (int t = 0; t < restore_pool.count; t++) {
+        pthread_join(restore_pool.threads[t], NULL);
+    }
+    pthread_mutex_lock(&restore_pool.lock);
+    restore_pool.count = 0;
+    restore_pool.stop = false;
+    pthread_mutex_unlock(&restore_pool.lock);
+}
+
+// Remplissage d'une fenêtre : la lecture et la décompression se font sur plusieurs threads
+static int fill_window(restore_window *window) {
+    int helpers = (backup_jobs > 0 ? backup_jobs : (int)sysconf(_SC_NPROCESSORS_ONLN)) - 1;
+    if (helpers > window->count / RESTORE_CHUNKS_PER_THREAD - 1) {
+        helpers = window->count / RESTORE_CHUNKS_PER_THREAD - 1;
+    }
+    if (helpers > RESTORE_MAX_THREADS - 1) {
+        helpers = RESTORE_MAX_THREADS - 1;
+    }
+    if (helpers > 0) {
+        pthread_mutex_lock(&restore_pool.lock);
+        while (restore_pool.count < helpers &&
+               pthread_create(&restore_pool.threads[restore_pool.count], NULL, fetch_worker, NULL) == 0) {
+            restore_pool.count++;
+        }
+        restore_pool.window = window;
+        restore_pool.wanted = helpers < restore_pool.count ? helpers : restore_pool.count;
+        pthread_cond_broadcast(&restore_pool.work);
+        pthread_mutex_unlock(&restore_pool.lock);
+    }
+    // Le thread appelant participe avec le lecteur du dépôt
+    fetch_window(window, &window->store->reader);
+    if (helpers > 0) {
+        // Les threads qui n'ont pas encore pris la fenêtre n'y touchent plus : elle est déjà lue
+        pthread_mutex_lock(&restore_pool.lock);
+        restore_pool.wanted = 0;
+        while (restore_pool.active > 0) {
+            pthread_cond_wait(&restore_pool.done, &restore_pool.lock);
+        }
+        restore_pool.window = NULL;
+        pthread_mutex_unlock(&restore_pool.lock);
+    }
+    if (atomic_load(&window->failed)) {
+        return -1;
+    }
 
-    // Réinitialisation des chunks et du compteur
-    *chunks = NULL;
-    *chunk_count = 0;
+    // Les répétitions sont recopiées une fois leur modèle lu
+    for (int i = 0; i < window->count; i++) {
+        if (window->chunks[i].repeat) {
+            memcpy(window->buffer + window->chunks[i].position, window->buffer + window->chunks[i - 1].position,
+                   window->chunks[i].ref.size);
+        }
+    }
+    return 0;
+}
 
-    // Lecture du fichier dédupliqué
-    while (fread(md5, 1, MD5_DIGEST_LENGTH, file) == MD5_DIGEST_LENGTH) {
-        // Lecture des données du chunk
+// Fichier existant d'une restauration différentielle, découpé avec le chunker du dépôt en avance sur
+// l'écriture : un chunk de la liste est conservé si le fichier a, à la même position, un chunk de même
+// taille et de même digest. Seuls ces candidats sont hachés.
+typedef struct {
+    FILE *file;
+    chunk_reader reader;
+    const unsigned char *chunk;  // Chunk courant du fichier
+    uint64_t start;              // Position du chunk courant
+    long size;                   // Taille du chunk courant (0 à la fin du fichier)
+} releve_en_place;
 
-        fread(buffer, 1, CHUNK_SIZE, file);
-        // Ajout des données au tableau de chunks
-        *chunks = realloc(*chunks, sizeof(Chunk) * (*chunk_count + 1));
-        if (*chunks == NULL) {
-            perror("Erreur d'allocation mémoire pour les chunks");
-            exit(EXIT_FAILURE);
+static int releve_ouvrir(releve_en_place *releve, chunk_store_t *store, int fd) {
+    memset(releve, 0, sizeof(*releve));
+    int copy = dup(fd);
+    releve->file = copy >= 0 ? fdopen(copy, "rb") : NULL;
+    if (!releve->file) {
+        perror("Erreur lors de la lecture du fichier existant");
+        if (copy >= 0) {
+            close(copy);
         }
+        return -1;
+    }
+    posix_fadvise(copy, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (chunk_reader_init(&releve->reader, releve->file, &store->chunker) != 0) {
+        fclose(releve->file);
+        return -1;
+    }
+    releve->size = chunk_reader_next(&releve->reader, &releve->chunk);
+    if (releve->size < 0) {
+        chunk_reader_free(&releve->reader);
+        fclose(releve->file);
+        return -1;
+    }
+    return 0;
+}
 
-        (*chunks)[*chunk_count].data = malloc(CHUNK_SIZE);
-        if ((*chunks)[*chunk_count].data == NULL) {
-            perror("Erreur d'allocation mémoire pour les données du chunk");
-            exit(EXIT_FAILURE);
+// Découpe du fichier existant jusqu'au premier chunk qui commence à position ou après : tout ce qui
+// précède est alors lu, et peut être réécrit
+static int releve_avancer(releve_en_place *releve, uint64_t position) {
+    while (releve->size > 0 && releve->start < position) {
+        releve->start += (uint64_t)releve->size;
+        releve->size = chunk_reader_next(&releve->reader, &releve->chunk);
+    }
+    return releve->size < 0 ? -1 : 0;
+}
+
+// Le chunk ref, à position dans le fichier restauré, est-il déjà en place ?
+static int releve_en_place_chunk(releve_en_place *releve, chunk_store_t *store, uint64_t position,
+                                 const chunk_ref *ref) {
+    /* @return: 1 si le chunk est en place, 0 sinon, -1 en cas d'erreur de lecture
+    */
+    unsigned char digest[DIGEST_MAX_LENGTH];
+    if (releve_avancer(releve, position) != 0) {
+        return -1;
+    }
+    if (releve->size <= 0 || releve->start != position || (uint32_t)releve->size != ref->size) {
+        return 0;
+    }
+    if (compute_hash(store->hash, releve->chunk, (size_t)releve->size, digest) != 0) {
+        return -1;
+    }
+    return memcmp(digest, ref->digest, store->digest_len) == 0;
+}
+
+static void releve_fermer(releve_en_place *releve) {
+    chunk_reader_free(&releve->reader);
+    fclose(releve->file);
+}
+
+// Restauration d'une liste de chunks dans un fichier ouvert, une fenêtre à la fois : seules les
+// références de la fenêtre en cours sont en mémoire. Avec releve, les chunks déjà en place ne sont
+// ni lus ni écrits ; kept_bytes reçoit alors leur taille totale.
+static int restaurer_recette(chunk_source *source, chunk_store_t *store, int fd, releve_en_place *releve,
+                             uint64_t *kept_bytes) {
+    if (source->hash != store->hash) {
+        fprintf(stderr, "La recette utilise %s mais le dépôt %s.\n", hash_algo_name(source->hash), hash_algo_name(store->hash));
+        return -1;
+    }
+
+    // Le tampon est borné par restore_buffer_size, quelle que soit la taille du fichier, et jamais plus
+    // grand que le fichier ; il n'est agrandi que pour un chunk plus grand que lui
+    size_t capacity = restore_buffer_size;
+    if (source->file_size < capacity) {
+        capacity = (size_t)source->file_size;
+    }
+    unsigned char *buffer = malloc(capacity ? capacity : 1);
+    window_chunk *chunks = malloc(RESTORE_WINDOW_CHUNKS * sizeof(*chunks));
+    if (!buffer || !chunks) {
+        perror("Erreur d'allocation mémoire pour la restauration");
+        free(buffer);
+        free(chunks);
+        return -1;
+    }
+
+    // Les chunks sont lus à la suite dans le tampon, qui est écrit d'un bloc quand il est plein
+    uint64_t offset = 0;
+    chunk_ref ref;
+    int status = 0;
+    int lue = chunk_source_next(source, &ref);
+    int kept = lue > 0 && releve ? releve_en_place_chunk(releve, store, offset, &ref) : 0;
+    while (status == 0 && lue > 0 && kept >= 0) {
+        // Chunk déjà en place : seule la position avance
+        if (kept) {
+            offset += ref.size;
+            *kept_bytes += ref.size;
+            lue = chunk_source_next(source, &ref);
+            kept = lue > 0 && releve ? releve_en_place_chunk(releve, store, offset, &ref) : 0;
+            continue;
         }
+        if (ref.size > capacity) {
+            unsigned char *grown = realloc(buffer, ref.size);
+            if (!grown) {
+                perror("Erreur d'allocation mémoire pour la restauration");
+                status = -1;
+                break;
+            }
+            buffer = grown;
+            capacity = ref.size;
+        }
+        restore_window window = {store, buffer, chunks, source->next - 1, 0, 0, 0};
+        size_t used = 0;
+        while (lue > 0 && kept == 0 && window.count < RESTORE_WINDOW_CHUNKS && used + ref.size <= capacity) {
+            // Une suite de chunks identiques (zones de zéros) n'est lue qu'une fois dans le dépôt
+            window_chunk *chunk = &chunks[window.count];
+            chunk->ref = ref;
+            chunk->position = used;
+            chunk->repeat = window.count > 0 && ref.size == chunk[-1].ref.size &&
+                            memcmp(ref.digest, chunk[-1].ref.digest, source->digest_len) == 0;
+            used += ref.size;
+            window.count++;
+            lue = chunk_source_next(source, &ref);
+            kept = lue > 0 && releve ? releve_en_place_chunk(releve, store, offset + used, &ref) : 0;
+        }
+        status = fill_window(&window);
+        // Le fichier existant doit être lu au-delà de la fenêtre avant qu'elle ne l'écrase
+        if (status == 0 && releve) {
+            status = releve_avancer(releve, offset + used);
+        }
+        if (status == 0) {
+            status = ecrire_bloc(fd, buffer, used, (off_t)offset);
+            offset += used;
+        }
+    }
+    free(chunks);
+    free(buffer);
 
-        memcpy((*chunks)[*chunk_count].data, buffer, CHUNK_SIZE);
-        memcpy((*chunks)[*chunk_count].md5, md5, MD5_DIGEST_LENGTH);
-        (*chunk_count)++;
+    if (lue < 0 || kept < 0) {
+        status = -1;
     }
+    if (status == 0 && offset != source->file_size) {
+        fprintf(stderr, "Taille restaurée incorrecte : %llu octets au lieu de %llu.\n",
+                (unsigned long long)offset, (unsigned long long)source->file_size);
+        status = -1;
+    }
+    return status;
+}
 
-    printf("Restauration réussie. Nombre de chunks restaurés : %d\n", *chunk_count);
+// Fonction pour restaurer le contenu d'une liste de chunks dans un fichier ouvert, en mémoire bornée
+int restore_recipe(chunk_source *source, chunk_store_t *store, int fd) {
+    /* @param: source est la liste des chunks du fichier, parcourue une seule fois
+    *           store est le dépôt qui contient les données des chunks
+    *           fd est le fichier de sortie, écrit à partir du début
+    *  @return: 0 si exactement source->file_size octets ont été écrits, -1 sinon
+    */
+    return restaurer_recette(source, store, fd, NULL, NULL);
+}
+
+// Fonction pour mettre à jour un fichier existant d'après une liste de chunks en n'écrivant que ceux qui diffèrent
+int restore_recipe_delta(chunk_source *source, chunk_store_t *store, int fd, uint64_t *written) {
+    /* @param: fd est le fichier existant, ouvert en lecture et écriture
+    *           written reçoit le nombre d'octets écrits (peut être NULL)
+    *  @return: 0 si le fichier a exactement le contenu de la liste, -1 sinon (il peut alors être
+    *           partiellement mis à jour)
+    */
+    if (source->hash != store->hash) {
+        fprintf(stderr, "La recette utilise %s mais le dépôt %s.\n", hash_algo_name(source->hash), hash_algo_name(store->hash));
+        return -1;
+    }
+    releve_en_place releve;
+    if (releve_ouvrir(&releve, store, fd) != 0) {
+        return -1;
+    }
 
+    // Les zones qui diffèrent sont réécrites en place, puis la taille est ajustée (troncature ou extension)
+    uint64_t kept_bytes = 0;
+    int status = restaurer_recette(source, store, fd, &releve, &kept_bytes);
+    releve_fermer(&releve);
+    if (status == 0 && ftruncate(fd, (off_t)source->file_size) != 0) {
+        perror("Erreur lors de l'ajustement de la taille du fichier restauré");
+        status = -1;
+    }
+    if (status == 0 && written) {
+        *written = source->file_size - kept_bytes;
+    }
+    return status;
 }
@@ -4,42 +4,140 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <openssl/md5.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "hash.h"
 #include <dirent.h>
+#include "chunk_store.h"
 
-// Taille d'un chunk (4096 octets)
-#define CHUNK_SIZE 4096
+// Signature d'une recette (liste des chunks qui composent un fichier)
+#define RECIPE_MAGIC "LP25RCP2"
+#define RECIPE_MAGIC_V1 "LP25RCP1" // Ancien format, digests MD5 uniquement
+#define RECIPE_MAGIC_LENGTH 8
 
-// Taille de la table de hachage qui contiendra les chunks
-// dont on a déjà calculé le MD5 pour effectuer les comparaisons
-#define HASH_TABLE_SIZE 1000
+// Mémoire allouée par défaut au tampon d'une restauration (octets)
+#define RESTORE_BUFFER_DEFAULT (8u * 1024u * 1024u)
+// Lecture parallèle d'une fenêtre du tampon : au moins ce nombre de chunks par thread
+#define RESTORE_CHUNKS_PER_THREAD 4
+#define RESTORE_MAX_THREADS 64
+// Nombre maximal de chunks d'une fenêtre du tampon de restauration
+#define RESTORE_WINDOW_CHUNKS 4096
 
-// Structure pour un chunk
+// Référence vers un chunk du dépôt
 typedef struct {
-    unsigned char md5[MD5_DIGEST_LENGTH]; // MD5 du chunk
-    void *data; // Données du chunk
-} Chunk;
+    unsigned char digest[DIGEST_MAX_LENGTH]; // Clé du chunk dans le dépôt
+    uint32_t size; // Taille du chunk
+} chunk_ref;
 
-// Table de hachage pour stocker les MD5 et leurs index
+// Taille d'une référence sérialisée (recettes, index) : digest puis taille sur 32 bits
+#define CHUNK_REF_RECORD_SIZE(digest_len) ((digest_len) + sizeof(uint32_t))
+
+// Recette d'un fichier : le fichier est la concaténation de ses chunks dans l'ordre
+typedef struct {
+    uint64_t file_size; // Taille totale du fichier
+    hash_algo hash; // Algorithme des digests
+    size_t digest_len; // Taille des digests
+    unsigned char file_digest[DIGEST_MAX_LENGTH]; // Digest du fichier complet
+    chunk_ref *refs; // Références des chunks dans l'ordre du fichier
+    int count; // Nombre de références
+    int capacity; // Capacité allouée de refs
+} recipe_t;
+
+// Liste des chunks d'un fichier rangée dans le dépôt. Au-delà de CHUNK_LIST_INLINE chunks, les enregistrements
+// sont découpés en objets de liste, coupés après un enregistrement dont le digest a ses bits bas nuls (une
+// modification ne déplace que les coupures voisines) ; chaque objet est adressé par son contenu et référencé
+// à son tour par un objet de niveau supérieur, jusqu'à une racine unique. Un arbre ou le cache des fichiers ne
+// garde que la référence de la racine : digest puis nombre d'enregistrements de l'objet, au format d'un chunk.
+#define CHUNK_LIST_INLINE 8
+#define CHUNK_LIST_MIN_RECORDS 512
+#define CHUNK_LIST_BOUNDARY_MASK 0x7ffu
+#define CHUNK_LIST_MAX_RECORDS 8192
+#define CHUNK_LIST_MAX_LEVELS 8
+
+// Liste terminée d'un fichier
+typedef struct {
+    uint32_t count;     // Nombre de chunks du fichier
+    uint32_t levels;    // 0 : records contient les count enregistrements ; sinon la référence de la racine
+    uint64_t file_size;
+    unsigned char file_digest[DIGEST_MAX_LENGTH];
+    unsigned char records[CHUNK_LIST_INLINE * CHUNK_REF_RECORD_SIZE(DIGEST_MAX_LENGTH)];
+} chunk_list_ref;
+
+// Construction d'une liste au fil des chunks stockés : seul l'objet en cours de chaque niveau est en
+// mémoire, quelle que soit la taille du fichier. Un seul thread l'utilise (l'écrivain du pipeline).
 typedef struct {
-    unsigned char md5[MD5_DIGEST_LENGTH];
-    int index;
-} Md5Entry;
-
-void compute_file_md5(FILE *file, unsigned char *md5_out);
-// Fonction de hachage MD5 pour l'indexation dans la table de hachage
-unsigned int hash_md5(unsigned char *md5);
-// Fonction pour calculer le MD5 d'un chunk
-void compute_md5(void *data, size_t len, unsigned char *md5_out);
-// Fonction permettant de chercher un MD5 dans la table de hachage
-int find_md5(Md5Entry *hash_table, unsigned char *md5);
-// Fonction pour ajouter un MD5 dans la table de hachage
-void add_md5(Md5Entry *hash_table, unsigned char *md5, int index);
-// Fonction pour convertir un fichier non dédupliqué en tableau de chunks
-void deduplicate_file(FILE *file, Chunk *chunks, Md5Entry *hash_table);
-// Fonction permettant de charger un fichier dédupliqué en table de chunks
-// en remplaçant les références par les données correspondantes
-void undeduplicate_file(FILE *file, Chunk **chunks, int *chunk_count);
+    chunk_store_t *store;
+    unsigned char *objects[CHUNK_LIST_MAX_LEVELS]; // Objet en cours de chaque niveau (0 : chunks du fichier)
+    uint32_t counts[CHUNK_LIST_MAX_LEVELS];
+    uint32_t top;       // Plus haut niveau atteint par la liste en cours
+    uint64_t total;     // Chunks de la liste en cours
+} chunk_list_builder;
+
+// Lecture d'un objet de liste ailleurs que dans un dépôt local (restauration distante) : renvoie ses
+// enregistrements, à libérer avec free, ou NULL
+typedef unsigned char *(*chunk_list_fetch_fn)(void *arg, const unsigned char *record, size_t digest_len);
+
+// Liste des chunks d'un fichier à restaurer, parcourue dans l'ordre sans être chargée : les références
+// sont lues dans les enregistrements d'un arbre ou d'un index déjà en mémoire, dans les objets de liste
+// du dépôt un à un, ou au fur et à mesure dans une recette ouverte
+typedef struct {
+    uint64_t file_size;
+    hash_algo hash;
+    size_t digest_len;
+    unsigned char file_digest[DIGEST_MAX_LENGTH];
+    uint64_t count;                // Nombre de références
+    uint64_t next;                 // Prochaine référence à lire
+    const unsigned char *records;  // Références sérialisées (NULL : lues dans file)
+    FILE *file;                    // Recette positionnée sur la prochaine référence
+    uint32_t levels;               // Liste rangée dans le dépôt : records est la référence de sa racine
+    chunk_store_t *store;          // Dépôt des objets de liste
+    pack_reader *reader;           // Lecteur du thread appelant (NULL : celui du dépôt)
+    chunk_list_fetch_fn fetch;     // Lecture des objets de liste hors du dépôt (NULL : dans store)
+    void *fetch_arg;
+    bool root_read;
+    unsigned char *objects[CHUNK_LIST_MAX_LEVELS]; // Objet en cours de chaque niveau, du plus bas à la racine
+    uint32_t object_count[CHUNK_LIST_MAX_LEVELS];
+    uint32_t object_next[CHUNK_LIST_MAX_LEVELS];
+} chunk_source;
+
+// Fonction pour restaurer le contenu d'une liste de chunks dans un fichier ouvert, en mémoire bornée
+// (restore_buffer_size octets, ou le plus grand chunk s'il est plus grand)
+int restore_recipe(chunk_source *source, chunk_store_t *store, int fd);
+// Fonction pour mettre à jour un fichier existant d'après une liste de chunks en n'écrivant que ceux qui diffèrent
+int restore_recipe_delta(chunk_source *source, chunk_store_t *store, int fd, uint64_t *written);
+// Fonction pour arrêter les threads de lecture des restaurations
+void restore_workers_stop(void);
+// Taille du tampon de restauration (--restore-memory)
+extern size_t restore_buffer_size;
+// Restauration différentielle (--delta) : un fichier déjà présent n'est réécrit qu'aux chunks qui diffèrent
+extern bool restore_delta;
+
+// Fonction pour initialiser une recette vide
+void recipe_init(recipe_t *recipe, hash_algo hash, size_t digest_len);
+// Fonction pour ajouter une référence à la fin d'une recette
+int recipe_append(recipe_t *recipe, const unsigned char *digest, uint32_t size);
+// Fonction pour lire une recette depuis un fichier
+int read_recipe(FILE *file, recipe_t *recipe);
+// Fonction pour lire l'en-tête d'une recette, dont les références seront lues une à une
+int recipe_open(FILE *file, chunk_source *source);
+// Fonction pour lire la référence suivante d'une liste de chunks
+int chunk_source_next(chunk_source *source, chunk_ref *ref);
+// Fonction pour libérer une recette
+void free_recipe(recipe_t *recipe);
+// Fonction pour libérer les objets de liste lus par un parcours
+void chunk_source_free(chunk_source *source);
+// Fonction pour préparer la construction des listes de chunks d'une sauvegarde
+void chunk_list_builder_init(chunk_list_builder *builder, chunk_store_t *store);
+// Fonction pour ajouter un chunk à la liste en cours
+int chunk_list_append(chunk_list_builder *builder, const unsigned char *digest, uint32_t size);
+// Fonction pour terminer la liste en cours et ranger ses derniers objets dans le dépôt
+int chunk_list_finish(chunk_list_builder *builder, chunk_list_ref *list);
+// Fonction pour abandonner la liste en cours
+void chunk_list_discard(chunk_list_builder *builder);
+// Fonction pour libérer les objets en cours
+void chunk_list_builder_free(chunk_list_builder *builder);
+// Fonction pour lire un objet de liste du dépôt
+unsigned char *chunk_list_load(chunk_store_t *store, pack_reader *reader, const unsigned char *record);
 
 #endif // DEDUPLICATION_H
 
@@ -0,0 +1,282 @@
+#include "extract.h"
+#include "backup_manager.h"
+#include "snapshot_index.h"
+#include "walker.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Écriture complète d'un bloc sur la sortie (les écritures partielles sont reprises)
+static int ecrire_sortie(int fd, const unsigned char *data, size_t size) {
+    uint64_t start = metrics_start();
+    uint64_t total = size;
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erreur d'écriture de l'extraction");
+            return -1;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    metrics_stop(METRIC_WRITE, start, total);
+    return 0;
+}
+
+// Écriture des octets [offset, end) d'un fichier : les chunks qui précèdent la plage sont sautés
+// d'après leur taille, sans être lus (seules leurs références sont parcourues)
+static int extraire_chunks(chunk_store_t *store, chunk_source *source, uint64_t offset, uint64_t end, int fd) {
+    unsigned char *buffer = NULL;
+    size_t buffer_size = 0;
+    uint64_t pos = 0;
+    int status = 0;
+    chunk_ref ref;
+    for (uint64_t c = 0; status == 0 && pos < end; c++) {
+        int next = chunk_source_next(source, &ref);
+        if (next <= 0) {
+            status = next;
+            break;
+        }
+        uint32_t size = ref.size;
+        if (pos + size <= offset) {
+            pos += size;
+            continue;
+        }
+        if (size > buffer_size) {
+            unsigned char *grown = realloc(buffer, size);
+            if (!grown) {
+                perror("Erreur d'allocation mémoire pour l'extraction");
+                status = -1;
+                break;
+            }
+            buffer = grown;
+            buffer_size = size;
+        }
+        long got = store_read(store, &store->reader, ref.digest, buffer, buffer_size);
+        if (got != (long)size) {
+            fprintf(stderr, "Erreur : chunk %llu du fichier illisible ou de taille inattendue.\n", (unsigned long long)c);
+            status = -1;
+            break;
+        }
+        uint64_t from = offset > pos ? offset - pos : 0;
+        uint64_t to = end - pos < size ? end - pos : size;
+        status = ecrire_sortie(fd, buffer + from, (size_t)(to - from));
+        pos += size;
+    }
+    free(buffer);
+    return status;
+}
+
+// Bornes de la plage demandée dans un fichier de taille size
+static uint64_t fin_de_plage(uint64_t size, uint64_t offset, uint64_t length) {
+    if (offset >= size) {
+        return offset;
+    }
+    return length > size - offset ? size : offset + length;
+}
+
+// Extraction d'une entrée d'arbre ou d'index plat
+static int extraire_entree(chunk_store_t *store, const snapshot_index_t *index, const snapshot_entry *entry,
+                           const char *path, uint64_t offset, uint64_t length, int fd) {
+    if (S_ISDIR(entry->mode)) {
+        fprintf(stderr, "Erreur : '%s' est un répertoire.\n", path);
+        return -1;
+    }
+    chunk_source source;
+    snapshot_entry_source(index, entry, store, NULL, &source);
+    int status = extraire_chunks(store, &source, offset, fin_de_plage(entry->size, offset, length), fd);
+    chunk_source_free(&source);
+    return status;
+}
+
+// Recherche d'un chemin dans l'arborescence d'une sauvegarde : un arbre lu et une recherche
+// dichotomique par composant du chemin. tree reste ouvert sur l'arbre qui contient l'entrée trouvée.
+static const snapshot_entry *chercher_chemin(chunk_store_t *store, const unsigned char *root, const char *path,
+                                             snapshot_index_t *tree) {
+    char *copy = strdup(path);
+    if (!copy) {
+        perror("Erreur d'allocation mémoire");
+        return NULL;
+    }
+    unsigned char digest[DIGEST_MAX_LENGTH];
+    memcpy(digest, root, store->digest_len);
+    const snapshot_entry *entry = NULL;
+    bool opened = false;
+    size_t components = 0;
+    char *saveptr = NULL;
+    for (char *name = strtok_r(copy, "/", &saveptr); name; name = strtok_r(NULL, "/", &saveptr)) {
+        // Composant "." : le répertoire courant
+        if (strcmp(name, ".") == 0) {
+            continue;
+        }
+        components++;
+        // Le composant précédent doit être un répertoire, dont l'arbre remplace celui qui est ouvert
+        if (entry) {
+            if (!S_ISDIR(entry->mode)) {
+                fprintf(stderr, "Erreur : '%s' n'est pas un répertoire dans la sauvegarde.\n", path);
+                entry = NULL;
+                break;
+            }
+            memcpy(digest, entry->digest, store->digest_len);
+            snapshot_index_close(tree);
+            opened = false;
+        }
+        if (snapshot_tree_open(tree, store, digest) != 0) {
+            entry = NULL;
+            break;
+        }
+        opened = true;
+        entry = snapshot_index_find(tree, name);
+        if (!entry) {
+            fprintf(stderr, "Erreur : '%s' est absent de la sauvegarde.\n", path);
+            break;
+        }
+    }
+    if (!entry && opened) {
+        snapshot_index_close(tree);
+    } else if (components == 0) {
+        fprintf(stderr, "Erreur : '%s' désigne la racine de la sauvegarde.\n", path);
+    }
+    free(copy);
+    return entry;
+}
+
+// Extraction depuis une sauvegarde antérieure à l'index binaire : recherche linéaire dans .backup_log
+static int extraire_backup_log(chunk_store_t *store, const char *backup_id, const char *path, uint64_t offset,
+                               uint64_t length, int fd) {
+    char *log_path = walk_join(backup_id, SNAPSHOT_BACKUP_LOG_NAME);
+    if (!log_path) {
+        return -1;
+    }
+    log_t logs = read_backup_log(log_path);
+    free(log_path);
+    size_t backup_len = strlen(backup_id);
+    int status = -1;
+    bool found = false;
+    for (log_element *current = logs.head; current && !found; current = current->next) {
+        const char *relative = current->path;
+        if (strncmp(relative, backup_id, backup_len) == 0 && relative[backup_len] == '/') {
+            relative += backup_len + 1;
+        }
+        if (strcmp(relative, path) != 0) {
+            continue;
+        }
+        found = true;
+        char *recipe_path = relative == current->path ? walk_join(backup_id, current->path) : strdup(current->path);
+        FILE *file = recipe_path ? fopen(recipe_path, "rb") : NULL;
+        free(recipe_path);
+        // Recette lue au fil de l'extraction, sans charger ses références
+        chunk_source source;
+        if (!file || recipe_open(file, &source) != 0) {
+            if (file) {
+                fclose(file);
+            }
+            fprintf(stderr, "Erreur : recette de '%s' illisible.\n", path);
+            break;
+        }
+        status = extraire_chunks(store, &source, offset, fin_de_plage(source.file_size, offset, length), fd);
+        fclose(file);
+    }
+    free_backup_log(&logs);
+    if (!found) {
+        fprintf(stderr, "Erreur : '%s' est absent de la sauvegarde.\n", path);
+    }
+    return status;
+}
+
+// Fonction pour écrire sur fd les octets [offset, offset + length) du fichier path d'une sauvegarde
+int extract_file(const char *backup_id, const char *path, uint64_t offset, uint64_t length, int fd) {
+    /* @param: backup_id est le chemin d'une sauvegarde, path le chemin du fichier relatif à sa racine
+    *           length vaut EXTRACT_TO_END pour aller jusqu'à la fin du fichier ; une plage qui dépasse
+    *           la fin est tronquée
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    // Chemins des index : relatifs à la racine, sans "/" ni "./" au début
+    while (path[0] == '/' || (path[0] == '.' && path[1] == '/')) {
+        path += path[0] == '/' ? 1 : 2;
+    }
+
+    char *store_parent = store_dir_of_backup(backup_id);
+    chunk_store_t store;
+    if (!store_parent || store_open_read(&store, store_parent) != 0) {
+        fprintf(stderr, "Erreur : dépôt de chunks introuvable pour '%s'.\n", backup_id);
+        free(store_parent);
+        return -1;
+    }
+    free(store_parent);
+
+    int status = -1;
+    snapshot_manifest manifest;
+    snapshot_index_t index;
+    const snapshot_entry *entry;
+    char *file_path = NULL;
+    memset(&index, 0, sizeof(index));
+    switch (snapshot_format_of(backup_id)) {
+        case SNAPSHOT_FORMAT_MANIFEST:
+            file_path = walk_join(backup_id, SNAPSHOT_MANIFEST_NAME);
+            if (!file_path || snapshot_manifest_read(file_path, &manifest) != 0 || manifest.digest_len != store.digest_len) {
+                fprintf(stderr, "Erreur : le manifeste de '%s' est illisible.\n", backup_id);
+                break;
+            }
+            entry = chercher_chemin(&store, manifest.root, path, &index);
+            if (entry) {
+                status = extraire_entree(&store, &index, entry, path, offset, length, fd);
+                snapshot_index_close(&index);
+            }
+            break;
+        case SNAPSHOT_FORMAT_FLAT_INDEX:
+            // Index plat : tous les chemins de la sauvegarde sont triés dans un seul index
+            file_path = walk_join(backup_id, SNAPSHOT_INDEX_NAME);
+            if (!file_path || snapshot_index_open(&index, file_path) != 0) {
+                break;
+            }
+            entry = snapshot_index_find(&index, path);
+            if (!entry) {
+                fprintf(stderr, "Erreur : '%s' est absent de la sauvegarde.\n", path);
+            } else {
+                status = extraire_entree(&store, &index, entry, path, offset, length, fd);
+            }
+            snapshot_index_close(&index);
+            break;
+        case SNAPSHOT_FORMAT_BACKUP_LOG:
+            status = extraire_backup_log(&store, backup_id, path, offset, length, fd);
+            break;
+        case SNAPSHOT_FORMAT_NONE:
+            fprintf(stderr, "Erreur : '%s' n'a ni manifeste ni index de sauvegarde.\n", backup_id);
+            break;
+    }
+    free(file_path);
+    store_close(&store);
+    return status;
+}
+
+// Fonction pour lire une plage DEBUT[:LONGUEUR] (octets)
+int extract_range_parse(const char *text, uint64_t *offset, uint64_t *length) {
+    unsigned long long start, count;
+    char extra;
+    // strtoull accepterait un nombre négatif
+    if (strchr(text, '-')) {
+        fprintf(stderr, "Format attendu pour la plage : DEBUT[:LONGUEUR] (octets).\n");
+        return -1;
+    }
+    if (sscanf(text, "%llu:%llu%c", &start, &count, &extra) == 2) {
+        *offset = start;
+        *length = count;
+        return 0;
+    }
+    if (sscanf(text, "%llu%c", &start, &extra) == 1) {
+        *offset = start;
+        *length = EXTRACT_TO_END;
+        return 0;
+    }
+    fprintf(stderr, "Format attendu pour la plage : DEBUT[:LONGUEUR] (octets).\n");
+    return -1;
+}
@@ -0,0 +1,18 @@
+#ifndef EXTRACT_H
+#define EXTRACT_H
+
+#include <stdint.h>
+
+// Extraction d'un seul fichier d'une sauvegarde (--extract) : le chemin est cherché composant par
+// composant dans les arbres triés (recherche dichotomique à chaque niveau), puis seuls les chunks
+// qui recouvrent la plage demandée sont lus dans les packs et écrits dans l'ordre.
+
+// Longueur d'une plage qui va jusqu'à la fin du fichier
+#define EXTRACT_TO_END UINT64_MAX
+
+// Fonction pour écrire sur fd les octets [offset, offset + length) du fichier path d'une sauvegarde
+int extract_file(const char *backup_id, const char *path, uint64_t offset, uint64_t length, int fd);
+// Fonction pour lire une plage DEBUT[:LONGUEUR] (octets)
+int extract_range_parse(const char *text, uint64_t *offset, uint64_t *length);
+
+#endif // EXTRACT_H
@@ -1,9 +1,15 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
 #include <dirent.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
 #include "file_handler.h"
 #include "deduplication.h"
 
@@ -17,44 +23,40 @@ log_t read_backup_log(const char *logfile) {
         perror("Erreur lors de l'ouverture du fichier de sauvegarde");
         return logs;  // Retourne une liste vide en cas d'erreur
     }
-    printf("Lecture du fichier: %s\n", logfile);
-
-
-    char line[1024];  // Buffer pour lire chaque ligne
-    while (fgets(line, sizeof(line), file)) {
-        printf("%s\n", line);
 
+    char *line = NULL;  // Buffer pour lire chaque ligne, agrandi par getline pour les chemins longs
+    size_t line_size = 0;
+    while (getline(&line, &line_size, file) != -1) {
         // Analyser la première partie : le chemin complet (YYYY-MM-DD-hh:mm:ss.sss/folder1/file1)
         char *path = strtok(line, ";");  // Le chemin est avant le premier point-virgule
         if (!path) {
-            printf("Impossible de recuperer path.\n");
+            fprintf(stderr, "Impossible de recuperer path.\n");
             continue;  // Continuer à la ligne suivante si on ne peut pas récupérer le path
         }
 
         // Analyser la deuxième partie : la date de dernière modification (mtime)
         char *mtime_str = strtok(NULL, ";");
         if (!mtime_str) {
-            printf("Impossible de recuperer mtime.\n");
+            fprintf(stderr, "Impossible de recuperer mtime.\n");
             continue;  // Continuer à la ligne suivante si mtime est manquant
         }
 
-        // Analyser la troisième partie : le MD5
-        char *md5_str = strtok(NULL, ";");
-        if (!md5_str) {
-            printf("Impossible de recuperer md5.\n");
-            continue;  // Continuer à la ligne suivante si md5 est manquant
+        // Analyser la troisième partie : le digest
+        char *digest_str = strtok(NULL, ";");
+        if (!digest_str) {
+            fprintf(stderr, "Impossible de recuperer le digest.\n");
+            continue;  // Continuer à la ligne suivante si le digest est manquant
         }
 
-        // Convertir le MD5 de la chaîne hexadécimale en binaire
-        unsigned char md5[MD5_DIGEST_LENGTH];
-        for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) {
-            sscanf(md5_str + 2 * i, "%2hhx", &md5[i]);  // Convertir deux caractères hexadécimaux en un octet
-        }
+        // Convertir le digest de la chaîne hexadécimale en binaire (sa taille dépend de l'algorithme)
+        unsigned char digest[DIGEST_MAX_LENGTH];
+        size_t digest_len = digest_from_hex(digest_str, digest, DIGEST_MAX_LENGTH);
 
         // Créer un nouvel élément de log
         log_element *new_log = (log_element *)malloc(sizeof(log_element));
         if (!new_log) {
             perror("Erreur d'allocation mémoire pour un nouvel élément de log");
+            free(line);
             fclose(file);
             return logs;  // Retourne la liste actuelle, vide en cas d'erreur
         }
@@ -62,7 +64,8 @@ log_t read_backup_log(const char *logfile) {
         // Copier les données dans le nouvel élément
         new_log->path = strdup(path);
         new_log->date = strdup(mtime_str);
-        memcpy(new_log->md5, md5, MD5_DIGEST_LENGTH);
+        memcpy(new_log->digest, digest, digest_len);
+        new_log->digest_len = digest_len;
 
         // Initialiser le next et prev du nouvel élément
         new_log->next = NULL;
@@ -77,13 +80,26 @@ log_t read_backup_log(const char *logfile) {
         logs.tail = new_log;  // Ce nouvel élément devient la queue de la liste
     }
 
-    printf("Fichier %s lu avec succes.\n", logfile);
-
+    free(line);
 
     fclose(file);  // Fermer le fichier après lecture
     return logs;  // Retourner la liste de logs
 }
 
+// Fonction pour libérer la liste renvoyée par read_backup_log
+void free_backup_log(log_t *logs) {
+    log_element *current = logs->head;
+    while (current) {
+        log_element *next = current->next;
+        free((char *)current->path);
+        free(current->date);
+        free(current);
+        current = next;
+    }
+    logs->head = NULL;
+    logs->tail = NULL;
+}
+
 // Fonction pour mettre à jour une ligne du fichier .backup_log
 void update_backup_log(const char *logfile, log_t *logs) {
     FILE *file = fopen(logfile, "r");
@@ -94,9 +110,10 @@ void update_backup_log(const char *logfile, log_t *logs) {
 
     char **lines = NULL; // Tableau dynamique pour stocker les lignes valides
     int line_count = 0;
-    char line[1024];
+    char *line = NULL;
+    size_t line_size = 0;
 
-    while (fgets(line, sizeof(line), file)) {
+    while (getline(&line, &line_size, file) != -1) {
         char *line_copy = strdup(line); // Copie de la ligne pour stockage
         if (!line_copy) {
             perror("Erreur d'allocation mémoire");
@@ -120,6 +137,7 @@ void update_backup_log(const char *logfile, log_t *logs) {
         }
     }
 
+    free(line);
     fclose(file);
 
     // Ouvre le fichier en mode écriture pour réécrire les lignes valides
@@ -145,19 +163,17 @@ void update_backup_log(const char *logfile, log_t *logs) {
 }
 
 void write_log_element(log_element *elt, FILE *logfile) {
-    if (!logfile || !elt || !elt->path || !elt->date || !elt->md5) {
+    if (!logfile || !elt || !elt->path || !elt->date) {
         fprintf(stderr, "Fichier ou log invalide.\n");
         return;
     }
 
-    // Calculer la somme des octets du MD5
-    unsigned int md5_sum = 0;
-    for (int i = 0; i < MD5_DIGEST_LENGTH; ++i) {
-        md5_sum += elt->md5[i];
-    }
+    // Le digest complet est écrit en hexadécimal, comme le relit read_backup_log
+    char digest_hex[2 * DIGEST_MAX_LENGTH + 1];
+    digest_to_hex(elt->digest, elt->digest_len, digest_hex);
 
     // Écriture dans le fichier
-    if (fprintf(logfile, "%s;%s;%u\n", elt->path, elt->date, md5_sum) < 0) {
+    if (fprintf(logfile, "%s;%s;%s\n", elt->path, elt->date, digest_hex) < 0) {
         perror("Erreur d'écriture dans le fichier");
         return;
     }
@@ -191,30 +207,217 @@ void list_files(const char *path){
   }
 }
 
-void copy_file(const char *src, const char *dest) {
-    FILE *src_f = fopen(src, "rb");  // Ouvre le fichier source en mode binaire
-    if (src_f == NULL) {
+// Noms des méthodes de copie, dans l'ordre de copy_method
+static const char *copy_method_names[COPY_METHOD_COUNT] = {
+    "reflink", "copy_file_range", "sendfile", "splice", "tampon"
+};
+
+// Fonction qui renvoie le nom d'une méthode de copie
+const char *copy_method_name(copy_method method) {
+    if (method < 0 || method >= COPY_METHOD_COUNT) {
+        return "échec";
+    }
+    return copy_method_names[method];
+}
+
+// Erreurs qui signifient "méthode non disponible ici" : on passe à la suivante
+static bool copy_unsupported(int err) {
+    return err == EOPNOTSUPP || err == ENOSYS || err == EXDEV || err == EINVAL || err == ENOTTY;
+}
+
+// Copie par copy_file_range : le noyau copie (ou partage les extents sur NFS, XFS...) sans passer par l'espace utilisateur
+static int copy_with_range(int in, int out, off_t *offset) {
+    for (;;) {
+        off_t off_in = *offset, off_out = *offset;
+        ssize_t n = copy_file_range(in, &off_in, out, &off_out, COPY_CHUNK_SIZE, 0);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        *offset += n;
+    }
+}
+
+// Copie par sendfile : du cache de pages source directement vers le fichier destination
+static int copy_with_sendfile(int in, int out, off_t *offset) {
+    if (lseek(out, *offset, SEEK_SET) == (off_t)-1) {
+        return -1;
+    }
+    for (;;) {
+        off_t off_in = *offset;
+        ssize_t n = sendfile(out, in, &off_in, COPY_CHUNK_SIZE);
+        if (n == 0) {
+            return 0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        *offset += n;
+    }
+}
+
+// Copie par splice à travers un tube : les pages sont déplacées sans copie vers l'espace utilisateur
+static int copy_with_splice(int in, int out, off_t *offset) {
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        return -1;
+    }
+    fcntl(pipefd[1], F_SETPIPE_SZ, COPY_CHUNK_SIZE);
+
+    int status = 0;
+    for (;;) {
+        off_t off_in = *offset;
+        ssize_t n = splice(in, &off_in, pipefd[1], NULL, COPY_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = -1;
+            break;
+        }
+        // Le tube doit être entièrement vidé avant l'appel suivant
+        ssize_t left = n;
+        while (left > 0) {
+            off_t off_out = *offset;
+            ssize_t m = splice(pipefd[0], NULL, out, &off_out, (size_t)left, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (m <= 0) {
+                if (m < 0 && errno == EINTR) {
+                    continue;
+                }
+                // Données déjà sorties du fichier source mais pas écrites : pas de repli possible
+                close(pipefd[0]);
+                close(pipefd[1]);
+                errno = m == 0 ? EIO : errno;
+                return -2;
+            }
+            *offset += m;
+            left -= m;
+        }
+    }
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return status;
+}
+
+// Copie classique par un grand tampon (pread/pwrite), dernier recours
+static int copy_with_buffer(int in, int out, off_t *offset) {
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (!buffer) {
+        return -1;
+    }
+    posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    int status = 0;
+    for (;;) {
+        ssize_t n = pread(in, buffer, COPY_BUFFER_SIZE, *offset);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = -1;
+            break;
+        }
+        ssize_t written = 0;
+        while (written < n) {
+            ssize_t m = pwrite(out, buffer + written, (size_t)(n - written), *offset + written);
+            if (m < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                status = -1;
+                break;
+            }
+            written += m;
+        }
+        if (status != 0) {
+            break;
+        }
+        *offset += n;
+    }
+    free(buffer);
+    return status;
+}
+
+// Fonction pour copier un fichier en essayant les méthodes autorisées de la plus rapide à la plus lente
+copy_method copy_file_methods(const char *src, const char *dest, unsigned methods) {
+    /* @param: methods est un masque de COPY_MASK(méthode) ; COPY_ALL_METHODS pour toutes
+    *  @return: la méthode qui a terminé la copie, COPY_FAILED en cas d'échec
+    */
+    int in = open(src, O_RDONLY | O_CLOEXEC);  // Ouvre le fichier source
+    if (in < 0) {
         perror("Erreur d'ouverture du fichier source");
-        return;
+        return COPY_FAILED;
     }
 
-    FILE *dest_f = fopen(dest, "wb");  // Ouvre le fichier destination en mode binaire
-    if (dest_f == NULL) {
+    int out = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);  // Ouvre le fichier destination
+    if (out < 0) {
         perror("Erreur d'ouverture du fichier destination");
-        fclose(src_f);
-        return;
+        close(in);
+        return COPY_FAILED;
     }
 
-    char buffer[4096];  // Buffer pour lire et écrire des données
-    size_t bytes_read;
-
-    // Lire et copier le contenu du fichier source dans le fichier destination
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer), src_f)) > 0) {
-        fwrite(buffer, 1, bytes_read, dest_f);
+    // Chaque méthode reprend là où la précédente s'est arrêtée
+    off_t offset = 0;
+    copy_method used = COPY_FAILED;
+    bool failed = false;
+    for (int method = 0; method < COPY_METHOD_COUNT && used == COPY_FAILED; method++) {
+        if (!(methods & COPY_MASK(method))) {
+            continue;
+        }
+        int status;
+        switch (method) {
+        case COPY_REFLINK:
+            // Reflink (btrfs, XFS...) : la destination partage les extents de la source, rien n'est copié
+            status = ioctl(out, FICLONE, in) == 0 ? 0 : -1;
+            break;
+        case COPY_RANGE:
+            status = copy_with_range(in, out, &offset);
+            break;
+        case COPY_SENDFILE:
+            status = copy_with_sendfile(in, out, &offset);
+            break;
+        case COPY_SPLICE:
+            status = copy_with_splice(in, out, &offset);
+            break;
+        default:
+            status = copy_with_buffer(in, out, &offset);
+            break;
+        }
+        if (status == 0) {
+            used = method;
+        } else if (status == -2 || !copy_unsupported(errno)) {
+            perror("Erreur lors de la copie du fichier");
+            failed = true;
+            break;
+        }
+    }
+    if (used == COPY_FAILED && !failed) {
+        fprintf(stderr, "Aucune méthode de copie disponible pour '%s'.\n", src);
     }
 
-    //printf("Le fichier '%s' a été copié vers '%s'.\n", src, dest);
+    close(in);  // Ferme le fichier source
+    if (close(out) != 0 && used != COPY_FAILED) {  // Ferme le fichier destination
+        perror("Erreur lors de la fermeture du fichier destination");
+        used = COPY_FAILED;
+    }
+    return used;
+}
 
-    fclose(src_f);  // Ferme le fichier source
-    fclose(dest_f);  // Ferme le fichier destination
+// Fonction pour copier un fichier, renvoie la méthode utilisée (COPY_FAILED en cas d'échec)
+copy_method copy_file(const char *src, const char *dest) {
+    return copy_file_methods(src, dest, COPY_ALL_METHODS);
 }
@@ -2,12 +2,14 @@
 #define FILE_HANDLER_H
 
 #include <stdio.h>
-#include <openssl/md5.h>
+#include <stddef.h>
+#include "hash.h"
 
 // Structure pour une ligne du fichier log
 typedef struct log_element{
     const char *path; // Chemin du fichier/dossier
-    unsigned char md5[MD5_DIGEST_LENGTH]; // MD5 du fichier dédupliqué
+    unsigned char digest[DIGEST_MAX_LENGTH]; // Digest du fichier dédupliqué
+    size_t digest_len; // Taille du digest (dépend de l'algorithme du dépôt)
     char *date; // Date de dernière modification
     struct log_element *next;
     struct log_element *prev;
@@ -20,11 +22,35 @@ typedef struct {
 } log_t;
 
 
+// Méthodes de copie d'un fichier, de la plus rapide à la plus lente
+typedef enum {
+    COPY_FAILED = -1,
+    COPY_REFLINK = 0,  // ioctl FICLONE : partage des extents (btrfs, XFS)
+    COPY_RANGE,        // copy_file_range : copie dans le noyau
+    COPY_SENDFILE,     // sendfile
+    COPY_SPLICE,       // splice à travers un tube
+    COPY_BUFFERED,     // pread/pwrite avec un grand tampon
+    COPY_METHOD_COUNT
+} copy_method;
+
+#define COPY_MASK(method) (1u << (method))
+#define COPY_ALL_METHODS ((1u << COPY_METHOD_COUNT) - 1)
+// Quantité demandée au noyau par appel (copy_file_range, sendfile, splice)
+#define COPY_CHUNK_SIZE (1 << 20)
+// Tampon de la copie classique
+#define COPY_BUFFER_SIZE (1 << 20)
+
 log_t read_backup_log(const char *logfile);
+void free_backup_log(log_t *logs);
 void update_backup_log(const char *logfile, log_t *logs);
 void write_log_element(log_element *elt, FILE *logfile);
 void list_files(const char *path);
-void copy_file(const char *src, const char *dest);
+// Fonction pour copier un fichier, renvoie la méthode utilisée (COPY_FAILED en cas d'échec)
+copy_method copy_file(const char *src, const char *dest);
+// Fonction pour copier un fichier en essayant les méthodes autorisées de la plus rapide à la plus lente
+copy_method copy_file_methods(const char *src, const char *dest, unsigned methods);
+// Fonction qui renvoie le nom d'une méthode de copie
+const char *copy_method_name(copy_method method);
 
 #endif // FILE_HANDLER_H
 
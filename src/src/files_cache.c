@@ -0,0 +1,419 @@
+#include "files_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define ENTRY_UNSEEN 0
+#define ENTRY_HIT 1
+#define ENTRY_REPLACED 2
+#define ENTRY_KEPT 3 // Conservée sans vieillir (nettoyage du dépôt)
+
+static int64_t timespec_ns(const struct timespec *ts) {
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+// Nombre d'enregistrements d'une entrée : sa liste, ou la racine d'une liste rangée dans le dépôt
+static uint32_t entry_records(const files_cache_entry *entry) {
+    return entry->list_levels ? 1 : entry->chunk_count;
+}
+
+// Comparaison de deux entrées par (dev, inode)
+static int compare_key(uint64_t dev_a, uint64_t inode_a, uint64_t dev_b, uint64_t inode_b) {
+    if (dev_a != dev_b) {
+        return dev_a < dev_b ? -1 : 1;
+    }
+    if (inode_a != inode_b) {
+        return inode_a < inode_b ? -1 : 1;
+    }
+    return 0;
+}
+
+// Projection de l'ancien cache ; un cache absent, invalide ou d'un autre algorithme est ignoré
+static void load_cache(files_cache_t *cache) {
+    int fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(files_cache_header)) {
+        close(fd);
+        return;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    const files_cache_header *header = map;
+    uint64_t size = (uint64_t)st.st_size;
+    size_t record = CHUNK_REF_RECORD_SIZE(cache->digest_len);
+    // Un cache d'une version précédente, ou d'une autre génération du dépôt distant, est simplement reconstruit
+    if (memcmp(header->magic, FILES_CACHE_MAGIC, FILES_CACHE_MAGIC_LENGTH) == 0 &&
+        (header->version < FILES_CACHE_VERSION || memcmp(header->epoch, cache->epoch, STORE_EPOCH_LENGTH) != 0)) {
+        munmap(map, (size_t)st.st_size);
+        return;
+    }
+    int valid = memcmp(header->magic, FILES_CACHE_MAGIC, FILES_CACHE_MAGIC_LENGTH) == 0 &&
+                header->version == FILES_CACHE_VERSION &&
+                header->hash == (uint8_t)cache->hash && header->digest_len == cache->digest_len &&
+                header->entries_offset >= sizeof(files_cache_header) &&
+                header->entry_count <= (size - header->entries_offset) / sizeof(files_cache_entry) &&
+                header->chunks_offset <= size && header->chunks_size <= size - header->chunks_offset;
+    const files_cache_entry *entries = (const files_cache_entry *)((const char *)map + header->entries_offset);
+    for (uint64_t i = 0; valid && i < header->entry_count; i++) {
+        valid = entries[i].chunk_offset <= header->chunks_size && entries[i].list_levels <= CHUNK_LIST_MAX_LEVELS &&
+                entry_records(&entries[i]) <= (header->chunks_size - entries[i].chunk_offset) / record;
+    }
+    unsigned char *state = valid ? calloc(header->entry_count + 1, 1) : NULL;
+    if (!state) {
+        if (!valid) {
+            fprintf(stderr, "Cache des fichiers invalide, il sera reconstruit.\n");
+        }
+        munmap(map, (size_t)st.st_size);
+        return;
+    }
+
+    cache->map = map;
+    cache->map_size = (size_t)st.st_size;
+    cache->entries = entries;
+    cache->chunks = (const unsigned char *)map + header->chunks_offset;
+    cache->count = (size_t)header->entry_count;
+    cache->state = state;
+}
+
+// Ouverture du cache enregistré dans path (alloué, repris par le cache)
+static void ouvrir_cache(files_cache_t *cache, char *path, hash_algo hash, size_t digest_len) {
+    cache->path = path;
+    cache->hash = hash;
+    cache->digest_len = digest_len;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    cache->start_ns = timespec_ns(&now);
+
+    pthread_mutex_init(&cache->lock, NULL);
+    load_cache(cache);
+}
+
+// Fonction pour ouvrir le cache des fichiers d'un dépôt
+int files_cache_open(files_cache_t *cache, const char *store_path, hash_algo hash, size_t digest_len) {
+    /* @param: store_path est le répertoire du dépôt (.store)
+    *  @return: 0 en cas de succès (cache vide s'il n'existait pas), -1 sinon
+    */
+    memset(cache, 0, sizeof(*cache));
+    char *path = malloc(strlen(store_path) + strlen(FILES_CACHE_NAME) + 2);
+    if (!path) {
+        perror("Erreur d'allocation mémoire pour le cache des fichiers");
+        return -1;
+    }
+    sprintf(path, "%s/%s", store_path, FILES_CACHE_NAME);
+    ouvrir_cache(cache, path, hash, digest_len);
+    return 0;
+}
+
+// Fonction pour ouvrir le cache des fichiers d'une sauvegarde distante, gardé par le client
+int files_cache_open_remote(files_cache_t *cache, const char *server, int port, hash_algo hash, size_t digest_len,
+                            const unsigned char *epoch) {
+    /* @param: server et port désignent le serveur ; epoch est la génération de son dépôt (STORE_EPOCH_LENGTH
+    *           octets) : un cache enregistré pour une autre génération, ou un autre dépôt, est reconstruit
+    *  @return: 0 en cas de succès (cache vide s'il n'existait pas), -1 si aucun répertoire de cache n'est utilisable
+    */
+    memset(cache, 0, sizeof(*cache));
+    memcpy(cache->epoch, epoch, STORE_EPOCH_LENGTH);
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[4096];
+    if (base && base[0] == '/') {
+        snprintf(dir, sizeof(dir), "%s", base);
+    } else if (home && home[0] == '/') {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    } else {
+        fprintf(stderr, "Aucun répertoire de cache ($XDG_CACHE_HOME, $HOME) : tous les fichiers seront relus.\n");
+        return -1;
+    }
+    size_t len = strlen(dir);
+    int ok = len + strlen(FILES_CACHE_REMOTE_DIR) + 2 <= sizeof(dir) && (mkdir(dir, 0700) == 0 || errno == EEXIST);
+    if (ok) {
+        snprintf(dir + len, sizeof(dir) - len, "/%s", FILES_CACHE_REMOTE_DIR);
+        ok = mkdir(dir, 0700) == 0 || errno == EEXIST;
+    }
+    if (!ok) {
+        fprintf(stderr, "Répertoire de cache %s inutilisable : tous les fichiers seront relus.\n", dir);
+        return -1;
+    }
+
+    // Un fichier par serveur ; le nom du serveur ne doit pas sortir du répertoire
+    size_t size = strlen(dir) + strlen(FILES_CACHE_NAME) + strlen(server) + 32;
+    char *path = malloc(size);
+    if (!path) {
+        perror("Erreur d'allocation mémoire pour le cache des fichiers");
+        return -1;
+    }
+    int prefix = snprintf(path, size, "%s/%s-", dir, FILES_CACHE_NAME);
+    snprintf(path + prefix, size - (size_t)prefix, "%s-%d", server, port);
+    for (char *c = path + prefix; *c; c++) {
+        if (*c == '/') {
+            *c = '_';
+        }
+    }
+    ouvrir_cache(cache, path, hash, digest_len);
+    return 0;
+}
+
+// Fonction pour rechercher un fichier inchangé
+const files_cache_entry *files_cache_lookup(files_cache_t *cache, const struct stat *st) {
+    /* @param: st sont les métadonnées du fichier relevées par le parcours
+    *  @return: l'entrée si le fichier n'a pas changé, NULL sinon
+    */
+    size_t low = 0, high = cache->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const files_cache_entry *entry = &cache->entries[middle];
+        int cmp = compare_key(entry->dev, entry->inode, (uint64_t)st->st_dev, (uint64_t)st->st_ino);
+        if (cmp < 0) {
+            low = middle + 1;
+        } else if (cmp > 0) {
+            high = middle;
+        } else {
+            // Le même inode avec une taille ou des dates différentes a été modifié (ou réutilisé)
+            if (entry->size == (uint64_t)st->st_size &&
+                entry->mtime_ns == timespec_ns(&st->st_mtim) &&
+                entry->ctime_ns == timespec_ns(&st->st_ctim)) {
+                __atomic_store_n(&cache->state[middle], ENTRY_HIT, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+                return entry;
+            }
+            __atomic_store_n(&cache->state[middle], ENTRY_REPLACED, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// Fonction pour reprendre la liste de chunks d'une entrée
+void files_cache_list(const files_cache_t *cache, const files_cache_entry *entry, chunk_list_ref *list) {
+    /* @param: list reçoit la liste (au plus CHUNK_LIST_INLINE enregistrements sont recopiés), la taille
+    *           et le digest du fichier
+    */
+    list->count = entry->chunk_count;
+    list->levels = entry->list_levels;
+    list->file_size = entry->size;
+    memcpy(list->file_digest, entry->digest, cache->digest_len);
+    memcpy(list->records, cache->chunks + entry->chunk_offset,
+           CHUNK_REF_RECORD_SIZE(cache->digest_len) * entry_records(entry));
+}
+
+// Fonction pour ajouter un fichier qui vient d'être lu
+int files_cache_add(files_cache_t *cache, const struct stat *st, const chunk_list_ref *list) {
+    /* @param: st sont les métadonnées relevées avant la lecture du fichier
+    *           list est sa liste de chunks, telle qu'ajoutée à la sauvegarde
+    *  @return: 0 en cas de succès ou si le fichier n'est pas mis en cache, -1 sinon
+    */
+    // Un fichier modifié pendant la sauvegarde pourrait l'être encore avec les mêmes dates : il sera relu
+    if (timespec_ns(&st->st_mtim) >= cache->start_ns || timespec_ns(&st->st_ctim) >= cache->start_ns) {
+        return 0;
+    }
+
+    size_t bytes = CHUNK_REF_RECORD_SIZE(cache->digest_len) * (list->levels ? 1 : list->count);
+    pthread_mutex_lock(&cache->lock);
+    if (cache->added_chunks_size + bytes > cache->added_chunks_capacity) {
+        size_t capacity = cache->added_chunks_capacity ? cache->added_chunks_capacity : 64 * 1024;
+        while (capacity < cache->added_chunks_size + bytes) {
+            capacity *= 2;
+        }
+        unsigned char *chunks = realloc(cache->added_chunks, capacity);
+        if (!chunks) {
+            pthread_mutex_unlock(&cache->lock);
+            perror("Erreur d'allocation mémoire pour le cache des fichiers");
+            return -1;
+        }
+        cache->added_chunks = chunks;
+        cache->added_chunks_capacity = capacity;
+    }
+    if (cache->added_count == cache->added_capacity) {
+        size_t capacity = cache->added_capacity ? cache->added_capacity * 2 : 1024;
+        files_cache_entry *added = realloc(cache->added, capacity * sizeof(files_cache_entry));
+        if (!added) {
+            pthread_mutex_unlock(&cache->lock);
+            perror("Erreur d'allocation mémoire pour le cache des fichiers");
+            return -1;
+        }
+        cache->added = added;
+        cache->added_capacity = capacity;
+    }
+
+    files_cache_entry *entry = &cache->added[cache->added_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->dev = (uint64_t)st->st_dev;
+    entry->inode = (uint64_t)st->st_ino;
+    entry->size = list->file_size;
+    entry->mtime_ns = timespec_ns(&st->st_mtim);
+    entry->ctime_ns = timespec_ns(&st->st_ctim);
+    entry->chunk_offset = cache->added_chunks_size;
+    entry->chunk_count = list->count;
+    entry->list_levels = (uint16_t)list->levels;
+    memcpy(entry->digest, list->file_digest, cache->digest_len);
+    memcpy(cache->added_chunks + cache->added_chunks_size, list->records, bytes);
+    cache->added_chunks_size += bytes;
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const files_cache_entry *x = a, *y = b;
+    return compare_key(x->dev, x->inode, y->dev, y->inode);
+}
+
+// Fonction pour retirer du cache les fichiers dont un chunk a été supprimé du dépôt
+size_t files_cache_forget(files_cache_t *cache, bool (*is_live)(const unsigned char *digest, void *arg), void *arg) {
+    /* @param: is_live indique si un chunk est encore dans le dépôt ; pour une liste rangée dans le
+    *           dépôt, seule sa racine est vérifiée (le nettoyage ne la garde qu'avec toute la liste)
+    *  @return: le nombre d'entrées retirées ; files_cache_save écrit alors le cache sans elles,
+    *           les autres entrées gardent leur âge
+    */
+    size_t record = CHUNK_REF_RECORD_SIZE(cache->digest_len);
+    size_t forgotten = 0;
+    for (size_t i = 0; i < cache->count; i++) {
+        const unsigned char *chunks = cache->chunks + cache->entries[i].chunk_offset;
+        cache->state[i] = ENTRY_KEPT;
+        for (uint32_t c = 0; c < entry_records(&cache->entries[i]); c++) {
+            if (!is_live(chunks + (size_t)c * record, arg)) {
+                cache->state[i] = ENTRY_REPLACED;
+                forgotten++;
+                break;
+            }
+        }
+    }
+    return forgotten;
+}
+
+// Fonction pour écrire le nouveau cache (entrées reprises, ajoutées et anciennes non expirées)
+int files_cache_save(files_cache_t *cache) {
+    /* @return: 0 en cas de succès, -1 sinon
+    */
+    size_t record = CHUNK_REF_RECORD_SIZE(cache->digest_len);
+    qsort(cache->added, cache->added_count, sizeof(files_cache_entry), compare_entries);
+
+    // Tous les fichiers retrouvés tels quels : le nouveau cache serait identique à l'ancien
+    size_t unchanged = 0;
+    while (cache->added_count == 0 && unchanged < cache->count &&
+           cache->state[unchanged] == ENTRY_HIT && cache->entries[unchanged].age == 0) {
+        unchanged++;
+    }
+    if (cache->map && cache->added_count == 0 && unchanged == cache->count) {
+        return 0;
+    }
+
+    size_t len = strlen(cache->path) + 5;
+    char *tmp_path = malloc(len);
+    if (!tmp_path) {
+        perror("Erreur d'allocation mémoire");
+        return -1;
+    }
+    snprintf(tmp_path, len, "%s.tmp", cache->path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        perror("Erreur lors de la création du cache des fichiers");
+        free(tmp_path);
+        return -1;
+    }
+
+    // Fusion des deux listes triées ; les listes de chunks sont écrites après les entrées,
+    // on réserve donc la place des entrées et on y revient une fois leur nombre connu
+    files_cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILES_CACHE_MAGIC, FILES_CACHE_MAGIC_LENGTH);
+    header.version = FILES_CACHE_VERSION;
+    header.hash = (uint8_t)cache->hash;
+    header.digest_len = (uint8_t)cache->digest_len;
+    header.entries_offset = sizeof(header);
+    memcpy(header.epoch, cache->epoch, STORE_EPOCH_LENGTH);
+
+    // sources donne la liste de chunks de chaque entrée, dans l'ancien cache ou parmi les nouvelles
+    files_cache_entry *merged = malloc((cache->count + cache->added_count + 1) * sizeof(files_cache_entry));
+    const unsigned char **sources = malloc((cache->count + cache->added_count + 1) * sizeof(unsigned char *));
+    if (!merged || !sources) {
+        perror("Erreur d'allocation mémoire pour le cache des fichiers");
+        free(merged);
+        free(sources);
+        fclose(file);
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    size_t count = 0, i = 0, j = 0;
+    while (i < cache->count || j < cache->added_count) {
+        int take_old;
+        if (i == cache->count) {
+            take_old = 0;
+        } else if (j == cache->added_count) {
+            take_old = 1;
+        } else {
+            take_old = compare_entries(&cache->entries[i], &cache->added[j]) < 0;
+        }
+        if (take_old) {
+            const files_cache_entry *old = &cache->entries[i];
+            unsigned char state = cache->state[i++];
+            if (state == ENTRY_REPLACED || (state == ENTRY_UNSEEN && old->age + 1 >= FILES_CACHE_TTL)) {
+                continue;
+            }
+            merged[count] = *old;
+            merged[count].age = state == ENTRY_HIT ? 0 : state == ENTRY_KEPT ? old->age : old->age + 1;
+            sources[count] = cache->chunks + old->chunk_offset;
+        } else {
+            merged[count] = cache->added[j];
+            sources[count] = cache->added_chunks + cache->added[j].chunk_offset;
+            j++;
+        }
+        // Un même fichier vu par deux liens durs n'est gardé qu'une fois
+        if (count > 0 && compare_entries(&merged[count - 1], &merged[count]) == 0) {
+            continue;
+        }
+        merged[count].chunk_offset = header.chunks_size;
+        header.chunks_size += record * entry_records(&merged[count]);
+        count++;
+    }
+    header.entry_count = count;
+    header.chunks_offset = header.entries_offset + count * sizeof(files_cache_entry);
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             (count == 0 || fwrite(merged, sizeof(files_cache_entry), count, file) == count);
+    for (size_t k = 0; ok && k < count; k++) {
+        size_t bytes = record * entry_records(&merged[k]);
+        ok = bytes == 0 || fwrite(sources[k], 1, bytes, file) == bytes;
+    }
+    free(merged);
+    free(sources);
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp_path, cache->path) != 0) {
+        perror("Erreur d'écriture du cache des fichiers");
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    free(tmp_path);
+    return 0;
+}
+
+// Fonction pour libérer le cache
+void files_cache_close(files_cache_t *cache) {
+    if (cache->map) {
+        munmap(cache->map, cache->map_size);
+    }
+    free(cache->state);
+    free(cache->added);
+    free(cache->added_chunks);
+    free(cache->path);
+    pthread_mutex_destroy(&cache->lock);
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,100 @@
+#ifndef FILES_CACHE_H
+#define FILES_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "hash.h"
+#include "deduplication.h"
+
+// Cache des fichiers du dépôt : pour un fichier inchangé, la liste de ses chunks est reprise
+// sans ouvrir le fichier. Il est enregistré dans .store/files.
+#define FILES_CACHE_NAME "files"
+#define FILES_CACHE_MAGIC "LP25FCHE"
+#define FILES_CACHE_MAGIC_LENGTH 8
+// Version 2 : une longue liste de chunks n'est gardée que par la référence de sa racine (deduplication.h)
+#define FILES_CACHE_VERSION 2
+// Nombre de sauvegardes sans voir un fichier avant de l'oublier
+#define FILES_CACHE_TTL 20
+// Caches des sauvegardes distantes, gardés par le client dans $XDG_CACHE_HOME (ou ~/.cache) : un par serveur,
+// repris seulement pour la génération du dépôt qu'il a enregistrée
+#define FILES_CACHE_REMOTE_DIR "lp25_borgbackup"
+
+// En-tête du fichier (64 octets) : [en-tête][entrées triées par (dev, inode)][listes de chunks]
+typedef struct {
+    char magic[FILES_CACHE_MAGIC_LENGTH];
+    uint32_t version;
+    uint8_t hash;
+    uint8_t digest_len;
+    uint16_t reserved;
+    uint64_t entry_count;
+    uint64_t entries_offset;
+    uint64_t chunks_offset;
+    uint64_t chunks_size;
+    unsigned char epoch[STORE_EPOCH_LENGTH]; // Génération du dépôt distant (nulle pour le cache d'un dépôt local)
+} files_cache_header;
+
+// Entrée du cache : un fichier n'est reconnu que si toute la clé est identique
+typedef struct {
+    uint64_t dev;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint64_t chunk_offset;
+    uint32_t chunk_count;
+    uint16_t age;          // Nombre de sauvegardes depuis la dernière fois que le fichier a été vu
+    uint16_t list_levels;  // 0 : chunk_count enregistrements ; sinon un seul, la racine de la liste
+    unsigned char digest[DIGEST_MAX_LENGTH]; // Digest du fichier complet
+} files_cache_entry;
+
+// Cache ouvert : l'ancien cache est projeté en mémoire, les nouvelles entrées sont accumulées
+typedef struct {
+    char *path;
+    hash_algo hash;
+    size_t digest_len;
+    int64_t start_ns;          // Début de la sauvegarde : les fichiers modifiés depuis ne sont pas mis en cache
+    unsigned char epoch[STORE_EPOCH_LENGTH]; // Génération exigée de l'ancien cache (nulle pour un dépôt local)
+
+    // Cache de la sauvegarde précédente
+    void *map;
+    size_t map_size;
+    const files_cache_entry *entries;
+    const unsigned char *chunks;
+    size_t count;
+    unsigned char *state;      // Pour chaque entrée : 0 non vue, 1 reprise, 2 remplacée
+
+    // Nouvelles entrées (fichiers lus pendant cette sauvegarde)
+    pthread_mutex_t lock;
+    files_cache_entry *added;
+    size_t added_count;
+    size_t added_capacity;
+    unsigned char *added_chunks; // Listes de chunks (ou leur racine) des nouvelles entrées, à la suite
+    size_t added_chunks_size;
+    size_t added_chunks_capacity;
+
+    uint64_t hits;
+    uint64_t misses;
+} files_cache_t;
+
+// Fonction pour ouvrir le cache des fichiers d'un dépôt
+int files_cache_open(files_cache_t *cache, const char *store_path, hash_algo hash, size_t digest_len);
+// Fonction pour ouvrir le cache des fichiers d'une sauvegarde distante, gardé par le client
+int files_cache_open_remote(files_cache_t *cache, const char *server, int port, hash_algo hash, size_t digest_len,
+                            const unsigned char *epoch);
+// Fonction pour rechercher un fichier inchangé
+const files_cache_entry *files_cache_lookup(files_cache_t *cache, const struct stat *st);
+// Fonction pour reprendre la liste de chunks d'une entrée
+void files_cache_list(const files_cache_t *cache, const files_cache_entry *entry, chunk_list_ref *list);
+// Fonction pour ajouter un fichier qui vient d'être lu
+int files_cache_add(files_cache_t *cache, const struct stat *st, const chunk_list_ref *list);
+// Fonction pour retirer du cache les fichiers dont un chunk a été supprimé du dépôt
+size_t files_cache_forget(files_cache_t *cache, bool (*is_live)(const unsigned char *digest, void *arg), void *arg);
+// Fonction pour écrire le nouveau cache (entrées reprises, ajoutées et anciennes non expirées)
+int files_cache_save(files_cache_t *cache);
+// Fonction pour libérer le cache
+void files_cache_close(files_cache_t *cache);
+
+#endif // FILES_CACHE_H
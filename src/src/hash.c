@@ -0,0 +1,245 @@
+#include "hash.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+// Interface EVP d'OpenSSL (routines SHA-NI / ARMv8 lorsque le processeur les fournit). Les algorithmes
+// sont récupérés une seule fois auprès du fournisseur (EVP_MD_fetch) et partagés par tous les threads ;
+// chaque thread réutilise son contexte d'un chunk à l'autre : un digest n'alloue rien.
+static EVP_MD *digest_md5;
+static EVP_MD *digest_sha256;
+static pthread_key_t thread_ctx_key;
+static pthread_once_t digest_once = PTHREAD_ONCE_INIT;
+
+// Contexte d'un thread, libéré à la fin du thread
+static void free_thread_ctx(void *ctx) {
+    EVP_MD_CTX_free(ctx);
+}
+
+static void fetch_digests(void) {
+    digest_md5 = EVP_MD_fetch(NULL, "MD5", NULL);
+    digest_sha256 = EVP_MD_fetch(NULL, "SHA256", NULL);
+    pthread_key_create(&thread_ctx_key, free_thread_ctx);
+}
+
+// Algorithme EVP d'un hash_algo (NULL pour BLAKE3 ou s'il est absent du fournisseur)
+static const EVP_MD *evp_digest(hash_algo algo) {
+    pthread_once(&digest_once, fetch_digests);
+    switch (algo) {
+        case HASH_MD5: return digest_md5;
+        case HASH_SHA256: return digest_sha256;
+        case HASH_BLAKE3: break;
+    }
+    return NULL;
+}
+
+// Contexte EVP du thread appelant, créé à son premier digest
+static EVP_MD_CTX *thread_ctx(void) {
+    EVP_MD_CTX *ctx = pthread_getspecific(thread_ctx_key);
+    if (!ctx) {
+        ctx = EVP_MD_CTX_new();
+        if (ctx && pthread_setspecific(thread_ctx_key, ctx) != 0) {
+            EVP_MD_CTX_free(ctx);
+            ctx = NULL;
+        }
+    }
+    return ctx;
+}
+
+// Fonction qui renvoie le nom d'un algorithme
+const char *hash_algo_name(hash_algo algo) {
+    switch (algo) {
+        case HASH_MD5: return "md5";
+        case HASH_SHA256: return "sha256";
+        case HASH_BLAKE3: return "blake3";
+    }
+    return "inconnu";
+}
+
+// Fonction pour retrouver un algorithme à partir de son nom
+int hash_algo_from_name(const char *name, hash_algo *algo) {
+    /* @return: 0 si le nom est connu, -1 sinon
+    */
+    if (strcmp(name, "md5") == 0) {
+        *algo = HASH_MD5;
+    } else if (strcmp(name, "sha256") == 0) {
+        *algo = HASH_SHA256;
+    } else if (strcmp(name, "blake3") == 0) {
+        *algo = HASH_BLAKE3;
+    } else {
+        fprintf(stderr, "Algorithme de hachage inconnu : %s (md5, sha256, blake3).\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction qui renvoie la taille des digests d'un algorithme
+size_t hash_digest_length(hash_algo algo) {
+    switch (algo) {
+        case HASH_MD5: return 16;
+        case HASH_SHA256: return 32;
+        case HASH_BLAKE3: return 32;
+    }
+    return 0;
+}
+
+// Fonction qui indique si un algorithme est disponible dans cette compilation
+bool hash_algo_available(hash_algo algo) {
+    if (algo == HASH_BLAKE3) {
+#ifdef WITH_BLAKE3
+        return true;
+#else
+        return false;
+#endif
+    }
+    return algo == HASH_MD5 || algo == HASH_SHA256;
+}
+
+// Ajout de données à un hachage, sans mesure
+static int hash_update_raw(hash_ctx *ctx, const void *data, size_t len) {
+    switch (ctx->algo) {
+        case HASH_MD5:
+        case HASH_SHA256:
+            return EVP_DigestUpdate(ctx->state.evp, data, len) == 1 ? 0 : -1;
+        case HASH_BLAKE3:
+#ifdef WITH_BLAKE3
+            blake3_hasher_update(&ctx->state.blake3, data, len);
+            return 0;
+#endif
+            break;
+    }
+    return -1;
+}
+
+// Fonction pour calculer le digest d'un bloc de données
+int compute_hash(hash_algo algo, const void *data, size_t len, unsigned char *digest_out) {
+    /* @param: algo est l'algorithme du dépôt
+    *           digest_out reçoit hash_digest_length(algo) octets
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    uint64_t start = metrics_start();
+    int status = -1;
+    const EVP_MD *md = evp_digest(algo);
+    if (md) {
+        EVP_MD_CTX *ctx = thread_ctx();
+        unsigned int size;
+        status = ctx && EVP_DigestInit_ex2(ctx, md, NULL) == 1 && EVP_DigestUpdate(ctx, data, len) == 1 &&
+                 EVP_DigestFinal_ex(ctx, digest_out, &size) == 1 ? 0 : -1;
+    } else {
+        // BLAKE3 : l'état reste sur la pile
+        hash_ctx ctx;
+        if (hash_init(&ctx, algo) != 0) {
+            return -1;
+        }
+        status = hash_update_raw(&ctx, data, len) == 0 ? hash_final(&ctx, digest_out) : -1;
+    }
+    metrics_stop(METRIC_HASH, start, len);
+    return status;
+}
+
+// Fonction pour démarrer un hachage incrémental
+int hash_init(hash_ctx *ctx, hash_algo algo) {
+    ctx->algo = algo;
+    const EVP_MD *md;
+    switch (algo) {
+        case HASH_MD5:
+        case HASH_SHA256:
+            md = evp_digest(algo);
+            ctx->state.evp = md ? EVP_MD_CTX_new() : NULL;
+            if (!ctx->state.evp) {
+                break;
+            }
+            if (EVP_DigestInit_ex2(ctx->state.evp, md, NULL) != 1) {
+                EVP_MD_CTX_free(ctx->state.evp);
+                ctx->state.evp = NULL;
+                return -1;
+            }
+            return 0;
+        case HASH_BLAKE3:
+#ifdef WITH_BLAKE3
+            blake3_hasher_init(&ctx->state.blake3);
+            return 0;
+#endif
+            break;
+    }
+    fprintf(stderr, "Algorithme de hachage indisponible : %s.\n", hash_algo_name(algo));
+    return -1;
+}
+
+// Fonction pour ajouter des données au hachage incrémental
+int hash_update(hash_ctx *ctx, const void *data, size_t len) {
+    uint64_t start = metrics_start();
+    int status = hash_update_raw(ctx, data, len);
+    metrics_stop(METRIC_HASH, start, len);
+    return status;
+}
+
+// Fonction pour terminer le hachage incrémental
+int hash_final(hash_ctx *ctx, unsigned char *digest_out) {
+    unsigned int size;
+    int status;
+    switch (ctx->algo) {
+        case HASH_MD5:
+        case HASH_SHA256:
+            status = EVP_DigestFinal_ex(ctx->state.evp, digest_out, &size) == 1 ? 0 : -1;
+            EVP_MD_CTX_free(ctx->state.evp);
+            ctx->state.evp = NULL;
+            return status;
+        case HASH_BLAKE3:
+#ifdef WITH_BLAKE3
+            blake3_hasher_finalize(&ctx->state.blake3, digest_out, BLAKE3_OUT_LEN);
+            return 0;
+#endif
+            break;
+    }
+    return -1;
+}
+
+// Fonction pour abandonner un hachage inachevé
+void hash_free(hash_ctx *ctx) {
+    if (ctx->algo == HASH_MD5 || ctx->algo == HASH_SHA256) {
+        EVP_MD_CTX_free(ctx->state.evp);
+    }
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+// Fonction pour convertir un digest en chaîne hexadécimale
+void digest_to_hex(const unsigned char *digest, size_t len, char *out) {
+    /* @param: out doit pouvoir contenir 2 * len + 1 caractères
+    */
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = hex[digest[i] >> 4];
+        out[2 * i + 1] = hex[digest[i] & 0x0f];
+    }
+    out[2 * len] = '\0';
+}
+
+// Valeur d'un chiffre hexadécimal, -1 si le caractère n'en est pas un
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Fonction pour convertir une chaîne hexadécimale en digest, renvoie la taille lue
+size_t digest_from_hex(const char *hex, unsigned char *digest, size_t max_len) {
+    size_t len = 0;
+    while (len < max_len) {
+        int high = hex_value(hex[2 * len]);
+        int low = high < 0 ? -1 : hex_value(hex[2 * len + 1]);
+        if (low < 0) {
+            break;
+        }
+        digest[len++] = (unsigned char)(high << 4 | low);
+    }
+    return len;
+}
@@ -0,0 +1,57 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <openssl/evp.h>
+#ifdef WITH_BLAKE3
+#include <blake3.h>
+#endif
+
+// Taille maximale d'un digest, quel que soit l'algorithme
+#define DIGEST_MAX_LENGTH 32
+
+// Algorithme utilisé par défaut à la création d'un dépôt
+#define HASH_DEFAULT HASH_SHA256
+
+// Algorithmes de hachage des chunks (la valeur est enregistrée dans les fichiers du dépôt)
+typedef enum {
+    HASH_MD5 = 1,    // Ancien format, conservé pour les dépôts existants
+    HASH_SHA256 = 2, // SHA-256 d'OpenSSL (instructions SHA-NI / ARMv8 lorsque le processeur les fournit)
+    HASH_BLAKE3 = 3  // BLAKE3 (SSE4.1/AVX2/AVX-512/NEON), disponible si compilé avec WITH_BLAKE3
+} hash_algo;
+
+// Contexte de hachage incrémental : contexte EVP alloué par hash_init (MD5, SHA-256),
+// état dans la structure pour BLAKE3 ; libéré par hash_final ou hash_free
+typedef struct {
+    hash_algo algo;
+    union {
+        EVP_MD_CTX *evp;
+#ifdef WITH_BLAKE3
+        blake3_hasher blake3;
+#endif
+    } state;
+} hash_ctx;
+
+// Fonction qui renvoie le nom d'un algorithme
+const char *hash_algo_name(hash_algo algo);
+// Fonction pour retrouver un algorithme à partir de son nom
+int hash_algo_from_name(const char *name, hash_algo *algo);
+// Fonction qui renvoie la taille des digests d'un algorithme
+size_t hash_digest_length(hash_algo algo);
+// Fonction qui indique si un algorithme est disponible dans cette compilation
+bool hash_algo_available(hash_algo algo);
+// Fonction pour calculer le digest d'un bloc de données
+int compute_hash(hash_algo algo, const void *data, size_t len, unsigned char *digest_out);
+// Fonctions de hachage incrémental (pour le digest d'un fichier complet)
+int hash_init(hash_ctx *ctx, hash_algo algo);
+int hash_update(hash_ctx *ctx, const void *data, size_t len);
+int hash_final(hash_ctx *ctx, unsigned char *digest_out);
+void hash_free(hash_ctx *ctx);
+// Fonction pour convertir un digest en chaîne hexadécimale
+void digest_to_hex(const unsigned char *digest, size_t len, char *out);
+// Fonction pour convertir une chaîne hexadécimale en digest, renvoie la taille lue
+size_t digest_from_hex(const char *hex, unsigned char *digest, size_t max_len);
+
+#endif // HASH_H
@@ -3,10 +3,17 @@
 #include <string.h>
 #include <getopt.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include "file_handler.h"
 #include "deduplication.h"
 #include "backup_manager.h"
 #include "network.h"
+#include "backup_server.h"
+#include "metrics.h"
+#include "uring.h"
+#include "prune.h"
+#include "check.h"
+#include "extract.h"
 #include <stdbool.h>
 
 
@@ -20,12 +27,30 @@ void print_usage(const char *prog_name) {
     printf("  --restore               : Restaure une sauvegarde\n");
     printf("  --list-backups          : Liste les sauvegardes existantes\n");
     printf("  --dry-run               : Effectue une simulation\n");
+    printf("  --export-log            : Affiche l'index de la sauvegarde --source au format texte\n");
+    printf("  --prune                 : Supprime la sauvegarde --source (facultative) et libère les chunks\n");
+    printf("                            que plus aucune sauvegarde de --dest ne référence\n");
+    printf("  --extract <CHEMIN>      : Écrit sur la sortie standard le fichier CHEMIN de la sauvegarde --source\n");
+    printf("  --range <DEBUT[:LONG]>  : Limite --extract à une plage d'octets du fichier\n");
+    printf("  --check                 : Relit et vérifie tous les chunks de --dest, puis les sauvegardes qui les utilisent\n");
+    printf("  --serve                 : Sert les sauvegardes de --dest (envoi et restauration), sur le port --d-port\n");
     printf("  --d-server <IP>         : Adresse IP du serveur de destination\n");
     printf("  --d-port <PORT>         : Port du serveur de destination\n");
     printf("  --s-server <IP>         : Adresse IP du serveur source\n");
     printf("  --s-port <PORT>         : Port du serveur source\n");
     printf("  --dest <CHEMIN>         : Chemin de destination\n");
     printf("  --source <CHEMIN>       : Chemin source\n");
+    printf("  --chunker <MIN,MOY,MAX> : Tailles des chunks d'un nouveau dépôt (octets)\n");
+    printf("  --hash <ALGO>           : Hachage des chunks d'un nouveau dépôt (sha256, blake3, md5)\n");
+    printf("  -j, --jobs <N>          : Nombre de threads de lecture/hachage (défaut : un par processeur)\n");
+    printf("  --delta                 : Restauration : ne réécrit que les chunks qui diffèrent des fichiers existants\n");
+    printf("  --restore-memory <Mio>  : Mémoire du tampon d'écriture d'une restauration (défaut : 8)\n");
+    printf("  --compress <ALGO[:N]>   : Compression des nouveaux chunks (none, zlib[:1-9], lz4, zstd[:1-19])\n");
+    printf("  --io <MOTEUR>           : E/S des fichiers sources et des packs (sync, uring, threads ; défaut : sync)\n");
+    printf("  --prune-threshold <%%>   : Réécrit les packs occupés à moins de ce pourcentage (défaut : %d)\n",
+           PRUNE_REPACK_DEFAULT);
+    printf("  --check-rate <Mio/s>    : Limite le débit de lecture des packs de --check (défaut : sans limite)\n");
+    printf("  --stats[=FICHIER]       : Écrit en fin d'exécution les mesures de chaque étape en JSON\n");
     printf("  -v, --verbose           : Active un affichage détaillé\n");
 }
 
@@ -65,11 +90,14 @@ void handle_list_backups(const char *source) {
 }
 
 int main(int argc, char *argv[]) {
-    bool backup = false, restore = false, liste_backups = false;
+    bool backup = false, restore = false, liste_backups = false, export_log = false, serve = false, prune = false;
+    bool check = false;
+    const char *extract_path = NULL;
+    uint64_t extract_offset = 0, extract_length = EXTRACT_TO_END;
     dry_run = false;
     verbose = false;
     const char *d_server = NULL, *s_server = NULL;
-    const char *dest = NULL, *source = NULL;
+    const char *dest = NULL, *source = NULL, *stats_path = NULL;
     int d_port = 0, s_port = 0;
 
     struct option long_options[] = {
@@ -84,11 +112,27 @@ int main(int argc, char *argv[]) {
             {"dest", required_argument, NULL, 't'},
             {"source", required_argument, NULL, 's'},
             {"verbose", no_argument, NULL, 'v'},
+            {"chunker", required_argument, NULL, 'c'},
+            {"hash", required_argument, NULL, 'H'},
+            {"jobs", required_argument, NULL, 'j'},
+            {"export-log", no_argument, NULL, 'e'},
+            {"restore-memory", required_argument, NULL, 'm'},
+            {"compress", required_argument, NULL, 'z'},
+            {"serve", no_argument, NULL, 'L'},
+            {"stats", optional_argument, NULL, 'T'},
+            {"io", required_argument, NULL, 'I'},
+            {"prune", no_argument, NULL, 'G'},
+            {"prune-threshold", required_argument, NULL, 'R'},
+            {"check", no_argument, NULL, 'K'},
+            {"check-rate", required_argument, NULL, 'W'},
+            {"extract", required_argument, NULL, 'X'},
+            {"range", required_argument, NULL, 'Y'},
+            {"delta", no_argument, NULL, 'A'},
             {0, 0, 0, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "brldD:P:S:p:t:s:v", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "brldD:P:S:p:t:s:vc:H:j:em:z:L", long_options, NULL)) != -1) {
         switch (opt) {
             case 'b': backup = true; break;
             case 'r': restore = true; break;
@@ -101,18 +145,107 @@ int main(int argc, char *argv[]) {
             case 't': dest = optarg; break;
             case 's': source = optarg; break;
             case 'v': verbose = true; break;
+            case 'c':
+                if (chunker_params_parse(&store_default_chunker, optarg) != 0) {
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j': backup_jobs = atoi(optarg); break;
+            case 'e': export_log = true; break;
+            case 'L': serve = true; break;
+            case 'G': prune = true; break;
+            case 'R':
+                if (atoi(optarg) < 0 || atoi(optarg) > 100) {
+                    fprintf(stderr, "Erreur : --prune-threshold attend un pourcentage entre 0 et 100.\n");
+                    return EXIT_FAILURE;
+                }
+                prune_repack_percent = (unsigned)atoi(optarg);
+                break;
+            case 'K': check = true; break;
+            case 'W':
+                if (atoi(optarg) < 0) {
+                    fprintf(stderr, "Erreur : --check-rate attend un nombre de Mio/s positif (0 : sans limite).\n");
+                    return EXIT_FAILURE;
+                }
+                check_rate = (unsigned)atoi(optarg);
+                break;
+            case 'X': extract_path = optarg; break;
+            case 'A': restore_delta = true; break;
+            case 'Y':
+                if (extract_range_parse(optarg, &extract_offset, &extract_length) != 0) {
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'T':
+                // Sans fichier, le rapport est la dernière ligne de la sortie standard
+                metrics_init();
+                stats_path = optarg;
+                break;
+            case 'm':
+                if (atoi(optarg) <= 0) {
+                    fprintf(stderr, "Erreur : --restore-memory attend un nombre de Mio positif.\n");
+                    return EXIT_FAILURE;
+                }
+                restore_buffer_size = (size_t)atoi(optarg) * 1024 * 1024;
+                break;
+            case 'z':
+                if (codec_params_parse(&store_default_codec, optarg) != 0) {
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'I':
+                if (io_backend_parse(optarg, &io_backend_choice) != 0) {
+                    fprintf(stderr, "Erreur : moteur d'E/S inconnu '%s' (sync, uring, threads).\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'H':
+                if (hash_algo_from_name(optarg, &store_default_hash) != 0) {
+                    return EXIT_FAILURE;
+                }
+                if (!hash_algo_available(store_default_hash)) {
+                    fprintf(stderr, "Erreur : %s n'est pas disponible dans cette version.\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
             default:
                 print_usage(argv[0]);
                 return EXIT_FAILURE;
         }
     }
 
-    if ((backup + restore + liste_backups) > 1) {
-        fprintf(stderr, "Erreur : Vous ne pouvez spécifier qu'une seule action principale (--backup, --restore, ou --list-backups).\n");
+    if ((backup + restore + liste_backups + export_log + serve + prune + check + (extract_path != NULL)) > 1) {
+        fprintf(stderr, "Erreur : Vous ne pouvez spécifier qu'une seule action principale (--backup, --restore, --list-backups, --export-log, --serve, --prune, --check ou --extract).\n");
         return EXIT_FAILURE;
     }
 
-    if (backup || restore) {
+    // Sauvegarde distante : la destination est le serveur --d-server:--d-port
+    if (backup && d_server) {
+        if (!source || d_port <= 0) {
+            fprintf(stderr, "Erreur : Les options --source et --d-port sont requises pour une sauvegarde distante.\n");
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    } else if (restore && s_server) {
+        // Restauration distante : --source désigne la sauvegarde sur le serveur (la dernière si absente)
+        if (!dest || s_port <= 0) {
+            fprintf(stderr, "Erreur : Les options --dest et --s-port sont requises pour une restauration distante.\n");
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    } else if (serve) {
+        if (!dest || d_port <= 0) {
+            fprintf(stderr, "Erreur : Les options --dest et --d-port sont requises pour --serve.\n");
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    } else if (prune || check) {
+        if (!dest) {
+            fprintf(stderr, "Erreur : L'option --dest est requise pour %s.\n", prune ? "--prune" : "--check");
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    } else if (backup || restore) {
         if (!source || !dest) {
             fprintf(stderr, "Erreur : Les options --source et --dest sont requises pour cette action.\n");
             print_usage(argv[0]);
@@ -129,7 +262,12 @@ int main(int argc, char *argv[]) {
         if (verbose){
             gettimeofday(&start, NULL); // Début du chronométrage
         }
-        create_backup(source,dest);
+        int status;
+        if (d_server) {
+            status = create_remote_backup(source, d_server, d_port);
+        } else {
+            status = create_backup(source,dest);
+        }
         if (verbose){
             gettimeofday(&end, NULL);   // Fin du chronométrage
             // Calcul de la durée
@@ -138,18 +276,25 @@ int main(int argc, char *argv[]) {
             total_time = seconds + useconds / 1e6;
             printf("Temps d'exécution : %f secondes\n", total_time);
         }
+        if (status != 0) {
+            return EXIT_FAILURE;
+        }
     } else if (restore) {
         struct timeval start, end;
         long seconds, useconds;
         double total_time;
         printf("Restauration en cours...\n");
         if (dry_run) printf("Simulation activée.\n");
-        if (verbose) printf("Source : %s, Destination : %s\n", source, dest);
+        if (verbose) printf("Source : %s, Destination : %s\n", source ? source : "(dernière sauvegarde)", dest);
         if (verbose){
             gettimeofday(&start, NULL); // Début du chronométrage
         }
 
-        restore_backup(source,dest);  //backup_id : source ; dest : restore_dir
+        if (s_server) {
+            restore_remote_backup(s_server, s_port, source, dest);
+        } else {
+            restore_backup(source,dest);  //backup_id : source ; dest : restore_dir
+        }
         if (verbose){
             gettimeofday(&end, NULL);   // Fin du chronométrage
             // Calcul de la durée
@@ -158,13 +303,57 @@ int main(int argc, char *argv[]) {
             total_time = seconds + useconds / 1e6;
             printf("Temps d'exécution : %f secondes\n", total_time);
         }
+    } else if (serve) {
+        if (serve_backups(dest, d_port) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if (prune) {
+        if (prune_backups(dest, source) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if (check) {
+        if (check_repository(dest) != 0) {
+            return EXIT_FAILURE;
+        }
+    } else if (extract_path) {
+        // La sortie standard ne reçoit que les octets du fichier
+        if (!source) {
+            fprintf(stderr, "Erreur : L'option --source est requise pour --extract.\n");
+            return EXIT_FAILURE;
+        }
+        if (extract_file(source, extract_path, extract_offset, extract_length, STDOUT_FILENO) != 0) {
+            return EXIT_FAILURE;
+        }
     } else if (liste_backups) {
         list_backups(source);
+    } else if (export_log) {
+        if (!source) {
+            fprintf(stderr, "Erreur : L'option --source est requise pour cette action.\n");
+            return EXIT_FAILURE;
+        }
+        if (export_backup_log(source, stdout) != 0) {
+            return EXIT_FAILURE;
+        }
     } else {
         fprintf(stderr, "Erreur : Aucune action spécifiée.\n");
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    if (metrics_enabled) {
+        FILE *stats = stats_path ? fopen(stats_path, "w") : stdout;
+        if (!stats) {
+            perror("Erreur lors de l'ouverture du fichier de mesures");
+            return EXIT_FAILURE;
+        }
+        int written = metrics_write_json(stats);
+        if (stats != stdout && fclose(stats) != 0) {
+            written = -1;
+        }
+        if (written != 0) {
+            fprintf(stderr, "Erreur d'écriture des mesures.\n");
+            return EXIT_FAILURE;
+        }
+    }
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+bool metrics_enabled = false;
+
+// Blocs de tous les threads qui ont mesuré quelque chose ; ils vivent jusqu'à la fin du programme
+static metric_block *blocks = NULL;
+static pthread_mutex_t blocks_lock = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local metric_block *thread_block = NULL;
+static uint64_t start_ns = 0;
+// Bloc commun si une allocation échoue : les mesures restent justes à un écrivain près
+static metric_block fallback_block;
+
+static const char *stage_names[METRIC_STAGE_COUNT] = {
+    "walk", "stat", "read", "hash", "lookup", "compress", "decompress", "write", "net_send", "net_recv"
+};
+static const char *queue_names[METRIC_QUEUE_COUNT] = {"files", "batches", "network"};
+
+// Fonction pour activer les mesures et noter le début de l'exécution
+void metrics_init(void) {
+    metrics_enabled = true;
+    start_ns = metrics_start();
+}
+
+// Fonction qui renvoie le bloc de compteurs du thread appelant (créé au premier appel)
+metric_block *metrics_thread_block(void) {
+    if (thread_block) {
+        return thread_block;
+    }
+    metric_block *block = calloc(1, sizeof(metric_block));
+    if (!block) {
+        return &fallback_block;
+    }
+    pthread_mutex_lock(&blocks_lock);
+    block->next = blocks;
+    blocks = block;
+    pthread_mutex_unlock(&blocks_lock);
+    thread_block = block;
+    return block;
+}
+
+static uint64_t load(_Atomic uint64_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// Borne supérieure (ns) de l'alvéole qui contient le quantile q
+static uint64_t quantile(const uint64_t *buckets, uint64_t total, double q) {
+    uint64_t rank = (uint64_t)(q * (double)total);
+    uint64_t seen = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            return (uint64_t)2 << i;
+        }
+    }
+    return (uint64_t)2 << (METRICS_BUCKETS - 1);
+}
+
+// Fonction pour écrire le rapport JSON de toutes les étapes
+int metrics_write_json(FILE *out) {
+    /* @param: out reçoit un objet JSON sur une ligne
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    metric_block total;
+    memset(&total, 0, sizeof(total));
+    pthread_mutex_lock(&blocks_lock);
+    for (metric_block *block = blocks; ; block = block->next) {
+        metric_block *source = block ? block : &fallback_block;
+        for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+            metric_counters *from = &source->stages[s], *to = &total.stages[s];
+            metrics_add(&to->ops, load(&from->ops));
+            metrics_add(&to->bytes, load(&from->bytes));
+            metrics_add(&to->ns, load(&from->ns));
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                metrics_add(&to->buckets[b], load(&from->buckets[b]));
+            }
+        }
+        for (int q = 0; q < METRIC_QUEUE_COUNT; q++) {
+            metric_queue_counters *from = &source->queues[q], *to = &total.queues[q];
+            metrics_add(&to->pushes, load(&from->pushes));
+            metrics_add(&to->depth_sum, load(&from->depth_sum));
+            if (load(&from->depth_max) > load(&to->depth_max)) {
+                atomic_store_explicit(&to->depth_max, load(&from->depth_max), memory_order_relaxed);
+            }
+        }
+        if (!block) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&blocks_lock);
+
+    fprintf(out, "{\"elapsed_s\":%.6f,\"stages\":{", (double)(metrics_start() - start_ns) / 1e9);
+    for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+        metric_counters *stage = &total.stages[s];
+        uint64_t ops = load(&stage->ops), bytes = load(&stage->bytes), ns = load(&stage->ns);
+        uint64_t buckets[METRICS_BUCKETS];
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            buckets[b] = load(&stage->buckets[b]);
+        }
+        fprintf(out, "%s\"%s\":{\"ops\":%llu,\"bytes\":%llu,\"seconds\":%.6f,\"mb_per_s\":%.2f,"
+                "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"histogram_ns\":{",
+                s ? "," : "", stage_names[s], (unsigned long long)ops, (unsigned long long)bytes, (double)ns / 1e9,
+                ns ? (double)bytes / ((double)ns / 1e9) / 1e6 : 0.0,
+                (unsigned long long)(ops ? quantile(buckets, ops, 0.50) : 0),
+                (unsigned long long)(ops ? quantile(buckets, ops, 0.90) : 0),
+                (unsigned long long)(ops ? quantile(buckets, ops, 0.99) : 0));
+        // Alvéoles non vides seulement, indexées par leur borne supérieure
+        bool first = true;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            if (buckets[b]) {
+                fprintf(out, "%s\"%llu\":%llu", first ? "" : ",", (unsigned long long)2 << b,
+                        (unsigned long long)buckets[b]);
+                first = false;
+            }
+        }
+        fprintf(out, "}}");
+    }
+    fprintf(out, "},\"queues\":{");
+    for (int q = 0; q < METRIC_QUEUE_COUNT; q++) {
+        metric_queue_counters *queue = &total.queues[q];
+        uint64_t pushes = load(&queue->pushes);
+        fprintf(out, "%s\"%s\":{\"pushes\":%llu,\"mean_depth\":%.2f,\"max_depth\":%llu}", q ? "," : "",
+                queue_names[q], (unsigned long long)pushes,
+                pushes ? (double)load(&queue->depth_sum) / (double)pushes : 0.0,
+                (unsigned long long)load(&queue->depth_max));
+    }
+    fprintf(out, "}}\n");
+    return fflush(out) == 0 && !ferror(out) ? 0 : -1;
+}
@@ -0,0 +1,114 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Mesures par étape (--stats) : opérations, octets, temps et histogramme des latences.
+// Chaque thread écrit dans son propre bloc de compteurs (aucun partage de ligne de cache,
+// aucune instruction atomique à verrou) ; les blocs sont additionnés au moment du rapport.
+
+// Histogramme des latences : l'alvéole i compte les opérations de durée dans [2^i, 2^(i+1)) ns
+#define METRICS_BUCKETS 32
+
+// Étapes mesurées
+typedef enum {
+    METRIC_WALK,       // Lecture des répertoires (getdents64)
+    METRIC_STAT,       // Métadonnées des entrées (fstatat)
+    METRIC_READ,       // Lecture des fichiers sources et des packs
+    METRIC_HASH,       // Digest des chunks et des fichiers
+    METRIC_LOOKUP,     // Recherche dans l'index des chunks
+    METRIC_COMPRESS,
+    METRIC_DECOMPRESS,
+    METRIC_WRITE,      // Écriture des packs et des fichiers restaurés
+    METRIC_NET_SEND,
+    METRIC_NET_RECV,
+    METRIC_STAGE_COUNT
+} metric_stage;
+
+// Files du pipeline dont la profondeur est relevée à chaque ajout
+typedef enum {
+    METRIC_QUEUE_NONE = -1,
+    METRIC_QUEUE_FILES,   // Fichiers entre le parcours et les lecteurs
+    METRIC_QUEUE_BATCHES, // Lots de chunks entre un lecteur et l'écrivain
+    METRIC_QUEUE_NETWORK, // Lots HAVE en attente de leur réponse
+    METRIC_QUEUE_COUNT
+} metric_queue;
+
+// Compteurs d'un thread ; un seul thread écrit, les lectures du rapport sont relâchées
+typedef struct {
+    _Atomic uint64_t ops;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t ns;
+    _Atomic uint64_t buckets[METRICS_BUCKETS];
+} metric_counters;
+
+typedef struct {
+    _Atomic uint64_t pushes;
+    _Atomic uint64_t depth_sum;
+    _Atomic uint64_t depth_max;
+} metric_queue_counters;
+
+typedef struct metric_block {
+    metric_counters stages[METRIC_STAGE_COUNT];
+    metric_queue_counters queues[METRIC_QUEUE_COUNT];
+    struct metric_block *next;
+} metric_block;
+
+// Mesures actives (--stats) ; désactivées, une mesure ne coûte qu'un test
+extern bool metrics_enabled;
+
+// Fonction pour activer les mesures et noter le début de l'exécution
+void metrics_init(void);
+// Fonction qui renvoie le bloc de compteurs du thread appelant (créé au premier appel)
+metric_block *metrics_thread_block(void);
+// Fonction pour écrire le rapport JSON de toutes les étapes
+int metrics_write_json(FILE *out);
+
+// Horloge des mesures (ns), 0 si les mesures sont désactivées
+static inline uint64_t metrics_start(void) {
+    if (!metrics_enabled) {
+        return 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Ajout à un compteur dont le thread appelant est le seul écrivain
+static inline void metrics_add(_Atomic uint64_t *counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+// Fin d'une opération commencée à start (valeur de metrics_start) qui a traité bytes octets
+static inline void metrics_stop(metric_stage stage, uint64_t start, uint64_t bytes) {
+    if (!metrics_enabled || start == 0) {
+        return;
+    }
+    uint64_t elapsed = metrics_start() - start;
+    metric_counters *counters = &metrics_thread_block()->stages[stage];
+    int bucket = elapsed ? 63 - __builtin_clzll(elapsed) : 0;
+    metrics_add(&counters->ops, 1);
+    metrics_add(&counters->bytes, bytes);
+    metrics_add(&counters->ns, elapsed);
+    metrics_add(&counters->buckets[bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1], 1);
+}
+
+// Profondeur d'une file après un ajout
+static inline void metrics_queue_depth(metric_queue queue, uint64_t depth) {
+    if (!metrics_enabled || queue == METRIC_QUEUE_NONE) {
+        return;
+    }
+    metric_queue_counters *counters = &metrics_thread_block()->queues[queue];
+    metrics_add(&counters->pushes, 1);
+    metrics_add(&counters->depth_sum, depth);
+    if (depth > atomic_load_explicit(&counters->depth_max, memory_order_relaxed)) {
+        atomic_store_explicit(&counters->depth_max, depth, memory_order_relaxed);
+    }
+}
+
+#endif // METRICS_H
@@ -1,108 +1,850 @@
 #include "network.h"
-#include "stdio.h"
-#include "stdlib.h"
-#include "string.h"
-#include "unistd.h"
-#include "arpa/inet.h"
-#include "sys/types.h"
-#include "sys/socket.h"
-#include "netinet/in.h"
-
-void send_data(const char *server_address, int port, const void *data, size_t size) {
-    // Implémenter la logique d'envoi de données à un serveur distant
-    int sockfd;
-    struct sockaddr_in server_addr;
-    if ((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {   // Créer la socket
-        perror("Échec de la création de la socket");
-        return;
-    }
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    if (inet_pton(AF_INET, server_address, &server_addr.sin_addr) <= 0) {   // Convertir les adresses IPv4 et IPv6 de texte en binaire
-        perror("Adresse invalide / Adresse non supportée");
-        close(sockfd);
-        return;
-    }
-    if (connect(sockfd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {    // Se connecter au serveur
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Écriture complète de plusieurs zones : un envoi partiel reprend là où il s'est arrêté
+static int write_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        struct msghdr message = {0};
+        message.msg_iov = iov;
+        message.msg_iovlen = (size_t)count;
+        // MSG_NOSIGNAL : une connexion fermée par le pair donne EPIPE au lieu de tuer le processus
+        ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0) {
+            return -1;
+        }
+        while (count > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+// Lecture complète de size octets, -1 si la connexion se termine avant
+static int read_all(int fd, void *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t got = recv(fd, (char *)buffer + done, size - done, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return -1;
+        }
+        done += (size_t)got;
+    }
+    return 0;
+}
+
+// Envoi d'une trame dont les données sont en plusieurs morceaux (parts[0] est réservé à l'en-tête)
+static int send_parts(int fd, uint32_t type, struct iovec *parts, int count) {
+    size_t length = 0;
+    for (int i = 1; i < count; i++) {
+        length += parts[i].iov_len;
+    }
+    if (length > NET_MAX_FRAME) {
+        fprintf(stderr, "Trame trop grande (%zu octets).\n", length);
+        return -1;
+    }
+    net_header header = {htonl((uint32_t)length), htonl(type)};
+    parts[0].iov_base = &header;
+    parts[0].iov_len = sizeof(header);
+    uint64_t start = metrics_start();
+    if (write_all(fd, parts, count) != 0) {
+        return -1;
+    }
+    metrics_stop(METRIC_NET_SEND, start, sizeof(header) + length);
+    return 0;
+}
+
+// Fonction pour envoyer une trame complète (les écritures partielles sont reprises)
+int net_send_frame(int fd, uint32_t type, const void *data, size_t size) {
+    /* @param: type est le type de la trame, data et size ses données (size peut être nul)
+    *  @return: 0 en cas de succès, -1 si la connexion est perdue
+    */
+    struct iovec parts[2];
+    parts[1].iov_base = (void *)data;
+    parts[1].iov_len = size;
+    return send_parts(fd, type, parts, 2);
+}
+
+// Fonction pour recevoir une trame complète
+int net_recv_frame(int fd, net_frame *frame) {
+    /* @param: frame reçoit le type, la longueur et les données (terminées par un '\0' supplémentaire)
+    *  @return: 0 en cas de succès, -1 si la connexion est fermée ou la trame invalide
+    */
+    net_header header;
+    if (read_all(fd, &header, sizeof(header)) != 0) {
+        return -1;
+    }
+    // Mesure à partir de l'en-tête : l'attente d'une trame n'est pas du temps de réception
+    uint64_t start = metrics_start();
+    frame->type = ntohl(header.type);
+    frame->length = ntohl(header.length);
+    if (frame->length > NET_MAX_FRAME) {
+        fprintf(stderr, "Trame reçue trop grande (%u octets).\n", frame->length);
+        return -1;
+    }
+    if ((size_t)frame->length + 1 > frame->capacity) {
+        unsigned char *data = realloc(frame->data, (size_t)frame->length + 1);
+        if (!data) {
+            perror("Erreur d'allocation mémoire pour une trame");
+            return -1;
+        }
+        frame->data = data;
+        frame->capacity = (size_t)frame->length + 1;
+    }
+    if (read_all(fd, frame->data, frame->length) != 0) {
+        return -1;
+    }
+    frame->data[frame->length] = '\0';
+    metrics_stop(METRIC_NET_RECV, start, sizeof(header) + frame->length);
+    return 0;
+}
+
+// Fonction pour libérer le tampon d'une trame
+void net_frame_free(net_frame *frame) {
+    free(frame->data);
+    memset(frame, 0, sizeof(*frame));
+}
+
+// Connexion TCP au serveur (nom ou adresse IPv4/IPv6)
+static int connect_to(const char *server, int port) {
+    struct addrinfo hints = {0}, *addresses, *address;
+    char service[16];
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+    int error = getaddrinfo(server, service, &hints, &addresses);
+    if (error != 0) {
+        fprintf(stderr, "Adresse invalide %s : %s\n", server, gai_strerror(error));
+        return -1;
+    }
+
+    int fd = -1;
+    for (address = addresses; address; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
         perror("Échec de la connexion");
-        close(sockfd);
-        return;
-    }
-    ssize_t sent_size = send(sockfd, data, size, 0);    // Envoyer les données
-    if (sent_size < 0) {
-        perror("Échec de l'envoi");
-    } else if (sent_size != size) {
-        fprintf(stderr, "Attention : la taille envoyée (%zd) ne correspond pas à la taille des données (%zu)\n", sent_size, size);
-    }
-    close(sockfd);  // Fermer la socket
-}
-
-void receive_data(int port, void **data, size_t *size) {
-    // Implémenter la logique de réception de données depuis un serveur distant
-    int server_fd, client_fd;
-    struct sockaddr_in address;
-    int opt = 1;
-    socklen_t addrlen = sizeof(address);
-    ssize_t read_size;
-    size_t buffer_size = 1024;  // Création d'un tampon pour recevoir des données
-    *data = malloc(buffer_size);
-    if (*data == NULL) {
-        perror("Échec de l'allocation de mémoire");
-        return;
-    }
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {   // Créer le descripteur de fichier socket
-        perror("Échec de la création de la socket");
-        free(*data);
-        return;
-    }
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {    // Attacher la socket au port spécifié
-        perror("Échec de setsockopt");
-        close(server_fd);
-        free(*data);
-        return;
-    }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(port);
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {    // Lier la socket à l'adresse réseau et au port
-        perror("Échec de la liaison");
-        close(server_fd);
-        free(*data);
-        return;
-    }
-    if (listen(server_fd, 3) < 0) {     // Écouter les connexions entrantes
-        perror("Échec de l'écoute");
-        close(server_fd);
-        free(*data);
-        return;
-    }
-    if ((client_fd = accept(server_fd, (struct sockaddr *)&address, &addrlen)) < 0) {   // Accepter une connexion
-        perror("Échec de l'acceptation");
-        close(server_fd);
-        free(*data);
-        return;
-    }
-    *size = 0;   // Recevoir les données
-    while ((read_size = recv(client_fd, *data + *size, buffer_size - *size, 0)) > 0) {
-        *size += read_size;
-        if (*size == buffer_size) {
-            buffer_size *= 2;
-            *data = realloc(*data, buffer_size);
-            if (*data == NULL) {
-                perror("Échec de la réallocation de mémoire");
-                close(client_fd);
-                close(server_fd);
-                return;
+        return -1;
+    }
+
+    // Les trames sont déjà regroupées en lots : inutile de retarder les petites
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// La session est perdue : les threads bloqués sur la connexion sont réveillés
+static void session_fail(remote_session *session) {
+    atomic_store(&session->failed, true);
+    shutdown(session->fd, SHUT_RDWR);
+    pthread_mutex_lock(&session->fetch_lock);
+    pthread_cond_broadcast(&session->fetch_cond);
+    pthread_mutex_unlock(&session->fetch_lock);
+}
+
+static void batch_free(remote_batch *batch) {
+    if (batch) {
+        free(batch->chunks);
+        free(batch->data);
+        free(batch);
+    }
+}
+
+// Envoi d'un chunk demandé par le serveur : digest, taille d'origine, compression, données
+static int send_chunk(remote_session *session, const remote_batch *batch, const remote_chunk *chunk) {
+    unsigned char fields[2 * sizeof(uint32_t)];
+    net_put_u32(fields, chunk->size);
+    net_put_u32(fields + sizeof(uint32_t), chunk->codec);
+
+    struct iovec parts[4];
+    parts[1].iov_base = (void *)chunk->digest;
+    parts[1].iov_len = session->store->digest_len;
+    parts[2].iov_base = fields;
+    parts[2].iov_len = sizeof(fields);
+    parts[3].iov_base = batch->data + chunk->offset;
+    parts[3].iov_len = chunk->stored_size;
+
+    pthread_mutex_lock(&session->send_lock);
+    int status = send_parts(session->fd, NET_CHUNK, parts, 4);
+    session->wire_bytes += sizeof(net_header) + session->store->digest_len + sizeof(fields) + chunk->stored_size;
+    pthread_mutex_unlock(&session->send_lock);
+    if (status != 0) {
+        return -1;
+    }
+    session->sent_chunks++;
+    session->sent_bytes += chunk->stored_size;
+    session->sent_raw_bytes += chunk->size;
+    return 0;
+}
+
+// Réponse du serveur à un lot : les chunks marqués manquants sont envoyés
+static int receive_want(remote_session *session, const remote_batch *batch, net_frame *frame) {
+    if (net_recv_frame(session->fd, frame) != 0) {
+        fprintf(stderr, "Connexion au serveur perdue.\n");
+        return -1;
+    }
+    if (frame->type == NET_ERROR) {
+        fprintf(stderr, "Erreur du serveur : %s\n", (const char *)frame->data);
+        return -1;
+    }
+    if (frame->type != NET_WANT || frame->length != (uint32_t)(batch->count + 7) / 8) {
+        fprintf(stderr, "Réponse inattendue du serveur (trame %u).\n", frame->type);
+        return -1;
+    }
+    for (int i = 0; i < batch->count; i++) {
+        if ((frame->data[i / 8] & (1u << (i % 8))) && send_chunk(session, batch, &batch->chunks[i]) != 0) {
+            perror("Erreur lors de l'envoi d'un chunk");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Thread de réception : traite les réponses dans l'ordre des lots envoyés
+static void *receiver_main(void *arg) {
+    remote_session *session = arg;
+    net_frame frame = {0};
+    remote_batch *batch;
+    while ((batch = queue_pop(&session->pending)) != NULL) {
+        // Après une erreur, les lots restants sont seulement libérés pour ne pas bloquer l'envoi
+        if (!atomic_load(&session->failed) && receive_want(session, batch, &frame) != 0) {
+            session_fail(session);
+        }
+        batch_free(batch);
+    }
+    net_frame_free(&frame);
+    return NULL;
+}
+
+// Envoi du lot en cours : ses digests partent tout de suite, la réponse est traitée par le thread de réception
+static int flush_batch(remote_session *session) {
+    remote_batch *batch = session->current;
+    session->current = NULL;
+    if (!batch || batch->count == 0) {
+        batch_free(batch);
+        return 0;
+    }
+
+    size_t digest_len = session->store->digest_len;
+    unsigned char *digests = malloc((size_t)batch->count * digest_len);
+    if (!digests) {
+        perror("Erreur d'allocation mémoire pour un lot de digests");
+        batch_free(batch);
+        session_fail(session);
+        return -1;
+    }
+    for (int i = 0; i < batch->count; i++) {
+        memcpy(digests + (size_t)i * digest_len, batch->chunks[i].digest, digest_len);
+    }
+    size_t size = (size_t)batch->count * digest_len;
+
+    // Le thread de réception démarre avec le premier lot
+    if (!session->receiver_started) {
+        if (pthread_create(&session->receiver, NULL, receiver_main, session) != 0) {
+            perror("Erreur lors de la création du thread de réception");
+            free(digests);
+            batch_free(batch);
+            session_fail(session);
+            return -1;
+        }
+        session->receiver_started = true;
+    }
+
+    // Le lot est mis en attente avant l'envoi : la file pleine retient l'envoi tant que
+    // NET_PIPELINE_DEPTH lots n'ont pas reçu de réponse
+    if (queue_push(&session->pending, batch) != 0) {
+        free(digests);
+        batch_free(batch);
+        session_fail(session);
+        return -1;
+    }
+    pthread_mutex_lock(&session->send_lock);
+    int status = net_send_frame(session->fd, NET_HAVE, digests, size);
+    session->wire_bytes += sizeof(net_header) + size;
+    pthread_mutex_unlock(&session->send_lock);
+    free(digests);
+    if (status != 0) {
+        perror("Erreur lors de l'envoi d'un lot de digests");
+        session_fail(session);
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour ouvrir une session vers un serveur et préparer le dépôt qui la représente
+int remote_open(remote_session *session, chunk_store_t *store, const char *server, int port) {
+    /* @param: store est initialisé avec la configuration du dépôt du serveur ; ses chunks
+    *           (store_put, store_put_compressed) sont proposés au serveur par la session
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    memset(session, 0, sizeof(*session));
+    memset(store, 0, sizeof(*store));
+    pack_reader_init(&store->reader);
+    store->lock_fd = -1;
+    session->fd = connect_to(server, port);
+    if (session->fd < 0) {
+        return -1;
+    }
+
+    unsigned char hello[2 * sizeof(uint32_t)];
+    net_put_u32(hello, NET_MAGIC);
+    net_put_u32(hello + sizeof(uint32_t), NET_VERSION);
+    net_frame frame = {0};
+    if (net_send_frame(session->fd, NET_HELLO, hello, sizeof(hello)) != 0 || net_recv_frame(session->fd, &frame) != 0) {
+        fprintf(stderr, "Le serveur %s:%d ne répond pas.\n", server, port);
+        net_frame_free(&frame);
+        close(session->fd);
+        return -1;
+    }
+    if (frame.type != NET_CONFIG || frame.length != sizeof(net_config)) {
+        if (frame.type == NET_ERROR) {
+            fprintf(stderr, "Erreur du serveur : %s\n", (const char *)frame.data);
+        } else {
+            fprintf(stderr, "Réponse inattendue du serveur (trame %u).\n", frame.type);
+        }
+        net_frame_free(&frame);
+        close(session->fd);
+        return -1;
+    }
+
+    // Les chunks sont découpés et hachés comme le dépôt du serveur l'exige
+    store->version = (int)net_get_u32(frame.data);
+    store->hash = (hash_algo)net_get_u32(frame.data + 4);
+    uint32_t min_size = net_get_u32(frame.data + 8);
+    uint32_t avg_size = net_get_u32(frame.data + 12);
+    uint32_t max_size = net_get_u32(frame.data + 16);
+    memcpy(session->epoch, frame.data + 20, STORE_EPOCH_LENGTH);
+    net_frame_free(&frame);
+    if (!hash_algo_available(store->hash)) {
+        fprintf(stderr, "Le dépôt du serveur utilise %s, non disponible dans cette version.\n", hash_algo_name(store->hash));
+        close(session->fd);
+        return -1;
+    }
+    store->digest_len = hash_digest_length(store->hash);
+    if (chunker_params_init(&store->chunker, min_size, avg_size, max_size) != 0) {
+        fprintf(stderr, "Configuration de découpage du serveur invalide.\n");
+        close(session->fd);
+        return -1;
+    }
+    store->codec = store_default_codec;
+    if (store->version < 2 && store->codec.algo != CODEC_NONE) {
+        fprintf(stderr, "Dépôt version %d : les nouveaux chunks ne seront pas compressés.\n", store->version);
+        store->codec.algo = CODEC_NONE;
+    }
+
+    // L'index du dépôt local ne contient que les digests déjà proposés : chacun ne l'est qu'une fois
+    if (chunk_index_init(&store->index, store->digest_len, 0) != 0) {
+        close(session->fd);
+        return -1;
+    }
+    if (queue_init(&session->pending, NET_PIPELINE_DEPTH) != 0) {
+        chunk_index_free(&store->index);
+        close(session->fd);
+        return -1;
+    }
+    session->pending.metric = METRIC_QUEUE_NETWORK;
+    pthread_mutex_init(&session->send_lock, NULL);
+    pthread_mutex_init(&session->fetch_lock, NULL);
+    pthread_cond_init(&session->fetch_cond, NULL);
+    session->store = store;
+    store->remote = session;
+    return 0;
+}
+
+// Fonction pour proposer un chunk au serveur (appelée par store_put_compressed)
+int remote_put(remote_session *session, const unsigned char *digest, uint32_t size,
+               codec_algo codec, const void *stored, size_t stored_size) {
+    /* @param: les données sont copiées : elles ne seront envoyées que si le serveur les demande
+    *  @return: 1 si le chunk est proposé, -1 si la session est perdue
+    */
+    if (atomic_load(&session->failed)) {
+        return -1;
+    }
+    // Refusé tout de suite plutôt qu'à l'envoi, quand le serveur le demanderait
+    if (stored_size > NET_MAX_FRAME - session->store->digest_len - 2 * sizeof(uint32_t)) {
+        fprintf(stderr, "Objet de %zu octets trop grand pour être envoyé au serveur (répertoire de trop nombreuses entrées).\n",
+                stored_size);
+        return -1;
+    }
+
+    remote_batch *batch = session->current;
+    if (!batch) {
+        batch = calloc(1, sizeof(remote_batch));
+        if (!batch || !(batch->chunks = malloc(NET_HAVE_COUNT * sizeof(remote_chunk)))) {
+            perror("Erreur d'allocation mémoire pour un lot");
+            free(batch);
+            return -1;
+        }
+        session->current = batch;
+    }
+    if (batch->used + stored_size > batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity : NET_HAVE_BYTES;
+        while (capacity < batch->used + stored_size) {
+            capacity *= 2;
+        }
+        unsigned char *data = realloc(batch->data, capacity);
+        if (!data) {
+            perror("Erreur d'allocation mémoire pour un lot");
+            return -1;
+        }
+        batch->data = data;
+        batch->capacity = capacity;
+    }
+
+    remote_chunk *chunk = &batch->chunks[batch->count++];
+    memcpy(chunk->digest, digest, session->store->digest_len);
+    chunk->size = size;
+    chunk->codec = (uint32_t)codec;
+    chunk->offset = batch->used;
+    chunk->stored_size = (uint32_t)stored_size;
+    memcpy(batch->data + batch->used, stored, stored_size);
+    batch->used += stored_size;
+    session->offered++;
+
+    chunk_location location = {0};
+    if (chunk_index_insert(&session->store->index, digest, &location) < 0) {
+        return -1;
+    }
+    if (batch->count == NET_HAVE_COUNT || batch->used >= NET_HAVE_BYTES) {
+        return flush_batch(session) == 0 ? 1 : -1;
+    }
+    return 1;
+}
+
+// Attente des réponses à tous les lots envoyés
+static void drain_pending(remote_session *session) {
+    if (session->receiver_started) {
+        queue_close(&session->pending);
+        pthread_join(session->receiver, NULL);
+        session->receiver_started = false;
+    }
+}
+
+// Fonction pour terminer l'envoi des chunks puis enregistrer la sauvegarde sur le serveur
+int remote_commit(remote_session *session, const char *name, const snapshot_manifest *manifest) {
+    /* @param: name est le nom de la sauvegarde sur le serveur (horodatage)
+    *           manifest référence l'arbre racine, qui doit être arrivé sur le serveur
+    *  @return: 0 si le serveur a enregistré la sauvegarde, -1 sinon
+    */
+    flush_batch(session);
+    drain_pending(session);
+
+    chunk_store_t *store = session->store;
+    store->new_chunks = session->sent_chunks;
+    store->new_bytes = session->sent_bytes;
+    store->new_raw_bytes = session->sent_raw_bytes;
+    if (atomic_load(&session->failed)) {
+        return -1;
+    }
+
+    // Tous les chunks demandés sont partis avant le manifeste : le serveur peut vérifier la racine
+    unsigned char payload[NET_NAME_MAX + sizeof(snapshot_manifest)] = {0};
+    snprintf((char *)payload, NET_NAME_MAX, "%s", name);
+    memcpy(payload + NET_NAME_MAX, manifest, sizeof(*manifest));
+    net_frame frame = {0};
+    if (net_send_frame(session->fd, NET_COMMIT, payload, sizeof(payload)) != 0 ||
+        net_recv_frame(session->fd, &frame) != 0) {
+        fprintf(stderr, "Connexion au serveur perdue.\n");
+        net_frame_free(&frame);
+        session_fail(session);
+        return -1;
+    }
+    session->wire_bytes += sizeof(net_header) + sizeof(payload);
+
+    int status = 0;
+    if (frame.type == NET_ERROR) {
+        fprintf(stderr, "Erreur du serveur : %s\n", (const char *)frame.data);
+        status = -1;
+    } else if (frame.type != NET_DONE) {
+        fprintf(stderr, "Réponse inattendue du serveur (trame %u).\n", frame.type);
+        status = -1;
+    }
+    net_frame_free(&frame);
+    return status;
+}
+
+// Fonction pour ouvrir une sauvegarde du serveur et lire son manifeste
+int remote_snapshot(remote_session *session, const char *name, char *resolved, size_t resolved_size,
+                    snapshot_manifest *manifest) {
+    /* @param: name est le nom de la sauvegarde sur le serveur, NULL ou vide pour la dernière
+    *           resolved reçoit le nom de la sauvegarde ouverte
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    size_t len = name ? strlen(name) : 0;
+    net_frame frame = {0};
+    if (net_send_frame(session->fd, NET_OPEN, name, len) != 0 || net_recv_frame(session->fd, &frame) != 0) {
+        fprintf(stderr, "Connexion au serveur perdue.\n");
+        net_frame_free(&frame);
+        session_fail(session);
+        return -1;
+    }
+    int status = -1;
+    if (frame.type == NET_ERROR) {
+        fprintf(stderr, "Erreur du serveur : %s\n", (const char *)frame.data);
+    } else if (frame.type != NET_MANIFEST || frame.length != NET_NAME_MAX + sizeof(snapshot_manifest)) {
+        fprintf(stderr, "Réponse inattendue du serveur (trame %u).\n", frame.type);
+    } else {
+        memcpy(manifest, frame.data + NET_NAME_MAX, sizeof(*manifest));
+        frame.data[NET_NAME_MAX - 1] = '\0';
+        snprintf(resolved, resolved_size, "%s", (const char *)frame.data);
+        status = manifest->digest_len == session->store->digest_len ? 0 : -1;
+        if (status != 0) {
+            fprintf(stderr, "Manifeste du serveur invalide.\n");
+        }
+    }
+    net_frame_free(&frame);
+    return status;
+}
+
+// Envoi d'un lot de demandes
+static int send_get(remote_session *session, const unsigned char *digests, size_t count) {
+    size_t size = count * session->store->digest_len;
+    pthread_mutex_lock(&session->send_lock);
+    int status = net_send_frame(session->fd, NET_GET, digests, size);
+    session->wire_bytes += sizeof(net_header) + size;
+    pthread_mutex_unlock(&session->send_lock);
+    return status;
+}
+
+// Thread fetcher : les demandes partent tant que la fenêtre n'est pas pleine, le lien reste occupé
+// pendant que l'appelant écrit les objets déjà reçus et ajoute les demandes suivantes
+static void *fetcher_main(void *arg) {
+    remote_session *session = arg;
+    size_t digest_len = session->store->digest_len;
+    unsigned char digests[NET_GET_COUNT * DIGEST_MAX_LENGTH];
+    size_t pending = 0;
+
+    pthread_mutex_lock(&session->fetch_lock);
+    while (!atomic_load(&session->failed)) {
+        const remote_request *request = NULL;
+        if (session->sent < session->pushed) {
+            request = &session->requests[session->sent - session->request_base];
+        }
+        // Un nouveau lot attend qu'un GET complet tienne dans la fenêtre : une demande par objet reçu
+        // coûterait une trame par objet
+        size_t room = pending > 0 ? 1 : NET_GET_COUNT;
+        bool full = request && session->inflight_count > 0 &&
+                    (session->inflight_count + room > NET_PREFETCH_COUNT ||
+                     session->inflight_bytes + request->size > NET_PREFETCH_BYTES);
+        if (!request || full) {
+            // Rien à ajouter pour l'instant : le lot commencé part avant d'attendre, sinon ses réponses
+            // ne viendraient jamais
+            if (pending > 0) {
+                pthread_mutex_unlock(&session->fetch_lock);
+                if (send_get(session, digests, pending) != 0) {
+                    session_fail(session);
+                }
+                pending = 0;
+                pthread_mutex_lock(&session->fetch_lock);
+                continue;
+            }
+            if (!request && session->fetch_stop) {
+                break;
+            }
+            pthread_cond_wait(&session->fetch_cond, &session->fetch_lock);
+            continue;
+        }
+        memcpy(digests + pending * digest_len, request->digest, digest_len);
+        session->sent++;
+        session->inflight_count++;
+        session->inflight_bytes += request->size;
+        if (++pending == NET_GET_COUNT) {
+            pthread_mutex_unlock(&session->fetch_lock);
+            if (send_get(session, digests, pending) != 0) {
+                session_fail(session);
+            }
+            pending = 0;
+            pthread_mutex_lock(&session->fetch_lock);
+        }
+    }
+    pthread_mutex_unlock(&session->fetch_lock);
+    return NULL;
+}
+
+// Fonction pour ajouter des objets à demander au serveur, envoyés en avance par un thread
+int remote_fetch_push(remote_session *session, const remote_request *requests, size_t count) {
+    /* @param: requests est recopié ; chaque objet est reçu une fois, dans l'ordre des ajouts,
+    *           par remote_fetch_next
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    if (count == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&session->fetch_lock);
+    size_t waiting = session->pushed - session->request_base;
+    if (waiting + count > session->request_capacity) {
+        // Les demandes déjà reçues libèrent le début du tableau
+        size_t received = session->next_request - session->request_base;
+        memmove(session->requests, session->requests + received, (waiting - received) * sizeof(remote_request));
+        session->request_base = session->next_request;
+        waiting -= received;
+    }
+    if (waiting + count > session->request_capacity) {
+        size_t capacity = session->request_capacity ? session->request_capacity * 2 : NET_PREFETCH_COUNT;
+        while (capacity < waiting + count) {
+            capacity *= 2;
+        }
+        remote_request *grown = realloc(session->requests, capacity * sizeof(*grown));
+        if (!grown) {
+            pthread_mutex_unlock(&session->fetch_lock);
+            perror("Erreur d'allocation mémoire pour les demandes");
+            return -1;
+        }
+        session->requests = grown;
+        session->request_capacity = capacity;
+    }
+    memcpy(session->requests + waiting, requests, count * sizeof(remote_request));
+    session->pushed += count;
+    pthread_cond_signal(&session->fetch_cond);
+    pthread_mutex_unlock(&session->fetch_lock);
+
+    if (!session->fetcher_started) {
+        if (pthread_create(&session->fetcher, NULL, fetcher_main, session) != 0) {
+            perror("Erreur lors de la création du thread de demandes");
+            session_fail(session);
+            return -1;
+        }
+        session->fetcher_started = true;
+    }
+    return 0;
+}
+
+// Réception sur la connexion de l'objet de la plus ancienne demande non reçue
+static const unsigned char *receive_object(remote_session *session, uint32_t *size) {
+    if (atomic_load(&session->failed)) {
+        return NULL;
+    }
+    pthread_mutex_lock(&session->fetch_lock);
+    if (session->next_request == session->pushed) {
+        pthread_mutex_unlock(&session->fetch_lock);
+        return NULL;
+    }
+    remote_request request = session->requests[session->next_request - session->request_base];
+    pthread_mutex_unlock(&session->fetch_lock);
+
+    size_t digest_len = session->store->digest_len;
+    size_t header = digest_len + 2 * sizeof(uint32_t);
+    net_frame *frame = &session->fetch_frame;
+    if (net_recv_frame(session->fd, frame) != 0) {
+        fprintf(stderr, "Connexion au serveur perdue.\n");
+        session_fail(session);
+        return NULL;
+    }
+    if (frame->type == NET_ERROR) {
+        fprintf(stderr, "Erreur du serveur : %s\n", (const char *)frame->data);
+        session_fail(session);
+        return NULL;
+    }
+    if (frame->type != NET_DATA || frame->length < header || memcmp(frame->data, request.digest, digest_len) != 0) {
+        fprintf(stderr, "Réponse inattendue du serveur (trame %u).\n", frame->type);
+        session_fail(session);
+        return NULL;
+    }
+    uint32_t raw_size = net_get_u32(frame->data + digest_len);
+    codec_algo codec = (codec_algo)net_get_u32(frame->data + digest_len + 4);
+    if (request.size != 0 && raw_size != request.size) {
+        fprintf(stderr, "Taille d'objet inattendue reçue du serveur.\n");
+        session_fail(session);
+        return NULL;
+    }
+    const unsigned char *stored = frame->data + header;
+    size_t stored_size = frame->length - header;
+
+    // Les chunks compressés dans le dépôt du serveur traversent le réseau compressés
+    const unsigned char *data = stored;
+    if (codec != CODEC_NONE || stored_size != raw_size) {
+        if (raw_size > session->fetch_capacity) {
+            unsigned char *buffer = realloc(session->fetch_buffer, raw_size);
+            if (!buffer) {
+                perror("Erreur d'allocation mémoire pour la décompression");
+                session_fail(session);
+                return NULL;
             }
+            session->fetch_buffer = buffer;
+            session->fetch_capacity = raw_size;
+        }
+        if (codec_decompress(codec, stored, stored_size, session->fetch_buffer, raw_size) != 0) {
+            session_fail(session);
+            return NULL;
         }
+        data = session->fetch_buffer;
     }
-    if (read_size < 0) {
-        perror("Échec de la réception");
-        free(*data);
-        *data = NULL;
-        *size = 0;
+
+    // La place libérée dans la fenêtre permet au thread fetcher d'envoyer la suite
+    pthread_mutex_lock(&session->fetch_lock);
+    session->inflight_count--;
+    session->inflight_bytes -= request.size;
+    session->next_request++;
+    pthread_cond_signal(&session->fetch_cond);
+    pthread_mutex_unlock(&session->fetch_lock);
+
+    session->received_objects++;
+    session->received_bytes += sizeof(net_header) + frame->length;
+    *size = raw_size;
+    return data;
+}
+
+// Fonction pour recevoir l'objet suivant, dans l'ordre des demandes
+const unsigned char *remote_fetch_next(remote_session *session, uint32_t *size) {
+    /* @param: size reçoit la taille (décompressée) de l'objet
+    *  @return: les données de l'objet, valides jusqu'au prochain appel (ou remote_fetch_now), NULL en cas d'erreur
+    */
+    if (atomic_load(&session->failed)) {
+        return NULL;
+    }
+    if (session->stash_first < session->stash_count) {
+        remote_object *object = &session->stash[session->stash_first++];
+        // Le stash vidé repart du début ; ses données restent en place jusqu'au prochain remote_fetch_now
+        if (session->stash_first == session->stash_count) {
+            session->stash_first = 0;
+            session->stash_count = 0;
+            session->stash_used = 0;
+        }
+        *size = object->size;
+        return session->stash_data + object->offset;
     }
-    close(client_fd);   // Fermer les sockets
-    close(server_fd);
+    return receive_object(session, size);
 }
 
+// Mise de côté d'un objet reçu avant son tour
+static int stash_object(remote_session *session, const unsigned char *data, uint32_t size) {
+    if (session->stash_count == session->stash_capacity) {
+        size_t capacity = session->stash_capacity ? session->stash_capacity * 2 : 64;
+        remote_object *grown = realloc(session->stash, capacity * sizeof(*grown));
+        if (!grown) {
+            perror("Erreur d'allocation mémoire pour les objets reçus");
+            return -1;
+        }
+        session->stash = grown;
+        session->stash_capacity = capacity;
+    }
+    if (session->stash_used + size > session->stash_data_capacity) {
+        size_t capacity = session->stash_data_capacity ? session->stash_data_capacity * 2 : 1024 * 1024;
+        while (capacity < session->stash_used + size) {
+            capacity *= 2;
+        }
+        unsigned char *grown = realloc(session->stash_data, capacity);
+        if (!grown) {
+            perror("Erreur d'allocation mémoire pour les objets reçus");
+            return -1;
+        }
+        session->stash_data = grown;
+        session->stash_data_capacity = capacity;
+    }
+    memcpy(session->stash_data + session->stash_used, data, size);
+    session->stash[session->stash_count++] = (remote_object){session->stash_used, size};
+    session->stash_used += size;
+    return 0;
+}
+
+// Fonction pour recevoir tout de suite un objet, derrière les demandes déjà ajoutées
+const unsigned char *remote_fetch_now(remote_session *session, const remote_request *request, uint32_t *size) {
+    /* @param: les objets des demandes précédentes qui arrivent avant lui sont gardés, dans l'ordre,
+    *           pour remote_fetch_next ; ils sont au plus ce que l'appelant a déjà demandé
+    *  @return: les données de l'objet, valides jusqu'au prochain appel, NULL en cas d'erreur
+    */
+    if (remote_fetch_push(session, request, 1) != 0) {
+        return NULL;
+    }
+    uint64_t target = session->pushed - 1;
+    for (;;) {
+        bool last = session->next_request == target;
+        uint32_t object_size;
+        const unsigned char *data = receive_object(session, &object_size);
+        if (!data) {
+            return NULL;
+        }
+        if (last) {
+            *size = object_size;
+            return data;
+        }
+        if (stash_object(session, data, object_size) != 0) {
+            session_fail(session);
+            return NULL;
+        }
+    }
+}
+
+// Fonction pour arrêter le thread fetcher une fois toutes les demandes reçues
+int remote_fetch_finish(remote_session *session) {
+    /* @return: 0 si tous les objets demandés ont été reçus, -1 sinon
+    */
+    if (session->next_request < session->pushed) {
+        // Objets demandés mais non lus : la connexion n'est plus utilisable
+        session_fail(session);
+    }
+    if (session->fetcher_started) {
+        pthread_mutex_lock(&session->fetch_lock);
+        session->fetch_stop = true;
+        pthread_cond_broadcast(&session->fetch_cond);
+        pthread_mutex_unlock(&session->fetch_lock);
+        pthread_join(session->fetcher, NULL);
+        session->fetcher_started = false;
+        session->fetch_stop = false;
+    }
+    session->stash_first = 0;
+    session->stash_count = 0;
+    session->stash_used = 0;
+    return atomic_load(&session->failed) ? -1 : 0;
+}
+
+// Fonction pour fermer la session
+void remote_close(remote_session *session) {
+    batch_free(session->current);
+    session->current = NULL;
+    drain_pending(session);
+    remote_fetch_finish(session);
+    if (!atomic_load(&session->failed)) {
+        net_send_frame(session->fd, NET_BYE, NULL, 0);
+    }
+    close(session->fd);
+    queue_destroy(&session->pending);
+    pthread_mutex_destroy(&session->send_lock);
+    pthread_mutex_destroy(&session->fetch_lock);
+    pthread_cond_destroy(&session->fetch_cond);
+    net_frame_free(&session->fetch_frame);
+    free(session->fetch_buffer);
+    session->fetch_buffer = NULL;
+    free(session->requests);
+    session->requests = NULL;
+    free(session->stash);
+    session->stash = NULL;
+    free(session->stash_data);
+    session->stash_data = NULL;
+    if (session->store) {
+        session->store->remote = NULL;
+    }
+    session->fd = -1;
+}
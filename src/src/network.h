@@ -1,8 +1,198 @@
 #ifndef NETWORK_H
 #define NETWORK_H
 
-void send_data(const char *server_address, int port, const void *data, size_t size);
-void receive_data(int port, void **data, size_t *size);
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "queue.h"
+#include "chunk_store.h"
+#include "snapshot_index.h"
 
-#endif // NETWORK_H
+// Protocole de sauvegarde distante : une seule connexion TCP pour toute la sauvegarde,
+// des trames préfixées par leur longueur, envoyées sans attendre les réponses précédentes.
+// Le client propose des lots de digests (HAVE), le serveur répond par ceux qui lui manquent (WANT),
+// seuls ces chunks traversent le réseau (CHUNK). Le manifeste termine la sauvegarde (COMMIT).
+
+#define NET_MAGIC 0x3532504cu // "LP25"
+// Version 2 : CONFIG donne la génération du dépôt (cache des fichiers du client)
+#define NET_VERSION 2
+
+// Taille maximale d'une trame, donc d'un objet envoyé ou reçu d'un seul tenant. Les listes de chunks des
+// fichiers sont rangées en objets de liste bornés (deduplication.h) : le plus gros objet est l'arbre d'un
+// répertoire, qui ne dépend que du nombre de ses entrées (plus d'un million tiennent dans une trame)
+#define NET_MAX_FRAME (256u * 1024u * 1024u)
+// Un lot HAVE est envoyé dès qu'il contient ce nombre de digests ou ce volume de données en attente
+#define NET_HAVE_COUNT 1024
+#define NET_HAVE_BYTES (4u * 1024u * 1024u)
+// Nombre de lots HAVE envoyés sans réponse : borne la mémoire du client et maintient le lien occupé
+#define NET_PIPELINE_DEPTH 16
+// Longueur maximale du nom d'une sauvegarde transmis dans COMMIT et MANIFEST
+#define NET_NAME_MAX 64
+// Restauration : nombre de digests par GET, et données demandées sans être encore reçues
+#define NET_GET_COUNT 64
+#define NET_PREFETCH_BYTES (32u * 1024u * 1024u)
+#define NET_PREFETCH_COUNT 4096
+
+// Types de trames
+typedef enum {
+    NET_HELLO = 1,  // client -> serveur : signature et version du protocole
+    NET_CONFIG = 2, // serveur -> client : version du dépôt, hachage et découpage
+    NET_HAVE = 3,   // client -> serveur : lot de digests
+    NET_WANT = 4,   // serveur -> client : un bit par digest du lot, 1 si le chunk manque
+    NET_CHUNK = 5,  // client -> serveur : digest, taille d'origine, compression, données
+    NET_COMMIT = 6, // client -> serveur : nom de la sauvegarde puis manifeste
+    NET_DONE = 7,   // serveur -> client : sauvegarde enregistrée
+    NET_ERROR = 8,  // serveur -> client : message d'erreur, la connexion est ensuite fermée
+    NET_BYE = 9,    // client -> serveur : fin de la session
+    NET_OPEN = 10,  // client -> serveur : nom de la sauvegarde à restaurer (vide : la dernière)
+    NET_MANIFEST = 11, // serveur -> client : nom de la sauvegarde puis manifeste
+    NET_GET = 12,   // client -> serveur : lot de digests à envoyer
+    NET_DATA = 13   // serveur -> client : un objet demandé (digest, taille, compression, données), dans l'ordre
+} net_msg_type;
+
+// En-tête d'une trame : longueur des données qui suivent puis type (ordre réseau)
+typedef struct {
+    uint32_t length;
+    uint32_t type;
+} net_header;
+
+// Trame reçue ; le tampon est réutilisé d'une trame à l'autre
+typedef struct {
+    uint32_t type;
+    uint32_t length;
+    unsigned char *data;
+    size_t capacity;
+} net_frame;
+
+// Contenu de CONFIG : ce que le client doit savoir pour produire des chunks compatibles
+typedef struct {
+    uint32_t store_version;
+    uint32_t hash;
+    uint32_t chunk_min;
+    uint32_t chunk_avg;
+    uint32_t chunk_max;
+    unsigned char epoch[STORE_EPOCH_LENGTH]; // Génération du dépôt (chunk_store.h)
+} net_config;
+
+// Chunk proposé au serveur, en attente de sa réponse
+typedef struct {
+    unsigned char digest[DIGEST_MAX_LENGTH];
+    uint32_t size;        // Taille d'origine
+    uint32_t codec;       // Compression des données
+    size_t offset;        // Position des données dans le lot
+    uint32_t stored_size; // Taille des données (après compression)
+} remote_chunk;
+
+// Lot de chunks proposés par un même HAVE
+typedef struct {
+    remote_chunk *chunks;
+    int count;
+    unsigned char *data;
+    size_t used;
+    size_t capacity;
+} remote_batch;
 
+// Objet demandé au serveur pendant une restauration
+typedef struct {
+    unsigned char digest[DIGEST_MAX_LENGTH];
+    uint32_t size;        // Taille attendue (0 si inconnue, pour un arbre)
+} remote_request;
+
+// Objet reçu avant son tour, gardé pour remote_fetch_next
+typedef struct {
+    size_t offset;        // Position de ses données dans stash_data
+    uint32_t size;
+} remote_object;
+
+// Session de sauvegarde vers un serveur : le dépôt local n'est plus qu'un ensemble de digests connus
+typedef struct remote_session {
+    int fd;
+    chunk_store_t *store;        // Dépôt « distant » dont store_put_compressed passe par la session
+    pthread_mutex_t send_lock;   // Une trame est écrite d'un seul tenant
+    pthread_t receiver;          // Lit les WANT et envoie les chunks demandés
+    bool receiver_started;
+    bounded_queue pending;       // Lots envoyés dont la réponse est attendue, dans l'ordre
+    remote_batch *current;       // Lot en cours de remplissage
+    unsigned char epoch[STORE_EPOCH_LENGTH]; // Génération du dépôt du serveur
+    atomic_bool failed;
+    uint64_t offered;            // Chunks proposés au serveur
+    uint64_t sent_chunks;        // Chunks demandés puis envoyés
+    uint64_t sent_bytes;         // Données de ces chunks (après compression)
+    uint64_t sent_raw_bytes;     // Taille d'origine de ces chunks
+    uint64_t wire_bytes;         // Octets écrits sur la connexion, en-têtes compris
+
+    // Restauration : les demandes partent en avance depuis le thread fetcher, qui reste actif d'une
+    // fenêtre à l'autre jusqu'à remote_fetch_finish
+    pthread_t fetcher;
+    bool fetcher_started;
+    bool fetch_stop;             // Plus aucune demande ne viendra
+    remote_request *requests;    // Demandes pas encore reçues : la demande n est requests[n - request_base]
+    size_t request_capacity;
+    uint64_t request_base;
+    uint64_t pushed;             // Demandes ajoutées, reçues dans cet ordre
+    uint64_t sent;               // Demandes envoyées au serveur
+    uint64_t next_request;       // Prochain objet attendu sur la connexion
+    remote_object *stash;        // Objets reçus par remote_fetch_now avant l'objet voulu
+    size_t stash_first;
+    size_t stash_count;
+    size_t stash_capacity;
+    unsigned char *stash_data;   // Leurs données, à la suite
+    size_t stash_used;
+    size_t stash_data_capacity;
+    pthread_mutex_t fetch_lock;  // Protège la file et la fenêtre des demandes en vol
+    pthread_cond_t fetch_cond;
+    uint64_t inflight_bytes;
+    size_t inflight_count;
+    net_frame fetch_frame;       // Dernier objet reçu
+    unsigned char *fetch_buffer; // Objet décompressé
+    size_t fetch_capacity;
+    uint64_t received_objects;
+    uint64_t received_bytes;     // Octets lus sur la connexion pour ces objets
+} remote_session;
+
+// Lecture d'un entier de 32 bits en ordre réseau
+static inline uint32_t net_get_u32(const unsigned char *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return ntohl(value);
+}
+
+// Écriture d'un entier de 32 bits en ordre réseau
+static inline void net_put_u32(unsigned char *data, uint32_t value) {
+    value = htonl(value);
+    memcpy(data, &value, sizeof(value));
+}
+
+// Fonction pour envoyer une trame complète (les écritures partielles sont reprises)
+int net_send_frame(int fd, uint32_t type, const void *data, size_t size);
+// Fonction pour recevoir une trame complète
+int net_recv_frame(int fd, net_frame *frame);
+// Fonction pour libérer le tampon d'une trame
+void net_frame_free(net_frame *frame);
+
+// Fonction pour ouvrir une session vers un serveur et préparer le dépôt qui la représente
+int remote_open(remote_session *session, chunk_store_t *store, const char *server, int port);
+// Fonction pour proposer un chunk au serveur (appelée par store_put_compressed)
+int remote_put(remote_session *session, const unsigned char *digest, uint32_t size,
+               codec_algo codec, const void *stored, size_t stored_size);
+// Fonction pour terminer l'envoi des chunks puis enregistrer la sauvegarde sur le serveur
+int remote_commit(remote_session *session, const char *name, const snapshot_manifest *manifest);
+// Fonction pour ouvrir une sauvegarde du serveur et lire son manifeste
+int remote_snapshot(remote_session *session, const char *name, char *resolved, size_t resolved_size,
+                    snapshot_manifest *manifest);
+// Fonction pour ajouter des objets à demander au serveur, envoyés en avance par un thread
+int remote_fetch_push(remote_session *session, const remote_request *requests, size_t count);
+// Fonction pour recevoir l'objet suivant, dans l'ordre des demandes
+const unsigned char *remote_fetch_next(remote_session *session, uint32_t *size);
+// Fonction pour recevoir tout de suite un objet, derrière les demandes déjà ajoutées
+const unsigned char *remote_fetch_now(remote_session *session, const remote_request *request, uint32_t *size);
+// Fonction pour arrêter le thread fetcher une fois toutes les demandes reçues
+int remote_fetch_finish(remote_session *session);
+// Fonction pour fermer la session
+void remote_close(remote_session *session);
+
+#endif // NETWORK_H
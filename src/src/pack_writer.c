@@ -0,0 +1,327 @@
+#include "pack_writer.h"
+#include "pool.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Écriture complète à une position (offset négatif : à la fin d'un fichier ouvert en ajout)
+static int write_all(int fd, const unsigned char *data, size_t size, int64_t offset) {
+    while (size > 0) {
+        ssize_t n = offset < 0 ? write(fd, data, size) : pwrite(fd, data, size, (off_t)offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            if (n == 0) {
+                errno = EIO;
+            }
+            return -1;
+        }
+        data += n;
+        size -= (size_t)n;
+        if (offset >= 0) {
+            offset += n;
+        }
+    }
+    return 0;
+}
+
+static void set_error(pack_writer *writer, int error) {
+    if (error && !writer->error) {
+        writer->error = error;
+    }
+}
+
+// Première erreur d'écriture, lue sous le verrou du thread d'écriture s'il existe
+static int writer_error(pack_writer *writer) {
+    if (writer->backend != IO_BACKEND_THREADS) {
+        return writer->error;
+    }
+    pthread_mutex_lock(&writer->lock);
+    int error = writer->error;
+    pthread_mutex_unlock(&writer->lock);
+    return error;
+}
+
+// Thread d'écriture : les tampons soumis, dans l'ordre, données puis index
+static void *writer_main(void *arg) {
+    pack_writer *writer = arg;
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->queue_count == 0 && !writer->stop) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        if (writer->queue_count == 0) {
+            break;
+        }
+        pack_buffer *buffer = &writer->buffers[writer->queue[writer->queue_head]];
+        writer->queue_head = (writer->queue_head + 1) % PACK_WRITER_BUFFERS;
+        writer->queue_count--;
+        pthread_mutex_unlock(&writer->lock);
+
+        uint64_t start = metrics_start();
+        int error = 0;
+        if (write_all(buffer->fd, buffer->data, buffer->used, (int64_t)buffer->offset) != 0 ||
+            write_all(writer->index_fd, buffer->index, buffer->index_used, -1) != 0) {
+            error = errno;
+        }
+        metrics_stop(METRIC_WRITE, start, buffer->used + buffer->index_used);
+
+        pthread_mutex_lock(&writer->lock);
+        set_error(writer, error);
+        buffer->busy = false;
+        pthread_cond_broadcast(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+// Fin d'un tampon écrit par io_uring. Une écriture courte rompt la chaîne : l'index est alors annulé
+// et le reste est écrit de façon bloquante, toujours données d'abord.
+static void finish_uring(pack_writer *writer, pack_buffer *buffer) {
+    int error = 0;
+    if (buffer->written < 0) {
+        error = (int)-buffer->written;
+    } else if ((size_t)buffer->written < buffer->used &&
+               write_all(buffer->fd, buffer->data + buffer->written, buffer->used - (size_t)buffer->written,
+                         (int64_t)(buffer->offset + (uint64_t)buffer->written)) != 0) {
+        error = errno;
+    }
+    if (!error) {
+        long index_written = buffer->index_written == -ECANCELED ? 0 : buffer->index_written;
+        if (index_written < 0) {
+            error = (int)-index_written;
+        } else if ((size_t)index_written < buffer->index_used &&
+                   write_all(writer->index_fd, buffer->index + index_written,
+                             buffer->index_used - (size_t)index_written, -1) != 0) {
+            error = errno;
+        }
+    }
+    set_error(writer, error);
+    metrics_stop(METRIC_WRITE, buffer->start, buffer->used + buffer->index_used);
+    buffer->busy = false;
+}
+
+// Récolte des écritures terminées (wait : attendre au moins une complétion)
+static void reap(pack_writer *writer, bool wait) {
+    if (wait) {
+        uring_submit(&writer->ring, 1);
+    }
+    struct io_uring_cqe cqe;
+    while (uring_next_cqe(&writer->ring, &cqe)) {
+        pack_buffer *buffer = &writer->buffers[cqe.user_data / 2];
+        if (cqe.user_data % 2) {
+            buffer->index_written = cqe.res;
+        } else {
+            buffer->written = cqe.res;
+        }
+        if (--buffer->pending == 0) {
+            finish_uring(writer, buffer);
+        }
+    }
+}
+
+// Soumission du tampon courant
+static void submit_buffer(pack_writer *writer, int index) {
+    pack_buffer *buffer = &writer->buffers[index];
+    buffer->busy = true;
+    buffer->start = metrics_start();
+    if (writer->backend == IO_BACKEND_THREADS) {
+        pthread_mutex_lock(&writer->lock);
+        writer->queue[(writer->queue_head + writer->queue_count) % PACK_WRITER_BUFFERS] = index;
+        writer->queue_count++;
+        pthread_cond_broadcast(&writer->cond);
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+
+    // Données puis index, liés : l'écriture de l'index ne commence qu'une fois les données écrites
+    buffer->pending = 0;
+    buffer->written = 0;
+    buffer->index_written = 0;
+    if (buffer->used) {
+        struct io_uring_sqe *sqe = uring_get_sqe(&writer->ring);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = buffer->fd;
+        sqe->addr = (uint64_t)(uintptr_t)buffer->data;
+        sqe->len = (uint32_t)buffer->used;
+        sqe->off = buffer->offset;
+        sqe->flags = buffer->index_used ? IOSQE_IO_LINK : 0;
+        sqe->user_data = (uint64_t)index * 2;
+        buffer->pending++;
+    }
+    if (buffer->index_used) {
+        struct io_uring_sqe *sqe = uring_get_sqe(&writer->ring);
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = writer->index_fd;
+        sqe->addr = (uint64_t)(uintptr_t)buffer->index;
+        sqe->len = (uint32_t)buffer->index_used;
+        sqe->off = (uint64_t)-1;
+        sqe->user_data = (uint64_t)index * 2 + 1;
+        buffer->pending++;
+    }
+    if (buffer->pending == 0) {
+        buffer->busy = false;
+        return;
+    }
+    uring_submit(&writer->ring, 0);
+}
+
+// Attente de la fin de l'écriture d'un tampon
+static void wait_buffer(pack_writer *writer, int index) {
+    pack_buffer *buffer = &writer->buffers[index];
+    if (writer->backend == IO_BACKEND_THREADS) {
+        pthread_mutex_lock(&writer->lock);
+        while (buffer->busy) {
+            pthread_cond_wait(&writer->cond, &writer->lock);
+        }
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+    reap(writer, false);
+    while (buffer->busy) {
+        reap(writer, true);
+    }
+}
+
+// Le tampon courant part à l'écriture, le suivant (libre une fois son écriture terminée) le remplace
+static void next_buffer(pack_writer *writer) {
+    submit_buffer(writer, writer->current);
+    writer->current = (writer->current + 1) % PACK_WRITER_BUFFERS;
+    wait_buffer(writer, writer->current);
+    writer->buffers[writer->current].used = 0;
+    writer->buffers[writer->current].index_used = 0;
+}
+
+// Fonction pour préparer l'écriture en arrière-plan des packs et de l'index
+int pack_writer_init(pack_writer *writer, io_backend backend, int index_fd) {
+    /* @param: backend est IO_BACKEND_URING (remplacé par les threads si io_uring manque) ou IO_BACKEND_THREADS
+    *           index_fd est le journal de l'index ouvert en ajout ; il reste à l'appelant
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    memset(writer, 0, sizeof(*writer));
+    writer->index_fd = index_fd;
+    writer->ring.fd = -1;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+    for (int i = 0; i < PACK_WRITER_BUFFERS; i++) {
+        void *data = NULL;
+        if (posix_memalign(&data, POOL_IO_ALIGN, PACK_WRITER_BUFFER_SIZE) != 0 ||
+            !(writer->buffers[i].index = malloc(PACK_WRITER_INDEX_SIZE))) {
+            fprintf(stderr, "Erreur d'allocation mémoire pour les tampons d'écriture des packs.\n");
+            free(data);
+            pack_writer_free(writer);
+            return -1;
+        }
+        writer->buffers[i].data = data;
+    }
+
+    writer->backend = io_backend_effective(backend);
+    if (writer->backend == IO_BACKEND_URING && uring_init(&writer->ring, 2 * PACK_WRITER_BUFFERS) != 0) {
+        perror("Erreur lors de la création de l'anneau io_uring, packs écrits par un thread");
+        writer->backend = IO_BACKEND_THREADS;
+    }
+    if (writer->backend == IO_BACKEND_THREADS) {
+        if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+            perror("Erreur lors de la création du thread d'écriture des packs");
+            pack_writer_free(writer);
+            return -1;
+        }
+        writer->thread_started = true;
+    }
+    return 0;
+}
+
+// Fonction pour ajouter un chunk (en-tête et données) et son enregistrement d'index
+int pack_writer_append(pack_writer *writer, int fd, uint64_t offset, const void *header, size_t header_size,
+                       const void *data, size_t size, const void *record, size_t record_size) {
+    /* @param: fd et offset désignent la place du chunk dans son pack ; les chunks d'un tampon se suivent
+    *  @return: 0 en cas de succès, -1 si une écriture a échoué (errno est positionné)
+    */
+    pack_buffer *buffer = &writer->buffers[writer->current];
+    size_t total = header_size + size;
+    bool empty = buffer->used == 0 && buffer->index_used == 0;
+    if (!empty && (buffer->fd != fd || buffer->offset + buffer->used != offset ||
+                   buffer->used + total > PACK_WRITER_BUFFER_SIZE ||
+                   buffer->index_used + record_size > PACK_WRITER_INDEX_SIZE)) {
+        next_buffer(writer);
+        buffer = &writer->buffers[writer->current];
+        empty = true;
+    }
+    if (empty) {
+        buffer->fd = fd;
+        buffer->offset = offset;
+    }
+
+    if (total > PACK_WRITER_BUFFER_SIZE) {
+        // Objet plus grand qu'un tampon (arbre d'un très grand répertoire) : écrit tout de suite,
+        // son enregistrement d'index part avec le tampon
+        uint64_t start = metrics_start();
+        if (write_all(fd, header, header_size, (int64_t)offset) != 0 ||
+            write_all(fd, data, size, (int64_t)(offset + header_size)) != 0) {
+            return -1;
+        }
+        metrics_stop(METRIC_WRITE, start, total);
+        buffer->offset = offset + total;
+    } else {
+        memcpy(buffer->data + buffer->used, header, header_size);
+        memcpy(buffer->data + buffer->used + header_size, data, size);
+        buffer->used += total;
+    }
+    memcpy(buffer->index + buffer->index_used, record, record_size);
+    buffer->index_used += record_size;
+
+    int error = writer_error(writer);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour écrire tous les tampons et attendre la fin des écritures
+int pack_writer_sync(pack_writer *writer) {
+    /* @return: 0 si tout ce qui a été ajouté est écrit, -1 sinon (errno est positionné)
+    */
+    pack_buffer *buffer = &writer->buffers[writer->current];
+    if (buffer->used || buffer->index_used) {
+        next_buffer(writer);
+    }
+    for (int i = 0; i < PACK_WRITER_BUFFERS; i++) {
+        wait_buffer(writer, i);
+    }
+    int error = writer_error(writer);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour terminer les écritures et libérer les tampons
+int pack_writer_free(pack_writer *writer) {
+    /* @return: le résultat de la dernière synchronisation
+    */
+    int status = writer->backend != IO_BACKEND_SYNC ? pack_writer_sync(writer) : 0;
+    if (writer->thread_started) {
+        pthread_mutex_lock(&writer->lock);
+        writer->stop = true;
+        pthread_cond_broadcast(&writer->cond);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, NULL);
+    }
+    if (writer->backend == IO_BACKEND_URING) {
+        uring_free(&writer->ring);
+    }
+    for (int i = 0; i < PACK_WRITER_BUFFERS; i++) {
+        free(writer->buffers[i].data);
+        free(writer->buffers[i].index);
+    }
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->cond);
+    memset(writer, 0, sizeof(*writer));
+    return status;
+}
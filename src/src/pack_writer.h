@@ -0,0 +1,62 @@
+#ifndef PACK_WRITER_H
+#define PACK_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "uring.h"
+
+// Écriture des packs en arrière-plan (--io uring|threads) : les chunks et leurs enregistrements
+// d'index sont accumulés dans un tampon, écrit pendant que le suivant se remplit. L'index d'un tampon
+// n'est écrit qu'après ses données, l'index ne référence donc jamais des octets absents du pack.
+
+// Tampons en rotation, taille des données de pack et des enregistrements d'index de chacun
+#define PACK_WRITER_BUFFERS 4
+#define PACK_WRITER_BUFFER_SIZE (4u * 1024u * 1024u)
+#define PACK_WRITER_INDEX_SIZE (256u * 1024u)
+
+typedef struct {
+    unsigned char *data;   // Octets à écrire dans le pack, à partir de offset
+    size_t used;
+    unsigned char *index;  // Enregistrements d'index des chunks de data
+    size_t index_used;
+    int fd;                // Pack visé
+    uint64_t offset;
+    bool busy;             // Soumis et pas encore écrit
+    uint64_t start;        // Instant de la soumission (--stats)
+    int pending;           // Complétions attendues (io_uring)
+    long written;          // Octets de data écrits par io_uring (-errno en cas d'échec)
+    long index_written;
+} pack_buffer;
+
+typedef struct {
+    io_backend backend;
+    int index_fd;          // Journal de l'index, ouvert en ajout
+    pack_buffer buffers[PACK_WRITER_BUFFERS];
+    int current;           // Tampon en cours de remplissage
+    int error;             // errno de la première écriture échouée
+    // io_uring : le thread qui ajoute des chunks soumet et récolte lui-même
+    uring_t ring;
+    // Threads : un thread écrit les tampons soumis, dans l'ordre
+    pthread_t thread;
+    bool thread_started;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int queue[PACK_WRITER_BUFFERS];
+    int queue_head;
+    int queue_count;
+    bool stop;
+} pack_writer;
+
+// Fonction pour préparer l'écriture en arrière-plan des packs et de l'index
+int pack_writer_init(pack_writer *writer, io_backend backend, int index_fd);
+// Fonction pour ajouter un chunk (en-tête et données) et son enregistrement d'index
+int pack_writer_append(pack_writer *writer, int fd, uint64_t offset, const void *header, size_t header_size,
+                       const void *data, size_t size, const void *record, size_t record_size);
+// Fonction pour écrire tous les tampons et attendre la fin des écritures
+int pack_writer_sync(pack_writer *writer);
+// Fonction pour terminer les écritures et libérer les tampons
+int pack_writer_free(pack_writer *writer);
+
+#endif // PACK_WRITER_H
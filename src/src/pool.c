@@ -0,0 +1,138 @@
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fonction pour initialiser une arène vide (block_size 0 : ARENA_BLOCK_SIZE)
+void arena_init(arena_t *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+}
+
+// Fonction pour allouer une zone alignée dans une arène
+void *arena_alloc(arena_t *arena, size_t size) {
+    /* @param: size est la taille demandée, arrondie à l'alignement maximal
+    *  @return: la zone, valide jusqu'à arena_reset ou arena_free, NULL si la mémoire manque
+    */
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    arena_block *block = arena->head;
+    if (block && block->size - block->used >= size) {
+        void *data = block->data + block->used;
+        block->used += size;
+        return data;
+    }
+
+    // Une grande zone a son propre bloc, placé derrière le bloc courant qui reste utilisable
+    size_t capacity = size > arena->block_size / 4 ? size : arena->block_size;
+    arena_block *fresh = malloc(sizeof(arena_block) + capacity);
+    if (!fresh) {
+        perror("Erreur d'allocation mémoire pour une arène");
+        return NULL;
+    }
+    fresh->size = capacity;
+    fresh->used = size;
+    if (block && capacity != arena->block_size) {
+        fresh->next = block->next;
+        block->next = fresh;
+    } else {
+        fresh->next = block;
+        arena->head = fresh;
+    }
+    return fresh->data;
+}
+
+// Fonction pour copier une chaîne dans une arène
+char *arena_strdup(arena_t *arena, const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = arena_alloc(arena, len);
+    if (copy) {
+        memcpy(copy, s, len);
+    }
+    return copy;
+}
+
+// Fonction pour vider une arène en gardant son bloc courant
+void arena_reset(arena_t *arena) {
+    arena_block *block = arena->head;
+    if (!block) {
+        return;
+    }
+    arena_block *next = block->next;
+    while (next) {
+        arena_block *following = next->next;
+        free(next);
+        next = following;
+    }
+    block->next = NULL;
+    block->used = 0;
+}
+
+// Fonction pour libérer tous les blocs d'une arène
+void arena_free(arena_t *arena) {
+    arena_reset(arena);
+    free(arena->head);
+    arena->head = NULL;
+}
+
+// Fonction pour initialiser une réserve de tampons
+int buffer_pool_init(buffer_pool *pool, size_t size, size_t align, size_t keep) {
+    /* @param: size est la taille de chaque tampon, align une puissance de 2 (au moins sizeof(void *))
+    *           keep borne la mémoire gardée quand les tampons sont rendus
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    memset(pool, 0, sizeof(*pool));
+    pool->size = size;
+    pool->align = align < sizeof(void *) ? sizeof(void *) : align;
+    pool->keep = keep;
+    pool->free_list = malloc(sizeof(void *) * (keep ? keep : 1));
+    if (!pool->free_list) {
+        perror("Erreur d'allocation mémoire pour une réserve de tampons");
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    return 0;
+}
+
+// Fonction pour obtenir un tampon (recyclé si possible)
+void *buffer_pool_get(buffer_pool *pool) {
+    /* @return: un tampon de pool->size octets au contenu indéfini, NULL si la mémoire manque
+    */
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count > 0) {
+        void *buffer = pool->free_list[--pool->free_count];
+        pthread_mutex_unlock(&pool->lock);
+        return buffer;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    void *buffer = NULL;
+    if (posix_memalign(&buffer, pool->align, pool->size) != 0) {
+        fprintf(stderr, "Erreur d'allocation mémoire pour un tampon de %zu octets.\n", pool->size);
+        return NULL;
+    }
+    return buffer;
+}
+
+// Fonction pour rendre un tampon à la réserve
+void buffer_pool_put(buffer_pool *pool, void *buffer) {
+    if (!buffer) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (pool->free_count < pool->keep) {
+        pool->free_list[pool->free_count++] = buffer;
+        buffer = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    free(buffer);
+}
+
+// Fonction pour libérer la réserve et ses tampons libres
+void buffer_pool_destroy(buffer_pool *pool) {
+    for (size_t i = 0; i < pool->free_count; i++) {
+        free(pool->free_list[i]);
+    }
+    free(pool->free_list);
+    pthread_mutex_destroy(&pool->lock);
+    memset(pool, 0, sizeof(*pool));
+}
@@ -0,0 +1,59 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdalign.h>
+#include <pthread.h>
+
+// Alignement des tampons d'E/S : une page, comme l'exigent O_DIRECT et les tampons enregistrés du noyau
+#define POOL_IO_ALIGN 4096
+// Taille par défaut d'un bloc d'arène
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Bloc d'une arène ; les données suivent l'en-tête
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t size;  // Capacité des données
+    size_t used;  // Octets déjà distribués
+    alignas(max_align_t) unsigned char data[];
+} arena_block;
+
+// Arène : allocations par simple avancée dans de grands blocs, libérées toutes ensemble.
+// Pour les métadonnées qui vivent autant qu'un fichier ou qu'une sauvegarde (chemins, entrées).
+typedef struct {
+    arena_block *head;  // Bloc courant, les blocs pleins suivent
+    size_t block_size;  // Taille des nouveaux blocs
+} arena_t;
+
+// Réserve de tampons de même taille et alignés, recyclés entre threads : un tampon rendu
+// est redonné tel quel, sans repasser par malloc
+typedef struct {
+    size_t size;        // Taille d'un tampon
+    size_t align;       // Alignement des tampons
+    size_t keep;        // Nombre maximal de tampons libres conservés (au-delà, ils sont libérés)
+    void **free_list;   // Tampons libres
+    size_t free_count;
+    pthread_mutex_t lock;
+} buffer_pool;
+
+// Fonction pour initialiser une arène vide (block_size 0 : ARENA_BLOCK_SIZE)
+void arena_init(arena_t *arena, size_t block_size);
+// Fonction pour allouer une zone alignée dans une arène
+void *arena_alloc(arena_t *arena, size_t size);
+// Fonction pour copier une chaîne dans une arène
+char *arena_strdup(arena_t *arena, const char *s);
+// Fonction pour vider une arène en gardant son bloc courant
+void arena_reset(arena_t *arena);
+// Fonction pour libérer tous les blocs d'une arène
+void arena_free(arena_t *arena);
+
+// Fonction pour initialiser une réserve de tampons
+int buffer_pool_init(buffer_pool *pool, size_t size, size_t align, size_t keep);
+// Fonction pour obtenir un tampon (recyclé si possible)
+void *buffer_pool_get(buffer_pool *pool);
+// Fonction pour rendre un tampon à la réserve
+void buffer_pool_put(buffer_pool *pool, void *buffer);
+// Fonction pour libérer la réserve et ses tampons libres
+void buffer_pool_destroy(buffer_pool *pool);
+
+#endif // POOL_H
@@ -0,0 +1,552 @@
+#include "prefetch.h"
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Opérations lancées par le moteur
+typedef enum {
+    TASK_OPEN,
+    TASK_READ,
+    TASK_CLOSE,
+    TASK_WAKE   // Lecture de l'eventfd de réveil (io_uring)
+} task_op;
+
+// Opération préparée sous le verrou et exécutée sans lui
+typedef struct {
+    task_op op;
+    int stream;       // Indice dans streams
+    int segment;
+    const char *path;
+    int fd;
+    void *buffer;
+    size_t len;
+    uint64_t offset;
+} prefetch_task;
+
+// Réveil du moteur après un changement fait par un lecteur (segment consommé, fichier rendu)
+static void wake_engine(prefetcher *io) {
+    if (io->backend == IO_BACKEND_THREADS) {
+        pthread_cond_signal(&io->work);
+        return;
+    }
+    // Un seul réveil en attente suffit : le moteur réexamine tous les fichiers à chaque tour
+    if (!io->wake_sent) {
+        uint64_t one = 1;
+        io->wake_sent = true;
+        if (write(io->event_fd, &one, sizeof(one)) < 0) {
+            io->wake_sent = false;
+        }
+    }
+}
+
+static void free_stream(prefetcher *io, prefetch_stream *stream) {
+    for (int i = 0; i < PREFETCH_SEGMENTS; i++) {
+        stream->segments[i].state = SEGMENT_FREE;
+    }
+    stream->state = STREAM_FREE;
+    io->active--;
+    if (io->backend == IO_BACKEND_THREADS) {
+        pthread_cond_broadcast(&io->work);
+    }
+}
+
+// Remise aux lecteurs des fichiers ouverts, dans l'ordre d'arrivée : l'écrivain du pipeline attend
+// les fichiers dans cet ordre, un fichier plus récent ne doit pas occuper un lecteur avant eux
+static void deliver(prefetcher *io) {
+    while (io->next_delivery < io->next_order) {
+        prefetch_stream *stream = &io->streams[io->next_delivery % PREFETCH_MAX_FILES];
+        if (stream->state == STREAM_OPENING) {
+            break;
+        }
+        // La file des lecteurs peut contenir tous les fichiers ouverts : l'ajout ne bloque pas
+        queue_push(io->ready, stream);
+        io->next_delivery++;
+    }
+}
+
+// Acceptation des fichiers confiés tant qu'il reste une place ; sans fichier en vol, on attend
+// le suivant sans tenir le verrou
+static void accept_jobs(prefetcher *io) {
+    while (!io->input_closed && !io->popping) {
+        prefetch_stream *stream = &io->streams[io->next_order % PREFETCH_MAX_FILES];
+        if (stream->state != STREAM_FREE) {
+            break;
+        }
+        void *job = NULL;
+        int got;
+        if (io->active == 0) {
+            io->popping = true;
+            pthread_mutex_unlock(&io->lock);
+            job = queue_pop(io->input);
+            pthread_mutex_lock(&io->lock);
+            io->popping = false;
+            got = job ? 1 : -1;
+        } else {
+            got = queue_try_pop(io->input, &job);
+        }
+        if (got == 0) {
+            break;
+        }
+        if (got < 0) {
+            io->input_closed = true;
+            if (io->backend == IO_BACKEND_THREADS) {
+                pthread_cond_broadcast(&io->work);
+            }
+            break;
+        }
+
+        stream->job = job;
+        stream->path = io->path_of(job, &stream->size_hint);
+        stream->order = io->next_order++;
+        stream->state = STREAM_OPENING;
+        stream->started = false;
+        stream->fd = -1;
+        stream->error = 0;
+        stream->eof = false;
+        stream->eof_seq = 0;
+        stream->next_seq = 0;
+        stream->read_seq = 0;
+        stream->reads = 0;
+        io->active++;
+        if (io->backend == IO_BACKEND_THREADS) {
+            pthread_cond_signal(&io->work);
+        }
+    }
+}
+
+// Prochaine lecture d'un fichier ouvert : suite d'une lecture courte, sinon segment suivant s'il est libre.
+// Au-delà de la taille relevée par le parcours, une seule lecture d'essai, lancée quand les autres sont finies.
+static bool next_read(prefetch_stream *stream, prefetch_task *task) {
+    prefetch_segment *segment = NULL;
+    for (int i = 0; i < PREFETCH_SEGMENTS; i++) {
+        if (stream->segments[i].state == SEGMENT_QUEUED) {
+            segment = &stream->segments[i];
+            break;
+        }
+    }
+    if (!segment) {
+        prefetch_segment *next = &stream->segments[stream->next_seq % PREFETCH_SEGMENTS];
+        uint64_t offset = stream->next_seq * PREFETCH_SEGMENT_SIZE;
+        if (stream->eof || next->state != SEGMENT_FREE || (offset >= stream->size_hint && stream->reads > 0)) {
+            return false;
+        }
+        segment = next;
+        segment->seq = stream->next_seq++;
+        segment->filled = 0;
+        segment->pos = 0;
+    }
+    segment->state = SEGMENT_READING;
+    stream->reads++;
+    task->op = TASK_READ;
+    task->segment = (int)(segment - stream->segments);
+    task->fd = stream->fd;
+    task->buffer = segment->data + segment->filled;
+    task->len = PREFETCH_SEGMENT_SIZE - segment->filled;
+    task->offset = segment->seq * PREFETCH_SEGMENT_SIZE + segment->filled;
+    return true;
+}
+
+// Prochaine opération à lancer, en servant d'abord les fichiers les plus anciens
+static bool next_task(prefetcher *io, prefetch_task *task) {
+    uint64_t first = io->next_order > PREFETCH_MAX_FILES ? io->next_order - PREFETCH_MAX_FILES : 0;
+    for (uint64_t order = first; order < io->next_order; order++) {
+        int index = (int)(order % PREFETCH_MAX_FILES);
+        prefetch_stream *stream = &io->streams[index];
+        if (stream->order != order) {
+            continue;
+        }
+        task->stream = index;
+        switch (stream->state) {
+        case STREAM_OPENING:
+            if (!stream->started) {
+                stream->started = true;
+                task->op = TASK_OPEN;
+                task->path = stream->path;
+                return true;
+            }
+            break;
+        case STREAM_OPEN:
+            if (stream->fd >= 0 && stream->error == 0 && next_read(stream, task)) {
+                return true;
+            }
+            break;
+        case STREAM_RELEASED:
+            if (stream->reads > 0) {
+                break;
+            }
+            if (stream->fd < 0) {
+                free_stream(io, stream);
+                break;
+            }
+            stream->state = STREAM_CLOSING;
+            task->op = TASK_CLOSE;
+            task->fd = stream->fd;
+            return true;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+// Résultat d'une opération (res : valeur de l'appel système, ou -errno)
+static void complete(prefetcher *io, const prefetch_task *task, long res) {
+    if (task->op == TASK_WAKE) {
+        io->event_armed = false;
+        io->wake_sent = false;
+        return;
+    }
+    prefetch_stream *stream = &io->streams[task->stream];
+    if (task->op == TASK_OPEN) {
+        stream->started = false;
+        stream->state = STREAM_OPEN;
+        if (res < 0) {
+            stream->error = (int)-res;
+        } else {
+            stream->fd = (int)res;
+        }
+        deliver(io);
+        return;
+    }
+    if (task->op == TASK_CLOSE) {
+        free_stream(io, stream);
+        return;
+    }
+
+    prefetch_segment *segment = &stream->segments[task->segment];
+    stream->reads--;
+    if (stream->state == STREAM_RELEASED || (stream->eof && segment->seq >= stream->eof_seq)) {
+        // Fichier abandonné par son lecteur, ou lecture au-delà de la fin
+        segment->state = SEGMENT_FREE;
+        return;
+    }
+    if (res == -EINTR || res == -EAGAIN) {
+        segment->state = SEGMENT_QUEUED;
+        return;
+    }
+    if (res < 0) {
+        segment->state = SEGMENT_FREE;
+        stream->error = (int)-res;
+        pthread_cond_broadcast(&io->segment_ready);
+        return;
+    }
+
+    // Une lecture courte qui atteint la taille relevée est la fin du fichier ; avant, on lit la suite
+    segment->filled += (size_t)res;
+    uint64_t end = segment->seq * PREFETCH_SEGMENT_SIZE + segment->filled;
+    if (res == 0 || (segment->filled < PREFETCH_SEGMENT_SIZE && end >= stream->size_hint)) {
+        uint64_t eof_seq = segment->filled ? segment->seq + 1 : segment->seq;
+        if (!stream->eof || eof_seq < stream->eof_seq) {
+            stream->eof = true;
+            stream->eof_seq = eof_seq;
+        }
+        segment->state = segment->filled ? SEGMENT_READY : SEGMENT_FREE;
+    } else {
+        segment->state = segment->filled == PREFETCH_SEGMENT_SIZE ? SEGMENT_READY : SEGMENT_QUEUED;
+    }
+    if (segment->state != SEGMENT_QUEUED) {
+        pthread_cond_broadcast(&io->segment_ready);
+    }
+}
+
+// Exécution bloquante d'une opération (moteur threads)
+static long run_task(const prefetch_task *task) {
+    long res;
+    switch (task->op) {
+    case TASK_OPEN:
+        res = open(task->path, O_RDONLY | O_CLOEXEC);
+        break;
+    case TASK_READ:
+        res = pread(task->fd, task->buffer, task->len, (off_t)task->offset);
+        break;
+    default:
+        res = close(task->fd);
+        break;
+    }
+    return res < 0 ? -errno : res;
+}
+
+static void *thread_main(void *arg) {
+    prefetcher *io = arg;
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        accept_jobs(io);
+        if (io->input_closed && io->active == 0) {
+            break;
+        }
+        prefetch_task task;
+        if (next_task(io, &task)) {
+            // Un autre thread prend l'opération suivante s'il y en a une
+            pthread_cond_signal(&io->work);
+            pthread_mutex_unlock(&io->lock);
+            long res = run_task(&task);
+            pthread_mutex_lock(&io->lock);
+            complete(io, &task, res);
+            continue;
+        }
+        pthread_cond_wait(&io->work, &io->lock);
+    }
+    pthread_cond_broadcast(&io->work);
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+// Identifiant d'une opération dans l'anneau : fichier, segment et type
+static uint64_t task_id(const prefetch_task *task) {
+    return ((uint64_t)task->stream << 16) | ((uint64_t)task->segment << 8) | (uint64_t)task->op;
+}
+
+static void prepare_sqe(prefetcher *io, struct io_uring_sqe *sqe, const prefetch_task *task) {
+    switch (task->op) {
+    case TASK_OPEN:
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)task->path;
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        break;
+    case TASK_READ:
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = task->fd;
+        sqe->addr = (uint64_t)(uintptr_t)task->buffer;
+        sqe->len = (uint32_t)task->len;
+        sqe->off = task->offset;
+        break;
+    case TASK_CLOSE:
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = task->fd;
+        break;
+    case TASK_WAKE:
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = io->event_fd;
+        sqe->addr = (uint64_t)(uintptr_t)&io->event_value;
+        sqe->len = sizeof(io->event_value);
+        break;
+    }
+    sqe->user_data = task_id(task);
+}
+
+// Moteur io_uring : un seul thread prépare les ouvertures, lectures et fermetures de tous les fichiers,
+// les soumet par lots en un appel système et traite les complétions
+static void *uring_main(void *arg) {
+    prefetcher *io = arg;
+    pthread_mutex_lock(&io->lock);
+    for (;;) {
+        accept_jobs(io);
+        if (io->input_closed && io->active == 0) {
+            break;
+        }
+        // Une place reste toujours libre pour la lecture de l'eventfd
+        prefetch_task task;
+        while (io->ops + 1 < io->ring.entries && next_task(io, &task)) {
+            prepare_sqe(io, uring_get_sqe(&io->ring), &task);
+            io->ops++;
+        }
+        if (!io->event_armed) {
+            task.op = TASK_WAKE;
+            task.stream = 0;
+            task.segment = 0;
+            prepare_sqe(io, uring_get_sqe(&io->ring), &task);
+            io->ops++;
+            io->event_armed = true;
+        }
+        pthread_mutex_unlock(&io->lock);
+        uring_submit(&io->ring, 1);
+        pthread_mutex_lock(&io->lock);
+
+        struct io_uring_cqe cqe;
+        while (uring_next_cqe(&io->ring, &cqe)) {
+            task.op = (task_op)(cqe.user_data & 0xff);
+            task.segment = (int)((cqe.user_data >> 8) & 0xff);
+            task.stream = (int)(cqe.user_data >> 16);
+            io->ops--;
+            complete(io, &task, cqe.res);
+        }
+    }
+
+    // La lecture de l'eventfd est menée à son terme : le noyau n'écrira plus dans event_value
+    while (io->event_armed) {
+        wake_engine(io);
+        pthread_mutex_unlock(&io->lock);
+        uring_submit(&io->ring, 1);
+        pthread_mutex_lock(&io->lock);
+        struct io_uring_cqe cqe;
+        while (uring_next_cqe(&io->ring, &cqe)) {
+            if ((cqe.user_data & 0xff) == TASK_WAKE) {
+                io->event_armed = false;
+            }
+        }
+    }
+    pthread_mutex_unlock(&io->lock);
+    return NULL;
+}
+
+static void prefetch_free(prefetcher *io) {
+    if (io->backend == IO_BACKEND_URING) {
+        uring_free(&io->ring);
+        close(io->event_fd);
+    }
+    free(io->threads);
+    free(io->memory);
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->segment_ready);
+    pthread_cond_destroy(&io->work);
+    free(io);
+}
+
+// Fonction pour démarrer la lecture anticipée des fichiers confiés à input
+int prefetch_start(prefetcher **out, io_backend backend, bounded_queue *input, bounded_queue *ready,
+                   prefetch_path_fn path_of) {
+    /* @param: backend est IO_BACKEND_URING ou IO_BACKEND_THREADS (io_uring indisponible : threads)
+    *           input contient les fichiers confiés, ready reçoit les prefetch_stream ouverts
+    *           et doit pouvoir contenir PREFETCH_MAX_FILES éléments
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    prefetcher *io = calloc(1, sizeof(prefetcher));
+    if (!io) {
+        perror("Erreur d'allocation mémoire pour la lecture anticipée");
+        return -1;
+    }
+    io->input = input;
+    io->ready = ready;
+    io->path_of = path_of;
+    io->event_fd = -1;
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->segment_ready, NULL);
+    pthread_cond_init(&io->work, NULL);
+
+    void *memory = NULL;
+    if (posix_memalign(&memory, POOL_IO_ALIGN, (size_t)PREFETCH_MAX_FILES * PREFETCH_SEGMENTS * PREFETCH_SEGMENT_SIZE) != 0) {
+        fprintf(stderr, "Erreur d'allocation mémoire pour les segments de lecture anticipée.\n");
+        prefetch_free(io);
+        return -1;
+    }
+    io->memory = memory;
+    for (int i = 0; i < PREFETCH_MAX_FILES; i++) {
+        io->streams[i].owner = io;
+        io->streams[i].order = UINT64_MAX;
+        for (int j = 0; j < PREFETCH_SEGMENTS; j++) {
+            io->streams[i].segments[j].data = io->memory + ((size_t)i * PREFETCH_SEGMENTS + j) * PREFETCH_SEGMENT_SIZE;
+        }
+    }
+
+    io->backend = io_backend_effective(backend);
+    if (io->backend == IO_BACKEND_URING) {
+        if (uring_init(&io->ring, URING_QUEUE_DEPTH) != 0) {
+            perror("Erreur lors de la création de l'anneau io_uring, E/S confiées à des threads");
+            io->backend = IO_BACKEND_THREADS;
+        } else if ((io->event_fd = eventfd(0, EFD_CLOEXEC)) < 0) {
+            perror("Erreur lors de la création de l'eventfd, E/S confiées à des threads");
+            uring_free(&io->ring);
+            io->backend = IO_BACKEND_THREADS;
+        }
+    }
+
+    int wanted = io->backend == IO_BACKEND_URING ? 1 : PREFETCH_THREADS;
+    io->threads = malloc(sizeof(pthread_t) * wanted);
+    if (!io->threads) {
+        perror("Erreur d'allocation mémoire pour les threads d'E/S");
+        prefetch_free(io);
+        return -1;
+    }
+    for (int i = 0; i < wanted; i++) {
+        if (pthread_create(&io->threads[i], NULL, io->backend == IO_BACKEND_URING ? uring_main : thread_main, io) != 0) {
+            perror("Erreur lors de la création d'un thread d'E/S");
+            break;
+        }
+        io->thread_count++;
+    }
+    if (io->thread_count == 0) {
+        prefetch_free(io);
+        return -1;
+    }
+    *out = io;
+    return 0;
+}
+
+// Fonction pour attendre la fin du moteur (input fermée, tous les fichiers rendus) et le libérer
+void prefetch_finish(prefetcher *io) {
+    for (int i = 0; i < io->thread_count; i++) {
+        pthread_join(io->threads[i], NULL);
+    }
+    prefetch_free(io);
+}
+
+// Fonction qui renvoie le fichier confié correspondant à un fichier ouvert
+void *prefetch_job(const prefetch_stream *stream) {
+    return stream->job;
+}
+
+// Fonction qui renvoie l'errno de l'ouverture d'un fichier, 0 s'il est ouvert
+int prefetch_error(const prefetch_stream *stream) {
+    return stream->fd < 0 ? stream->error : 0;
+}
+
+// Fonction pour lire la suite d'un fichier ouvert
+long prefetch_read(prefetch_stream *stream, void *buffer, size_t size) {
+    /* @param: stream vient de la file ready ; un seul lecteur le lit
+    *  @return: le nombre d'octets copiés dans buffer (au moins un segment disponible, sans attendre
+    *           les suivants), 0 en fin de fichier, -1 en cas d'erreur de lecture (errno est positionné)
+    */
+    prefetcher *io = stream->owner;
+    size_t done = 0;
+    pthread_mutex_lock(&io->lock);
+    while (done < size) {
+        if (stream->error) {
+            if (done == 0) {
+                errno = stream->error;
+                pthread_mutex_unlock(&io->lock);
+                return -1;
+            }
+            break;
+        }
+        if (stream->eof && stream->read_seq >= stream->eof_seq) {
+            break;
+        }
+        prefetch_segment *segment = &stream->segments[stream->read_seq % PREFETCH_SEGMENTS];
+        if (segment->state != SEGMENT_READY || segment->seq != stream->read_seq) {
+            if (done > 0) {
+                break;
+            }
+            pthread_cond_wait(&io->segment_ready, &io->lock);
+            continue;
+        }
+
+        // Un segment prêt n'appartient qu'au lecteur : la copie se fait sans le verrou
+        pthread_mutex_unlock(&io->lock);
+        size_t n = segment->filled - segment->pos;
+        if (n > size - done) {
+            n = size - done;
+        }
+        memcpy((unsigned char *)buffer + done, segment->data + segment->pos, n);
+        segment->pos += n;
+        done += n;
+        pthread_mutex_lock(&io->lock);
+        if (segment->pos == segment->filled) {
+            segment->state = SEGMENT_FREE;
+            stream->read_seq++;
+            wake_engine(io);
+        }
+    }
+    pthread_mutex_unlock(&io->lock);
+    return (long)done;
+}
+
+// Fonction pour rendre un fichier lu (ou abandonné) au moteur, qui le ferme
+void prefetch_release(prefetch_stream *stream) {
+    prefetcher *io = stream->owner;
+    pthread_mutex_lock(&io->lock);
+    // Les segments en cours de lecture seront libérés à leur complétion
+    for (int i = 0; i < PREFETCH_SEGMENTS; i++) {
+        if (stream->segments[i].state != SEGMENT_READING) {
+            stream->segments[i].state = SEGMENT_FREE;
+        }
+    }
+    stream->state = STREAM_RELEASED;
+    wake_engine(io);
+    pthread_mutex_unlock(&io->lock);
+}
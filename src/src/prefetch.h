@@ -0,0 +1,112 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "queue.h"
+#include "uring.h"
+
+// Lecture anticipée des fichiers sources (--io uring|threads) : un moteur d'E/S ouvre de nombreux
+// fichiers à la fois et lit leurs premiers segments pendant que les lecteurs du pipeline découpent
+// et hachent. Les fichiers sont remis aux lecteurs dans l'ordre où ils ont été confiés.
+
+// Nombre de fichiers ouverts en même temps
+#define PREFETCH_MAX_FILES 64
+// Segments lus d'avance par fichier, et leur taille
+#define PREFETCH_SEGMENTS 4
+#define PREFETCH_SEGMENT_SIZE (128u * 1024u)
+// Threads d'E/S bloquantes du moteur de repli
+#define PREFETCH_THREADS 16
+
+// Fonction qui donne le chemin d'un fichier confié et sa taille relevée par le parcours
+typedef const char *(*prefetch_path_fn)(void *job, uint64_t *size);
+
+typedef enum {
+    SEGMENT_FREE,
+    SEGMENT_QUEUED,  // Lecture (ou suite d'une lecture courte) à lancer
+    SEGMENT_READING,
+    SEGMENT_READY    // Données disponibles pour le lecteur
+} prefetch_segment_state;
+
+typedef struct {
+    unsigned char *data;
+    size_t filled;   // Octets lus
+    size_t pos;      // Octets déjà rendus au lecteur
+    uint64_t seq;    // Rang du segment dans le fichier
+    prefetch_segment_state state;
+} prefetch_segment;
+
+typedef enum {
+    STREAM_FREE,
+    STREAM_OPENING,  // Ouverture à lancer ou en cours
+    STREAM_OPEN,     // Ouvert (ou en échec) : remis ou à remettre à un lecteur
+    STREAM_RELEASED, // Rendu par le lecteur, à fermer une fois ses lectures terminées
+    STREAM_CLOSING
+} prefetch_stream_state;
+
+struct prefetcher;
+
+// Fichier ouvert par le moteur ; les segments sont lus dans l'ordre par un seul lecteur
+typedef struct {
+    struct prefetcher *owner;
+    void *job;
+    const char *path;
+    uint64_t size_hint;  // Taille relevée par le parcours : au-delà, une seule lecture d'essai
+    uint64_t order;      // Rang d'arrivée
+    prefetch_stream_state state;
+    bool started;        // Ouverture ou fermeture lancée
+    int fd;
+    int error;           // errno de l'ouverture ou d'une lecture (0 : aucun)
+    bool eof;            // Fin de fichier atteinte au segment eof_seq
+    uint64_t eof_seq;
+    uint64_t next_seq;   // Prochain segment à lire
+    uint64_t read_seq;   // Prochain segment à rendre au lecteur
+    int reads;           // Lectures en vol
+    prefetch_segment segments[PREFETCH_SEGMENTS];
+} prefetch_stream;
+
+// Moteur de lecture anticipée
+typedef struct prefetcher {
+    io_backend backend;
+    bounded_queue *input;   // Fichiers confiés (le moteur en est le seul consommateur)
+    bounded_queue *ready;   // Fichiers ouverts, pris par les lecteurs
+    prefetch_path_fn path_of;
+    pthread_mutex_t lock;
+    pthread_cond_t segment_ready; // Lecteurs en attente d'un segment
+    pthread_cond_t work;          // Threads d'E/S en attente d'une opération (moteur threads)
+    // Le fichier de rang k occupe streams[k % PREFETCH_MAX_FILES]
+    prefetch_stream streams[PREFETCH_MAX_FILES];
+    int active;                // Fichiers ouverts ou en cours d'ouverture/fermeture
+    uint64_t next_order;       // Rang du prochain fichier accepté
+    uint64_t next_delivery;    // Rang du prochain fichier à remettre aux lecteurs
+    bool input_closed;
+    bool popping;              // Un thread attend un fichier dans input
+    unsigned char *memory;     // Segments de tous les fichiers
+    // io_uring : un seul thread soumet et récolte ; les lecteurs le réveillent par un eventfd
+    uring_t ring;
+    unsigned ops;              // Opérations en vol dans l'anneau
+    int event_fd;
+    uint64_t event_value;
+    bool event_armed;          // Lecture de l'eventfd en vol
+    bool wake_sent;            // Réveil déjà signalé et pas encore reçu
+    // Threads d'E/S
+    pthread_t *threads;
+    int thread_count;
+} prefetcher;
+
+// Fonction pour démarrer la lecture anticipée des fichiers confiés à input
+int prefetch_start(prefetcher **out, io_backend backend, bounded_queue *input, bounded_queue *ready,
+                   prefetch_path_fn path_of);
+// Fonction pour attendre la fin du moteur (input fermée, tous les fichiers rendus) et le libérer
+void prefetch_finish(prefetcher *io);
+// Fonction qui renvoie le fichier confié correspondant à un fichier ouvert
+void *prefetch_job(const prefetch_stream *stream);
+// Fonction qui renvoie l'errno de l'ouverture d'un fichier, 0 s'il est ouvert
+int prefetch_error(const prefetch_stream *stream);
+// Fonction pour lire la suite d'un fichier ouvert
+long prefetch_read(prefetch_stream *stream, void *buffer, size_t size);
+// Fonction pour rendre un fichier lu (ou abandonné) au moteur, qui le ferme
+void prefetch_release(prefetch_stream *stream);
+
+#endif // PREFETCH_H
@@ -0,0 +1,516 @@
+#include "prune.h"
+#include "backup_manager.h"
+#include "snapshot_index.h"
+#include "files_cache.h"
+#include "catalog.h"
+#include "walker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Pourcentage d'occupation en dessous duquel un pack est réécrit
+unsigned prune_repack_percent = PRUNE_REPACK_DEFAULT;
+
+// Marquage des chunks vivants, partagé par les threads
+typedef struct {
+    chunk_store_t *store;
+    unsigned char *live;       // Un octet par entrée de l'index, posé une seule fois
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned char *pending;    // Digests des arbres à parcourir (pile)
+    size_t pending_count;
+    size_t pending_capacity;
+    int busy;                  // Threads en train de parcourir un arbre
+    bool failed;               // Un arbre est illisible : rien ne doit être supprimé
+    uint64_t trees;
+    uint64_t missing;          // Chunks référencés mais absents du dépôt
+} mark_state;
+
+// Marquage d'un digest : renvoie 1 s'il vient d'être marqué, 0 s'il l'était déjà, -1 s'il est absent
+static int mark_digest(mark_state *state, const unsigned char *digest) {
+    int64_t entry = chunk_index_entry(&state->store->index, digest);
+    if (entry < 0) {
+        return -1;
+    }
+    return __atomic_exchange_n(&state->live[entry], 1, __ATOMIC_RELAXED) == 0;
+}
+
+// Marquage des chunks d'une liste sérialisée (digest puis taille sur 32 bits)
+static void mark_records(mark_state *state, const unsigned char *records, uint32_t count) {
+    size_t record_size = CHUNK_REF_RECORD_SIZE(state->store->digest_len);
+    uint64_t missing = 0;
+    for (uint32_t c = 0; c < count; c++) {
+        if (mark_digest(state, records + (size_t)c * record_size) < 0) {
+            missing++;
+        }
+    }
+    if (missing) {
+        __atomic_fetch_add(&state->missing, missing, __ATOMIC_RELAXED);
+    }
+}
+
+// Marquage d'une liste rangée en objets de liste : chaque objet est marqué puis lu, sauf s'il l'était
+// déjà (liste partagée avec un fichier déjà parcouru). Un objet illisible empêche le nettoyage.
+static int mark_list(mark_state *state, pack_reader *reader, const unsigned char *record, uint32_t levels) {
+    size_t record_size = CHUNK_REF_RECORD_SIZE(state->store->digest_len);
+    int marked = mark_digest(state, record);
+    if (marked < 0) {
+        __atomic_fetch_add(&state->missing, 1, __ATOMIC_RELAXED);
+    }
+    if (marked <= 0) {
+        return 0;
+    }
+    unsigned char *object = chunk_list_load(state->store, reader, record);
+    if (!object) {
+        return -1;
+    }
+    uint32_t count;
+    memcpy(&count, record + state->store->digest_len, sizeof(count));
+    int status = 0;
+    if (levels == 1) {
+        mark_records(state, object, count);
+    }
+    for (uint32_t c = 0; levels > 1 && status == 0 && c < count; c++) {
+        status = mark_list(state, reader, object + (size_t)c * record_size, levels - 1);
+    }
+    free(object);
+    return status;
+}
+
+// Marquage des chunks d'un fichier d'un arbre ou d'un index plat
+static int mark_entry(mark_state *state, pack_reader *reader, const snapshot_index_t *index, const snapshot_entry *entry) {
+    if (entry->list_levels > 0) {
+        return mark_list(state, reader, index->chunks + entry->chunk_offset, entry->list_levels);
+    }
+    mark_records(state, index->chunks + entry->chunk_offset, entry->chunk_count);
+    return 0;
+}
+
+// Ajout d'un arbre à parcourir
+static int push_tree(mark_state *state, const unsigned char *digest) {
+    size_t digest_len = state->store->digest_len;
+    pthread_mutex_lock(&state->lock);
+    if (state->pending_count == state->pending_capacity) {
+        size_t capacity = state->pending_capacity ? state->pending_capacity * 2 : 256;
+        unsigned char *grown = realloc(state->pending, capacity * digest_len);
+        if (!grown) {
+            perror("Erreur d'allocation mémoire pour le marquage");
+            state->failed = true;
+            pthread_cond_broadcast(&state->cond);
+            pthread_mutex_unlock(&state->lock);
+            return -1;
+        }
+        state->pending = grown;
+        state->pending_capacity = capacity;
+    }
+    memcpy(state->pending + state->pending_count * digest_len, digest, digest_len);
+    state->pending_count++;
+    pthread_cond_signal(&state->cond);
+    pthread_mutex_unlock(&state->lock);
+    return 0;
+}
+
+// Marquage d'une racine (arbre d'un manifeste) : elle n'est parcourue que si elle ne l'a pas déjà été
+static int mark_root(mark_state *state, const unsigned char *digest) {
+    int marked = mark_digest(state, digest);
+    if (marked < 0) {
+        char hex[DIGEST_MAX_LENGTH * 2 + 1];
+        digest_to_hex(digest, state->store->digest_len, hex);
+        fprintf(stderr, "Arbre %s absent du dépôt.\n", hex);
+        return -1;
+    }
+    return marked ? push_tree(state, digest) : 0;
+}
+
+// Parcours d'un arbre : ses fichiers sont marqués, ses sous-répertoires encore non marqués sont empilés.
+// Un sous-arbre déjà marqué (inchangé depuis une autre sauvegarde) n'est jamais relu.
+static int mark_tree(mark_state *state, pack_reader *reader, const unsigned char *digest) {
+    snapshot_index_t tree;
+    if (snapshot_tree_read(&tree, state->store, reader, digest) != 0) {
+        return -1;
+    }
+    int status = 0;
+    for (size_t i = 0; status == 0 && i < tree.count; i++) {
+        const snapshot_entry *entry = &tree.entries[i];
+        if (S_ISDIR(entry->mode)) {
+            status = mark_root(state, entry->digest);
+        } else {
+            status = mark_entry(state, reader, &tree, entry);
+        }
+    }
+    snapshot_index_close(&tree);
+    __atomic_fetch_add(&state->trees, 1, __ATOMIC_RELAXED);
+    return status;
+}
+
+// Thread du marquage : les arbres sont pris dans la pile jusqu'à ce qu'elle soit vide et que
+// plus aucun thread ne puisse y ajouter de sous-répertoire
+static void *mark_worker(void *arg) {
+    mark_state *state = arg;
+    size_t digest_len = state->store->digest_len;
+    unsigned char digest[DIGEST_MAX_LENGTH];
+    pack_reader reader;
+    pack_reader_init(&reader);
+    for (;;) {
+        pthread_mutex_lock(&state->lock);
+        while (state->pending_count == 0 && state->busy > 0 && !state->failed) {
+            pthread_cond_wait(&state->cond, &state->lock);
+        }
+        if (state->pending_count == 0 || state->failed) {
+            pthread_cond_broadcast(&state->cond);
+            pthread_mutex_unlock(&state->lock);
+            break;
+        }
+        state->pending_count--;
+        memcpy(digest, state->pending + state->pending_count * digest_len, digest_len);
+        state->busy++;
+        pthread_mutex_unlock(&state->lock);
+
+        int status = mark_tree(state, &reader, digest);
+
+        pthread_mutex_lock(&state->lock);
+        state->busy--;
+        if (status != 0) {
+            state->failed = true;
+        }
+        if (state->failed || (state->pending_count == 0 && state->busy == 0)) {
+            pthread_cond_broadcast(&state->cond);
+        }
+        pthread_mutex_unlock(&state->lock);
+    }
+    pack_reader_free(&reader);
+    return NULL;
+}
+
+// Marquage d'une sauvegarde à index plat (.backup_index)
+static int mark_flat_index(mark_state *state, const char *index_path) {
+    snapshot_index_t index;
+    if (snapshot_index_open(&index, index_path) != 0) {
+        return -1;
+    }
+    if (index.digest_len != state->store->digest_len) {
+        fprintf(stderr, "L'index %s ne correspond pas au dépôt.\n", index_path);
+        snapshot_index_close(&index);
+        return -1;
+    }
+    int status = 0;
+    for (size_t i = 0; status == 0 && i < index.count; i++) {
+        status = mark_entry(state, &state->store->reader, &index, &index.entries[i]);
+    }
+    snapshot_index_close(&index);
+    return status;
+}
+
+// Marquage d'une sauvegarde antérieure à l'index binaire : une recette par fichier, listées par .backup_log
+static int mark_backup_log(mark_state *state, const char *backup_path, const char *log_path) {
+    log_t logs = read_backup_log(log_path);
+    for (log_element *current = logs.head; current && !state->failed; current = current->next) {
+        char *recipe_path = strncmp(current->path, backup_path, strlen(backup_path)) == 0
+                            ? strdup(current->path) : walk_join(backup_path, current->path);
+        if (!recipe_path) {
+            state->failed = true;
+            break;
+        }
+        // Les répertoires du journal n'ont pas de recette ; toute autre entrée illisible empêche le nettoyage
+        struct stat recipe_stat;
+        if (stat(recipe_path, &recipe_stat) == 0 && S_ISDIR(recipe_stat.st_mode)) {
+            free(recipe_path);
+            continue;
+        }
+        FILE *file = fopen(recipe_path, "rb");
+        recipe_t recipe;
+        int lue = file ? read_recipe(file, &recipe) : -1;
+        if (file) {
+            fclose(file);
+        }
+        if (lue != 0) {
+            fprintf(stderr, "Recette %s illisible.\n", recipe_path);
+            free(recipe_path);
+            state->failed = true;
+            break;
+        }
+        free(recipe_path);
+        for (int c = 0; c < recipe.count; c++) {
+            if (recipe.digest_len != state->store->digest_len || mark_digest(state, recipe.refs[c].digest) < 0) {
+                state->missing++;
+            }
+        }
+        free_recipe(&recipe);
+    }
+    free_backup_log(&logs);
+    return state->failed ? -1 : 0;
+}
+
+// Marquage d'une sauvegarde selon son format
+static int mark_backup(mark_state *state, const char *backup_path) {
+    snapshot_manifest manifest;
+    char *path = NULL;
+    int status = -1;
+    switch (snapshot_format_of(backup_path)) {
+        case SNAPSHOT_FORMAT_MANIFEST:
+            path = walk_join(backup_path, SNAPSHOT_MANIFEST_NAME);
+            if (!path || snapshot_manifest_read(path, &manifest) != 0 || manifest.digest_len != state->store->digest_len) {
+                fprintf(stderr, "Manifeste de %s illisible.\n", backup_path);
+            } else {
+                status = mark_root(state, manifest.root);
+            }
+            break;
+        case SNAPSHOT_FORMAT_FLAT_INDEX:
+            path = walk_join(backup_path, SNAPSHOT_INDEX_NAME);
+            status = path ? mark_flat_index(state, path) : -1;
+            break;
+        case SNAPSHOT_FORMAT_BACKUP_LOG:
+            path = walk_join(backup_path, SNAPSHOT_BACKUP_LOG_NAME);
+            status = path ? mark_backup_log(state, backup_path, path) : -1;
+            break;
+        case SNAPSHOT_FORMAT_NONE:
+            // Sauvegarde inachevée ou répertoire inconnu : ses chunks ne peuvent pas être retrouvés
+            fprintf(stderr, "%s n'a ni manifeste ni index de sauvegarde.\n", backup_path);
+            break;
+    }
+    free(path);
+    return status;
+}
+
+// Recherche des racines : chaque sauvegarde restante de la destination, sauf excluded (--dry-run)
+static int mark_backups(mark_state *state, const char *dest_dir, const char *excluded, size_t *backups) {
+    DIR *dir = opendir(dest_dir);
+    if (!dir) {
+        perror("Erreur lors de l'ouverture du répertoire destination");
+        return -1;
+    }
+    int status = 0;
+    struct dirent *entry;
+    while (status == 0 && (entry = readdir(dir)) != NULL) {
+        // Ignorer les entrées cachées : ".", ".." et le dépôt de chunks
+        if (entry->d_name[0] == '.' || (excluded && strcmp(entry->d_name, excluded) == 0)) {
+            continue;
+        }
+        char *backup_path = walk_join(dest_dir, entry->d_name);
+        struct stat backup_stat;
+        if (!backup_path) {
+            status = -1;
+            break;
+        }
+        if (stat(backup_path, &backup_stat) != 0 || !S_ISDIR(backup_stat.st_mode)) {
+            free(backup_path);
+            continue;
+        }
+        status = mark_backup(state, backup_path);
+        (*backups)++;
+        free(backup_path);
+    }
+    closedir(dir);
+    return status;
+}
+
+// Un chunk du cache des fichiers reste-t-il dans le dépôt après le nettoyage ?
+static bool chunk_survives(const unsigned char *digest, void *arg) {
+    const mark_state *state = arg;
+    int64_t entry = chunk_index_entry(&state->store->index, digest);
+    return entry >= 0 && state->live[entry];
+}
+
+// Retrait du cache des fichiers qui référencent un chunk supprimé : une prochaine sauvegarde
+// ne doit pas reprendre une liste de chunks qui n'existent plus
+static int prune_files_cache(mark_state *state) {
+    files_cache_t cache;
+    if (files_cache_open(&cache, state->store->path, state->store->hash, state->store->digest_len) != 0) {
+        return -1;
+    }
+    int status = 0;
+    if (cache.count > 0 && files_cache_forget(&cache, chunk_survives, state) > 0) {
+        status = files_cache_save(&cache);
+    }
+    files_cache_close(&cache);
+    return status;
+}
+
+// Un chunk de l'index au moins n'est plus référencé par aucune sauvegarde
+static bool chunks_to_delete(const mark_state *state) {
+    for (uint32_t i = 0; i < state->store->index.count; i++) {
+        if (!state->live[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parcours parallèle des arbres empilés
+static int mark_trees(mark_state *state) {
+    int threads = backup_jobs > 0 ? backup_jobs : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > PRUNE_MAX_THREADS) {
+        threads = PRUNE_MAX_THREADS;
+    }
+    pthread_t workers[PRUNE_MAX_THREADS];
+    int started = 0;
+    for (int t = 1; t < threads; t++) {
+        if (pthread_create(&workers[started], NULL, mark_worker, state) != 0) {
+            break;
+        }
+        started++;
+    }
+    // Le thread appelant participe au parcours
+    mark_worker(state);
+    for (int t = 0; t < started; t++) {
+        pthread_join(workers[t], NULL);
+    }
+    return state->failed ? -1 : 0;
+}
+
+// Retrait du catalogue des sauvegardes qui n'existent plus
+static int prune_catalog(const char *dest_dir, const char *store_path) {
+    catalog_t catalog;
+    if (catalog_load(&catalog, store_path) != 0) {
+        return -1;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < catalog.count; i++) {
+        char *backup_path = walk_join(dest_dir, catalog.records[i].name);
+        if (backup_path && access(backup_path, F_OK) == 0) {
+            catalog.records[kept++] = catalog.records[i];
+        }
+        free(backup_path);
+    }
+    int status = 0;
+    if (kept != catalog.count) {
+        catalog.count = kept;
+        status = catalog_write(store_path, &catalog);
+    }
+    catalog_free(&catalog);
+    return status;
+}
+
+// Vérification que backup_id est une sauvegarde de dest_dir, renvoie son nom dans la destination
+static char *backup_name_in(const char *dest_dir, const char *backup_id) {
+    char dest_real[PATH_MAX], parent_real[PATH_MAX];
+    char *parent = store_dir_of_backup(backup_id);
+    if (!parent) {
+        return NULL;
+    }
+    int same = realpath(dest_dir, dest_real) && realpath(parent, parent_real) && strcmp(dest_real, parent_real) == 0;
+    free(parent);
+    if (!same) {
+        fprintf(stderr, "Erreur : '%s' n'est pas une sauvegarde de '%s'.\n", backup_id, dest_dir);
+        return NULL;
+    }
+    if (snapshot_format_of(backup_id) == SNAPSHOT_FORMAT_NONE) {
+        fprintf(stderr, "Erreur : '%s' n'a ni manifeste ni index de sauvegarde.\n", backup_id);
+        return NULL;
+    }
+    char *copy = strdup(backup_id);
+    if (!copy) {
+        return NULL;
+    }
+    size_t len = strlen(copy);
+    while (len > 1 && copy[len - 1] == '/') {
+        copy[--len] = '\0';
+    }
+    char *slash = strrchr(copy, '/');
+    char *name = strdup(slash ? slash + 1 : copy);
+    free(copy);
+    return name;
+}
+
+// Fonction pour supprimer une sauvegarde puis libérer les chunks que plus aucune sauvegarde ne référence
+int prune_backups(const char *dest_dir, const char *backup_id) {
+    /* @param: dest_dir est la destination qui contient les sauvegardes et leur dépôt
+    *           backup_id est le chemin d'une sauvegarde de dest_dir à supprimer d'abord (NULL : aucune)
+    *  @return: 0 en cas de succès, -1 sinon (le dépôt reste alors intact)
+    */
+    char *excluded = NULL;
+    if (backup_id) {
+        excluded = backup_name_in(dest_dir, backup_id);
+        if (!excluded) {
+            return -1;
+        }
+    }
+
+    // Les chunks recopiés sont écrits dans l'ordre, avant le nouvel index : pas d'écriture en arrière-plan.
+    // Le dépôt est verrouillé avant toute suppression : aucune sauvegarde, aucun serveur ni aucune
+    // vérification ne peut l'utiliser pendant le nettoyage
+    io_backend_choice = IO_BACKEND_SYNC;
+    chunk_store_t store;
+    if (store_open_exclusive(&store, dest_dir) != 0) {
+        fprintf(stderr, "Erreur : dépôt de chunks indisponible dans '%s'.\n", dest_dir);
+        free(excluded);
+        return -1;
+    }
+    if (backup_id) {
+        if (dry_run) {
+            printf("La sauvegarde %s serait supprimée.\n", excluded);
+        } else if (supprimer_recursivement(backup_id) != 0) {
+            fprintf(stderr, "Erreur : la sauvegarde %s n'a pas pu être supprimée.\n", backup_id);
+            store_close(&store);
+            free(excluded);
+            return -1;
+        }
+    }
+
+    mark_state state;
+    memset(&state, 0, sizeof(state));
+    state.store = &store;
+    state.live = calloc(store.index.count ? store.index.count : 1, 1);
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.cond, NULL);
+    size_t backups = 0;
+    int status = state.live ? 0 : -1;
+    if (!state.live) {
+        perror("Erreur d'allocation mémoire pour le marquage");
+    }
+    if (status == 0) {
+        status = mark_backups(&state, dest_dir, dry_run ? excluded : NULL, &backups);
+    }
+    if (status == 0) {
+        status = mark_trees(&state);
+    }
+
+    // Le cache des fichiers est allégé avant que les chunks disparaissent
+    if (status == 0 && !dry_run && prune_files_cache(&state) != 0) {
+        fprintf(stderr, "Erreur : le cache des fichiers n'a pas pu être mis à jour.\n");
+        status = -1;
+    }
+
+    // Les caches des fichiers gardés par les clients distants pourraient référencer les chunks supprimés :
+    // une nouvelle génération du dépôt les fait reconstruire
+    if (status == 0 && !dry_run && chunks_to_delete(&state) && store_renew_epoch(&store) != 0) {
+        status = -1;
+    }
+
+    store_sweep_stats stats;
+    if (status != 0) {
+        fprintf(stderr, "Erreur : nettoyage interrompu, aucun chunk n'est supprimé.\n");
+    } else if (store_sweep(&store, state.live, prune_repack_percent, !dry_run, &stats) != 0) {
+        fprintf(stderr, "Erreur : le nettoyage du dépôt a échoué, l'index précédent est conservé.\n");
+        status = -1;
+    } else {
+        if (!dry_run) {
+            prune_catalog(dest_dir, store.path);
+        }
+        if (state.missing) {
+            fprintf(stderr, "Attention : %llu références vers des chunks absents du dépôt.\n",
+                    (unsigned long long)state.missing);
+        }
+        printf("%s : %zu sauvegardes (%llu arbres), %llu chunks conservés, %llu supprimés (%llu octets).\n",
+               dry_run ? "Simulation du nettoyage" : "Nettoyage", backups, (unsigned long long)state.trees,
+               (unsigned long long)stats.live_chunks, (unsigned long long)stats.dead_chunks,
+               (unsigned long long)stats.dead_bytes);
+        printf("Packs : %u supprimés, %u réécrits (%llu octets recopiés), %llu octets libérés.\n",
+               stats.packs_deleted, stats.packs_repacked, (unsigned long long)stats.repacked_bytes,
+               (unsigned long long)stats.freed_bytes);
+    }
+
+    pthread_mutex_destroy(&state.lock);
+    pthread_cond_destroy(&state.cond);
+    free(state.pending);
+    free(state.live);
+    store_close(&store);
+    free(excluded);
+    return status;
+}
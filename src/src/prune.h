@@ -0,0 +1,22 @@
+#ifndef PRUNE_H
+#define PRUNE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Nettoyage d'une destination (--prune) : les chunks référencés par les sauvegardes restantes
+// (et par le cache des fichiers) sont marqués en parcourant leurs arbres, les autres sont retirés
+// de l'index et leurs packs supprimés ou réécrits. Seules les métadonnées sont lues, plus les
+// chunks vivants des packs réécrits. Ne doit pas être lancé pendant une sauvegarde de la même destination.
+
+// Nombre maximal de threads du marquage
+#define PRUNE_MAX_THREADS 64
+
+// Pourcentage d'occupation en dessous duquel un pack est réécrit (--prune-threshold)
+extern unsigned prune_repack_percent;
+
+// Fonction pour supprimer une sauvegarde (si backup_id n'est pas NULL) puis libérer les chunks
+// que plus aucune sauvegarde de dest_dir ne référence
+int prune_backups(const char *dest_dir, const char *backup_id);
+
+#endif // PRUNE_H
@@ -0,0 +1,118 @@
+#include "queue.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Fonction pour initialiser une file de capacité donnée
+int queue_init(bounded_queue *queue, size_t capacity) {
+    void **items = malloc(sizeof(void *) * capacity);
+    if (!items) {
+        perror("Erreur d'allocation mémoire pour la file");
+        return -1;
+    }
+    queue_init_items(queue, items, capacity);
+    queue->owns_items = true;
+    return 0;
+}
+
+// Fonction pour initialiser une file dont le tampon est fourni par l'appelant
+void queue_init_items(bounded_queue *queue, void **items, size_t capacity) {
+    /* @param: items contient capacity pointeurs et doit vivre autant que la file
+    */
+    queue->items = items;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->count = 0;
+    queue->closed = false;
+    queue->owns_items = false;
+    queue->metric = METRIC_QUEUE_NONE;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+}
+
+// Fonction pour libérer une file (qui doit être vide)
+void queue_destroy(bounded_queue *queue) {
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    if (queue->owns_items) {
+        free(queue->items);
+    }
+    queue->items = NULL;
+}
+
+// Fonction pour ajouter un élément, bloque tant que la file est pleine
+int queue_push(bounded_queue *queue, void *item) {
+    /* @return: 0 si l'élément a été ajouté, -1 si la file est fermée
+    */
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->capacity && !queue->closed) {
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return -1;
+    }
+    queue->items[(queue->head + queue->count) % queue->capacity] = item;
+    queue->count++;
+    metrics_queue_depth(queue->metric, queue->count);
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+// Fonction pour retirer un élément, bloque tant que la file est vide
+void *queue_pop(bounded_queue *queue) {
+    /* @return: l'élément le plus ancien, NULL si la file est fermée et vide
+    */
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->count == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return NULL;
+    }
+    void *item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return item;
+}
+
+// Fonction pour retirer un élément s'il y en a un, sans attendre
+int queue_try_pop(bounded_queue *queue, void **item) {
+    /* @param: item reçoit l'élément le plus ancien
+    *  @return: 1 si un élément a été retiré, 0 si la file est vide, -1 si elle est fermée et vide
+    */
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == 0) {
+        int status = queue->closed ? -1 : 0;
+        pthread_mutex_unlock(&queue->lock);
+        return status;
+    }
+    *item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return 1;
+}
+
+// Fonction pour signaler la fin des ajouts : queue_pop renvoie NULL une fois la file vidée
+void queue_close(bounded_queue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// Fonction qui renvoie le nombre d'éléments en attente
+size_t queue_depth(bounded_queue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    size_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
@@ -0,0 +1,40 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "metrics.h"
+
+// File bornée et bloquante entre deux étages d'un pipeline
+typedef struct {
+    void **items;           // Tampon circulaire
+    size_t capacity;        // Nombre maximal d'éléments
+    size_t head;            // Prochain élément à retirer
+    size_t count;           // Nombre d'éléments présents
+    bool closed;            // Plus aucun ajout ne sera fait
+    bool owns_items;        // items a été alloué par queue_init
+    metric_queue metric;    // Profondeur relevée par --stats (METRIC_QUEUE_NONE par défaut)
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} bounded_queue;
+
+// Fonction pour initialiser une file de capacité donnée
+int queue_init(bounded_queue *queue, size_t capacity);
+// Fonction pour initialiser une file dont le tampon est fourni par l'appelant
+void queue_init_items(bounded_queue *queue, void **items, size_t capacity);
+// Fonction pour libérer une file (qui doit être vide)
+void queue_destroy(bounded_queue *queue);
+// Fonction pour ajouter un élément, bloque tant que la file est pleine
+int queue_push(bounded_queue *queue, void *item);
+// Fonction pour retirer un élément, bloque tant que la file est vide
+void *queue_pop(bounded_queue *queue);
+// Fonction pour retirer un élément s'il y en a un, sans attendre
+int queue_try_pop(bounded_queue *queue, void **item);
+// Fonction pour signaler la fin des ajouts : queue_pop renvoie NULL une fois la file vidée
+void queue_close(bounded_queue *queue);
+// Fonction qui renvoie le nombre d'éléments en attente
+size_t queue_depth(bounded_queue *queue);
+
+#endif // QUEUE_H
@@ -0,0 +1,633 @@
+#include "snapshot_index.h"
+#include "file_handler.h"
+#include "walker.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Vérification de l'en-tête et des entrées d'une image d'index, projetée ou en mémoire
+static int index_attach(snapshot_index_t *index, void *image, size_t image_size) {
+    const snapshot_index_header *header = image;
+    uint64_t size = (uint64_t)image_size;
+    if (image_size < sizeof(snapshot_index_header)) {
+        return -1;
+    }
+    size_t record = CHUNK_REF_RECORD_SIZE(header->digest_len);
+    int valid = memcmp(header->magic, SNAPSHOT_INDEX_MAGIC, SNAPSHOT_INDEX_MAGIC_LENGTH) == 0 &&
+                header->version >= 1 && header->version <= SNAPSHOT_INDEX_VERSION &&
+                header->digest_len == hash_digest_length((hash_algo)header->hash) &&
+                header->entries_offset >= sizeof(snapshot_index_header) &&
+                header->entries_offset <= size &&
+                header->entry_count <= (size - header->entries_offset) / sizeof(snapshot_entry) &&
+                header->paths_offset <= size && header->paths_size <= size - header->paths_offset &&
+                header->chunks_offset <= size && header->chunks_size <= size - header->chunks_offset;
+    if (!valid) {
+        return -1;
+    }
+
+    index->map = image;
+    index->map_size = image_size;
+    index->header = header;
+    index->entries = (const snapshot_entry *)((const char *)image + header->entries_offset);
+    index->paths = (const char *)image + header->paths_offset;
+    index->chunks = (const unsigned char *)image + header->chunks_offset;
+    index->count = (size_t)header->entry_count;
+    index->digest_len = header->digest_len;
+
+    // Les entrées sont lues sans copie : on vérifie une fois qu'elles restent dans l'image
+    for (size_t i = 0; i < index->count; i++) {
+        const snapshot_entry *entry = &index->entries[i];
+        if (entry->path_offset + entry->path_len >= header->paths_size ||
+            index->paths[entry->path_offset + entry->path_len] != '\0' ||
+            entry->chunk_offset > header->chunks_size || entry->list_levels > CHUNK_LIST_MAX_LEVELS ||
+            snapshot_entry_records(entry) > (header->chunks_size - entry->chunk_offset) / record) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Fonction pour projeter un index en mémoire et vérifier son en-tête
+int snapshot_index_open(snapshot_index_t *index, const char *path) {
+    /* @param: index reçoit l'index projeté, à libérer avec snapshot_index_close
+    *  @return: 0 en cas de succès, -1 si le fichier est absent ou invalide
+    */
+    memset(index, 0, sizeof(*index));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(snapshot_index_header)) {
+        fprintf(stderr, "Index de sauvegarde invalide : %s\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Erreur lors de la projection de l'index");
+        return -1;
+    }
+
+    if (index_attach(index, map, (size_t)st.st_size) != 0) {
+        fprintf(stderr, "Index de sauvegarde invalide ou corrompu : %s\n", path);
+        munmap(map, (size_t)st.st_size);
+        memset(index, 0, sizeof(*index));
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour vérifier une image d'index déjà en mémoire (allouée avec malloc, libérée avec l'index)
+int snapshot_index_load(snapshot_index_t *index, void *image, size_t size) {
+    /* @return: 0 en cas de succès, -1 si l'image est invalide (elle est alors libérée)
+    */
+    memset(index, 0, sizeof(*index));
+    if (index_attach(index, image, size) != 0) {
+        free(image);
+        memset(index, 0, sizeof(*index));
+        return -1;
+    }
+    index->allocated = true;
+    return 0;
+}
+
+// Fonction pour lire l'arbre d'un répertoire depuis le dépôt
+int snapshot_tree_open(snapshot_index_t *tree, chunk_store_t *store, const unsigned char *id) {
+    /* @param: id est le digest de l'arbre, tel que référencé par le manifeste ou le répertoire parent
+    *  @return: 0 en cas de succès, -1 si l'arbre est absent ou invalide
+    */
+    return snapshot_tree_read(tree, store, &store->reader, id);
+}
+
+// Fonction pour lire l'arbre d'un répertoire avec un lecteur propre au thread appelant
+int snapshot_tree_read(snapshot_index_t *tree, chunk_store_t *store, pack_reader *reader, const unsigned char *id) {
+    /* @param: reader est le lecteur de packs du thread (lectures concurrentes du dépôt)
+    *  @return: 0 en cas de succès, -1 si l'arbre est absent ou invalide
+    */
+    char hex[DIGEST_MAX_LENGTH * 2 + 1];
+    chunk_location location;
+    memset(tree, 0, sizeof(*tree));
+    digest_to_hex(id, store->digest_len, hex);
+    if (!store_lookup(store, id, &location)) {
+        fprintf(stderr, "Arbre %s absent du dépôt.\n", hex);
+        return -1;
+    }
+    void *image = malloc(location.size ? location.size : 1);
+    if (!image) {
+        perror("Erreur d'allocation mémoire pour un arbre");
+        return -1;
+    }
+    long size = store_read(store, reader, id, image, location.size);
+    if (size < 0) {
+        free(image);
+        return -1;
+    }
+    if (snapshot_index_load(tree, image, (size_t)size) != 0 ||
+        !(tree->header->flags & SNAPSHOT_INDEX_TREE) || tree->digest_len != store->digest_len) {
+        fprintf(stderr, "Arbre %s invalide.\n", hex);
+        snapshot_index_close(tree);
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour libérer un index ouvert
+void snapshot_index_close(snapshot_index_t *index) {
+    if (index->allocated) {
+        free(index->map);
+    } else if (index->map) {
+        munmap(index->map, index->map_size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+// Fonction qui renvoie le chemin (relatif à la sauvegarde) d'une entrée
+const char *snapshot_entry_path(const snapshot_index_t *index, const snapshot_entry *entry) {
+    return index->paths + entry->path_offset;
+}
+
+// Fonction pour rechercher un chemin par dichotomie
+const snapshot_entry *snapshot_index_find(const snapshot_index_t *index, const char *path) {
+    /* @return: l'entrée du chemin, NULL s'il n'est pas dans l'index
+    */
+    size_t low = 0, high = index->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int cmp = strcmp(snapshot_entry_path(index, &index->entries[middle]), path);
+        if (cmp == 0) {
+            return &index->entries[middle];
+        }
+        if (cmp < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+// Fonction qui renvoie le nombre d'enregistrements d'une entrée dans la zone des chunks
+uint32_t snapshot_entry_records(const snapshot_entry *entry) {
+    return entry->list_levels ? 1 : entry->chunk_count;
+}
+
+// Fonction pour parcourir les chunks d'une entrée sans les copier
+void snapshot_entry_source(const snapshot_index_t *index, const snapshot_entry *entry, chunk_store_t *store,
+                           pack_reader *reader, chunk_source *source) {
+    /* @param: source lit les références dans les enregistrements de l'index, qui doit rester ouvert, ou
+    *           dans les objets de liste de store avec reader (NULL : le lecteur du dépôt) ; elle est
+    *           libérée avec chunk_source_free
+    */
+    memset(source, 0, sizeof(*source));
+    source->file_size = entry->size;
+    source->hash = (hash_algo)index->header->hash;
+    source->digest_len = index->digest_len;
+    memcpy(source->file_digest, entry->digest, index->digest_len);
+    source->count = entry->chunk_count;
+    source->records = index->chunks + entry->chunk_offset;
+    source->levels = entry->list_levels;
+    source->store = store;
+    source->reader = reader;
+}
+
+// Fonction pour exporter une entrée au format texte de .backup_log
+int snapshot_entry_export(const snapshot_index_t *index, const snapshot_entry *entry, const char *path, FILE *out) {
+    /* @param: path est le chemin complet écrit pour l'entrée
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    // La date est celle de dernière modification du fichier ; strftime ne tronque jamais en silence
+    // (il renvoie 0 si la date ne tient pas), les millisecondes tiennent toujours sur trois chiffres
+    char date[64];
+    time_t seconds = (time_t)(entry->mtime_ns / 1000000000);
+    struct tm tm_info;
+    if (!localtime_r(&seconds, &tm_info)) {
+        return -1;
+    }
+    size_t len = strftime(date, sizeof(date), "%Y-%m-%d-%H:%M:%S", &tm_info);
+    if (len == 0) {
+        return -1;
+    }
+    snprintf(date + len, sizeof(date) - len, ".%03u", (unsigned)(entry->mtime_ns % 1000000000 / 1000000));
+
+    log_element element = {path, {0}, index->digest_len, date, NULL, NULL};
+    memcpy(element.digest, entry->digest, index->digest_len);
+    write_log_element(&element, out);
+    return ferror(out) ? -1 : 0;
+}
+
+// Fonction pour exporter les fichiers de l'index au format texte de .backup_log
+int snapshot_index_export(const snapshot_index_t *index, const char *prefix, FILE *out) {
+    /* @param: prefix est ajouté devant chaque chemin (répertoire de la sauvegarde)
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    for (size_t i = 0; i < index->count; i++) {
+        const snapshot_entry *entry = &index->entries[i];
+        if (S_ISDIR(entry->mode)) {
+            continue;
+        }
+        char *path = malloc(strlen(prefix) + entry->path_len + 2);
+        if (!path) {
+            perror("Erreur d'allocation mémoire pour un chemin");
+            return -1;
+        }
+        sprintf(path, "%s/%s", prefix, snapshot_entry_path(index, entry));
+        int status = snapshot_entry_export(index, entry, path, out);
+        free(path);
+        if (status != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Fonction qui renvoie le format de la sauvegarde d'un répertoire
+snapshot_format snapshot_format_of(const char *backup_path) {
+    /* @return: le format du fichier le plus récent présent, SNAPSHOT_FORMAT_NONE s'il n'y en a aucun
+    */
+    static const struct {
+        const char *name;
+        snapshot_format format;
+    } formats[] = {
+        {SNAPSHOT_MANIFEST_NAME, SNAPSHOT_FORMAT_MANIFEST},
+        {SNAPSHOT_INDEX_NAME, SNAPSHOT_FORMAT_FLAT_INDEX},
+        {SNAPSHOT_BACKUP_LOG_NAME, SNAPSHOT_FORMAT_BACKUP_LOG},
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        char *path = walk_join(backup_path, formats[i].name);
+        int found = path && access(path, F_OK) == 0;
+        free(path);
+        if (found) {
+            return formats[i].format;
+        }
+    }
+    return SNAPSHOT_FORMAT_NONE;
+}
+
+// Fonction pour écrire le manifeste d'une sauvegarde
+int snapshot_manifest_write(const char *path, const snapshot_manifest *manifest) {
+    /* @param: path est l'emplacement du manifeste (écrit dans un fichier temporaire puis renommé)
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    size_t len = strlen(path) + 5;
+    char *tmp_path = malloc(len);
+    if (!tmp_path) {
+        perror("Erreur d'allocation mémoire");
+        return -1;
+    }
+    snprintf(tmp_path, len, "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        perror("Erreur lors de la création du manifeste");
+        free(tmp_path);
+        return -1;
+    }
+    int ok = fwrite(manifest, sizeof(*manifest), 1, file) == 1;
+    if (fclose(file) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp_path, path) != 0) {
+        perror("Erreur d'écriture du manifeste");
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+    free(tmp_path);
+    return 0;
+}
+
+// Fonction pour lire le manifeste d'une sauvegarde
+int snapshot_manifest_read(const char *path, snapshot_manifest *manifest) {
+    /* @return: 0 en cas de succès, -1 si le manifeste est absent ou invalide
+    */
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return -1;
+    }
+    int ok = fread(manifest, sizeof(*manifest), 1, file) == 1;
+    fclose(file);
+    if (!ok || memcmp(manifest->magic, SNAPSHOT_MANIFEST_MAGIC, SNAPSHOT_INDEX_MAGIC_LENGTH) != 0 ||
+        manifest->version != SNAPSHOT_MANIFEST_VERSION ||
+        manifest->digest_len != hash_digest_length((hash_algo)manifest->hash)) {
+        fprintf(stderr, "Manifeste de sauvegarde invalide : %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// Fonction pour initialiser la construction d'un index
+int snapshot_writer_init(snapshot_index_writer *writer, hash_algo hash, size_t digest_len) {
+    /* @return: 0 en cas de succès, -1 sinon
+    */
+    memset(writer, 0, sizeof(*writer));
+    writer->hash = hash;
+    writer->digest_len = digest_len;
+    arena_init(&writer->paths, 0);
+    if (pthread_mutex_init(&writer->lock, NULL) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Réservation d'une entrée et de la place de sa liste de chunks (verrou tenu)
+static snapshot_pending *writer_reserve(snapshot_index_writer *writer, const char *path, size_t chunk_bytes) {
+    if (writer->count == writer->capacity) {
+        size_t capacity = writer->capacity ? writer->capacity * 2 : 1024;
+        snapshot_pending *entries = realloc(writer->entries, capacity * sizeof(snapshot_pending));
+        if (!entries) {
+            perror("Erreur d'allocation mémoire pour l'index de sauvegarde");
+            return NULL;
+        }
+        writer->entries = entries;
+        writer->capacity = capacity;
+    }
+    if (writer->chunks_size + chunk_bytes > writer->chunks_capacity) {
+        size_t capacity = writer->chunks_capacity ? writer->chunks_capacity : 64 * 1024;
+        while (capacity < writer->chunks_size + chunk_bytes) {
+            capacity *= 2;
+        }
+        unsigned char *chunks = realloc(writer->chunks, capacity);
+        if (!chunks) {
+            perror("Erreur d'allocation mémoire pour l'index de sauvegarde");
+            return NULL;
+        }
+        writer->chunks = chunks;
+        writer->chunks_capacity = capacity;
+    }
+
+    snapshot_pending *pending = &writer->entries[writer->count];
+    memset(pending, 0, sizeof(*pending));
+    pending->path = arena_strdup(&writer->paths, path);
+    if (!pending->path) {
+        perror("Erreur d'allocation mémoire pour l'index de sauvegarde");
+        return NULL;
+    }
+    pending->entry.path_len = (uint32_t)strlen(path);
+    pending->entry.chunk_offset = writer->chunks_size;
+    writer->count++;
+    writer->chunks_size += chunk_bytes;
+    return pending;
+}
+
+// Fonction pour ajouter un fichier sauvegardé ou repris du cache des fichiers
+int snapshot_writer_add_file(snapshot_index_writer *writer, const char *path, const struct stat *st,
+                             const chunk_list_ref *list) {
+    /* @param: path est le chemin du fichier relatif à la sauvegarde
+    *           st sont ses métadonnées au moment du parcours
+    *           list est sa liste de chunks : au plus CHUNK_LIST_INLINE enregistrements sont recopiés
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    size_t bytes = CHUNK_REF_RECORD_SIZE(writer->digest_len) * (list->levels ? 1 : list->count);
+    pthread_mutex_lock(&writer->lock);
+    snapshot_pending *pending = writer_reserve(writer, path, bytes);
+    if (!pending) {
+        pthread_mutex_unlock(&writer->lock);
+        return -1;
+    }
+    snapshot_entry *entry = &pending->entry;
+    entry->mode = (uint32_t)st->st_mode;
+    entry->size = list->file_size;
+    entry->mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+    entry->inode = (uint64_t)st->st_ino;
+    entry->chunk_count = list->count;
+    entry->list_levels = list->levels;
+    memcpy(entry->digest, list->file_digest, writer->digest_len);
+    if (bytes > 0) {
+        memcpy(writer->chunks + entry->chunk_offset, list->records, bytes);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return 0;
+}
+
+// Fonction pour ajouter un répertoire (même vide)
+int snapshot_writer_add_dir(snapshot_index_writer *writer, const char *path, const struct stat *st) {
+    /* @param: path est le chemin du répertoire relatif à la sauvegarde
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    pthread_mutex_lock(&writer->lock);
+    snapshot_pending *pending = writer_reserve(writer, path, 0);
+    if (!pending) {
+        pthread_mutex_unlock(&writer->lock);
+        return -1;
+    }
+    pending->entry.mode = (uint32_t)st->st_mode;
+    pending->entry.mtime_ns = (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+    pending->entry.inode = (uint64_t)st->st_ino;
+    pthread_mutex_unlock(&writer->lock);
+    return 0;
+}
+
+// Ordre des chemins où '/' passe avant tout autre caractère : le contenu d'un répertoire suit
+// alors immédiatement son entrée ("a", "a/x", "a-b" et non "a", "a-b", "a/x")
+static int compare_tree_order(const void *a, const void *b) {
+    const unsigned char *p = (const unsigned char *)((const snapshot_pending *)a)->path;
+    const unsigned char *q = (const unsigned char *)((const snapshot_pending *)b)->path;
+    while (*p && *p == *q) {
+        p++;
+        q++;
+    }
+    int c = *p == '/' ? 1 : *p;
+    int d = *q == '/' ? 1 : *q;
+    return c - d;
+}
+
+// Les noms des entrées d'un arbre ne sont pas terminés par '\0' : on compare sur leur longueur
+static int compare_names(const void *a, const void *b) {
+    const snapshot_pending *x = a, *y = b;
+    uint32_t len = x->entry.path_len < y->entry.path_len ? x->entry.path_len : y->entry.path_len;
+    int cmp = memcmp(x->path, y->path, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (x->entry.path_len > y->entry.path_len) - (x->entry.path_len < y->entry.path_len);
+}
+
+// Répertoire en cours de construction : ses entrées directes, nommées par leur seul nom
+typedef struct {
+    const char *path;          // Chemin du répertoire, non terminé ("" pour la racine)
+    size_t path_len;
+    snapshot_entry entry;      // Entrée du répertoire dans son parent
+    snapshot_pending *children;
+    size_t count;
+    size_t capacity;
+} tree_level;
+
+static int level_add(tree_level *level, const char *name, size_t name_len, const snapshot_entry *entry) {
+    if (level->count == level->capacity) {
+        size_t capacity = level->capacity ? level->capacity * 2 : 16;
+        snapshot_pending *children = realloc(level->children, capacity * sizeof(snapshot_pending));
+        if (!children) {
+            perror("Erreur d'allocation mémoire pour un arbre");
+            return -1;
+        }
+        level->children = children;
+        level->capacity = capacity;
+    }
+    snapshot_pending *child = &level->children[level->count++];
+    child->path = (char *)name;
+    child->entry = *entry;
+    child->entry.path_len = (uint32_t)name_len;
+    return 0;
+}
+
+// Sérialisation d'un répertoire au format de l'index puis ajout au dépôt (sans écriture s'il y est déjà)
+static int store_level(snapshot_index_writer *writer, chunk_store_t *store, tree_level *level, unsigned char *id) {
+    size_t record = CHUNK_REF_RECORD_SIZE(writer->digest_len);
+    qsort(level->children, level->count, sizeof(snapshot_pending), compare_names);
+
+    snapshot_index_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_INDEX_MAGIC, SNAPSHOT_INDEX_MAGIC_LENGTH);
+    header.version = SNAPSHOT_INDEX_VERSION;
+    header.hash = (uint8_t)writer->hash;
+    header.digest_len = (uint8_t)writer->digest_len;
+    header.flags = SNAPSHOT_INDEX_TREE;
+    header.entry_count = level->count;
+    header.entries_offset = sizeof(header);
+    header.paths_offset = header.entries_offset + level->count * sizeof(snapshot_entry);
+    for (size_t i = 0; i < level->count; i++) {
+        header.paths_size += level->children[i].entry.path_len + 1;
+        header.chunks_size += record * snapshot_entry_records(&level->children[i].entry);
+    }
+    header.chunks_offset = header.paths_offset + header.paths_size;
+
+    size_t size = (size_t)(header.chunks_offset + header.chunks_size);
+    if (size > UINT32_MAX) {
+        fprintf(stderr, "Répertoire trop grand pour un arbre : %.*s\n", (int)level->path_len, level->path);
+        return -1;
+    }
+    unsigned char *image = calloc(1, size);
+    if (!image) {
+        perror("Erreur d'allocation mémoire pour un arbre");
+        return -1;
+    }
+    memcpy(image, &header, sizeof(header));
+
+    snapshot_entry *entries = (snapshot_entry *)(image + header.entries_offset);
+    char *paths = (char *)image + header.paths_offset;
+    unsigned char *chunks = image + header.chunks_offset;
+    uint64_t path_offset = 0, chunk_offset = 0;
+    for (size_t i = 0; i < level->count; i++) {
+        const snapshot_pending *child = &level->children[i];
+        entries[i] = child->entry;
+        entries[i].path_offset = path_offset;
+        entries[i].chunk_offset = chunk_offset;
+        memcpy(paths + path_offset, child->path, child->entry.path_len);
+        path_offset += child->entry.path_len + 1;
+
+        size_t bytes = record * snapshot_entry_records(&child->entry);
+        if (bytes > 0) {
+            memcpy(chunks + chunk_offset, writer->chunks + child->entry.chunk_offset, bytes);
+        }
+        chunk_offset += bytes;
+    }
+
+    // L'arbre est adressé par son contenu : un répertoire inchangé redonne le même objet
+    int status = compute_hash(writer->hash, image, size, id) == 0 && store_put(store, id, image, size) >= 0 ? 0 : -1;
+    free(image);
+    return status;
+}
+
+// Fonction pour ranger les entrées en un arbre par répertoire dans le dépôt et remplir le manifeste
+int snapshot_writer_store(snapshot_index_writer *writer, chunk_store_t *store, snapshot_manifest *manifest) {
+    /* @param: store est le dépôt où sont ajoutés les arbres (seuls les répertoires modifiés y sont écrits)
+    *           manifest reçoit la racine et les totaux de la sauvegarde
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    memset(manifest, 0, sizeof(*manifest));
+    memcpy(manifest->magic, SNAPSHOT_MANIFEST_MAGIC, SNAPSHOT_INDEX_MAGIC_LENGTH);
+    manifest->version = SNAPSHOT_MANIFEST_VERSION;
+    manifest->hash = (uint8_t)writer->hash;
+    manifest->digest_len = (uint8_t)writer->digest_len;
+    qsort(writer->entries, writer->count, sizeof(snapshot_pending), compare_tree_order);
+
+    // Pile des répertoires ouverts, de la racine au répertoire courant ; un répertoire est
+    // rangé dans le dépôt dès que le parcours trié sort de son contenu
+    size_t depth = 1, capacity = 16;
+    tree_level *levels = calloc(capacity, sizeof(tree_level));
+    if (!levels) {
+        perror("Erreur d'allocation mémoire pour un arbre");
+        return -1;
+    }
+    levels[0].path = "";
+    levels[0].entry.mode = S_IFDIR | 0755;
+
+    int status = 0;
+    size_t i = 0;
+    while (status == 0 && (i < writer->count || depth > 1)) {
+        const char *path = i < writer->count ? writer->entries[i].path : NULL;
+        tree_level *top = &levels[depth - 1];
+
+        // Fin du contenu du répertoire courant : son arbre est rangé et il devient une entrée du parent
+        if (depth > 1 && (!path || strncmp(path, top->path, top->path_len) != 0 || path[top->path_len] != '/')) {
+            tree_level *parent = &levels[depth - 2];
+            size_t skip = parent->path_len ? parent->path_len + 1 : 0;
+            status = store_level(writer, store, top, top->entry.digest);
+            if (status == 0) {
+                top->entry.chunk_count = 0;
+                top->entry.size = 0;
+                status = level_add(parent, top->path + skip, top->path_len - skip, &top->entry);
+                manifest->tree_count++;
+            }
+            free(top->children);
+            memset(top, 0, sizeof(*top));
+            depth--;
+            continue;
+        }
+
+        const snapshot_entry *entry = &writer->entries[i].entry;
+        const char *name = path + (top->path_len ? top->path_len + 1 : 0);
+        const char *slash = strchr(name, '/');
+        if (slash || S_ISDIR(entry->mode)) {
+            // Nouveau répertoire ; un parent absent de la liste (entrée perdue) est recréé sans métadonnées
+            if (depth == capacity) {
+                tree_level *grown = realloc(levels, capacity * 2 * sizeof(tree_level));
+                if (!grown) {
+                    perror("Erreur d'allocation mémoire pour un arbre");
+                    status = -1;
+                    break;
+                }
+                levels = grown;
+                capacity *= 2;
+            }
+            tree_level *level = &levels[depth++];
+            memset(level, 0, sizeof(*level));
+            level->path = path;
+            if (slash) {
+                level->path_len = (size_t)(slash - path);
+                level->entry.mode = S_IFDIR | 0755;
+                continue;
+            }
+            level->path_len = strlen(path);
+            level->entry = *entry;
+        } else {
+            status = level_add(top, name, strlen(name), entry);
+            manifest->file_count++;
+            manifest->total_size += entry->size;
+        }
+        i++;
+    }
+
+    if (status == 0) {
+        status = store_level(writer, store, &levels[0], manifest->root);
+        manifest->tree_count++;
+    }
+    for (size_t d = 0; d < depth; d++) {
+        free(levels[d].children);
+    }
+    free(levels);
+    return status;
+}
+
+// Fonction pour libérer un index en construction
+void snapshot_writer_free(snapshot_index_writer *writer) {
+    arena_free(&writer->paths);
+    free(writer->entries);
+    free(writer->chunks);
+    pthread_mutex_destroy(&writer->lock);
+    memset(writer, 0, sizeof(*writer));
+}
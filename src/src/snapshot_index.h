@@ -0,0 +1,163 @@
+#ifndef SNAPSHOT_INDEX_H
+#define SNAPSHOT_INDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "hash.h"
+#include "deduplication.h"
+#include "chunk_store.h"
+#include "pool.h"
+
+// Index binaire d'une sauvegarde, à la racine du répertoire de la sauvegarde (format plat,
+// relu pour les anciennes sauvegardes)
+#define SNAPSHOT_INDEX_NAME ".backup_index"
+#define SNAPSHOT_INDEX_MAGIC "LP25SIDX"
+#define SNAPSHOT_INDEX_MAGIC_LENGTH 8
+// Version 2 : une longue liste de chunks est rangée en objets de liste, l'entrée ne référence que sa racine
+#define SNAPSHOT_INDEX_VERSION 2
+
+// Arbre d'un répertoire, stocké comme un objet du dépôt : même format, mais les entrées sont
+// nommées par leur seul nom et un sous-répertoire référence son propre arbre par son digest
+#define SNAPSHOT_INDEX_TREE 0x1
+
+// Manifeste d'une sauvegarde : seul fichier du répertoire de la sauvegarde
+#define SNAPSHOT_MANIFEST_NAME ".manifest"
+#define SNAPSHOT_MANIFEST_MAGIC "LP25MANI"
+#define SNAPSHOT_MANIFEST_VERSION 1
+
+// Journal texte des toutes premières sauvegardes (une recette par fichier dans le répertoire de la sauvegarde)
+#define SNAPSHOT_BACKUP_LOG_NAME ".backup_log"
+
+// Format d'une sauvegarde, d'après le fichier qui la décrit
+typedef enum {
+    SNAPSHOT_FORMAT_NONE,       // Ni manifeste ni index : sauvegarde inachevée ou répertoire inconnu
+    SNAPSHOT_FORMAT_MANIFEST,   // .manifest et arbres dans le dépôt
+    SNAPSHOT_FORMAT_FLAT_INDEX, // .backup_index
+    SNAPSHOT_FORMAT_BACKUP_LOG  // .backup_log et recettes
+} snapshot_format;
+
+// En-tête du fichier (64 octets). Le fichier est projeté en mémoire tel quel :
+// [en-tête][entrées triées par chemin][chemins terminés par '\0'][listes de chunks]
+typedef struct {
+    char magic[SNAPSHOT_INDEX_MAGIC_LENGTH];
+    uint32_t version;
+    uint8_t hash;            // Algorithme des digests (hash_algo)
+    uint8_t digest_len;
+    uint16_t flags;          // SNAPSHOT_INDEX_TREE pour l'arbre d'un répertoire
+    uint64_t entry_count;
+    uint64_t entries_offset;
+    uint64_t paths_offset;
+    uint64_t paths_size;
+    uint64_t chunks_offset;
+    uint64_t chunks_size;
+} snapshot_index_header;
+
+// Entrée d'un fichier (taille fixe, pour la recherche dichotomique)
+typedef struct {
+    uint64_t path_offset;    // Position du chemin dans la zone des chemins
+    uint32_t path_len;
+    uint32_t mode;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t inode;
+    uint64_t chunk_offset;   // Position de la liste de chunks dans la zone des chunks
+    uint32_t chunk_count;    // Chaque chunk : digest (digest_len octets) puis taille (u32)
+    uint32_t list_levels;    // 0 : chunk_count enregistrements ; sinon un seul, la racine de la liste (deduplication.h)
+    unsigned char digest[DIGEST_MAX_LENGTH]; // Digest du fichier complet, ou de l'arbre d'un répertoire
+} snapshot_entry;
+
+// Manifeste (96 octets) : racine de l'arborescence et totaux de la sauvegarde
+typedef struct {
+    char magic[SNAPSHOT_INDEX_MAGIC_LENGTH];
+    uint32_t version;
+    uint8_t hash;
+    uint8_t digest_len;
+    uint16_t reserved;
+    uint64_t file_count;
+    uint64_t total_size;     // Taille cumulée des fichiers
+    uint64_t tree_count;     // Nombre de répertoires
+    uint64_t reserved2[3];
+    unsigned char root[DIGEST_MAX_LENGTH]; // Digest de l'arbre de la racine
+} snapshot_manifest;
+
+// Index ouvert en lecture (projection en mémoire ou objet lu depuis le dépôt, aucune analyse au chargement)
+typedef struct {
+    void *map;
+    size_t map_size;
+    bool allocated;          // Image allouée (arbre lu depuis le dépôt) plutôt que projetée
+    const snapshot_index_header *header;
+    const snapshot_entry *entries;
+    const char *paths;
+    const unsigned char *chunks;
+    size_t count;
+    size_t digest_len;
+} snapshot_index_t;
+
+// Entrée en cours de construction
+typedef struct {
+    char *path;
+    snapshot_entry entry;
+} snapshot_pending;
+
+// Construction d'un index : les entrées arrivent dans n'importe quel ordre, depuis plusieurs threads
+typedef struct {
+    pthread_mutex_t lock;
+    hash_algo hash;
+    size_t digest_len;
+    snapshot_pending *entries;
+    size_t count;
+    size_t capacity;
+    arena_t paths;          // Chemins des entrées, libérés ensemble avec l'index
+    unsigned char *chunks;   // Listes de chunks des entrées (ou leur racine), à la suite
+    size_t chunks_size;
+    size_t chunks_capacity;
+} snapshot_index_writer;
+
+// Fonction pour projeter un index en mémoire et vérifier son en-tête
+int snapshot_index_open(snapshot_index_t *index, const char *path);
+// Fonction pour vérifier une image d'index déjà en mémoire (allouée avec malloc, libérée avec l'index)
+int snapshot_index_load(snapshot_index_t *index, void *image, size_t size);
+// Fonction pour lire l'arbre d'un répertoire depuis le dépôt
+int snapshot_tree_open(snapshot_index_t *tree, chunk_store_t *store, const unsigned char *id);
+// Fonction pour lire l'arbre d'un répertoire avec un lecteur propre au thread appelant
+int snapshot_tree_read(snapshot_index_t *tree, chunk_store_t *store, pack_reader *reader, const unsigned char *id);
+// Fonction pour libérer un index ouvert
+void snapshot_index_close(snapshot_index_t *index);
+// Fonction qui renvoie le chemin (relatif à la sauvegarde) d'une entrée
+const char *snapshot_entry_path(const snapshot_index_t *index, const snapshot_entry *entry);
+// Fonction pour rechercher un chemin par dichotomie
+const snapshot_entry *snapshot_index_find(const snapshot_index_t *index, const char *path);
+// Fonction qui renvoie le nombre d'enregistrements d'une entrée dans la zone des chunks
+uint32_t snapshot_entry_records(const snapshot_entry *entry);
+// Fonction pour parcourir les chunks d'une entrée sans les copier
+void snapshot_entry_source(const snapshot_index_t *index, const snapshot_entry *entry, chunk_store_t *store,
+                           pack_reader *reader, chunk_source *source);
+// Fonction pour exporter une entrée au format texte de .backup_log
+int snapshot_entry_export(const snapshot_index_t *index, const snapshot_entry *entry, const char *path, FILE *out);
+// Fonction pour exporter les fichiers de l'index au format texte de .backup_log
+int snapshot_index_export(const snapshot_index_t *index, const char *prefix, FILE *out);
+
+// Fonction qui renvoie le format de la sauvegarde d'un répertoire
+snapshot_format snapshot_format_of(const char *backup_path);
+// Fonction pour écrire le manifeste d'une sauvegarde
+int snapshot_manifest_write(const char *path, const snapshot_manifest *manifest);
+// Fonction pour lire le manifeste d'une sauvegarde
+int snapshot_manifest_read(const char *path, snapshot_manifest *manifest);
+
+// Fonction pour initialiser la construction d'un index
+int snapshot_writer_init(snapshot_index_writer *writer, hash_algo hash, size_t digest_len);
+// Fonction pour ajouter un fichier sauvegardé ou repris du cache des fichiers
+int snapshot_writer_add_file(snapshot_index_writer *writer, const char *path, const struct stat *st,
+                             const chunk_list_ref *list);
+// Fonction pour ajouter un répertoire (même vide)
+int snapshot_writer_add_dir(snapshot_index_writer *writer, const char *path, const struct stat *st);
+// Fonction pour ranger les entrées en un arbre par répertoire dans le dépôt et remplir le manifeste
+int snapshot_writer_store(snapshot_index_writer *writer, chunk_store_t *store, snapshot_manifest *manifest);
+// Fonction pour libérer un index en construction
+void snapshot_writer_free(snapshot_index_writer *writer);
+
+#endif // SNAPSHOT_INDEX_H
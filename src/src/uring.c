@@ -0,0 +1,189 @@
+#include "uring.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Moteur choisi par --io
+io_backend io_backend_choice = IO_BACKEND_SYNC;
+
+static const char *backend_names[] = {"sync", "uring", "threads"};
+
+// Fonction pour analyser un nom de moteur d'E/S (sync, uring, threads)
+int io_backend_parse(const char *name, io_backend *backend) {
+    /* @return: 0 si le nom est connu, -1 sinon
+    */
+    for (int i = 0; i < (int)(sizeof(backend_names) / sizeof(backend_names[0])); i++) {
+        if (strcmp(name, backend_names[i]) == 0) {
+            *backend = (io_backend)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Fonction qui renvoie le nom d'un moteur d'E/S
+const char *io_backend_name(io_backend backend) {
+    return backend_names[backend];
+}
+
+// Fonction qui renvoie le moteur utilisable : io_uring s'il est disponible, sinon les threads
+io_backend io_backend_effective(io_backend backend) {
+    // Un anneau d'essai est créé une fois ; ENOSYS (noyau trop ancien) ou EPERM (interdit par
+    // seccomp ou kernel.io_uring_disabled) font basculer sur les threads
+    static int available = -1;
+    if (backend != IO_BACKEND_URING) {
+        return backend;
+    }
+    if (available < 0) {
+        uring_t ring;
+        available = uring_init(&ring, 8) == 0;
+        if (available) {
+            uring_free(&ring);
+        } else {
+            fprintf(stderr, "io_uring indisponible (%s), E/S confiées à des threads.\n", strerror(errno));
+        }
+    }
+    return available ? IO_BACKEND_URING : IO_BACKEND_THREADS;
+}
+
+// Fonction pour créer un anneau
+int uring_init(uring_t *ring, unsigned entries) {
+    /* @param: entries est le nombre d'entrées de soumission (arrondi par le noyau à une puissance de 2)
+    *  @return: 0 en cas de succès, -1 sinon (errno est conservé)
+    */
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return -1;
+    }
+    ring->fd = fd;
+    ring->entries = params.sq_entries;
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && ring->cq_ring_size > ring->sq_ring_size) {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        goto fail;
+    }
+    if (single) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            goto fail;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    char *sq = ring->sq_ring, *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->sq_tail_local = *ring->sq_tail;
+    return 0;
+
+fail:;
+    int saved = errno;
+    uring_free(ring);
+    errno = saved;
+    return -1;
+}
+
+// Fonction pour détruire un anneau
+void uring_free(uring_t *ring) {
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+// Fonction qui renvoie une entrée de soumission vide, NULL si la file est pleine
+struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    /* @return: l'entrée à remplir, publiée au prochain uring_submit
+    */
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_tail_local - head >= ring->entries) {
+        return NULL;
+    }
+    unsigned index = ring->sq_tail_local & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_tail_local++;
+    ring->to_submit++;
+    return sqe;
+}
+
+// Fonction pour soumettre les entrées préparées et attendre des complétions
+int uring_submit(uring_t *ring, unsigned wait) {
+    /* @param: wait est le nombre de complétions à attendre (0 : ne bloque pas)
+    *  @return: 0 en cas de succès, -1 sinon
+    */
+    __atomic_store_n(ring->sq_tail, ring->sq_tail_local, __ATOMIC_RELEASE);
+    for (;;) {
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait,
+                               wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) {
+            // Les entrées non consommées restent dans la file pour la soumission suivante
+            ring->to_submit -= (unsigned)ret < ring->to_submit ? (unsigned)ret : ring->to_submit;
+            return 0;
+        }
+        // EAGAIN/EBUSY : les complétions en attente doivent d'abord être récoltées
+        if (errno == EAGAIN || errno == EBUSY) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            perror("Erreur de soumission io_uring");
+            return -1;
+        }
+    }
+}
+
+// Fonction pour récolter une complétion
+bool uring_next_cqe(uring_t *ring, struct io_uring_cqe *cqe) {
+    /* @param: cqe reçoit une copie de la complétion, qui est rendue au noyau
+    *  @return: true si une complétion était disponible
+    */
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *cqe = ring->cqes[head & *ring->cq_mask];
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
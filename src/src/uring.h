@@ -0,0 +1,56 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <linux/io_uring.h>
+
+// Moteur d'E/S des lectures de fichiers sources et des écritures de packs (--io)
+typedef enum {
+    IO_BACKEND_SYNC,    // Lectures et écritures bloquantes dans les threads du pipeline (défaut)
+    IO_BACKEND_URING,   // io_uring : nombreuses lectures en vol, packs écrits en arrière-plan
+    IO_BACKEND_THREADS  // Même fonctionnement avec un groupe de threads d'E/S bloquantes
+} io_backend;
+
+// Profondeur des anneaux : nombre maximal d'opérations en vol par anneau
+#define URING_QUEUE_DEPTH 256
+
+// Moteur choisi par --io ; io_uring est remplacé par les threads si le noyau ne l'offre pas
+extern io_backend io_backend_choice;
+
+// Anneau io_uring manipulé directement par les appels système (sans liburing).
+// Un seul thread à la fois prépare, soumet et récolte.
+typedef struct {
+    int fd;
+    unsigned entries;
+    // File de soumission, partagée avec le noyau
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_tail_local;  // Entrées préparées, publiées par uring_submit
+    unsigned to_submit;
+    // File de complétion
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    // Projections des anneaux (sq et cq confondus si le noyau a IORING_FEAT_SINGLE_MMAP)
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+} uring_t;
+
+// Fonction pour analyser un nom de moteur d'E/S (sync, uring, threads)
+int io_backend_parse(const char *name, io_backend *backend);
+// Fonction qui renvoie le nom d'un moteur d'E/S
+const char *io_backend_name(io_backend backend);
+// Fonction qui renvoie le moteur utilisable : io_uring s'il est disponible, sinon les threads
+io_backend io_backend_effective(io_backend backend);
+// Fonction pour créer un anneau
+int uring_init(uring_t *ring, unsigned entries);
+// Fonction pour détruire un anneau
+void uring_free(uring_t *ring);
+// Fonction qui renvoie une entrée de soumission vide, NULL si la file est pleine
+struct io_uring_sqe *uring_get_sqe(uring_t *ring);
+// Fonction pour soumettre les entrées préparées et attendre des complétions
+int uring_submit(uring_t *ring, unsigned wait);
+// Fonction pour récolter une complétion
+bool uring_next_cqe(uring_t *ring, struct io_uring_cqe *cqe);
+
+#endif // URING_H
@@ -0,0 +1,507 @@
+#define _GNU_SOURCE
+#include "walker.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Format des entrées renvoyées par getdents64
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Répertoire à parcourir : il est ouvert par son parent, relativement au descripteur de celui-ci
+typedef struct walk_dir {
+    int fd;
+    char *path;              // Chemin relatif à la racine ("" pour la racine)
+    char *name;              // Nom dans le répertoire parent
+    int depth;
+    struct walk_dir *parent;
+    atomic_int refs;         // 1 + sous-répertoires non terminés (uniquement avec leave_dir)
+} walk_dir;
+
+// File de travail d'un thread : le propriétaire travaille à la fin, les voleurs prennent au début
+typedef struct {
+    walk_dir **items;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    pthread_mutex_t lock;
+} walk_deque;
+
+// État partagé d'un parcours
+typedef struct {
+    const walk_options *options;
+    walk_deque *deques;
+    int threads;
+    atomic_long pending;   // Répertoires en file ou en cours de traitement
+    atomic_int open_dirs;  // Répertoires ouverts qui attendent dans les files
+    atomic_int errors;
+    atomic_bool aborted;
+} walk_state;
+
+typedef struct {
+    walk_state *state;
+    int id;
+    char *path;            // Chemin de l'entrée visitée, réutilisé d'une entrée à l'autre
+    size_t path_capacity;
+} walk_thread;
+
+// Fonction pour construire "base/relatif" dans une chaîne allouée
+char *walk_join(const char *base, const char *relative) {
+    size_t base_len = strlen(base);
+    size_t rel_len = strlen(relative);
+    char *path = malloc(base_len + rel_len + 2);
+    if (!path) {
+        perror("Erreur d'allocation mémoire pour un chemin");
+        return NULL;
+    }
+    if (base_len == 0) {
+        memcpy(path, relative, rel_len + 1);
+    } else {
+        memcpy(path, base, base_len);
+        path[base_len] = '/';
+        memcpy(path + base_len + 1, relative, rel_len + 1);
+    }
+    return path;
+}
+
+static int deque_push(walk_deque *deque, walk_dir *dir) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail == deque->capacity) {
+        // Récupération de la place libérée par les vols avant d'agrandir
+        if (deque->head > 0) {
+            memmove(deque->items, deque->items + deque->head, (deque->tail - deque->head) * sizeof(walk_dir *));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        } else {
+            size_t capacity = deque->capacity ? deque->capacity * 2 : 64;
+            walk_dir **items = realloc(deque->items, capacity * sizeof(walk_dir *));
+            if (!items) {
+                pthread_mutex_unlock(&deque->lock);
+                perror("Erreur d'allocation mémoire pour la file de parcours");
+                return -1;
+            }
+            deque->items = items;
+            deque->capacity = capacity;
+        }
+    }
+    deque->items[deque->tail++] = dir;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+// Le propriétaire reprend le dernier répertoire ajouté (parcours en profondeur, localité du cache)
+static walk_dir *deque_pop(walk_deque *deque) {
+    walk_dir *dir = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head) {
+        dir = deque->items[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return dir;
+}
+
+// Un voleur prend le plus ancien, en général le plus haut dans l'arbre donc le plus gros travail
+static walk_dir *deque_steal(walk_deque *deque) {
+    walk_dir *dir = NULL;
+    if (pthread_mutex_trylock(&deque->lock) != 0) {
+        return NULL;
+    }
+    if (deque->tail > deque->head) {
+        dir = deque->items[deque->head++];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return dir;
+}
+
+// Libération d'un répertoire terminé ; avec leave_dir, le parent est libéré après son dernier enfant
+static void release_dir(walk_state *state, walk_dir *dir) {
+    const walk_options *options = state->options;
+    while (dir) {
+        if (options->leave_dir && atomic_fetch_sub(&dir->refs, 1) != 1) {
+            return;
+        }
+        close(dir->fd);
+        walk_dir *parent = dir->parent;
+        if (options->leave_dir && parent && !atomic_load(&state->aborted)) {
+            walk_entry entry = {parent->fd, dir->name, dir->path, DT_DIR, NULL, dir->depth};
+            if (options->leave_dir(&entry, options->arg) == WALK_ABORT) {
+                atomic_store(&state->aborted, true);
+            }
+        }
+        free(dir->path);
+        free(dir->name);
+        free(dir);
+        if (!options->leave_dir) {
+            return;
+        }
+        dir = parent;
+    }
+}
+
+static void run_dir(walk_thread *thread, walk_dir *dir, char *buffer);
+
+// Chemin d'une entrée construit dans le tampon du thread : seul un répertoire à parcourir en garde une copie
+static char *entry_path(walk_thread *thread, const walk_dir *dir, const char *name) {
+    size_t base_len = strlen(dir->path);
+    size_t name_len = strlen(name);
+    if (base_len + name_len + 2 > thread->path_capacity) {
+        size_t capacity = (base_len + name_len + 2) * 2;
+        char *grown = realloc(thread->path, capacity);
+        if (!grown) {
+            perror("Erreur d'allocation mémoire pour un chemin");
+            return NULL;
+        }
+        thread->path = grown;
+        thread->path_capacity = capacity;
+    }
+    char *path = thread->path;
+    if (base_len > 0) {
+        memcpy(path, dir->path, base_len);
+        path[base_len++] = '/';
+    }
+    memcpy(path + base_len, name, name_len + 1);
+    return path;
+}
+
+// Visite d'une entrée d'un répertoire, puis parcours ou mise en file de l'entrée si c'est un sous-répertoire
+static void visit_dirent(walk_thread *thread, walk_dir *dir, const char *name, unsigned char type) {
+    walk_state *state = thread->state;
+    const walk_options *options = state->options;
+
+    // d_type évite un stat par entrée : il n'est fait que si on en a besoin
+    struct stat st;
+    const struct stat *stp = NULL;
+    int need_stat = type == DT_UNKNOWN ||
+                    (type == DT_DIR ? (options->flags & WALK_STAT_DIRS) : (options->flags & WALK_STAT_FILES));
+    if (need_stat) {
+        uint64_t stat_start = metrics_start();
+        int stat_status = fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW);
+        metrics_stop(METRIC_STAT, stat_start, 0);
+        if (stat_status == -1) {
+            perror("Erreur lors de la récupération des métadonnées");
+            atomic_fetch_add(&state->errors, 1);
+            return;
+        }
+        stp = &st;
+        type = IFTODT(st.st_mode);
+    }
+
+    char *path = entry_path(thread, dir, name);
+    if (!path) {
+        atomic_fetch_add(&state->errors, 1);
+        return;
+    }
+
+    int action = WALK_CONTINUE;
+    if (options->visit) {
+        walk_entry entry = {dir->fd, name, path, type, stp, dir->depth + 1};
+        action = options->visit(&entry, options->arg);
+    }
+    if (action == WALK_ABORT) {
+        atomic_store(&state->aborted, true);
+    }
+    if (type != DT_DIR || action != WALK_CONTINUE || atomic_load(&state->aborted)) {
+        return;
+    }
+
+    int fd = openat(dir->fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    walk_dir *child = fd < 0 ? NULL : malloc(sizeof(walk_dir));
+    char *child_name = child ? strdup(name) : NULL;
+    path = child_name ? strdup(path) : NULL;
+    if (!path) {
+        perror("Erreur lors de l'ouverture d'un sous-répertoire");
+        atomic_fetch_add(&state->errors, 1);
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(child);
+        free(child_name);
+        return;
+    }
+    child->fd = fd;
+    child->path = path;
+    child->name = child_name;
+    child->depth = dir->depth + 1;
+    child->parent = options->leave_dir ? dir : NULL;
+    atomic_init(&child->refs, 1);
+    if (options->leave_dir) {
+        atomic_fetch_add(&dir->refs, 1);
+    }
+    atomic_fetch_add(&state->pending, 1);
+
+    // Le sous-répertoire est proposé aux autres threads, sauf si trop de répertoires sont déjà ouverts :
+    // on le parcourt alors immédiatement, ce qui borne le nombre de descripteurs.
+    // Un parcours trié descend toujours immédiatement.
+    if (!(options->flags & WALK_SORTED)) {
+        if (atomic_fetch_add(&state->open_dirs, 1) < WALK_MAX_OPEN_DIRS &&
+            deque_push(&state->deques[thread->id], child) == 0) {
+            return;
+        }
+        atomic_fetch_sub(&state->open_dirs, 1);
+    }
+    char *inline_buffer = malloc(WALK_GETDENTS_BUFFER);
+    if (!inline_buffer) {
+        perror("Erreur d'allocation mémoire pour le parcours");
+        atomic_fetch_add(&state->errors, 1);
+        release_dir(state, child);
+        atomic_fetch_sub(&state->pending, 1);
+        return;
+    }
+    run_dir(thread, child, inline_buffer);
+    free(inline_buffer);
+}
+
+// Entrée d'un répertoire relevée par un parcours trié
+typedef struct {
+    size_t name;          // Position du nom dans le tampon des noms
+    unsigned char type;
+} sorted_dirent;
+
+static int compare_dirents(const void *a, const void *b, void *names) {
+    return strcmp((const char *)names + ((const sorted_dirent *)a)->name,
+                  (const char *)names + ((const sorted_dirent *)b)->name);
+}
+
+// Parcours trié : toutes les entrées du répertoire sont relevées, triées par nom puis visitées
+static void process_dir_sorted(walk_thread *thread, walk_dir *dir, char *buffer) {
+    walk_state *state = thread->state;
+    sorted_dirent *entries = NULL;
+    size_t count = 0, capacity = 0;
+    char *names = NULL;
+    size_t names_used = 0, names_capacity = 0;
+    bool failed = false;
+
+    for (;;) {
+        uint64_t start = metrics_start();
+        long n = syscall(SYS_getdents64, dir->fd, buffer, WALK_GETDENTS_BUFFER);
+        metrics_stop(METRIC_WALK, start, n > 0 ? (uint64_t)n : 0);
+        if (n < 0) {
+            perror("Erreur de lecture du répertoire");
+            failed = true;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        for (long off = 0; off < n && !failed;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buffer + off);
+            off += d->d_reclen;
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+            size_t len = strlen(d->d_name) + 1;
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                sorted_dirent *grown = realloc(entries, capacity * sizeof(sorted_dirent));
+                failed = !grown;
+                entries = grown ? grown : entries;
+            }
+            if (!failed && names_used + len > names_capacity) {
+                names_capacity = (names_used + len) * 2;
+                char *grown = realloc(names, names_capacity);
+                failed = !grown;
+                names = grown ? grown : names;
+            }
+            if (failed) {
+                perror("Erreur d'allocation mémoire pour le parcours");
+                break;
+            }
+            memcpy(names + names_used, d->d_name, len);
+            entries[count].name = names_used;
+            entries[count].type = d->d_type;
+            names_used += len;
+            count++;
+        }
+        if (failed) {
+            break;
+        }
+    }
+    if (failed) {
+        atomic_fetch_add(&state->errors, 1);
+    } else {
+        qsort_r(entries, count, sizeof(sorted_dirent), compare_dirents, names);
+        for (size_t i = 0; i < count && !atomic_load(&state->aborted); i++) {
+            visit_dirent(thread, dir, names + entries[i].name, entries[i].type);
+        }
+    }
+    free(entries);
+    free(names);
+}
+
+// Lecture d'un répertoire par lots getdents64 et visite de ses entrées
+static void process_dir(walk_thread *thread, walk_dir *dir, char *buffer) {
+    walk_state *state = thread->state;
+    if (state->options->flags & WALK_SORTED) {
+        process_dir_sorted(thread, dir, buffer);
+        return;
+    }
+
+    for (;;) {
+        uint64_t start = metrics_start();
+        long n = syscall(SYS_getdents64, dir->fd, buffer, WALK_GETDENTS_BUFFER);
+        metrics_stop(METRIC_WALK, start, n > 0 ? (uint64_t)n : 0);
+        if (n < 0) {
+            perror("Erreur de lecture du répertoire");
+            atomic_fetch_add(&state->errors, 1);
+            return;
+        }
+        if (n == 0) {
+            return;
+        }
+
+        for (long off = 0; off < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(buffer + off);
+            off += d->d_reclen;
+            if (atomic_load(&state->aborted)) {
+                return;
+            }
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+            visit_dirent(thread, dir, d->d_name, d->d_type);
+        }
+    }
+}
+
+// Traitement complet d'un répertoire
+static void run_dir(walk_thread *thread, walk_dir *dir, char *buffer) {
+    process_dir(thread, dir, buffer);
+    release_dir(thread->state, dir);
+    atomic_fetch_sub(&thread->state->pending, 1);
+}
+
+// Boucle d'un thread : sa propre file d'abord, puis vol dans les files des autres
+static void *walk_thread_main(void *arg) {
+    walk_thread *thread = arg;
+    walk_state *state = thread->state;
+    char *buffer = malloc(WALK_GETDENTS_BUFFER);
+    if (!buffer) {
+        perror("Erreur d'allocation mémoire pour le parcours");
+        atomic_fetch_add(&state->errors, 1);
+        return NULL;
+    }
+
+    while (!atomic_load(&state->aborted)) {
+        walk_dir *dir = deque_pop(&state->deques[thread->id]);
+        for (int i = 1; !dir && i < state->threads; i++) {
+            dir = deque_steal(&state->deques[(thread->id + i) % state->threads]);
+        }
+        if (dir) {
+            atomic_fetch_sub(&state->open_dirs, 1);
+            run_dir(thread, dir, buffer);
+            continue;
+        }
+        if (atomic_load(&state->pending) == 0) {
+            break;
+        }
+        sched_yield();
+    }
+    free(buffer);
+    return NULL;
+}
+
+// Fonction pour parcourir une arborescence en parallèle (vol de travail entre threads)
+int walk_tree(const char *root, const walk_options *options) {
+    /* @param: root est le répertoire à parcourir (il n'est pas lui-même visité)
+    *           options décrit les fonctions de visite, appelées simultanément par plusieurs threads
+    *  @return: -1 si la racine n'a pas pu être ouverte ou si le parcours a été interrompu,
+    *           sinon le nombre d'entrées qui n'ont pas pu être traitées (0 : parcours complet)
+    */
+    walk_state state;
+    memset(&state, 0, sizeof(state));
+    state.options = options;
+    state.threads = options->threads;
+    // Un parcours trié visite les entrées dans un ordre fixe : un seul thread
+    if (options->flags & WALK_SORTED) {
+        state.threads = 1;
+    }
+    if (state.threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        state.threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    walk_dir *top = malloc(sizeof(walk_dir));
+    int fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!top || fd < 0) {
+        perror("Erreur lors de l'ouverture du répertoire à parcourir");
+        free(top);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    top->fd = fd;
+    top->path = strdup("");
+    top->name = strdup("");
+    top->depth = 0;
+    top->parent = NULL;
+    atomic_init(&top->refs, 1);
+
+    state.deques = calloc(state.threads, sizeof(walk_deque));
+    walk_thread *threads = calloc(state.threads, sizeof(walk_thread));
+    pthread_t *ids = calloc(state.threads, sizeof(pthread_t));
+    if (!state.deques || !threads || !ids || !top->path || !top->name) {
+        perror("Erreur d'allocation mémoire pour le parcours");
+        free(state.deques);
+        free(threads);
+        free(ids);
+        close(fd);
+        free(top->path);
+        free(top->name);
+        free(top);
+        return -1;
+    }
+    for (int i = 0; i < state.threads; i++) {
+        pthread_mutex_init(&state.deques[i].lock, NULL);
+        threads[i].state = &state;
+        threads[i].id = i;
+    }
+    atomic_init(&state.pending, 1);
+    atomic_init(&state.open_dirs, 1);
+    deque_push(&state.deques[0], top);
+
+    // Le thread appelant participe au parcours en tant que thread 0
+    int started = 1;
+    for (; started < state.threads; started++) {
+        if (pthread_create(&ids[started], NULL, walk_thread_main, &threads[started]) != 0) {
+            break;
+        }
+    }
+    walk_thread_main(&threads[0]);
+    for (int i = 1; i < started; i++) {
+        pthread_join(ids[i], NULL);
+    }
+
+    // Après un arrêt anticipé, des répertoires peuvent rester dans les files
+    for (int i = 0; i < state.threads; i++) {
+        walk_dir *dir;
+        while ((dir = deque_pop(&state.deques[i])) != NULL) {
+            release_dir(&state, dir);
+        }
+        free(state.deques[i].items);
+        pthread_mutex_destroy(&state.deques[i].lock);
+    }
+    for (int i = 0; i < state.threads; i++) {
+        free(threads[i].path);
+    }
+    free(state.deques);
+    free(threads);
+    free(ids);
+
+    return atomic_load(&state.aborted) ? -1 : atomic_load(&state.errors);
+}
@@ -0,0 +1,50 @@
+#ifndef WALKER_H
+#define WALKER_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+
+// Taille du tampon getdents64 : des milliers d'entrées par appel système
+#define WALK_GETDENTS_BUFFER (256 * 1024)
+// Nombre maximal de répertoires ouverts en attente dans les files de travail ;
+// au-delà, un thread parcourt ses sous-répertoires lui-même (en profondeur)
+#define WALK_MAX_OPEN_DIRS 512
+
+// Options de parcours
+#define WALK_STAT_FILES 0x1 // fstatat sur les entrées qui ne sont pas des répertoires
+#define WALK_STAT_DIRS  0x2 // fstatat sur les répertoires
+#define WALK_SORTED     0x4 // Un seul thread, entrées de chaque répertoire visitées par nom croissant, en profondeur
+
+// Valeurs de retour des fonctions de visite
+#define WALK_CONTINUE 0  // Continuer (et descendre dans un répertoire)
+#define WALK_SKIP 1      // Ne pas descendre dans ce répertoire
+#define WALK_ABORT -1    // Arrêter tout le parcours
+
+// Entrée visitée ; les pointeurs ne sont valides que pendant l'appel
+typedef struct {
+    int dirfd;             // Descripteur du répertoire parent (pour les appels *at())
+    const char *name;      // Nom de l'entrée dans son répertoire
+    const char *path;      // Chemin relatif à la racine du parcours, sans limite de longueur
+    unsigned char type;    // DT_REG, DT_DIR, DT_LNK...
+    const struct stat *st; // Métadonnées, NULL si aucun stat n'a été nécessaire
+    int depth;             // 1 pour les entrées de la racine
+} walk_entry;
+
+// Fonction de visite, appelée en parallèle depuis plusieurs threads
+typedef int (*walk_fn)(const walk_entry *entry, void *arg);
+
+// Paramètres d'un parcours
+typedef struct {
+    walk_fn visit;     // Appelée pour chaque entrée, avant le contenu des répertoires
+    walk_fn leave_dir; // Optionnelle : appelée pour un répertoire une fois tout son contenu traité
+    void *arg;         // Argument transmis aux fonctions de visite
+    int threads;       // Nombre de threads (0 : un par processeur)
+    int flags;         // WALK_STAT_FILES, WALK_STAT_DIRS, WALK_SORTED
+} walk_options;
+
+// Fonction pour parcourir une arborescence en parallèle (vol de travail entre threads)
+int walk_tree(const char *root, const walk_options *options);
+// Fonction pour construire "base/relatif" dans une chaîne allouée
+char *walk_join(const char *base, const char *relative);
+
+#endif // WALKER_H
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Dépôt qui ne peut plus être écrit (disque plein) : la sauvegarde échoue avec un code de sortie non nul
+# et aucune nouvelle sauvegarde n'apparaît dans la destination.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src" "$WORK/dest"
+head -c 100000 /dev/urandom > "$WORK/src/a.bin"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+
+# Le pack courant devient /dev/full : toute écriture échoue avec ENOSPC
+rm "$WORK/dest/.store/pack-000000.pack"
+ln -s /dev/full "$WORK/dest/.store/pack-000000.pack"
+head -c 300000 /dev/urandom > "$WORK/src/b.bin"
+if "$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" -j 4 > /dev/null 2>&1; then
+    echo "test_backup_store_full : la sauvegarde a réussi malgré le dépôt plein"
+    exit 1
+fi
+test "$(ls "$WORK/dest" | wc -l)" -eq 1
+echo "test_backup_store_full : OK"
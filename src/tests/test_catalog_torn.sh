@@ -0,0 +1,21 @@
+#!/bin/sh
+# Ajout au catalogue interrompu : l'enregistrement incomplet est retiré avant l'ajout suivant,
+# toutes les sauvegardes terminées restent listées avec leurs statistiques.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src" "$WORK/dest"
+echo "premier" > "$WORK/src/a.txt"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+head -c 50 /dev/urandom >> "$WORK/dest/.store/catalog"
+
+echo "second" > "$WORK/src/a.txt"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null 2>&1
+# En-tête de 16 octets puis enregistrements de 128 octets
+test $(( ($(stat -c %s "$WORK/dest/.store/catalog") - 16) % 128 )) -eq 0
+for backup in $(ls "$WORK/dest"); do
+    "$BIN" --list-backups --source "$WORK/dest" | grep "$backup" | grep -q "nouveaux octets"
+done
+echo "test_catalog_torn : OK"
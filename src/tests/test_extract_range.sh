@@ -0,0 +1,44 @@
+#!/bin/sh
+# Extraction d'une plage d'octets (--range) aux bords du fichier : début après la fin (sortie vide,
+# aucun chunk lu), plage qui déborde de la fin (tronquée), plage qui commence au milieu d'un chunk et
+# en traverse plusieurs.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src" "$WORK/dest"
+head -c 300000 /dev/urandom > "$WORK/src/data"
+"$BIN" --backup --chunker 1024,4096,16384 --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+backup=$(ls "$WORK/dest" | tail -n 1)
+
+# Extraction de la plage $1, comparée aux octets attendus (début $2, longueur $3)
+check_range() {
+    "$BIN" --extract data --source "$WORK/dest/$backup" --range "$1" --stats="$WORK/stats.json" > "$WORK/out"
+    tail -c +$(($2 + 1)) "$WORK/src/data" | head -c "$3" | cmp - "$WORK/out"
+}
+# Octets lus dans le dépôt par la dernière extraction
+read_bytes() {
+    sed 's/.*"read":{"ops":[0-9]*,"bytes":\([0-9]*\).*/\1/' "$WORK/stats.json"
+}
+
+check_range 400000 0 0
+test ! -s "$WORK/out"
+# Aucun chunk de données n'est lu : seulement l'arbre et la liste de chunks
+if [ "$(read_bytes)" -gt 16384 ]; then
+    echo "test_extract_range : $(read_bytes) octets lus pour une plage après la fin" >&2
+    exit 1
+fi
+check_range 300000 0 0
+check_range 299990 299990 10
+check_range 290000:100000 290000 10000
+check_range 0 0 300000
+
+# Plage de 50000 octets qui commence au milieu d'un chunk : les chunks qui la précèdent sont sautés
+check_range 1000:50000 1000 50000
+if [ "$(read_bytes)" -gt $((50000 + 2 * 16384 + 16384)) ]; then
+    echo "test_extract_range : $(read_bytes) octets lus pour une plage de 50000 octets" >&2
+    exit 1
+fi
+check_range 150001:77777 150001 77777
+echo "test_extract_range : OK"
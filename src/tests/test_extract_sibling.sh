@@ -0,0 +1,23 @@
+#!/bin/sh
+# Extraction d'un petit fichier rangé à côté d'une grosse image découpée en petits chunks : l'arbre
+# du répertoire ne contient que la référence de la liste de l'image, l'extraction ne doit donc lire
+# que quelques Kio du dépôt (mesurés par --stats) et pas la liste de chunks de son voisin.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src/etc" "$WORK/dest"
+head -c 16M /dev/urandom > "$WORK/src/etc/disk.img"
+echo "port=22" > "$WORK/src/etc/app.conf"
+"$BIN" --backup --chunker 64,128,256 --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+backup=$(ls "$WORK/dest" | tail -n 1)
+
+"$BIN" --extract etc/app.conf --source "$WORK/dest/$backup" --stats="$WORK/stats.json" > "$WORK/app.conf"
+cmp "$WORK/src/etc/app.conf" "$WORK/app.conf"
+read_bytes=$(sed 's/.*"read":{"ops":[0-9]*,"bytes":\([0-9]*\).*/\1/' "$WORK/stats.json")
+if [ "$read_bytes" -gt 65536 ]; then
+    echo "test_extract_sibling : $read_bytes octets lus pour extraire 8 octets" >&2
+    exit 1
+fi
+echo "test_extract_sibling : OK"
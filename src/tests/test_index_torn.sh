@@ -0,0 +1,40 @@
+#!/bin/sh
+# Sauvegarde interrompue au milieu de l'ajout d'un enregistrement d'index : la sauvegarde suivante
+# doit retirer l'enregistrement incomplet avant d'ajouter les siens, et les sauvegardes complètes
+# doivent rester restaurables.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src/sub" "$WORK/dest"
+head -c 3000000 /dev/urandom > "$WORK/src/a.bin"
+head -c 200000 /dev/urandom > "$WORK/src/sub/b.bin"
+echo "premier" > "$WORK/src/sub/c.txt"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+first=$(ls "$WORK/dest" | tail -n 1)
+cp -a "$WORK/src" "$WORK/expected1"
+size=$(stat -c %s "$WORK/dest/.store/index")
+cp "$WORK/dest/.store/files" "$WORK/dest/.store/catalog" "$WORK"
+
+# Sauvegarde interrompue : journal coupé au milieu de son deuxième enregistrement, ni manifeste
+# ni cache des fichiers ni entrée au catalogue
+head -c 500000 /dev/urandom > "$WORK/src/d.bin"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+torn=$(ls "$WORK/dest" | tail -n 1)
+rm -rf "${WORK:?}/dest/$torn"
+truncate -s $((size + 70)) "$WORK/dest/.store/index"
+cp "$WORK/files" "$WORK/catalog" "$WORK/dest/.store"
+
+head -c 1000000 /dev/urandom > "$WORK/src/e.bin"
+echo "second" > "$WORK/src/sub/c.txt"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null 2>&1
+second=$(ls "$WORK/dest" | tail -n 1)
+test "$first" != "$second"
+
+"$BIN" --restore --source "$WORK/dest/$first" --dest "$WORK/out1" > /dev/null
+"$BIN" --restore --source "$WORK/dest/$second" --dest "$WORK/out2" > /dev/null
+diff -r "$WORK/expected1" "$WORK/out1"
+diff -r "$WORK/src" "$WORK/out2"
+"$BIN" --check --dest "$WORK/dest" > /dev/null
+echo "test_index_torn : OK"
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Liste de chunks rangée en objets de liste : après la modification d'un octet d'un gros fichier,
+# la sauvegarde suivante n'écrit que le chunk modifié et les quelques objets de liste qui le
+# référencent, pas toute la liste. Les deux sauvegardes doivent se restaurer, se vérifier et se
+# nettoyer, et un petit fichier voisin doit s'extraire.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src" "$WORK/dest"
+head -c 32M /dev/urandom > "$WORK/src/big.bin"
+echo "petit fichier" > "$WORK/src/small.txt"
+"$BIN" --backup --chunker 64,128,256 --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+first=$(ls "$WORK/dest" | tail -n 1)
+before=$(du -sb "$WORK/dest/.store" | cut -f1)
+
+# Un octet modifié au milieu : la liste compte plus de 200 000 chunks (plus de 7 Mo d'enregistrements)
+printf 'X' | dd of="$WORK/src/big.bin" bs=1 seek=16000000 conv=notrunc 2> /dev/null
+sleep 1
+"$BIN" --backup --chunker 64,128,256 --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+second=$(ls "$WORK/dest" | tail -n 1)
+after=$(du -sb "$WORK/dest/.store" | cut -f1)
+if [ $((after - before)) -gt 2097152 ]; then
+    echo "test_large_list : la seconde sauvegarde a écrit $((after - before)) octets" >&2
+    exit 1
+fi
+
+"$BIN" --check --dest "$WORK/dest" > /dev/null
+"$BIN" --extract small.txt --source "$WORK/dest/$second" > "$WORK/small.txt"
+cmp "$WORK/src/small.txt" "$WORK/small.txt"
+"$BIN" --prune --source "$WORK/dest/$first" --dest "$WORK/dest" > /dev/null
+"$BIN" --check --dest "$WORK/dest" > /dev/null
+"$BIN" --restore --source "$WORK/dest/$second" --dest "$WORK/out" > /dev/null
+cmp "$WORK/src/big.bin" "$WORK/out/big.bin"
+echo "test_large_list : OK"
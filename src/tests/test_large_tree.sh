@@ -0,0 +1,18 @@
+#!/bin/sh
+# Liste de chunks plus grande que PACK_MAX_SIZE (64 Mio) : un fichier de 600 Mo découpé en chunks de
+# 256 octets au plus donne plus de 2 millions de chunks, rangés en objets de liste hors de l'arbre.
+# --check doit les relire sans les signaler et la restauration doit redonner le fichier.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src" "$WORK/dest"
+truncate -s 600M "$WORK/src/zero.img"
+"$BIN" --backup --chunker 64,128,256 --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+backup=$(ls "$WORK/dest" | tail -n 1)
+
+"$BIN" --check --dest "$WORK/dest" > /dev/null
+"$BIN" --restore --source "$WORK/dest/$backup" --dest "$WORK/out" > /dev/null
+cmp "$WORK/src/zero.img" "$WORK/out/zero.img"
+echo "test_large_tree : OK"
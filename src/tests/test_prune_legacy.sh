@@ -0,0 +1,83 @@
+#!/bin/sh
+# Nettoyage d'une destination qui garde des sauvegardes des anciens formats : un index plat
+# (.backup_index, version 1) et un journal texte (.backup_log) avec une recette par fichier. Les
+# fixtures sont écrites octet par octet et référencent des chunks rangés par une sauvegarde actuelle :
+# ces chunks doivent survivre au nettoyage de celle-ci, et le nettoyage d'une ancienne sauvegarde ne
+# retire que les siens.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Écriture binaire, petit-boutiste comme les formats du dépôt
+octet() { printf "\\$(printf %03o "$1")"; }
+u16() { octet $(($1 & 255)); octet $((($1 >> 8) & 255)); }
+u32() { u16 $(($1 & 65535)); u16 $((($1 >> 16) & 65535)); }
+u64() { u32 $(($1 & 4294967295)); u32 $(($1 >> 32)); }
+hexbin() {
+    h=$1
+    while [ -n "$h" ]; do
+        rest=${h#??}
+        octet $((0x${h%"$rest"}))
+        h=$rest
+    done
+}
+# Digest SHA-256 d'un fichier, qui tient en un seul chunk (moins que la taille minimale d'un chunk)
+digest() { sha256sum "$1" | cut -d ' ' -f 1; }
+
+mkdir -p "$WORK/src" "$WORK/dest"
+head -c 5000 /dev/urandom > "$WORK/src/idx.bin"
+head -c 6000 /dev/urandom > "$WORK/src/log.bin"
+head -c 7000 /dev/urandom > "$WORK/src/gone.bin"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+current=$(ls "$WORK/dest")
+
+# Index plat : en-tête de 64 octets, une entrée de 88 octets, son chemin, sa liste d'un chunk
+flat="$WORK/dest/2020-01-01-00:00:00.000"
+mkdir "$flat"
+idx_digest=$(digest "$WORK/src/idx.bin")
+{
+    printf 'LP25SIDX'; u32 1; octet 2; octet 32; u16 0
+    u64 1; u64 64; u64 152; u64 8; u64 160; u64 36
+    u64 0; u32 7; u32 33188; u64 5000; u64 0; u64 0; u64 0; u32 1; u32 0; hexbin "$idx_digest"
+    printf 'idx.bin'; octet 0
+    hexbin "$idx_digest"; u32 5000
+} > "$flat/.backup_index"
+
+# Journal texte et recette : signature, algorithme, taille, digest du fichier, puis ses chunks
+log="$WORK/dest/2020-01-02-00:00:00.000"
+mkdir "$log"
+log_digest=$(digest "$WORK/src/log.bin")
+echo "log.bin;2020-01-02 00:00:00;$log_digest" > "$log/.backup_log"
+{
+    printf 'LP25RCP2'; octet 2; octet 0; u64 6000; hexbin "$log_digest"
+    u32 1; hexbin "$log_digest"; u32 6000
+} > "$log/log.bin"
+
+# Les fixtures sont lisibles : la vérification parcourt les trois sauvegardes
+"$BIN" --check --dest "$WORK/dest" > /dev/null
+
+# Bilan du dernier nettoyage, d'après sa sortie
+pruned() {
+    grep -q "$1 chunks conservés, $2 supprimés" "$WORK/prune.log"
+}
+
+# Nettoyage de la sauvegarde actuelle : gone.bin et l'arbre racine disparaissent, les chunks des deux
+# anciennes sauvegardes restent
+"$BIN" --prune --source "$WORK/dest/$current" --dest "$WORK/dest" > "$WORK/prune.log"
+pruned 2 2
+"$BIN" --check --dest "$WORK/dest" > /dev/null
+"$BIN" --extract idx.bin --source "$flat" | cmp - "$WORK/src/idx.bin"
+"$BIN" --extract log.bin --source "$log" | cmp - "$WORK/src/log.bin"
+
+# Nettoyage de l'ancienne sauvegarde à journal : sa recette et son chunk disparaissent
+"$BIN" --prune --source "$log" --dest "$WORK/dest" > "$WORK/prune.log"
+pruned 1 1
+test ! -e "$log"
+"$BIN" --extract idx.bin --source "$flat" | cmp - "$WORK/src/idx.bin"
+
+# Nettoyage de la sauvegarde à index plat : plus aucun chunk vivant
+"$BIN" --prune --source "$flat" --dest "$WORK/dest" > "$WORK/prune.log"
+pruned 0 1
+test -z "$(ls "$WORK/dest")"
+echo "test_prune_legacy : OK"
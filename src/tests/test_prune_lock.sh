@@ -0,0 +1,37 @@
+#!/bin/sh
+# Verrou du dépôt : un nettoyage refuse un dépôt servi par --serve, une sauvegarde attend la fin d'un nettoyage.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+SERVER=
+trap '[ -n "$SERVER" ] && kill "$SERVER" 2>/dev/null; rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src" "$WORK/dest"
+head -c 100000 /dev/urandom > "$WORK/src/a.bin"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+first=$(ls "$WORK/dest" | tail -n 1)
+
+# Le serveur garde un verrou partagé : le nettoyage échoue sans rien supprimer
+PORT=$((20000 + $$ % 10000))
+"$BIN" --serve --dest "$WORK/dest" --d-port "$PORT" > /dev/null 2>&1 &
+SERVER=$!
+sleep 1
+if "$BIN" --prune --source "$WORK/dest/$first" --dest "$WORK/dest" > /dev/null 2>&1; then
+    echo "test_prune_lock : le nettoyage a ignoré le serveur"
+    exit 1
+fi
+test -f "$WORK/dest/$first/.manifest"
+kill "$SERVER"
+wait "$SERVER" || true
+SERVER=
+
+# Un nettoyage en cours (verrou exclusif) fait attendre la sauvegarde, qui aboutit ensuite
+flock -x "$WORK/dest/.store" sleep 2 &
+HOLDER=$!
+sleep 1
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null 2> "$WORK/err"
+wait "$HOLDER"
+grep -q "attente" "$WORK/err"
+"$BIN" --prune --source "$WORK/dest/$first" --dest "$WORK/dest" > /dev/null
+"$BIN" --check --dest "$WORK/dest" > /dev/null
+echo "test_prune_lock : OK"
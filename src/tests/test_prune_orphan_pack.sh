@@ -0,0 +1,34 @@
+#!/bin/sh
+# Nettoyage avec un pack orphelin (absent de l'index) de numéro supérieur au pack courant : les chunks
+# recopiés qui débordent du pack courant ne doivent pas aller dans ce pack, supprimé à la fin du nettoyage.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Sauvegarde 1 : a et c remplissent pack 0 et le début de pack 1
+mkdir -p "$WORK/src" "$WORK/dest"
+head -c 50000000 /dev/urandom > "$WORK/src/a.bin"
+head -c 50000000 /dev/urandom > "$WORK/src/c.bin"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+first=$(ls "$WORK/dest" | tail -n 1)
+
+# Sauvegarde 2 : c est repris, d remplit presque pack 1 (pack courant)
+rm "$WORK/src/a.bin"
+head -c 25000000 /dev/urandom > "$WORK/src/d.bin"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+test -f "$WORK/dest/.store/pack-000001.pack"
+
+# Pack orphelin (sauvegarde interrompue avant d'écrire l'index)
+head -c 1000 /dev/urandom > "$WORK/dest/.store/pack-000002.pack"
+
+# La sauvegarde 1 disparaît : la fin de c est recopiée depuis pack 0, au-delà de la place restante du pack 1
+"$BIN" --prune --source "$WORK/dest/$first" --prune-threshold 50 --dest "$WORK/dest" > /dev/null
+test ! -f "$WORK/dest/.store/pack-000002.pack"
+test ! -f "$WORK/dest/.store/pack-000000.pack"
+
+second=$(ls "$WORK/dest" | tail -n 1)
+"$BIN" --check --dest "$WORK/dest" > /dev/null
+"$BIN" --restore --source "$WORK/dest/$second" --dest "$WORK/out" > /dev/null
+diff -r "$WORK/src" "$WORK/out"
+echo "test_prune_orphan_pack : OK"
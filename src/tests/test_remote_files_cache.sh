@@ -0,0 +1,52 @@
+#!/bin/sh
+# Cache des fichiers d'une sauvegarde distante, gardé par le client : une seconde sauvegarde ne relit
+# que le fichier modifié. Un nettoyage du serveur qui supprime des chunks change la génération du
+# dépôt : le cache n'est plus repris (tous les fichiers sont relus) et la sauvegarde reste restaurable.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+PORT=$((20000 + $$ % 20000))
+SERVER=
+trap 'if [ -n "$SERVER" ]; then kill "$SERVER"; wait "$SERVER" || true; fi; rm -rf "$WORK"' EXIT
+export XDG_CACHE_HOME="$WORK/cache"
+
+start_server() {
+    "$BIN" --serve --dest "$WORK/dest" --d-port "$PORT" > /dev/null 2>&1 &
+    SERVER=$!
+    sleep 1
+}
+
+stop_server() {
+    kill "$SERVER"
+    wait "$SERVER" || true
+    SERVER=
+}
+
+# Nombre de fichiers repris du cache par une sauvegarde (affichage détaillé)
+backup_hits() {
+    sleep 1
+    "$BIN" --backup -v --source "$WORK/src" --d-server 127.0.0.1 --d-port "$PORT" |
+        sed -n 's/^Cache des fichiers : \([0-9]*\) fichiers inchangés.*/\1/p'
+}
+
+mkdir -p "$WORK/src/d" "$WORK/dest" "$WORK/out"
+for i in 1 2 3 4 5; do
+    head -c 100000 /dev/urandom > "$WORK/src/d/f$i"
+done
+start_server
+[ "$(backup_hits)" = "0" ]
+[ "$(backup_hits)" = "5" ]
+head -c 100000 /dev/urandom > "$WORK/src/d/f1"
+[ "$(backup_hits)" = "4" ]
+
+# Le nettoyage supprime l'ancien contenu de f1 : le cache du client devient invalide
+stop_server
+for backup in $(ls "$WORK/dest" | head -n 2); do
+    "$BIN" --prune --source "$WORK/dest/$backup" --dest "$WORK/dest" > /dev/null
+done
+start_server
+[ "$(backup_hits)" = "0" ]
+[ "$(backup_hits)" = "5" ]
+"$BIN" --restore --s-server 127.0.0.1 --s-port "$PORT" --dest "$WORK/out" > /dev/null
+diff -r "$WORK/src" "$WORK/out"
+echo "test_remote_files_cache : OK"
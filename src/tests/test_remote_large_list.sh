@@ -0,0 +1,23 @@
+#!/bin/sh
+# Sauvegarde et restauration distantes d'un fichier de 2,5 Go découpé en chunks de 256 octets au plus :
+# sa liste de 10 millions de chunks (plus de 350 Mo d'enregistrements) dépasserait NET_MAX_FRAME si
+# elle était rangée dans l'arbre du répertoire ; en objets de liste, tous les objets tiennent dans une trame.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+PORT=$((20000 + $$ % 20000))
+SERVER=
+trap 'if [ -n "$SERVER" ]; then kill "$SERVER"; wait "$SERVER" || true; fi; rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src" "$WORK/dest" "$WORK/out"
+truncate -s 2500M "$WORK/src/zero.img"
+echo "voisin" > "$WORK/src/small.txt"
+"$BIN" --serve --chunker 64,128,256 --dest "$WORK/dest" --d-port "$PORT" > /dev/null 2>&1 &
+SERVER=$!
+sleep 1
+
+"$BIN" --backup --source "$WORK/src" --d-server 127.0.0.1 --d-port "$PORT" > /dev/null
+"$BIN" --restore --s-server 127.0.0.1 --s-port "$PORT" --dest "$WORK/out" > /dev/null
+cmp "$WORK/src/zero.img" "$WORK/out/zero.img"
+cmp "$WORK/src/small.txt" "$WORK/out/small.txt"
+echo "test_remote_large_list : OK"
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Restauration différentielle (--delta) par-dessus d'anciennes versions des fichiers : un fichier
+# agrandi, un fichier tronqué, un fichier décalé par une insertion en tête et un fichier inchangé.
+# Le résultat doit être identique à la sauvegarde ; seuls les chunks qui diffèrent à leur position
+# sont écrits.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src" "$WORK/dest" "$WORK/out"
+head -c 262144 /dev/urandom > "$WORK/base"
+head -c 524288 /dev/urandom > "$WORK/long"
+
+# Anciennes versions, déjà présentes dans le répertoire de restauration
+cp "$WORK/base" "$WORK/out/grow"
+cp "$WORK/long" "$WORK/out/trunc"
+cp "$WORK/base" "$WORK/out/shift"
+cp "$WORK/base" "$WORK/out/same"
+
+# Nouvelles versions, sauvegardées
+{ cat "$WORK/base"; head -c 65536 /dev/urandom; } > "$WORK/src/grow"
+head -c 131072 "$WORK/long" > "$WORK/src/trunc"
+{ printf 'inserted'; cat "$WORK/base"; } > "$WORK/src/shift"
+cp "$WORK/base" "$WORK/src/same"
+"$BIN" --backup --chunker 1024,4096,16384 --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+backup=$(ls "$WORK/dest" | tail -n 1)
+
+"$BIN" --restore --delta -v --source "$WORK/dest/$backup" --dest "$WORK/out" > "$WORK/restore.log"
+diff -r "$WORK/src" "$WORK/out"
+
+# Octets écrits pour un fichier, d'après la sortie de --verbose
+written() {
+    sed -n "s|^Fichier '.*/$1' mis à jour : \([0-9]*\) octets écrits.*|\1|p" "$WORK/restore.log"
+}
+# Un fichier agrandi ne réécrit que la fin : les données ajoutées et au plus le dernier chunk d'avant
+# (16 Kio au plus) ; un fichier tronqué au plus son dernier chunk
+same=$(written same)
+grow=$(written grow)
+trunc=$(written trunc)
+if [ -z "$same" ] || [ -z "$grow" ] || [ -z "$trunc" ] ||
+   [ "$same" -ne 0 ] || [ "$grow" -gt $((65536 + 16384)) ] || [ "$trunc" -gt 16384 ]; then
+    echo "test_restore_delta : trop d'octets réécrits" >&2
+    cat "$WORK/restore.log" >&2
+    exit 1
+fi
+echo "test_restore_delta : OK"
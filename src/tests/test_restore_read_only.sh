@@ -0,0 +1,29 @@
+#!/bin/sh
+# Une restauration et un export ne font que lire le dépôt : ni pack, ni index, ni dépôt créés.
+# Une restauration simulée (--dry-run) n'écrit rien.
+set -e
+BIN=$(realpath "${1:-./lp25_borgbackup}")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+mkdir -p "$WORK/src/sub" "$WORK/dest"
+head -c 2000000 /dev/urandom > "$WORK/src/a.bin"
+echo "texte" > "$WORK/src/sub/b.txt"
+"$BIN" --backup --source "$WORK/src" --dest "$WORK/dest" > /dev/null
+snapshot=$(ls "$WORK/dest" | tail -n 1)
+before=$(ls -l --time-style=full-iso "$WORK/dest/.store")
+
+"$BIN" --restore --source "$WORK/dest/$snapshot" --dest "$WORK/out" > /dev/null
+diff -r "$WORK/src" "$WORK/out"
+"$BIN" --export-log --source "$WORK/dest/$snapshot" > /dev/null
+test "$before" = "$(ls -l --time-style=full-iso "$WORK/dest/.store")"
+
+"$BIN" --restore --dry-run --source "$WORK/dest/$snapshot" --dest "$WORK/simulated" > /dev/null
+test ! -e "$WORK/simulated"
+
+# Sauvegarde copiée sans son dépôt : la restauration échoue sans en créer un vide
+mkdir "$WORK/orphan"
+cp -a "$WORK/dest/$snapshot" "$WORK/orphan/"
+"$BIN" --restore --source "$WORK/orphan/$snapshot" --dest "$WORK/out2" > /dev/null 2>&1 || true
+test ! -e "$WORK/orphan/.store"
+echo "test_restore_read_only : OK"